@@ -0,0 +1,30 @@
+// Generated by tools/embed_assets.py from ui/, do not edit
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+
+// ui/index.html: 394 bytes, 264 gzipped
+static const uint8_t ui_index_html[] PROGMEM = {
+  0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6D, 0xD1, 0x51, 0x4B, 0xC3, 0x30,
+  0x10, 0x07, 0xF0, 0xF7, 0x7D, 0x8A, 0x23, 0x2F, 0x9B, 0x30, 0x17, 0x71, 0x4F, 0x8E, 0x18, 0x18,
+  0x32, 0x84, 0xE1, 0x5C, 0xA1, 0x7B, 0x97, 0x5B, 0x9A, 0xB5, 0x9D, 0x49, 0x13, 0x9B, 0xEB, 0x60,
+  0x88, 0xDF, 0xDD, 0xB4, 0x99, 0x22, 0xB2, 0x97, 0xE4, 0x38, 0xF2, 0xFB, 0xE7, 0x48, 0x44, 0x45,
+  0xD6, 0x48, 0xB1, 0x77, 0xC5, 0x59, 0x8A, 0x6A, 0x2E, 0x57, 0x79, 0x36, 0xBF, 0x87, 0x65, 0x38,
+  0x37, 0x0A, 0x36, 0xEB, 0x6C, 0xF5, 0x0C, 0x93, 0xEC, 0xE9, 0x36, 0xD4, 0x85, 0x86, 0xA5, 0x6F,
+  0x6B, 0xB3, 0xC3, 0xF2, 0x46, 0xF0, 0x78, 0x70, 0x24, 0xBC, 0x14, 0x08, 0x55, 0xAB, 0x0F, 0x8F,
+  0x63, 0x6E, 0x8F, 0x5E, 0x97, 0x63, 0x99, 0x76, 0xC1, 0x51, 0xC2, 0x04, 0x87, 0x8C, 0x53, 0x94,
+  0x0E, 0x02, 0xB5, 0x1A, 0x6D, 0x84, 0xFE, 0x9F, 0x3B, 0xFA, 0x5E, 0xC5, 0x35, 0x99, 0x50, 0x37,
+  0xA5, 0xD1, 0x10, 0x1A, 0xF4, 0xA1, 0x72, 0x74, 0x05, 0x04, 0x42, 0xEA, 0x42, 0x34, 0xA9, 0x48,
+  0xCC, 0x60, 0x20, 0x50, 0xCE, 0x5A, 0x6C, 0x0A, 0x58, 0xE7, 0xDB, 0xD7, 0x2B, 0x90, 0x94, 0xEF,
+  0x49, 0x4F, 0x7F, 0xCA, 0x3F, 0x73, 0xBE, 0xC5, 0x1E, 0x7C, 0x74, 0xBA, 0xD3, 0xD0, 0x67, 0x28,
+  0x34, 0x66, 0x8F, 0xEA, 0x1D, 0xA8, 0xB6, 0x71, 0xA4, 0xDF, 0xB8, 0x6C, 0x9B, 0xEF, 0xE2, 0x45,
+  0x0D, 0xB5, 0xCE, 0x00, 0x39, 0x10, 0xCA, 0x15, 0x5A, 0x72, 0x65, 0x0B, 0xC1, 0x87, 0x72, 0x0A,
+  0x7A, 0x56, 0xCE, 0x2E, 0xFD, 0x4F, 0xB6, 0x61, 0x0B, 0xF6, 0xA2, 0x0F, 0xC4, 0xA6, 0xEC, 0xC4,
+  0x16, 0x0F, 0x77, 0x5F, 0x97, 0x63, 0x29, 0x8F, 0xA7, 0x57, 0xE7, 0xC3, 0x17, 0x8C, 0xBE, 0x01,
+  0xDE, 0xBC, 0x01, 0xD6, 0x8A, 0x01, 0x00, 0x00,
+};
+
+static const AsyncWebAsset ui_assets[] = {
+  { "/", ui_index_html, 264, "\"de316fec\"", "Content-Length: 264\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\nETag: \"de316fec\"\r\nCache-Control: no-cache\r\n" },
+};
+static const size_t ui_assets_count = sizeof(ui_assets) / sizeof(ui_assets[0]);
@@ -0,0 +1,147 @@
+/*
+ * Closed-slot churn: connections open and close at random while a share of the slots stays taken.
+ *
+ * Compares AsyncSlotTable with the allocator it replaced (a least-recently-freed scan over every
+ * slot), for table sizes up to 1024. Also checks that no id survives its free().
+ *
+ *   async_tcp_slot_churn_bench [operations per case]
+ */
+
+#include "AsyncSlotTable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+//the previous _allocate_closed_slot/_free_closed_slot, without the semaphore
+template<int SLOTS>
+class LinearSlotTable {
+  public:
+    LinearSlotTable(){
+        for (int i = 0; i < SLOTS; ++ i) {
+            _closed_slots[i] = 1;
+        }
+    }
+    int32_t allocate(){
+        int32_t closed_slot = -1;
+        uint32_t closed_slot_min_index = 0;
+        for (int i = 0; i < SLOTS; ++ i) {
+            if ((closed_slot == -1 || _closed_slots[i] <= closed_slot_min_index) && _closed_slots[i] != 0) {
+                closed_slot_min_index = _closed_slots[i];
+                closed_slot = i;
+            }
+        }
+        if (closed_slot != -1) {
+            _closed_slots[closed_slot] = 0;
+        }
+        return closed_slot;
+    }
+    void free(int32_t id){
+        if (id != -1) {
+            _closed_slots[id] = _closed_index;
+            ++ _closed_index;
+        }
+    }
+    bool isOpen(int32_t id) const {
+        return id == -1 || !_closed_slots[id];
+    }
+  private:
+    uint32_t _closed_slots[SLOTS];
+    uint32_t _closed_index = 1;
+};
+
+static uint64_t now_ns(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+//xorshift, so both tables see the same sequence
+static uint32_t next(uint32_t * s){
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static int failures;
+
+//ns per close + open pair with `held` percent of the slots open
+template<int SLOTS, class Table>
+static double churn(int held, long ops, bool check){
+    Table * table = new Table();
+    std::vector<int32_t> open;
+    std::vector<int32_t> stale;
+    int keep = SLOTS * held / 100;
+    for (int i = 0; i < keep; i++) {
+        open.push_back(table->allocate());
+    }
+    uint32_t seed = 2463534242u;
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        size_t k = next(&seed) % open.size();
+        table->free(open[k]);
+        if (check && stale.size() < 64) {
+            stale.push_back(open[k]);
+        }
+        open[k] = table->allocate();
+    }
+    uint64_t ns = now_ns() - start;
+    if (check) {
+        for (int32_t id : stale) {
+            bool reopened = false;
+            for (int32_t o : open) {
+                reopened |= (o == id);
+            }
+            if (!reopened && table->isOpen(id)) {
+                fprintf(stderr, "%d slots: freed id %08x is still open\n", SLOTS, (unsigned)id);
+                failures++;
+            }
+        }
+        for (int32_t o : open) {
+            if (o == ASYNC_SLOT_NONE || !table->isOpen(o)) {
+                fprintf(stderr, "%d slots: open id %08x is not open\n", SLOTS, (unsigned)o);
+                failures++;
+            }
+        }
+    }
+    delete table;
+    return (double)ns / ops;
+}
+
+template<int SLOTS>
+static void run(long ops){
+    for (int held : {50, 90}) {
+        double linear = churn<SLOTS, LinearSlotTable<SLOTS> >(held, ops, false);
+        double bitmap = churn<SLOTS, AsyncSlotTable<SLOTS> >(held, ops, true);
+        printf("%5d slots %3d%% open   linear %8.1f ns   bitmap %6.1f ns   x%.1f\n",
+            SLOTS, held, linear, bitmap, linear / bitmap);
+    }
+}
+
+int main(int argc, char ** argv){
+    long ops = (argc > 1) ? atol(argv[1]) : 2000000;
+    if (ops <= 0) {
+        ops = 1;
+    }
+    run<16>(ops);
+    run<64>(ops);
+    run<256>(ops);
+    run<1024>(ops);
+    //a stale id reaching the tcpip thread after its slot was reused must be refused
+    AsyncSlotTable<4> t;
+    int32_t a = t.allocate();
+    t.free(a);
+    int32_t b = t.allocate();
+    if ((a & 0xFFFF) != (b & 0xFFFF) || t.isOpen(a) || !t.isOpen(b)) {
+        fprintf(stderr, "reused slot accepts the old id\n");
+        failures++;
+    }
+    t.free(a);
+    if (!t.isOpen(b)) {
+        fprintf(stderr, "a stale free() closed the new owner\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * The part of the Arduino core that AsyncTCP and ESPAsyncWebServer use, for the Linux build
+ * (see the POSIX backend in the README). Not a general purpose core.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include "WString.h"
+#include "Print.h"
+#include "IPAddress.h"
+typedef bool boolean;
+typedef uint8_t byte;
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define vsnprintf_P vsnprintf
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+#define ets_printf ::printf
+#define log_e(...) do{ fprintf(stderr, __VA_ARGS__); fputc('\n', stderr);}while(0)
+#define log_w log_e
+#define log_d(...)
+#define log_v(...)
+#define log_i(...)
+static inline uint64_t _host_us(){ struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return (uint64_t)t.tv_sec*1000000ull + t.tv_nsec/1000; }
+static inline unsigned long millis(){ return (unsigned long)(_host_us()/1000); }
+static inline unsigned long micros(){ return (unsigned long)_host_us(); }
+static inline void delay(unsigned long ms){ struct timespec t = { (time_t)(ms/1000), (long)(ms%1000)*1000000L }; nanosleep(&t, NULL); }
+static inline void yield(){}
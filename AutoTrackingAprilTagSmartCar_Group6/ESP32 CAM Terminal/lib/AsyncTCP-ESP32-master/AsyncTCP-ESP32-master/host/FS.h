@@ -0,0 +1,54 @@
+//fs::FS over stdio: paths are taken relative to $ASYNC_HOST_FS_ROOT (default /tmp/hostfs)
+#pragma once
+#include "Arduino.h"
+#include <time.h>
+#include <memory>
+namespace fs {
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+class File: public Stream {
+  //copies share the FILE, as they share the FileImpl on the ESP32: closed once, by close() or the last copy
+  std::shared_ptr<FILE*> h; String p; bool dir = false;
+  FILE *f() const { return h ? *h : nullptr; }
+public:
+  File(){}
+  File(FILE *fp, const String &path): p(path) { if(fp) h.reset(new FILE*(fp), [](FILE **x){ if(*x) fclose(*x); delete x; }); }
+  size_t write(uint8_t c) override { return f() ? fwrite(&c,1,1,f()) : 0; }
+  size_t write(const uint8_t *b, size_t n) override { return f() ? fwrite(b,1,n,f()) : 0; }
+  int available() override { if(!f()) return 0; long c = ftell(f()); fseek(f(),0,SEEK_END); long e = ftell(f()); fseek(f(),c,SEEK_SET); return e-c; }
+  int read() override { if(!f()) return -1; int c = fgetc(f()); return c == EOF ? -1 : c; }
+  int peek() override { if(!f()) return -1; int c = fgetc(f()); if(c != EOF) ungetc(c,f()); return c == EOF ? -1 : c; }
+  size_t read(uint8_t *b, size_t n){ return f() ? fread(b,1,n,f()) : 0; }
+  size_t readBytes(char *b, size_t n) override { return f() ? fread(b,1,n,f()) : 0; }
+  bool seek(uint32_t pos, SeekMode m = SeekSet){ return f() && fseek(f(),pos,m)==0; }
+  size_t position() const { return f() ? ftell(f()) : 0; }
+  size_t size() const { if(!f()) return 0; long c = ftell(f()); fseek(f(),0,SEEK_END); long e = ftell(f()); fseek(f(),c,SEEK_SET); return e; }
+  void close(){ if(f()){ fclose(*h); *h = nullptr; } }
+  time_t getLastWrite(){ return 0; }
+  const char *name() const { return p.c_str(); }
+  const char *path() const { return p.c_str(); }
+  bool isDirectory(){ return dir; }
+  File openNextFile(const char *mode = "r"){ (void)mode; return File(); }
+  operator bool() const { return f() != nullptr; }
+  bool operator==(bool b) const { return (f() != nullptr) == b; }
+  bool operator!=(bool b) const { return (f() != nullptr) != b; }
+};
+class FS {
+  String root;
+public:
+  FS(const char *r = getenv("ASYNC_HOST_FS_ROOT") ? getenv("ASYNC_HOST_FS_ROOT") : "/tmp/hostfs"): root(r) {}
+  //fopen()s made by every FS, for open() and exists() alike: what the tests count as filesystem accesses
+  static unsigned long &opens(){ static unsigned long n = 0; return n; }
+  File open(const String &path, const char *mode = "r", bool create = false){ (void)create; opens()++; FILE *f = fopen((root + path).c_str(), mode); return File(f, path); }
+  File open(const char *path, const char *mode = "r", bool create = false){ return open(String(path), mode, create); }
+  bool exists(const String &path){ opens()++; FILE *f = fopen((root + path).c_str(), "r"); if(f) fclose(f); return f; }
+  bool exists(const char *path){ return exists(String(path)); }
+  bool remove(const String &path){ return ::remove((root + path).c_str()) == 0; }
+  bool remove(const char *path){ return remove(String(path)); }
+  bool rename(const String &a, const String &b){ return ::rename((root+a).c_str(), (root+b).c_str()) == 0; }
+  size_t totalBytes(){ return 1<<20; }
+  size_t usedBytes(){ return 0; }
+};
+}
+using fs::FS;
+using fs::File;
+using fs::SeekSet;
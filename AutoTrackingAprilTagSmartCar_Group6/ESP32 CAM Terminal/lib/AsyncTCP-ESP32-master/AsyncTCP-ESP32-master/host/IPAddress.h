@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+#include "WString.h"
+class IPAddress {
+  uint8_t b[4];
+public:
+  IPAddress(){ memset(b,0,4); }
+  IPAddress(uint32_t a){ memcpy(b,&a,4); }
+  IPAddress(uint8_t a, uint8_t c, uint8_t d, uint8_t e){ b[0]=a;b[1]=c;b[2]=d;b[3]=e; }
+  operator uint32_t() const { uint32_t a; memcpy(&a,b,4); return a; }
+  uint8_t operator[](int i) const { return b[i]; }
+  uint8_t &operator[](int i){ return b[i]; }
+  bool operator==(const IPAddress &o) const { return !memcmp(b,o.b,4); }
+  String toString() const { char s[16]; snprintf(s,16,"%u.%u.%u.%u",b[0],b[1],b[2],b[3]); return String(s); }
+};
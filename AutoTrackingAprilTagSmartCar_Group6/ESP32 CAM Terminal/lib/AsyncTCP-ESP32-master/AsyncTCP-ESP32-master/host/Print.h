@@ -0,0 +1,34 @@
+#pragma once
+#include "WString.h"
+#include <stdarg.h>
+class Print {
+public:
+  virtual ~Print(){}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *b, size_t n){ size_t r=0; while(n--) r += write(*b++); return r; }
+  size_t write(const char *s){ return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+  size_t write(const char *b, size_t n){ return write((const uint8_t*)b, n); }
+  size_t print(const char *s){ return write(s); }
+  size_t print(const String &s){ return write((const uint8_t*)s.c_str(), s.length()); }
+  size_t print(char c){ return write((uint8_t)c); }
+  size_t print(int v){ return print(String(v)); }
+  size_t print(unsigned v){ return print(String(v)); }
+  size_t print(long v){ return print(String(v)); }
+  size_t print(unsigned long v){ return print(String(v)); }
+  size_t print(double v, int d=2){ return print(String(v, (unsigned char)d)); }
+  size_t print(const __FlashStringHelper *f){ return write((const char*)f); }
+  template<typename T> size_t println(const T &v){ size_t n = print(v); return n + write("\r\n"); }
+  size_t println(){ return write("\r\n"); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf,2,3))){ char b[512]; va_list a; va_start(a, fmt); int n = vsnprintf(b, sizeof b, fmt, a); va_end(a); return write((const uint8_t*)b, n < (int)sizeof b ? n : sizeof b - 1); }
+};
+class Stream: public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush(){}
+  virtual size_t readBytes(char *b, size_t n){ size_t i=0; while(i<n){ int c = read(); if(c<0) break; b[i++]=c; } return i; }
+  size_t readBytes(uint8_t *b, size_t n){ return readBytes((char*)b, n); }
+  String readString(){ String r; int c; while((c = read()) >= 0) r += (char)c; return r; }
+  String readStringUntil(char t){ String r; int c; while((c = read()) >= 0 && c != t) r += (char)c; return r; }
+};
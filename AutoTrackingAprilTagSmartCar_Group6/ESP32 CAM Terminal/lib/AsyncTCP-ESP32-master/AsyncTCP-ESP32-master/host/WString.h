@@ -0,0 +1,105 @@
+//Arduino String on std::string
+#pragma once
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define FPSTR(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+class String {
+  std::string s;
+public:
+  String(): s() {}
+  String(const char *c): s(c ? c : "") {}
+  String(const char *c, size_t n): s(c, n) {}
+  String(const String &o) = default;
+  String(String &&o) = default;
+  String(const __FlashStringHelper *f): s((const char*)f) {}
+  explicit String(char c): s(1, c) {}
+  explicit String(unsigned char v, unsigned char base=10){ num(v, base); }
+  explicit String(int v, unsigned char base=10){ if(base==10) s=std::to_string(v); else num(v,base); }
+  explicit String(unsigned int v, unsigned char base=10){ num(v, base); }
+  explicit String(long v, unsigned char base=10){ if(base==10) s=std::to_string(v); else num(v,base);}
+  explicit String(unsigned long v, unsigned char base=10){ num(v, base); }
+  explicit String(long long v){ s=std::to_string(v);}
+  explicit String(unsigned long long v){ s=std::to_string(v);}
+  explicit String(float v, unsigned char d=2){ char b[64]; snprintf(b,64,"%.*f",d,v); s=b; }
+  explicit String(double v, unsigned char d=2){ char b[64]; snprintf(b,64,"%.*f",d,v); s=b; }
+  void num(unsigned long long v, int base){ char b[72]; int i=71; b[i]=0; if(!v) b[--i]='0'; while(v){ int d=v%base; b[--i]= d<10?'0'+d:'a'+d-10; v/=base;} s=b+i; }
+  String &operator=(const String &o) = default;
+  String &operator=(String &&o) = default;
+  String &operator=(const char *c){ s = c ? c : ""; return *this; }
+  String &operator=(const __FlashStringHelper *c){ s = (const char*)c; return *this; }
+  const char *c_str() const { return s.c_str(); }
+  char *begin(){ return &s[0]; }
+  char *end(){ return &s[0] + s.size(); }
+  const char *begin() const { return s.data(); }
+  const char *end() const { return s.data() + s.size(); }
+  unsigned int length() const { return s.size(); }
+  bool reserve(unsigned int n){ s.reserve(n); return true; }
+  bool concat(const String &o){ s += o.s; return true; }
+  bool concat(const char *c){ if(c) s += c; return true; }
+  bool concat(const char *c, unsigned int n){ s.append(c, n); return true; }
+  bool concat(char c){ s += c; return true; }
+  bool concat(unsigned char c){ s += std::to_string(c); return true; }
+  bool concat(int v){ s += std::to_string(v); return true; }
+  bool concat(unsigned int v){ s += std::to_string(v); return true; }
+  bool concat(long v){ s += std::to_string(v); return true; }
+  bool concat(unsigned long v){ s += std::to_string(v); return true; }
+  bool concat(long long v){ s += std::to_string(v); return true; }
+  bool concat(unsigned long long v){ s += std::to_string(v); return true; }
+  bool concat(double v){ s += String(v).s; return true; }
+  bool concat(const __FlashStringHelper *f){ s += (const char*)f; return true; }
+  template<typename T> String &operator+=(const T &v){ concat(v); return *this; }
+  String &operator+=(const char *c){ concat(c); return *this; }
+  friend String operator+(const String &a, const String &b){ String r(a); r.s += b.s; return r; }
+  friend String operator+(const String &a, const char *b){ String r(a); r.concat(b); return r; }
+  friend String operator+(const char *a, const String &b){ String r(a); r.s += b.s; return r; }
+  friend String operator+(const String &a, char b){ String r(a); r.s += b; return r; }
+  friend String operator+(const String &a, int b){ String r(a); r.concat(b); return r; }
+  friend String operator+(const String &a, unsigned int b){ String r(a); r.concat(b); return r; }
+  friend String operator+(const String &a, long b){ String r(a); r.concat(b); return r; }
+  friend String operator+(const String &a, unsigned long b){ String r(a); r.concat(b); return r; }
+  friend String operator+(const String &a, const __FlashStringHelper *b){ String r(a); r.concat(b); return r; }
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *c) const { return s == (c ? c : ""); }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator!=(const char *c) const { return !(*this == c); }
+  bool operator<(const String &o) const { return s < o.s; }
+  explicit operator bool() const { return true; }
+  char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+  char &operator[](unsigned int i){ return s[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  void setCharAt(unsigned int i, char c){ if(i < s.size()) s[i] = c; }
+  bool equals(const String &o) const { return s == o.s; }
+  bool equals(const char *c) const { return *this == c; }
+  bool equalsIgnoreCase(const String &o) const { return s.size()==o.s.size() && strcasecmp(s.c_str(), o.s.c_str())==0; }
+  int compareTo(const String &o) const { return s.compare(o.s); }
+  bool startsWith(const String &p) const { return s.compare(0, p.s.size(), p.s) == 0 && s.size() >= p.s.size(); }
+  bool startsWith(const String &p, unsigned int off) const { return off <= s.size() && s.compare(off, p.s.size(), p.s) == 0; }
+  bool endsWith(const String &p) const { return s.size() >= p.s.size() && s.compare(s.size()-p.s.size(), p.s.size(), p.s) == 0; }
+  int indexOf(char c, unsigned int from=0) const { auto p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const String &o, unsigned int from=0) const { auto p = s.find(o.s, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const char *o, unsigned int from=0) const { auto p = s.find(o, from); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(char c) const { auto p = s.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(char c, unsigned int from) const { auto p = s.rfind(c, from); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(const String &o) const { auto p = s.rfind(o.s); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned int b) const { return b >= s.size() ? String() : String(s.substr(b).c_str(), s.size()-b); }
+  String substring(unsigned int b, unsigned int e) const { if(b > e) std::swap(b,e); if(b >= s.size()) return String(); if(e > s.size()) e = s.size(); return String(s.data()+b, e-b); }
+  void replace(const String &a, const String &b){ if(a.s.empty()) return; size_t p=0; while((p=s.find(a.s,p))!=std::string::npos){ s.replace(p,a.s.size(),b.s); p+=b.s.size(); } }
+  void replace(char a, char b){ for(auto &c: s) if(c==a) c=b; }
+  void remove(unsigned int i){ if(i < s.size()) s.erase(i); }
+  void remove(unsigned int i, unsigned int n){ if(i < s.size()) s.erase(i, n); }
+  void toLowerCase(){ for(auto &c: s) c = tolower(c); }
+  void toUpperCase(){ for(auto &c: s) c = toupper(c); }
+  void trim(){ size_t b = s.find_first_not_of(" \t\r\n"); if(b == std::string::npos){ s.clear(); return; } size_t e = s.find_last_not_of(" \t\r\n"); s = s.substr(b, e-b+1); }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  void getBytes(unsigned char *b, unsigned int n, unsigned int idx=0) const { if(!n) return; size_t k = s.size() > idx ? std::min<size_t>(n-1, s.size()-idx) : 0; memcpy(b, s.data()+idx, k); b[k]=0; }
+  void toCharArray(char *b, unsigned int n, unsigned int idx=0) const { getBytes((unsigned char*)b, n, idx); }
+  bool isEmpty() const { return s.empty(); }
+  void clear(){ s.clear(); }
+};
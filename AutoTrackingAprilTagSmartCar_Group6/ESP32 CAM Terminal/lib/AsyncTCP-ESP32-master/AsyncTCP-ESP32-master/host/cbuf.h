@@ -0,0 +1,23 @@
+//ring buffer with the interface of the ESP32 core cbuf
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+class cbuf {
+  char *b; size_t cap, r = 0, w = 0, n = 0;
+public:
+  cbuf(size_t size): b((char*)malloc(size)), cap(size) {}
+  ~cbuf(){ free(b); }
+  size_t available() const { return n; }
+  size_t room() const { return cap - n; }
+  size_t size(){ return cap; }
+  bool empty() const { return n == 0; }
+  bool full() const { return n == cap; }
+  size_t resizeAdd(size_t add){ char *nb = (char*)malloc(cap + add); size_t k = read(nb, n); free(b); b = nb; cap += add; r = 0; w = k; n = k; return cap; }
+  size_t write(char c){ if(full()) return 0; b[w] = c; w = (w+1)%cap; n++; return 1; }
+  size_t write(const char *d, size_t len){ size_t k = 0; while(k < len && write(d[k])) k++; return k; }
+  int read(){ if(empty()) return -1; char c = b[r]; r = (r+1)%cap; n--; return (uint8_t)c; }
+  size_t read(char *d, size_t len){ size_t k = 0; while(k < len && !empty()){ d[k++] = b[r]; r = (r+1)%cap; n--; } return k; }
+  int peek(){ return empty() ? -1 : (uint8_t)b[r]; }
+  void flush(){ r = w = n = 0; }
+};
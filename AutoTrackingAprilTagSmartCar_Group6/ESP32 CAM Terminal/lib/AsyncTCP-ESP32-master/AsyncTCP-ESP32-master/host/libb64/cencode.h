@@ -0,0 +1,24 @@
+//libb64 base64 encoder as shipped with the ESP32 core
+#pragma once
+typedef enum { step_A, step_B, step_C } base64_encodestep;
+typedef struct { base64_encodestep step; char result; int stepcount; } base64_encodestate;
+static inline void base64_init_encodestate(base64_encodestate* s){ s->step = step_A; s->result = 0; s->stepcount = 0; }
+static inline char base64_encode_value(char v){ static const char* e = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"; if(v > 63) return '='; return e[(int)v]; }
+static inline int base64_encode_block(const char* in, int len, char* out, base64_encodestate* s){
+  const char* p = in; const char* const end = in + len; char* o = out; char r = s->result; char f;
+  switch(s->step){
+    while(1){
+    case step_A: if(p == end){ s->result = r; s->step = step_A; return o - out; } f = *p++; r = (f & 0x0fc) >> 2; *o++ = base64_encode_value(r); r = (f & 0x003) << 4;
+    case step_B: if(p == end){ s->result = r; s->step = step_B; return o - out; } f = *p++; r |= (f & 0x0f0) >> 4; *o++ = base64_encode_value(r); r = (f & 0x00f) << 2;
+    case step_C: if(p == end){ s->result = r; s->step = step_C; return o - out; } f = *p++; r |= (f & 0x0c0) >> 6; *o++ = base64_encode_value(r); r = (f & 0x03f) >> 0; *o++ = base64_encode_value(r);
+    }
+  }
+  return o - out;
+}
+static inline int base64_encode_blockend(char* out, base64_encodestate* s){
+  char* o = out;
+  switch(s->step){ case step_B: *o++ = base64_encode_value(s->result); *o++ = '='; *o++ = '='; break; case step_C: *o++ = base64_encode_value(s->result); *o++ = '='; break; case step_A: break; }
+  *o = 0; return o - out;
+}
+static inline int base64_encode_expected_len(int n){ return ((n + 2) / 3) * 4 + 1; }
+static inline int base64_encode_chars(const char* in, int len, char* out){ base64_encodestate s; base64_init_encodestate(&s); int n = base64_encode_block(in, len, out, &s); return n + base64_encode_blockend(out + n, &s); }
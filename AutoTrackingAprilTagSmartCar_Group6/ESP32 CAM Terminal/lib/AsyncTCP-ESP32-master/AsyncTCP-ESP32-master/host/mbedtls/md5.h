@@ -0,0 +1,12 @@
+//mbedtls MD5 on OpenSSL libcrypto, for WebAuthentication on the host
+#pragma once
+#include <openssl/md5.h>
+typedef MD5_CTX mbedtls_md5_context;
+static inline void mbedtls_md5_init(mbedtls_md5_context*){}
+static inline void mbedtls_md5_free(mbedtls_md5_context*){}
+static inline int mbedtls_md5_starts_ret(mbedtls_md5_context*c){ MD5_Init(c); return 0; }
+static inline int mbedtls_md5_update_ret(mbedtls_md5_context*c, const unsigned char*d, size_t n){ MD5_Update(c,d,n); return 0; }
+static inline int mbedtls_md5_finish_ret(mbedtls_md5_context*c, unsigned char*o){ MD5_Final(o,c); return 0; }
+static inline void mbedtls_md5_starts(mbedtls_md5_context*c){ MD5_Init(c); }
+static inline void mbedtls_md5_update(mbedtls_md5_context*c, const unsigned char*d, size_t n){ MD5_Update(c,d,n); }
+static inline void mbedtls_md5_finish(mbedtls_md5_context*c, unsigned char*o){ MD5_Final(o,c); }
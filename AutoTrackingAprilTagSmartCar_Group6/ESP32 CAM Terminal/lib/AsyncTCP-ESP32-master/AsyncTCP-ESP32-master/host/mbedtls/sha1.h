@@ -0,0 +1,9 @@
+//mbedtls SHA1 on OpenSSL libcrypto, for the WebSocket handshake on the host
+#pragma once
+#include <openssl/sha.h>
+typedef SHA_CTX mbedtls_sha1_context;
+static inline void mbedtls_sha1_init(mbedtls_sha1_context*){}
+static inline void mbedtls_sha1_free(mbedtls_sha1_context*){}
+static inline int mbedtls_sha1_starts_ret(mbedtls_sha1_context*c){ SHA1_Init(c); return 0; }
+static inline int mbedtls_sha1_update_ret(mbedtls_sha1_context*c, const unsigned char*d, size_t n){ SHA1_Update(c,d,n); return 0; }
+static inline int mbedtls_sha1_finish_ret(mbedtls_sha1_context*c, unsigned char*o){ SHA1_Final(o,c); return 0; }
@@ -0,0 +1,80 @@
+/*
+  Asynchronous TCP library for Espressif MCUs
+
+  Closed-slot allocator for AsyncClient
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ASYNCSLOTTABLE_H_
+#define ASYNCSLOTTABLE_H_
+
+#include <stdint.h>
+
+#define ASYNC_SLOT_NONE -1
+#define ASYNC_SLOT_ID(slot, gen) ((int32_t)(((gen) & 0x7FFF) << 16) | (slot))
+
+//SLOTS slots handed out first free first from a bitmap (find-first-set), each with a generation that is
+//bumped when it is freed. An id is index | generation << 16, so an id kept past free() is never open again,
+//even once its slot is reused. Not thread safe, the caller locks, except for isOpen().
+template<int SLOTS>
+class AsyncSlotTable {
+  public:
+    AsyncSlotTable(){
+        for (int i = 0; i < SLOTS; ++ i) {
+            _free[i >> 5] |= (1u << (i & 31));
+        }
+    }
+
+    //ASYNC_SLOT_NONE when all slots are taken
+    int32_t allocate(){
+        for (int w = 0; w < WORDS; ++ w) {
+            if (_free[w]) {
+                int slot = (w << 5) + __builtin_ctz(_free[w]);
+                _free[w] &= ~(1u << (slot & 31));
+                return ASYNC_SLOT_ID(slot, _gen[slot]);
+            }
+        }
+        return ASYNC_SLOT_NONE;
+    }
+
+    //ignores ids that are no longer open, so freeing twice is harmless
+    void free(int32_t id){
+        if (id == ASYNC_SLOT_NONE) {
+            return;
+        }
+        int slot = id & 0xFFFF;
+        if (slot < SLOTS && ASYNC_SLOT_ID(slot, _gen[slot]) == id) {
+            _gen[slot]++;
+            _free[slot >> 5] |= (1u << (slot & 31));
+        }
+    }
+
+    //lock free: a stale id differs from the slot's generation once it was freed
+    bool isOpen(int32_t id) const {
+        if (id == ASYNC_SLOT_NONE) {
+            return true;
+        }
+        int slot = id & 0xFFFF;
+        return slot < SLOTS && ASYNC_SLOT_ID(slot, _gen[slot]) == id;
+    }
+
+  private:
+    static const int WORDS = (SLOTS + 31) / 32;
+    uint32_t _free[WORDS] = {}; //bit set: slot is free
+    uint16_t _gen[SLOTS] = {};
+};
+
+#endif /* ASYNCSLOTTABLE_H_ */
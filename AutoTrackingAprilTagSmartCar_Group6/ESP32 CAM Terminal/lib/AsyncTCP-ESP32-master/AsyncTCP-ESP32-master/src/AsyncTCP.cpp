@@ -20,8 +20,13 @@
  */
 
 #include "Arduino.h"
+#include <new>
 
 #include "AsyncTCP.h"
+#include "AsyncSlotTable.h"
+
+#ifndef ASYNC_TCP_POSIX
+
 extern "C"{
 #include "lwip/opt.h"
 #include "lwip/tcp.h"
@@ -30,13 +35,14 @@ extern "C"{
 #include "lwip/err.h"
 }
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 
 /*
  * TCP/IP Event Task
  * */
 
 typedef enum {
-    LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS
+    LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS, LWIP_TCP_TIMER
 } lwip_event_t;
 
 typedef struct {
@@ -80,22 +86,70 @@ static xQueueHandle _async_queue;
 static TaskHandle_t _async_service_task_handle = NULL;
 
 
-SemaphoreHandle_t _slots_lock;
-const int _number_of_closed_slots = CONFIG_LWIP_MAX_ACTIVE_TCP;
-static uint32_t _closed_slots[_number_of_closed_slots];
-static uint32_t _closed_index = []() {
-    _slots_lock = xSemaphoreCreateBinary();
-    xSemaphoreGive(_slots_lock);
-    for (int i = 0; i < _number_of_closed_slots; ++ i) {
-        _closed_slots[i] = 1;
-    }
-    return 1;
-}();
+/*
+ * Closed slots: a client owns a slot while its pcb is open. API calls carry the slot id
+ * (index and generation), so a call that reaches the tcpip thread after the pcb is gone
+ * is dropped, even if the slot has been reused by then.
+ * */
+
+static portMUX_TYPE _slots_mux = portMUX_INITIALIZER_UNLOCKED;
+static AsyncSlotTable<CONFIG_LWIP_MAX_ACTIVE_TCP> _slots;
+
+static inline bool _slot_is_open(int32_t id){
+    return _slots.isOpen(id);
+}
+
+/*
+ * Zero-copy send bookkeeping
+ * */
 
+struct async_tx_ref {
+    struct async_tx_ref * next;
+    uint32_t end; //value of _tx_queued right after this buffer was written
+    const char * data;
+    size_t len;
+    AcReleaseHandler cb;
+    void * arg;
+};
+
+static portMUX_TYPE _tx_refs_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/*
+ * Event queue statistics
+ * */
+
+static portMUX_TYPE _stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static async_tcp_stats_t _stats;
+//bytes handed to lwIP copied and by reference, added to from any task that writes
+static uint32_t _tx_bytes_copied = 0;
+static uint32_t _tx_bytes_referenced = 0;
+
+static inline void _stats_tx(size_t copied, size_t referenced){
+    portENTER_CRITICAL(&_stats_mux);
+    _tx_bytes_copied += copied;
+    _tx_bytes_referenced += referenced;
+    portEXIT_CRITICAL(&_stats_mux);
+}
+
+static inline uint8_t _stats_bucket(uint32_t us){
+    uint8_t b = (us > 1) ? (31 - __builtin_clz(us)) : 0;
+    return (b < ASYNC_TCP_STATS_BUCKETS) ? b : (ASYNC_TCP_STATS_BUCKETS - 1);
+}
+
+//called on the async_tcp task only, so no lock is needed
+static inline void _stats_handled(uint8_t event, uint32_t us){
+    _stats.handled[event]++;
+    _stats.handle_us[event] += us;
+    if(us > _stats.handle_max_us[event]){
+        _stats.handle_max_us[event] = us;
+    }
+    _stats.handle_hist[event][_stats_bucket(us)]++;
+}
 
 static inline bool _init_async_event_queue(){
     if(!_async_queue){
-        _async_queue = xQueueCreate(32, sizeof(lwip_event_packet_t *));
+        _async_queue = xQueueCreate(CONFIG_ASYNC_TCP_QUEUE_SIZE, sizeof(lwip_event_packet_t *));
         if(!_async_queue){
             return false;
         }
@@ -103,16 +157,158 @@ static inline bool _init_async_event_queue(){
     return true;
 }
 
+static bool _queue_async_event(lwip_event_packet_t ** e, bool front, bool wait){
+    //the packet may be handled and freed as soon as it is queued
+    uint8_t event = (*e)->event;
+    uint32_t blocked_us = 0;
+    BaseType_t res = front ? xQueueSendToFront(_async_queue, e, 0) : xQueueSend(_async_queue, e, 0);
+    if(res != pdPASS && !wait){
+        portENTER_CRITICAL(&_stats_mux);
+        _stats.overflow[event]++;
+        portEXIT_CRITICAL(&_stats_mux);
+        return false;
+    }
+    if(res != pdPASS){
+        int64_t started = esp_timer_get_time();
+        res = front ? xQueueSendToFront(_async_queue, e, portMAX_DELAY) : xQueueSend(_async_queue, e, portMAX_DELAY);
+        blocked_us = (uint32_t)(esp_timer_get_time() - started);
+    }
+    uint32_t depth = uxQueueMessagesWaiting(_async_queue);
+    portENTER_CRITICAL(&_stats_mux);
+    if(res == pdPASS){
+        _stats.enqueued[event]++;
+    }
+    if(depth > _stats.queue_peak){
+        _stats.queue_peak = depth;
+    }
+    if(blocked_us){
+        _stats.blocked++;
+        _stats.blocked_us += blocked_us;
+        if(blocked_us > _stats.blocked_max_us){
+            _stats.blocked_max_us = blocked_us;
+        }
+    }
+    portEXIT_CRITICAL(&_stats_mux);
+    return res == pdPASS;
+}
+
 static inline bool _send_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueSend(_async_queue, e, portMAX_DELAY) == pdPASS;
+    return _async_queue && _queue_async_event(e, false, true);
 }
 
 static inline bool _prepend_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueSendToFront(_async_queue, e, portMAX_DELAY) == pdPASS;
+    return _async_queue && _queue_async_event(e, true, true);
+}
+
+//for events the caller can shed when the queue is full (poll, sent, recv), so that lwIP never waits on them
+static inline bool _try_send_async_event(lwip_event_packet_t ** e){
+#if CONFIG_ASYNC_TCP_QUEUE_BLOCK
+    return _async_queue && _queue_async_event(e, false, true);
+#else
+    return _async_queue && _queue_async_event(e, false, false);
+#endif
 }
 
-static inline bool _get_async_event(lwip_event_packet_t ** e){
-    return _async_queue && xQueueReceive(_async_queue, e, portMAX_DELAY) == pdPASS;
+/*
+ * Acks that did not fit in the queue are added up per client by _tcp_sent()
+ * and delivered with that client's next sent or poll event
+ * */
+
+static portMUX_TYPE _deferred_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void _defer_sent(void * arg, uint16_t len){
+    AsyncClient * client = reinterpret_cast<AsyncClient*>(arg);
+    portENTER_CRITICAL(&_deferred_mux);
+    client->_sent_deferred += len;
+    portEXIT_CRITICAL(&_deferred_mux);
+    portENTER_CRITICAL(&_stats_mux);
+    _stats.deferred_bytes += len;
+    portEXIT_CRITICAL(&_stats_mux);
+}
+
+//returns len plus as much of the deferred acks as fits in one sent event
+static uint16_t _take_deferred_sent(void * arg, uint16_t len){
+    AsyncClient * client = reinterpret_cast<AsyncClient*>(arg);
+    portENTER_CRITICAL(&_deferred_mux);
+    uint32_t total = client->_sent_deferred + len;
+    uint16_t now = (total > 0xFFFF) ? 0xFFFF : total;
+    client->_sent_deferred = total - now;
+    portEXIT_CRITICAL(&_deferred_mux);
+    return now;
+}
+
+static inline bool _get_async_event(lwip_event_packet_t ** e, TickType_t wait){
+    return _async_queue && xQueueReceive(_async_queue, e, wait) == pdPASS;
+}
+
+/*
+ * Connection timeouts: one timer wheel for all clients, run by the async_tcp task between events
+ * */
+
+static portMUX_TYPE _timers_mux = portMUX_INITIALIZER_UNLOCKED;
+static AsyncTimerWheel _timers(CONFIG_ASYNC_TCP_TIMER_TICK_MS);
+static bool _timers_idle = true;    //the task waits for events only
+static uint32_t _timers_wake_at = 0; //else when it wakes up on its own
+
+//how long the task may wait for the next event
+static TickType_t _timers_wait(){
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_timers_mux);
+    uint32_t left = _timers.nextTimeout(now);
+    _timers_idle = (left == ASYNC_TIMER_NONE);
+    _timers_wake_at = now + left;
+    portEXIT_CRITICAL(&_timers_mux);
+    if(left == ASYNC_TIMER_NONE){
+        return portMAX_DELAY;
+    }
+    return left ? pdMS_TO_TICKS(left) + 1 : 0;
+}
+
+//arms t unless it already expires earlier, and wakes the task if it would sleep past the new deadline
+static void _timers_arm(async_timer_node * t, uint32_t now, uint32_t delay){
+    bool wake = false;
+    portENTER_CRITICAL(&_timers_mux);
+    if(!t->armed || (int32_t)(now + delay - t->expires_ms) < 0){
+        _timers.arm(t, now, delay);
+        if(_timers_idle || (int32_t)(now + delay - _timers_wake_at) < 0){
+            _timers_idle = false;
+            _timers_wake_at = now + delay;
+            wake = true;
+        }
+    }
+    portEXIT_CRITICAL(&_timers_mux);
+    //the task itself picks the new deadline up before it waits again
+    if(wake && xTaskGetCurrentTaskHandle() != _async_service_task_handle){
+        lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+        e->event = LWIP_TCP_TIMER;
+        e->arg = NULL;
+        //a full queue keeps the task awake anyway
+        if(!_async_queue || !_queue_async_event(&e, false, false)){
+            free((void*)(e));
+        }
+    }
+}
+
+static void _timers_cancel(async_timer_node * t){
+    portENTER_CRITICAL(&_timers_mux);
+    _timers.cancel(t);
+    portEXIT_CRITICAL(&_timers_mux);
+}
+
+//like queued events, a client must not be deleted by another task while its timeout is being handled
+static void _run_timers(){
+    for(;;){
+        uint32_t now = millis();
+        portENTER_CRITICAL(&_timers_mux);
+        async_timer_node * t = _timers.expired(now);
+        portEXIT_CRITICAL(&_timers_mux);
+        if(!t){
+            return;
+        }
+        int64_t started = esp_timer_get_time();
+        AsyncClient::_s_timer(t->arg);
+        _stats_handled(LWIP_TCP_TIMER, (uint32_t)(esp_timer_get_time() - started));
+    }
 }
 
 static bool _remove_events_with_arg(void * arg){
@@ -129,6 +325,7 @@ static bool _remove_events_with_arg(void * arg){
         }
         //discard packet if matching
         if((int)first_packet->arg == (int)arg){
+            _stats.discarded++;
             free(first_packet);
             first_packet = NULL;
         //return first packet to the back of the queue
@@ -142,6 +339,7 @@ static bool _remove_events_with_arg(void * arg){
             return false;
         }
         if((int)packet->arg == (int)arg){
+            _stats.discarded++;
             free(packet);
             packet = NULL;
         } else if(xQueueSend(_async_queue, &packet, portMAX_DELAY) != pdPASS){
@@ -165,10 +363,17 @@ static void _handle_async_event(lwip_event_packet_t * e){
         AsyncClient::_s_fin(e->arg, e->fin.pcb, e->fin.err);
     } else if(e->event == LWIP_TCP_SENT){
         //ets_printf("-S: 0x%08x\n", e->sent.pcb);
-        AsyncClient::_s_sent(e->arg, e->sent.pcb, e->sent.len);
+        AsyncClient::_s_sent(e->arg, e->sent.pcb, _take_deferred_sent(e->arg, e->sent.len));
     } else if(e->event == LWIP_TCP_POLL){
         //ets_printf("-P: 0x%08x\n", e->poll.pcb);
-        AsyncClient::_s_poll(e->arg, e->poll.pcb);
+        reinterpret_cast<AsyncClient*>(e->arg)->_poll_queued = false;
+        //deferred acks take the place of this poll: one callback per event, the client may be gone after it
+        uint16_t acked = _take_deferred_sent(e->arg, 0);
+        if(acked){
+            AsyncClient::_s_sent(e->arg, e->poll.pcb, acked);
+        } else {
+            AsyncClient::_s_poll(e->arg, e->poll.pcb);
+        }
     } else if(e->event == LWIP_TCP_ERROR){
         //ets_printf("-E: 0x%08x %d\n", e->arg, e->error.err);
         AsyncClient::_s_error(e->arg, e->error.err);
@@ -188,19 +393,27 @@ static void _handle_async_event(lwip_event_packet_t * e){
 static void _async_service_task(void *pvParameters){
     lwip_event_packet_t * packet = NULL;
     for (;;) {
-        if(_get_async_event(&packet)){
+        bool got = _get_async_event(&packet, _timers_wait());
 #if CONFIG_ASYNC_TCP_USE_WDT
-            if(esp_task_wdt_add(NULL) != ESP_OK){
-                log_e("Failed to add async task to WDT");
-            }
+        if(esp_task_wdt_add(NULL) != ESP_OK){
+            log_e("Failed to add async task to WDT");
+        }
 #endif
+        if(got){
+            uint8_t event = packet->event;
+            int64_t started = esp_timer_get_time();
             _handle_async_event(packet);
-#if CONFIG_ASYNC_TCP_USE_WDT
-            if(esp_task_wdt_delete(NULL) != ESP_OK){
-                log_e("Failed to remove loop task from WDT");
+            //a timer event only wakes the task up, the timeouts it runs are counted by _run_timers()
+            if(event != LWIP_TCP_TIMER){
+                _stats_handled(event, (uint32_t)(esp_timer_get_time() - started));
             }
-#endif
         }
+        _run_timers();
+#if CONFIG_ASYNC_TCP_USE_WDT
+        if(esp_task_wdt_delete(NULL) != ESP_OK){
+            log_e("Failed to remove loop task from WDT");
+        }
+#endif
     }
     vTaskDelete(NULL);
     _async_service_task_handle = NULL;
@@ -255,17 +468,37 @@ static int8_t _tcp_connected(void * arg, tcp_pcb * pcb, int8_t err) {
 
 static int8_t _tcp_poll(void * arg, struct tcp_pcb * pcb) {
     //ets_printf("+P: 0x%08x\n", pcb);
+    AsyncClient * client = reinterpret_cast<AsyncClient*>(arg);
+    //timeouts run on the timer wheel, so a poll is only needed for onPoll() or to deliver deferred acks
+    if(client && !client->_poll_wanted && !client->_sent_deferred){
+        return ERR_OK;
+    }
+    //the one still in the queue will do
+    if(client && client->_poll_queued){
+        portENTER_CRITICAL(&_stats_mux);
+        _stats.coalesced++;
+        portEXIT_CRITICAL(&_stats_mux);
+        return ERR_OK;
+    }
     lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
     e->event = LWIP_TCP_POLL;
     e->arg = arg;
     e->poll.pcb = pcb;
-    if (!_send_async_event(&e)) {
+    if(client){
+        client->_poll_queued = true;
+    }
+    //a dropped poll is repeated by lwIP on the next interval
+    if (!_try_send_async_event(&e)) {
+        if(client){
+            client->_poll_queued = false;
+        }
         free((void*)(e));
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
+    int8_t ret = ERR_OK;
     lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
     e->arg = arg;
     if(pb){
@@ -274,18 +507,25 @@ static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_
         e->recv.pcb = pcb;
         e->recv.pb = pb;
         e->recv.err = err;
+        //queue full: refuse the data. lwIP keeps pb as refused_data, does not open the
+        //window for it and hands it to us again from its timer or the next segment
+        if (!_try_send_async_event(&e)) {
+            free((void*)(e));
+            return ERR_MEM;
+        }
+        return ERR_OK;
     } else {
         //ets_printf("+F: 0x%08x\n", pcb);
         e->event = LWIP_TCP_FIN;
         e->fin.pcb = pcb;
         e->fin.err = err;
-        //close the PCB in LwIP thread
-        AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
+        //close the PCB in LwIP thread (ERR_ABRT if it had to be aborted)
+        ret = AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
     }
     if (!_send_async_event(&e)) {
         free((void*)(e));
     }
-    return ERR_OK;
+    return ret;
 }
 
 static int8_t _tcp_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
@@ -295,8 +535,11 @@ static int8_t _tcp_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
     e->arg = arg;
     e->sent.pcb = pcb;
     e->sent.len = len;
-    if (!_send_async_event(&e)) {
+    if (!_try_send_async_event(&e)) {
         free((void*)(e));
+        if(arg){
+            _defer_sent(arg, len);
+        }
     }
     return ERR_OK;
 }
@@ -349,7 +592,7 @@ static int8_t _tcp_accept(void * arg, AsyncClient * client) {
 typedef struct {
     struct tcpip_api_call_data call;
     tcp_pcb * pcb;
-    int8_t closed_slot;
+    int32_t closed_slot;
     int8_t err;
     union {
             struct {
@@ -367,20 +610,27 @@ typedef struct {
                     ip_addr_t * addr;
                     uint16_t port;
             } bind;
+            struct {
+                    const async_iovec_t* iov;
+                    size_t count;
+                    size_t done;
+                    bool output;
+            } writev;
             uint8_t backlog;
+            async_tcp_info_t * info;
     };
 } tcp_api_call_t;
 
 static err_t _tcp_output_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_slot_is_open(msg->closed_slot)) {
         msg->err = tcp_output(msg->pcb);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_output(tcp_pcb * pcb, int8_t closed_slot) {
+static esp_err_t _tcp_output(tcp_pcb * pcb, int32_t closed_slot) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -394,13 +644,13 @@ static esp_err_t _tcp_output(tcp_pcb * pcb, int8_t closed_slot) {
 static err_t _tcp_write_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_slot_is_open(msg->closed_slot)) {
         msg->err = tcp_write(msg->pcb, msg->write.data, msg->write.size, msg->write.apiflags);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_write(tcp_pcb * pcb, int8_t closed_slot, const char* data, size_t size, uint8_t apiflags) {
+static esp_err_t _tcp_write(tcp_pcb * pcb, int32_t closed_slot, const char* data, size_t size, uint8_t apiflags) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -414,17 +664,92 @@ static esp_err_t _tcp_write(tcp_pcb * pcb, int8_t closed_slot, const char* data,
     return msg.err;
 }
 
+static err_t _tcp_writev_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    msg->err = ERR_CONN;
+    msg->writev.done = 0;
+    if(_slot_is_open(msg->closed_slot)) {
+        msg->err = ERR_OK;
+        for(size_t i = 0; i < msg->writev.count; i++){
+            const async_iovec_t * v = &msg->writev.iov[i];
+            if(v->len){
+                uint8_t flags = v->release ? (v->apiflags & ~TCP_WRITE_FLAG_COPY) : v->apiflags;
+                if(i + 1 < msg->writev.count){
+                    flags |= TCP_WRITE_FLAG_MORE;
+                }
+                //whole segments only
+                if(tcp_sndbuf(msg->pcb) < v->len || tcp_write(msg->pcb, v->data, v->len, flags) != ERR_OK){
+                    break;
+                }
+            }
+            msg->writev.done++;
+        }
+        if(msg->writev.output && msg->writev.done){
+            msg->err = tcp_output(msg->pcb);
+        }
+    }
+    return msg->err;
+}
+
+static esp_err_t _tcp_writev(tcp_pcb * pcb, int32_t closed_slot, const async_iovec_t* iov, size_t count, bool output, size_t * done) {
+    *done = 0;
+    if(!pcb){
+        return ERR_CONN;
+    }
+    tcp_api_call_t msg;
+    msg.pcb = pcb;
+    msg.closed_slot = closed_slot;
+    msg.writev.iov = iov;
+    msg.writev.count = count;
+    msg.writev.output = output;
+    tcpip_api_call(_tcp_writev_api, (struct tcpip_api_call_data*)&msg);
+    *done = msg.writev.done;
+    return msg.err;
+}
+
+static err_t _tcp_info_api(struct tcpip_api_call_data *api_call_msg){
+    tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
+    msg->err = ERR_CONN;
+    if(_slot_is_open(msg->closed_slot) && msg->pcb->state == ESTABLISHED) {
+        tcp_pcb * pcb = msg->pcb;
+        async_tcp_info_t * info = msg->info;
+        info->srtt_ms = (pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+        info->rttvar_ms = (pcb->sv >> 2) * TCP_SLOW_INTERVAL;
+        info->unacked = pcb->snd_nxt - pcb->lastack;
+        info->cwnd = pcb->cwnd;
+        info->snd_wnd = pcb->snd_wnd;
+        info->snd_buf = tcp_sndbuf(pcb);
+        info->snd_queuelen = pcb->snd_queuelen;
+        info->mss = tcp_mss(pcb);
+        info->nrtx = pcb->nrtx;
+        msg->err = ERR_OK;
+    }
+    return msg->err;
+}
+
+static esp_err_t _tcp_info(tcp_pcb * pcb, int32_t closed_slot, async_tcp_info_t * info) {
+    if(!pcb){
+        return ERR_CONN;
+    }
+    tcp_api_call_t msg;
+    msg.pcb = pcb;
+    msg.closed_slot = closed_slot;
+    msg.info = info;
+    tcpip_api_call(_tcp_info_api, (struct tcpip_api_call_data*)&msg);
+    return msg.err;
+}
+
 static err_t _tcp_recved_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_slot_is_open(msg->closed_slot)) {
         msg->err = 0;
         tcp_recved(msg->pcb, msg->received);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_recved(tcp_pcb * pcb, int8_t closed_slot, size_t len) {
+static esp_err_t _tcp_recved(tcp_pcb * pcb, int32_t closed_slot, size_t len) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -439,13 +764,13 @@ static esp_err_t _tcp_recved(tcp_pcb * pcb, int8_t closed_slot, size_t len) {
 static err_t _tcp_close_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_slot_is_open(msg->closed_slot)) {
         msg->err = tcp_close(msg->pcb);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_close(tcp_pcb * pcb, int8_t closed_slot) {
+static esp_err_t _tcp_close(tcp_pcb * pcb, int32_t closed_slot) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -459,13 +784,13 @@ static esp_err_t _tcp_close(tcp_pcb * pcb, int8_t closed_slot) {
 static err_t _tcp_abort_api(struct tcpip_api_call_data *api_call_msg){
     tcp_api_call_t * msg = (tcp_api_call_t *)api_call_msg;
     msg->err = ERR_CONN;
-    if(msg->closed_slot == -1 || !_closed_slots[msg->closed_slot]) {
+    if(_slot_is_open(msg->closed_slot)) {
         tcp_abort(msg->pcb);
     }
     return msg->err;
 }
 
-static esp_err_t _tcp_abort(tcp_pcb * pcb, int8_t closed_slot) {
+static esp_err_t _tcp_abort(tcp_pcb * pcb, int32_t closed_slot) {
     if(!pcb){
         return ERR_CONN;
     }
@@ -482,7 +807,7 @@ static err_t _tcp_connect_api(struct tcpip_api_call_data *api_call_msg){
     return msg->err;
 }
 
-static esp_err_t _tcp_connect(tcp_pcb * pcb, int8_t closed_slot, ip_addr_t * addr, uint16_t port, tcp_connected_fn cb) {
+static esp_err_t _tcp_connect(tcp_pcb * pcb, int32_t closed_slot, ip_addr_t * addr, uint16_t port, tcp_connected_fn cb) {
     if(!pcb){
         return ESP_FAIL;
     }
@@ -562,11 +887,20 @@ AsyncClient::AsyncClient(tcp_pcb* pcb)
 , _rx_since_timeout(0)
 , _ack_timeout(ASYNC_MAX_ACK_TIME)
 , _connect_port(0)
+, _tx_refs(NULL)
+, _tx_refs_tail(NULL)
+, _tx_queued(0)
+, _tx_acked(0)
 , prev(NULL)
 , next(NULL)
 {
     _pcb = pcb;
     _closed_slot = -1;
+    _poll_queued = false;
+    _poll_wanted = false;
+    _sent_deferred = 0;
+    _timer = async_timer_node();
+    _timer.arg = this;
     if(_pcb){
         _allocate_closed_slot();
         _rx_last_packet = millis();
@@ -582,6 +916,8 @@ AsyncClient::~AsyncClient(){
     if(_pcb) {
         _close();
     }
+    _cancel_timer();
+    _release_tx_refs(true);
     _free_closed_slot();
 }
 
@@ -668,6 +1004,7 @@ void AsyncClient::onTimeout(AcTimeoutHandler cb, void* arg){
 void AsyncClient::onPoll(AcConnectHandler cb, void* arg){
     _poll_cb = cb;
     _poll_cb_arg = arg;
+    _poll_wanted = (bool)cb;
 }
 
 /*
@@ -694,6 +1031,8 @@ bool AsyncClient::connect(IPAddress ip, uint16_t port){
         return false;
     }
 
+    _poll_queued = false;
+    _sent_deferred = 0;
     tcp_arg(pcb, this);
     tcp_err(pcb, &_tcp_error);
     tcp_recv(pcb, &_tcp_recv);
@@ -734,6 +1073,8 @@ int8_t AsyncClient::abort(){
     if(_pcb) {
         _tcp_abort(_pcb, _closed_slot );
         _pcb = NULL;
+        //lwIP has dropped the queued segments
+        _release_tx_refs(true);
     }
     return ERR_ABRT;
 }
@@ -759,15 +1100,148 @@ size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
     if(err != ERR_OK) {
         return 0;
     }
+    _tx_queued += will_send;
+    if(apiflags & ASYNC_WRITE_FLAG_COPY) {
+        _stats_tx(will_send, 0);
+    } else {
+        _stats_tx(0, will_send);
+    }
     return will_send;
 }
 
+size_t AsyncClient::addRef(const char* data, size_t size, AcReleaseHandler cb, void* arg, uint8_t apiflags) {
+    if(!_pcb || size == 0 || data == NULL || space() < size) {
+        return 0;
+    }
+    async_tx_ref * ref = new (std::nothrow) async_tx_ref;
+    if(!ref) {
+        return 0;
+    }
+    int8_t err = _tcp_write(_pcb, _closed_slot, data, size, apiflags & ~ASYNC_WRITE_FLAG_COPY);
+    if(err != ERR_OK) {
+        delete ref;
+        return 0;
+    }
+    _stats_tx(0, size);
+    ref->next = NULL;
+    ref->data = data;
+    ref->len = size;
+    ref->cb = cb;
+    ref->arg = arg;
+    portENTER_CRITICAL(&_tx_refs_mux);
+    _tx_queued += size;
+    ref->end = _tx_queued;
+    if(_tx_refs_tail) {
+        _tx_refs_tail->next = ref;
+    } else {
+        _tx_refs = ref;
+    }
+    _tx_refs_tail = ref;
+    portEXIT_CRITICAL(&_tx_refs_mux);
+    //the ack might have been handled before we got here
+    _release_tx_refs(false);
+    return size;
+}
+
+size_t AsyncClient::addv(const async_iovec_t* iov, size_t count) {
+    return _addv(iov, count, false);
+}
+
+size_t AsyncClient::writev(const async_iovec_t* iov, size_t count) {
+    return _addv(iov, count, true);
+}
+
+size_t AsyncClient::_addv(const async_iovec_t* iov, size_t count, bool output) {
+    if(!_pcb || iov == NULL || count == 0) {
+        return 0;
+    }
+    //refs are allocated before lwIP holds the data, nothing may fail after that
+    async_tx_ref * spare = NULL;
+    for(size_t i = 0; i < count; i++) {
+        if(iov[i].release && iov[i].len) {
+            async_tx_ref * ref = new (std::nothrow) async_tx_ref;
+            if(!ref) {
+                count = i;
+                break;
+            }
+            ref->next = spare;
+            spare = ref;
+        }
+    }
+    size_t done = 0;
+    int8_t err = _tcp_writev(_pcb, _closed_slot, iov, count, output, &done);
+    async_tx_ref * head = NULL;
+    async_tx_ref * tail = NULL;
+    size_t copied = 0;
+    size_t referenced = 0;
+    for(size_t i = 0; i < done; i++) {
+        const async_iovec_t * v = &iov[i];
+        if(v->release && v->len) {
+            async_tx_ref * ref = spare;
+            spare = ref->next;
+            ref->next = NULL;
+            ref->data = v->data;
+            ref->len = v->len;
+            ref->cb = v->release;
+            ref->arg = v->release_arg;
+            if(tail) {
+                tail->next = ref;
+            } else {
+                head = ref;
+            }
+            tail = ref;
+            referenced += v->len;
+        } else if(v->apiflags & ASYNC_WRITE_FLAG_COPY) {
+            copied += v->len;
+        } else {
+            referenced += v->len;
+        }
+    }
+    if(done) {
+        _stats_tx(copied, referenced);
+    }
+    while(spare) {
+        async_tx_ref * ref = spare;
+        spare = ref->next;
+        delete ref;
+    }
+    portENTER_CRITICAL(&_tx_refs_mux);
+    async_tx_ref * ref = head;
+    for(size_t i = 0; i < done; i++) {
+        _tx_queued += iov[i].len;
+        if(iov[i].release && iov[i].len) {
+            ref->end = _tx_queued;
+            ref = ref->next;
+        }
+    }
+    if(head) {
+        if(_tx_refs_tail) {
+            _tx_refs_tail->next = head;
+        } else {
+            _tx_refs = head;
+        }
+        _tx_refs_tail = tail;
+    }
+    portEXIT_CRITICAL(&_tx_refs_mux);
+    if(output && done && err == ERR_OK) {
+        _pcb_busy = true;
+        _pcb_sent_at = millis();
+        _arm_timer();
+    }
+    if(head) {
+        //the ack might have been handled before we got here
+        _release_tx_refs(false);
+    }
+    return done;
+}
+
 bool AsyncClient::send(){
     int8_t err = ERR_OK;
     err = _tcp_output(_pcb, _closed_slot);
     if(err == ERR_OK){
         _pcb_busy = true;
         _pcb_sent_at = millis();
+        _arm_timer();
         return true;
     }
     return false;
@@ -798,6 +1272,7 @@ void AsyncClient::ackPacket(struct pbuf * pb){
 int8_t AsyncClient::_close(){
     //ets_printf("X: 0x%08x\n", (uint32_t)this);
     int8_t err = ERR_OK;
+    _cancel_timer();
     if(_pcb) {
         //log_i("");
         tcp_arg(_pcb, NULL);
@@ -806,11 +1281,17 @@ int8_t AsyncClient::_close(){
         tcp_err(_pcb, NULL);
         tcp_poll(_pcb, NULL, 0);
         _tcp_clear_events(this);
-        err = _tcp_close(_pcb, _closed_slot);
-        if(err != ERR_OK) {
+        if(_tx_refs) {
+            //a graceful close lets lwIP keep sending from buffers we are about to release
             err = abort();
+        } else {
+            err = _tcp_close(_pcb, _closed_slot);
+            if(err != ERR_OK) {
+                err = abort();
+            }
         }
         _pcb = NULL;
+        _release_tx_refs(true);
         if(_discard_cb) {
             _discard_cb(_discard_cb_arg, this);
         }
@@ -819,26 +1300,40 @@ int8_t AsyncClient::_close(){
 }
 
 void AsyncClient::_allocate_closed_slot(){
-    xSemaphoreTake(_slots_lock, portMAX_DELAY);
-    uint32_t closed_slot_min_index = 0;
-    for (int i = 0; i < _number_of_closed_slots; ++ i) {
-        if ((_closed_slot == -1 || _closed_slots[i] <= closed_slot_min_index) && _closed_slots[i] != 0) {
-            closed_slot_min_index = _closed_slots[i];
-            _closed_slot = i;
+    portENTER_CRITICAL(&_slots_mux);
+    _closed_slot = _slots.allocate();
+    portEXIT_CRITICAL(&_slots_mux);
+}
+
+void AsyncClient::_release_tx_refs(bool all){
+    for(;;) {
+        portENTER_CRITICAL(&_tx_refs_mux);
+        async_tx_ref * ref = _tx_refs;
+        if(ref && (all || (int32_t)(_tx_acked - ref->end) >= 0)) {
+            _tx_refs = ref->next;
+            if(!_tx_refs) {
+                _tx_refs_tail = NULL;
+            }
+        } else {
+            ref = NULL;
         }
+        portEXIT_CRITICAL(&_tx_refs_mux);
+        if(!ref) {
+            return;
+        }
+        if(ref->cb) {
+            ref->cb(ref->arg, ref->data, ref->len);
+        }
+        delete ref;
     }
-    if (_closed_slot != -1) {
-        _closed_slots[_closed_slot] = 0;
-    }
-    xSemaphoreGive(_slots_lock);
 }
 
 void AsyncClient::_free_closed_slot(){
-    if (_closed_slot != -1) {
-        _closed_slots[_closed_slot] = _closed_index;
-        _closed_slot = -1;
-        ++ _closed_index;
-    }
+    //runs on the tcpip thread (fin) as well as the owner's, and a copied client shares the id
+    portENTER_CRITICAL(&_slots_mux);
+    _slots.free(_closed_slot);
+    _closed_slot = -1;
+    portEXIT_CRITICAL(&_slots_mux);
 }
 
 /*
@@ -850,6 +1345,7 @@ int8_t AsyncClient::_connected(void* pcb, int8_t err){
     if(_pcb){
         _rx_last_packet = millis();
         _pcb_busy = false;
+        _arm_timer();
 //        tcp_recv(_pcb, &_tcp_recv);
 //        tcp_sent(_pcb, &_tcp_sent);
 //        tcp_poll(_pcb, &_tcp_poll, 1);
@@ -861,6 +1357,7 @@ int8_t AsyncClient::_connected(void* pcb, int8_t err){
 }
 
 void AsyncClient::_error(int8_t err) {
+    _cancel_timer();
     if(_pcb){
         tcp_arg(_pcb, NULL);
         if(_pcb->state == LISTEN) {
@@ -871,6 +1368,8 @@ void AsyncClient::_error(int8_t err) {
         }
         _pcb = NULL;
     }
+    //the pcb is gone together with everything it still referenced
+    _release_tx_refs(true);
     if(_error_cb) {
         _error_cb(_error_cb_arg, this, err);
     }
@@ -892,17 +1391,22 @@ int8_t AsyncClient::_lwip_fin(tcp_pcb* pcb, int8_t err) {
         tcp_err(_pcb, NULL);
         tcp_poll(_pcb, NULL, 0);
     }
-    if(tcp_close(_pcb) != ERR_OK) {
+    int8_t ret = ERR_OK;
+    if(_tx_refs || tcp_close(_pcb) != ERR_OK) {
+        //referenced buffers are released in _fin, so lwIP must not keep sending from them
         tcp_abort(_pcb);
+        ret = ERR_ABRT;
     }
     _free_closed_slot();
     _pcb = NULL;
-    return ERR_OK;
+    return ret;
 }
 
 //In Async Thread
 int8_t AsyncClient::_fin(tcp_pcb* pcb, int8_t err) {
+    _cancel_timer();
     _tcp_clear_events(this);
+    _release_tx_refs(true);
     if(_discard_cb) {
         _discard_cb(_discard_cb_arg, this);
     }
@@ -913,6 +1417,8 @@ int8_t AsyncClient::_sent(tcp_pcb* pcb, uint16_t len) {
     _rx_last_packet = millis();
     //log_i("%u", len);
     _pcb_busy = false;
+    _tx_acked += len;
+    _release_tx_refs(false);
     if(_sent_cb) {
         _sent_cb(_sent_cb_arg, this, len, (millis() - _pcb_sent_at));
     }
@@ -953,28 +1459,65 @@ int8_t AsyncClient::_poll(tcp_pcb* pcb){
         log_e("0x%08x != 0x%08x", (uint32_t)pcb, (uint32_t)_pcb);
         return ERR_OK;
     }
+    if(_poll_cb) {
+        _poll_cb(_poll_cb_arg, this);
+    }
+    return ERR_OK;
+}
 
+//arms the timer for the earliest timeout. Activity only moves the deadlines back,
+//so the timer is not moved then: _timeout() checks again and re-arms
+void AsyncClient::_arm_timer(){
+    if(!_pcb){
+        return;
+    }
+    uint32_t now = millis();
+    uint32_t delay = ASYNC_TIMER_NONE;
+    if(_pcb_busy && _ack_timeout){
+        uint32_t waited = now - _pcb_sent_at;
+        delay = (waited < _ack_timeout) ? (_ack_timeout - waited) : 0;
+    }
+    if(_rx_since_timeout){
+        uint32_t idle = now - _rx_last_packet;
+        uint32_t rx = (idle < _rx_since_timeout * 1000) ? (_rx_since_timeout * 1000 - idle) : 0;
+        if(rx < delay){
+            delay = rx;
+        }
+    }
+    if(delay != ASYNC_TIMER_NONE){
+        _timers_arm(&_timer, now, delay);
+    }
+}
+
+void AsyncClient::_cancel_timer(){
+    _timers_cancel(&_timer);
+}
+
+//In Async Thread, when _timer expires
+void AsyncClient::_timeout(){
+    if(!_pcb){
+        return;
+    }
     uint32_t now = millis();
 
     // ACK Timeout
     if(_pcb_busy && _ack_timeout && (now - _pcb_sent_at) >= _ack_timeout){
         _pcb_busy = false;
-        log_w("ack timeout %d", pcb->state);
+        //before the callback, which may delete us
+        _arm_timer();
+        log_w("ack timeout %d", _pcb->state);
         if(_timeout_cb)
             _timeout_cb(_timeout_cb_arg, this, (now - _pcb_sent_at));
-        return ERR_OK;
+        return;
     }
     // RX Timeout
     if(_rx_since_timeout && (now - _rx_last_packet) >= (_rx_since_timeout * 1000)){
-        log_w("rx timeout %d", pcb->state);
+        log_w("rx timeout %d", _pcb->state);
         _close();
-        return ERR_OK;
-    }
-    // Everything is fine
-    if(_poll_cb) {
-        _poll_cb(_poll_cb_arg, this);
+        return;
     }
-    return ERR_OK;
+    // Everything is fine, wait for the moved deadlines
+    _arm_timer();
 }
 
 void AsyncClient::_dns_found(struct ip_addr *ipaddr){
@@ -1025,6 +1568,7 @@ size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
 
 void AsyncClient::setRxTimeout(uint32_t timeout){
     _rx_since_timeout = timeout;
+    _arm_timer();
 }
 
 uint32_t AsyncClient::getRxTimeout(){
@@ -1037,6 +1581,7 @@ uint32_t AsyncClient::getAckTimeout(){
 
 void AsyncClient::setAckTimeout(uint32_t timeout){
     _ack_timeout = timeout;
+    _arm_timer();
 }
 
 void AsyncClient::setNoDelay(bool nodelay){
@@ -1064,6 +1609,13 @@ uint16_t AsyncClient::getMss(){
     return tcp_mss(_pcb);
 }
 
+bool AsyncClient::getTransportInfo(async_tcp_info_t * info){
+    if(!_pcb || !info) {
+        return false;
+    }
+    return _tcp_info(_pcb, _closed_slot, info) == ERR_OK;
+}
+
 uint32_t AsyncClient::getRemoteAddress() {
     if(!_pcb) {
         return 0;
@@ -1177,6 +1729,20 @@ const char * AsyncClient::errorToString(int8_t error){
     }
 }
 
+uint32_t AsyncClient::bytesCopied(){
+    portENTER_CRITICAL(&_stats_mux);
+    uint32_t n = _tx_bytes_copied;
+    portEXIT_CRITICAL(&_stats_mux);
+    return n;
+}
+
+uint32_t AsyncClient::bytesReferenced(){
+    portENTER_CRITICAL(&_stats_mux);
+    uint32_t n = _tx_bytes_referenced;
+    portEXIT_CRITICAL(&_stats_mux);
+    return n;
+}
+
 const char * AsyncClient::stateToString(){
     switch(state()){
         case 0: return "Closed";
@@ -1206,6 +1772,10 @@ int8_t AsyncClient::_s_poll(void * arg, struct tcp_pcb * pcb) {
     return reinterpret_cast<AsyncClient*>(arg)->_poll(pcb);
 }
 
+void AsyncClient::_s_timer(void * arg) {
+    reinterpret_cast<AsyncClient*>(arg)->_timeout();
+}
+
 int8_t AsyncClient::_s_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
     return reinterpret_cast<AsyncClient*>(arg)->_recv(pcb, pb, err);
 }
@@ -1355,3 +1925,42 @@ int8_t AsyncServer::_s_accept(void * arg, tcp_pcb * pcb, int8_t err){
 int8_t AsyncServer::_s_accepted(void *arg, AsyncClient* client){
     return reinterpret_cast<AsyncServer*>(arg)->_accepted(client);
 }
+
+/*
+ * Statistics API
+ * */
+
+void AsyncTCPStats::snapshot(async_tcp_stats_t * stats){
+    if(!stats){
+        return;
+    }
+    portENTER_CRITICAL(&_stats_mux);
+    memcpy(stats, &_stats, sizeof(async_tcp_stats_t));
+    portEXIT_CRITICAL(&_stats_mux);
+    stats->queue_size = CONFIG_ASYNC_TCP_QUEUE_SIZE;
+    stats->queue_depth = _async_queue ? uxQueueMessagesWaiting(_async_queue) : 0;
+}
+
+void AsyncTCPStats::reset(){
+    portENTER_CRITICAL(&_stats_mux);
+    memset(&_stats, 0, sizeof(async_tcp_stats_t));
+    portEXIT_CRITICAL(&_stats_mux);
+}
+
+const char * AsyncTCPStats::eventName(uint8_t event){
+    switch(event){
+        case ASYNC_TCP_EV_SENT: return "sent";
+        case ASYNC_TCP_EV_RECV: return "recv";
+        case ASYNC_TCP_EV_FIN: return "fin";
+        case ASYNC_TCP_EV_ERROR: return "error";
+        case ASYNC_TCP_EV_POLL: return "poll";
+        case ASYNC_TCP_EV_CLEAR: return "clear";
+        case ASYNC_TCP_EV_ACCEPT: return "accept";
+        case ASYNC_TCP_EV_CONNECTED: return "connected";
+        case ASYNC_TCP_EV_DNS: return "dns";
+        case ASYNC_TCP_EV_TIMER: return "timer";
+        default: return "unknown";
+    }
+}
+
+#endif /* ASYNC_TCP_POSIX */
@@ -22,13 +22,32 @@
 #ifndef ASYNCTCP_H_
 #define ASYNCTCP_H_
 
+//Linux builds use the epoll backend in AsyncTCP_posix.cpp instead of lwIP
+#if !defined(ASYNC_TCP_POSIX) && defined(__linux__) && !defined(ESP_PLATFORM)
+#define ASYNC_TCP_POSIX 1
+#endif
+
 #include "IPAddress.h"
-#include "sdkconfig.h"
+#include "AsyncTimerWheel.h"
 #include <functional>
+#ifdef ASYNC_TCP_POSIX
+#include <stdint.h>
+#include <stddef.h>
+//minimal pbuf, as handed to onPacket(). Free it with ackPacket() or pbuf_free()
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    uint16_t tot_len;
+    uint16_t len;
+};
+extern "C" uint8_t pbuf_free(struct pbuf *p);
+#else
+#include "sdkconfig.h"
 extern "C" {
     #include "freertos/semphr.h"
     #include "lwip/pbuf.h"
 }
+#endif
 
 //If core is not defined, then we are running in Arduino or PIO
 #ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
@@ -36,6 +55,16 @@ extern "C" {
 #define CONFIG_ASYNC_TCP_USE_WDT 1 //if enabled, adds between 33us and 200us per event
 #endif
 
+#ifndef CONFIG_ASYNC_TCP_QUEUE_SIZE
+#define CONFIG_ASYNC_TCP_QUEUE_SIZE 32 //events waiting for the async_tcp task
+#endif
+//CONFIG_ASYNC_TCP_QUEUE_BLOCK=1 makes lwIP wait for room in a full queue for every event (the old behaviour).
+//Otherwise poll events are dropped, acks are deferred and received data is refused until there is room again.
+
+#ifndef CONFIG_ASYNC_TCP_TIMER_TICK_MS
+#define CONFIG_ASYNC_TCP_TIMER_TICK_MS 10 //resolution of the rx and ack timeouts
+#endif
+
 class AsyncClient;
 
 #define ASYNC_MAX_ACK_TIME 5000
@@ -48,9 +77,70 @@ typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
 typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
 typedef std::function<void(void*, AsyncClient*, struct pbuf *pb)> AcPacketHandler;
 typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+typedef std::function<void(void*, const char* data, size_t len)> AcReleaseHandler;
 
 struct tcp_pcb;
 struct ip_addr;
+struct async_tx_ref;
+
+//one segment for AsyncClient::addv(), like struct iovec
+typedef struct {
+    const char* data;
+    size_t len;
+    uint8_t apiflags;          //ASYNC_WRITE_FLAG_COPY to copy the segment, else it is referenced
+    AcReleaseHandler release;  //optional, makes the segment behave like addRef(): called with release_arg once acked
+    void* release_arg;
+} async_iovec_t;
+
+//transport state of a connection, see AsyncClient::getTransportInfo()
+typedef struct {
+    uint32_t srtt_ms;      //smoothed round trip time (lwIP measures it in 500ms ticks)
+    uint32_t rttvar_ms;    //round trip time variance, same resolution
+    uint32_t unacked;      //bytes sent and not acked yet
+    uint32_t cwnd;         //congestion window in bytes
+    uint32_t snd_wnd;      //receive window advertised by the peer (0 if not known)
+    uint32_t snd_buf;      //free room in the send buffer, as space()
+    uint16_t snd_queuelen; //segments queued for sending
+    uint16_t mss;
+    uint8_t nrtx;          //retransmissions of the oldest unacked segment
+} async_tcp_info_t;
+
+//event types counted by AsyncTCPStats, in the order of the service task's event queue.
+//TIMER counts wakeups of the service task as enqueued and expired timeouts as handled
+typedef enum {
+    ASYNC_TCP_EV_SENT, ASYNC_TCP_EV_RECV, ASYNC_TCP_EV_FIN, ASYNC_TCP_EV_ERROR, ASYNC_TCP_EV_POLL,
+    ASYNC_TCP_EV_CLEAR, ASYNC_TCP_EV_ACCEPT, ASYNC_TCP_EV_CONNECTED, ASYNC_TCP_EV_DNS, ASYNC_TCP_EV_TIMER,
+    ASYNC_TCP_EV_MAX
+} async_tcp_event_t;
+
+#define ASYNC_TCP_STATS_BUCKETS 16 //handling time histogram: bucket i counts times below 2^(i+1) us, the last one the rest
+
+typedef struct {
+    uint32_t enqueued[ASYNC_TCP_EV_MAX];   //events put on the queue
+    uint32_t handled[ASYNC_TCP_EV_MAX];    //events taken off the queue and dispatched
+    uint32_t discarded;                    //events dropped by LWIP_TCP_CLEAR for a closed client
+    uint64_t handle_us[ASYNC_TCP_EV_MAX];  //total time spent in the callbacks
+    uint32_t handle_max_us[ASYNC_TCP_EV_MAX];
+    uint32_t handle_hist[ASYNC_TCP_EV_MAX][ASYNC_TCP_STATS_BUCKETS];
+    uint32_t queue_size;
+    uint32_t queue_depth;                  //at the time of the snapshot
+    uint32_t queue_peak;
+    uint32_t overflow[ASYNC_TCP_EV_MAX];   //events that found the queue full and were shed instead of waiting
+    uint32_t coalesced;                    //poll events skipped because the client still had one queued
+    uint32_t deferred_bytes;               //acked bytes carried over to a later sent/poll event
+    uint32_t blocked;                      //enqueues that found the queue full and had to wait
+    uint64_t blocked_us;                   //total time lwIP spent waiting for room in the queue
+    uint32_t blocked_max_us;
+} async_tcp_stats_t;
+
+//Counters for the async_tcp event queue and callbacks. Always compiled in:
+//an enqueue costs a short critical section, a dispatch two esp_timer_get_time() calls.
+class AsyncTCPStats {
+  public:
+    static void snapshot(async_tcp_stats_t * stats);
+    static void reset(); //everything but the current queue depth
+    static const char * eventName(uint8_t event);
+};
 
 class AsyncClient {
   public:
@@ -77,6 +167,16 @@ class AsyncClient {
     size_t add(const char* data, size_t size, uint8_t apiflags=ASYNC_WRITE_FLAG_COPY);//add for sending
     bool send();//send all data added with the method above
 
+    //queue data by reference (no copy). Either all of it is queued or nothing is (returns 0).
+    //cb is called once the peer has acked the data or the connection is gone; until then the buffer must stay valid.
+    //cb runs on the async_tcp task (or the caller, if the data got acked before addRef returned)
+    size_t addRef(const char* data, size_t size, AcReleaseHandler cb, void* arg = 0, uint8_t apiflags = 0);
+
+    //queue several segments with one call into the tcpip thread. Segments are taken in order and whole:
+    //returns how many were queued, the first one that does not fit and all after it are left to the caller
+    size_t addv(const async_iovec_t* iov, size_t count);
+    size_t writev(const async_iovec_t* iov, size_t count);//addv()+send() in the same call
+
     //write equals add()+send()
     size_t write(const char* data);
     size_t write(const char* data, size_t size, uint8_t apiflags=ASYNC_WRITE_FLAG_COPY); //only when canSend() == true
@@ -89,6 +189,7 @@ class AsyncClient {
     bool freeable();//disconnected or disconnecting
 
     uint16_t getMss();
+    bool getTransportInfo(async_tcp_info_t * info);//false if not connected. Goes through the tcpip thread, do not call from lwIP callbacks
 
     uint32_t getRxTimeout();
     void setRxTimeout(uint32_t timeout);//no RX data timeout for the connection in seconds
@@ -117,7 +218,7 @@ class AsyncClient {
     void onData(AcDataHandler cb, void* arg = 0);           //data received (called if onPacket is not used)
     void onPacket(AcPacketHandler cb, void* arg = 0);       //data received
     void onTimeout(AcTimeoutHandler cb, void* arg = 0);     //ack timeout
-    void onPoll(AcConnectHandler cb, void* arg = 0);        //every 125ms when connected
+    void onPoll(AcConnectHandler cb, void* arg = 0);        //every 500ms when connected, no poll events are queued without it
 
     void ackPacket(struct pbuf * pb);//ack pbuf from onPacket
     size_t ack(size_t len); //ack data that you have not acked using the method below
@@ -126,6 +227,10 @@ class AsyncClient {
     const char * errorToString(int8_t error);
     const char * stateToString();
 
+    //bytes handed to lwIP by all clients since boot (wrap around at 4GB)
+    static uint32_t bytesCopied();      //written with ASYNC_WRITE_FLAG_COPY
+    static uint32_t bytesReferenced();  //written by reference
+
     //Do not use any of the functions below!
     static int8_t _s_poll(void *arg, struct tcp_pcb *tpcb);
     static int8_t _s_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *pb, int8_t err);
@@ -135,13 +240,18 @@ class AsyncClient {
     static int8_t _s_sent(void *arg, struct tcp_pcb *tpcb, uint16_t len);
     static int8_t _s_connected(void* arg, void* tpcb, int8_t err);
     static void _s_dns_found(const char *name, struct ip_addr *ipaddr, void *arg);
+    static void _s_timer(void *arg);
 
     int8_t _recv(tcp_pcb* pcb, pbuf* pb, int8_t err);
     tcp_pcb * pcb(){ return _pcb; }
 
+    volatile bool _poll_queued; //a poll event for this client is in the queue
+    uint32_t _sent_deferred;    //acked bytes that did not fit in the queue yet
+    volatile bool _poll_wanted; //onPoll() is set, read by lwIP before it queues a poll event
+
   protected:
     tcp_pcb* _pcb;
-    int8_t  _closed_slot;
+    int32_t _closed_slot; //slot index | generation << 16, -1 if none
 
     AcConnectHandler _connect_cb;
     void* _connect_cb_arg;
@@ -169,7 +279,16 @@ class AsyncClient {
     uint32_t _ack_timeout;
     uint16_t _connect_port;
 
+    struct async_tx_ref* _tx_refs;
+    struct async_tx_ref* _tx_refs_tail;
+    uint32_t _tx_queued;
+    uint32_t _tx_acked;
+
+    async_timer_node _timer; //earliest of the rx and ack timeouts, checked again when it expires
+
     int8_t _close();
+    void _release_tx_refs(bool all);
+    size_t _addv(const async_iovec_t* iov, size_t count, bool output);
     void _free_closed_slot();
     void _allocate_closed_slot();
     int8_t _connected(void* pcb, int8_t err);
@@ -179,6 +298,9 @@ class AsyncClient {
     int8_t _fin(tcp_pcb* pcb, int8_t err);
     int8_t _lwip_fin(tcp_pcb* pcb, int8_t err);
     void _dns_found(struct ip_addr *ipaddr);
+    void _arm_timer();
+    void _cancel_timer();
+    void _timeout();
 
   public:
     AsyncClient* prev;
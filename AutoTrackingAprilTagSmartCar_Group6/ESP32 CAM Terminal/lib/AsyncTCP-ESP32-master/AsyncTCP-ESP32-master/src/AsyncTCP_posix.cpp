@@ -0,0 +1,1709 @@
+/*
+  Asynchronous TCP library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * POSIX backend: AsyncClient/AsyncServer on nonblocking Linux sockets and epoll.
+ *
+ * One service thread plays the role of the async_tcp task: it runs every callback.
+ * Public methods may be called from any thread; they take the same (recursive) core
+ * lock as the service thread, the way tcpip_api_call() serializes with lwIP.
+ *
+ * Semantics kept from the lwIP backend:
+ *  - space() is a fixed send budget minus bytes queued or not yet acked by the peer
+ *  - onAck() reports bytes acked by the peer (from SIOCOUTQ), not bytes written
+ *  - onPoll() runs every 500ms (tcp_poll interval 1), with the same ack/rx timeouts
+ *  - a remote FIN closes our side and fires onDisconnect()
+ * ack()/ackLater() only keep the books: the kernel owns the receive window.
+ */
+
+#include "Arduino.h"
+#include <new>
+#include "AsyncTCP.h"
+
+#ifdef ASYNC_TCP_POSIX
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifndef log_e
+#define log_e(format, ...) fprintf(stderr, "[E][AsyncTCP] %s(): " format "\n", __FUNCTION__, ##__VA_ARGS__)
+#endif
+#ifndef log_w
+#define log_w(format, ...) fprintf(stderr, "[W][AsyncTCP] %s(): " format "\n", __FUNCTION__, ##__VA_ARGS__)
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_POSIX_SND_BUF
+#define CONFIG_ASYNC_TCP_POSIX_SND_BUF (16 * 1460) //bytes a client may have queued or unacked, like TCP_SND_BUF
+#endif
+#ifndef CONFIG_ASYNC_TCP_POSIX_BACKLOG
+#define CONFIG_ASYNC_TCP_POSIX_BACKLOG 128
+#endif
+
+#define ASYNC_TCP_POSIX_POLL_MS 500   //tcp_poll(pcb, cb, 1) on lwIP
+#define ASYNC_TCP_POSIX_ACK_MS  5     //how often connections with unacked data look at SIOCOUTQ
+#define ASYNC_TCP_POSIX_RX_SIZE 8192
+#define ASYNC_TCP_POSIX_COPY_CHUNK 1460
+#define ASYNC_TCP_POSIX_LINGER_MS ASYNC_MAX_ACK_TIME //a closed connection gets this long to drain, then it is reset
+
+//lwIP error codes, so that callbacks get the same values as on the ESP32
+enum {
+    ERR_OK = 0, ERR_MEM = -1, ERR_BUF = -2, ERR_TIMEOUT = -3, ERR_RTE = -4, ERR_INPROGRESS = -5,
+    ERR_VAL = -6, ERR_WOULDBLOCK = -7, ERR_USE = -8, ERR_ALREADY = -9, ERR_ISCONN = -10,
+    ERR_CONN = -11, ERR_IF = -12, ERR_ABRT = -13, ERR_RST = -14, ERR_CLSD = -15, ERR_ARG = -16
+};
+
+//lwIP tcp_state numbering, returned by state()
+enum { PCB_CLOSED = 0, PCB_LISTEN = 1, PCB_SYN_SENT = 2, PCB_ESTABLISHED = 4 };
+
+//how a pcb closed by its client goes away once its queued data is in the kernel
+enum { PCB_OPEN = 0, PCB_CLOSE_NOW, PCB_CLOSE_LINGER };
+
+/*
+ * Socket state (stands in for the lwIP pcb)
+ * */
+
+typedef struct async_tx_chunk {
+    struct async_tx_chunk * next;
+    const char * data;
+    size_t len;
+    size_t off;
+    size_t cap; //0 for data held by reference
+} async_tx_chunk_t;
+
+struct tcp_pcb {
+    int fd;
+    uint8_t state;
+    bool dead;
+    uint32_t events;
+    AsyncClient * client;
+    AsyncServer * server;
+    async_tx_chunk_t * tx_head;
+    async_tx_chunk_t * tx_tail;
+    size_t tx_pending;   //bytes not handed to the kernel yet
+    uint32_t tx_written; //bytes handed to the kernel
+    uint32_t tx_acked;   //bytes the peer has acked
+    uint32_t polled_at;
+    uint8_t closing;     //PCB_CLOSE_NOW: close the socket once tx_head is drained. PCB_CLOSE_LINGER: send
+                         //our FIN then, and close when the peer's comes, so late input does not cause a RST
+    bool fin_sent;
+    uint32_t closing_at;
+    struct tcp_pcb * prev;
+    struct tcp_pcb * next;
+};
+
+struct async_tx_ref {
+    struct async_tx_ref * next;
+    uint32_t end; //value of _tx_queued right after this buffer was written
+    const char * data;
+    size_t len;
+    AcReleaseHandler cb;
+    void * arg;
+};
+
+static pthread_mutex_t _core_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pthread_t _async_service_thread;
+static bool _async_service_running = false;
+static int _epoll_fd = -1;
+static int _wake_fd = -1;
+static tcp_pcb * _pcbs = NULL;
+static tcp_pcb * _dead_pcbs = NULL;
+static uint32_t _tx_bytes_copied = 0;
+static uint32_t _tx_bytes_referenced = 0;
+
+//there is no event queue here: every event is counted as enqueued and handled when it is dispatched
+static async_tcp_stats_t _stats;
+
+static inline uint64_t _stats_now_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline uint8_t _stats_bucket(uint32_t us){
+    uint8_t b = (us > 1) ? (31 - __builtin_clz(us)) : 0;
+    return (b < ASYNC_TCP_STATS_BUCKETS) ? b : (ASYNC_TCP_STATS_BUCKETS - 1);
+}
+
+static inline void _stats_handled(uint8_t event, uint64_t started){
+    uint32_t us = (uint32_t)(_stats_now_us() - started);
+    _stats.enqueued[event]++;
+    _stats.handled[event]++;
+    _stats.handle_us[event] += us;
+    if(us > _stats.handle_max_us[event]){
+        _stats.handle_max_us[event] = us;
+    }
+    _stats.handle_hist[event][_stats_bucket(us)]++;
+}
+
+class AsyncTCPCoreLock {
+  public:
+    AsyncTCPCoreLock(){ pthread_mutex_lock(&_core_lock); }
+    ~AsyncTCPCoreLock(){ pthread_mutex_unlock(&_core_lock); }
+};
+
+extern "C" uint8_t pbuf_free(struct pbuf *p){
+    ::free(p);
+    return 1;
+}
+
+static int8_t _errno_to_err(int e){
+    switch(e){
+        case ECONNRESET: case EPIPE: return ERR_RST;
+        case ECONNREFUSED: return ERR_RST;
+        case ETIMEDOUT: return ERR_TIMEOUT;
+        case ECONNABORTED: return ERR_ABRT;
+        case ENETUNREACH: case EHOSTUNREACH: return ERR_RTE;
+        case EADDRINUSE: return ERR_USE;
+        case ENOMEM: case ENOBUFS: return ERR_MEM;
+        default: return ERR_CONN;
+    }
+}
+
+static void _wake_service_thread(){
+    if(_wake_fd >= 0 && !pthread_equal(pthread_self(), _async_service_thread)){
+        uint64_t one = 1;
+        if(write(_wake_fd, &one, sizeof(one)) < 0){
+            //counter is saturated, the thread is awake anyway
+        }
+    }
+}
+
+/*
+ * Connection timeouts: one timer wheel for all clients, run by the service thread after each wakeup
+ * */
+
+static AsyncTimerWheel _timers(CONFIG_ASYNC_TCP_TIMER_TICK_MS);
+
+//arms t unless it already expires earlier
+static void _timers_arm(async_timer_node * t, uint32_t now, uint32_t delay){
+    if(!t->armed || (int32_t)(now + delay - t->expires_ms) < 0){
+        _timers.arm(t, now, delay);
+        //so that the thread computes its epoll timeout again
+        _wake_service_thread();
+    }
+}
+
+static void _run_timers(){
+    async_timer_node * t;
+    while((t = _timers.expired(millis())) != NULL){
+        AsyncClient::_s_timer(t->arg);
+    }
+}
+
+static void _pcb_set_events(tcp_pcb * pcb, uint32_t events){
+    if(pcb->dead || pcb->events == events){
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = pcb;
+    epoll_ctl(_epoll_fd, pcb->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, pcb->fd, &ev);
+    pcb->events = events;
+}
+
+static tcp_pcb * _pcb_new(int fd, uint8_t state){
+    tcp_pcb * pcb = (tcp_pcb *)calloc(1, sizeof(tcp_pcb));
+    if(!pcb){
+        return NULL;
+    }
+    pcb->fd = fd;
+    pcb->state = state;
+    pcb->polled_at = millis();
+    pcb->next = _pcbs;
+    if(_pcbs){
+        _pcbs->prev = pcb;
+    }
+    _pcbs = pcb;
+    return pcb;
+}
+
+//closes the socket; the memory is freed by the service thread once no event can point at it
+static void _pcb_free(tcp_pcb * pcb, bool rst){
+    if(pcb->dead){
+        return;
+    }
+    if(rst){
+        struct linger lg = { 1, 0 };
+        setsockopt(pcb->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, pcb->fd, NULL);
+    close(pcb->fd);
+    pcb->fd = -1;
+    pcb->dead = true;
+    pcb->client = NULL;
+    pcb->server = NULL;
+    while(pcb->tx_head){
+        async_tx_chunk_t * c = pcb->tx_head;
+        pcb->tx_head = c->next;
+        ::free(c);
+    }
+    pcb->tx_tail = NULL;
+    if(pcb->prev){
+        pcb->prev->next = pcb->next;
+    } else {
+        _pcbs = pcb->next;
+    }
+    if(pcb->next){
+        pcb->next->prev = pcb->prev;
+    }
+    pcb->prev = NULL;
+    pcb->next = _dead_pcbs;
+    _dead_pcbs = pcb;
+}
+
+static void _free_dead_pcbs(){
+    while(_dead_pcbs){
+        tcp_pcb * pcb = _dead_pcbs;
+        _dead_pcbs = pcb->next;
+        ::free(pcb);
+    }
+}
+
+static bool _pcb_queue(tcp_pcb * pcb, const char * data, size_t size, bool copy){
+    async_tx_chunk_t * t = pcb->tx_tail;
+    if(copy && t && t->cap && (t->cap - t->len) >= size){
+        memcpy((char*)t->data + t->len, data, size);
+        t->len += size;
+    } else {
+        size_t cap = copy ? ((size > ASYNC_TCP_POSIX_COPY_CHUNK) ? size : ASYNC_TCP_POSIX_COPY_CHUNK) : 0;
+        async_tx_chunk_t * c = (async_tx_chunk_t *)malloc(sizeof(async_tx_chunk_t) + cap);
+        if(!c){
+            return false;
+        }
+        c->next = NULL;
+        c->off = 0;
+        c->len = size;
+        c->cap = cap;
+        if(copy){
+            c->data = (const char*)(c + 1);
+            memcpy((char*)c->data, data, size);
+        } else {
+            c->data = data;
+        }
+        if(t){
+            t->next = c;
+        } else {
+            pcb->tx_head = c;
+        }
+        pcb->tx_tail = c;
+    }
+    pcb->tx_pending += size;
+    return true;
+}
+
+//hands queued data to the kernel; returns 0 or an errno
+static int _pcb_flush(tcp_pcb * pcb){
+    while(pcb->tx_head){
+        struct iovec iov[16];
+        int n = 0;
+        for(async_tx_chunk_t * c = pcb->tx_head; c && n < 16; c = c->next){
+            iov[n].iov_base = (void*)(c->data + c->off);
+            iov[n].iov_len = c->len - c->off;
+            n++;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        ssize_t w = sendmsg(pcb->fd, &msg, MSG_NOSIGNAL);
+        if(w < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                break;
+            }
+            return errno;
+        }
+        pcb->tx_written += w;
+        pcb->tx_pending -= w;
+        while(w > 0){
+            async_tx_chunk_t * c = pcb->tx_head;
+            size_t left = c->len - c->off;
+            if((size_t)w < left){
+                c->off += w;
+                break;
+            }
+            w -= left;
+            pcb->tx_head = c->next;
+            ::free(c);
+        }
+        if(!pcb->tx_head){
+            pcb->tx_tail = NULL;
+        }
+    }
+    if(pcb->closing == PCB_CLOSE_NOW){
+        //input is of no use any more
+        _pcb_set_events(pcb, pcb->tx_head ? EPOLLOUT : 0);
+    } else {
+        _pcb_set_events(pcb, EPOLLIN | EPOLLRDHUP | (pcb->tx_head ? EPOLLOUT : 0));
+    }
+    return 0;
+}
+
+/*
+ * Graceful close: like tcp_close() on lwIP, whatever is queued still goes out. The pcb leaves its
+ * client and stays with the service thread until the data is in the kernel (and, when lingering,
+ * until the peer has closed too), or until ASYNC_TCP_POSIX_LINGER_MS have passed.
+ * */
+
+//one step of a closing pcb; it may be freed here
+static void _pcb_linger_step(tcp_pcb * pcb){
+    if(pcb->tx_head){
+        if(_pcb_flush(pcb)){
+            _pcb_free(pcb, true);
+            return;
+        }
+    }
+    if(!pcb->tx_head){
+        if(pcb->closing == PCB_CLOSE_NOW){
+            _pcb_free(pcb, false);
+            return;
+        }
+        if(!pcb->fin_sent){
+            shutdown(pcb->fd, SHUT_WR);
+            pcb->fin_sent = true;
+        }
+    }
+    if((millis() - pcb->closing_at) >= ASYNC_TCP_POSIX_LINGER_MS){
+        _pcb_free(pcb, true);
+    }
+}
+
+//takes a pcb from its client; data it still holds by reference is copied, the caller may release it next
+static void _pcb_linger(tcp_pcb * pcb, uint8_t how){
+    pcb->client = NULL;
+    pcb->closing = how;
+    pcb->closing_at = millis();
+    //nothing reports acks any more
+    pcb->tx_acked = pcb->tx_written;
+    async_tx_chunk_t * prev = NULL;
+    for(async_tx_chunk_t * c = pcb->tx_head; c; c = c->next){
+        if(!c->cap){
+            size_t len = c->len - c->off;
+            async_tx_chunk_t * n = (async_tx_chunk_t *)malloc(sizeof(async_tx_chunk_t) + len);
+            if(!n){
+                _pcb_free(pcb, true);
+                return;
+            }
+            n->next = c->next;
+            n->off = 0;
+            n->len = len;
+            n->cap = len;
+            n->data = (const char*)(n + 1);
+            memcpy((char*)n->data, c->data + c->off, len);
+            if(prev){
+                prev->next = n;
+            } else {
+                pcb->tx_head = n;
+            }
+            if(pcb->tx_tail == c){
+                pcb->tx_tail = n;
+            }
+            ::free(c);
+            c = n;
+        }
+        prev = c;
+    }
+    _pcb_linger_step(pcb);
+}
+
+//input on a closing pcb is read and dropped; the peer's FIN or an error ends it
+static void _pcb_linger_read(tcp_pcb * pcb){
+    static char buf[ASYNC_TCP_POSIX_RX_SIZE];
+    for(int i = 0; i < 8 && !pcb->dead; i++){
+        ssize_t r = recv(pcb->fd, buf, sizeof(buf), 0);
+        if(r > 0){
+            continue;
+        }
+        if(r < 0 && errno == EINTR){
+            continue;
+        }
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return;
+        }
+        if(r == 0 && pcb->tx_head){
+            //the peer has closed its side, what we queued may still be read
+            pcb->closing = PCB_CLOSE_NOW;
+            _pcb_set_events(pcb, EPOLLOUT);
+            return;
+        }
+        //with our data sent, the peer's FIN completes the close; an error means it will not be read
+        _pcb_free(pcb, r != 0);
+        return;
+    }
+}
+
+/*
+ * Service Thread
+ * */
+
+static void _pcb_check_acks(tcp_pcb * pcb){
+    if(pcb->tx_written == pcb->tx_acked || !pcb->client){
+        return;
+    }
+    int outq = 0;
+    if(ioctl(pcb->fd, SIOCOUTQ, &outq) < 0){
+        return;
+    }
+    uint32_t acked = pcb->tx_written - (uint32_t)outq;
+    uint32_t len = acked - pcb->tx_acked;
+    pcb->tx_acked = acked;
+    //lwIP reports acks in 16 bit chunks
+    while(len && !pcb->dead){
+        uint16_t part = (len > 0xFFFF) ? 0xFFFF : len;
+        len -= part;
+        AsyncClient::_s_sent(pcb->client, pcb, part);
+    }
+}
+
+static void _pcb_read(tcp_pcb * pcb){
+    static char buf[ASYNC_TCP_POSIX_RX_SIZE];
+    //bounded, so one busy connection does not starve the others (epoll is level triggered)
+    for(int i = 0; i < 8 && !pcb->dead; i++){
+        //acks first, as lwIP does: data the peer sent in answer to ours comes after its ack
+        //(an onData() callback may have written that just now; a WebSocket handshake is only
+        //switched over to the AsyncWebSocketClient by the ack of the 101)
+        _pcb_check_acks(pcb);
+        if(pcb->dead || !pcb->client){
+            return;
+        }
+        ssize_t r = recv(pcb->fd, buf, sizeof(buf), 0);
+        if(r > 0){
+            struct pbuf pb;
+            pb.next = NULL;
+            pb.payload = buf;
+            pb.tot_len = pb.len = (uint16_t)r;
+            AsyncClient::_s_recv(pcb->client, pcb, &pb, ERR_OK);
+        } else if(r == 0){
+            AsyncClient::_s_fin(pcb->client, pcb, ERR_OK);
+            return;
+        } else if(errno == EINTR){
+            continue;
+        } else if(errno == EAGAIN || errno == EWOULDBLOCK){
+            return;
+        } else {
+            AsyncClient::_s_error(pcb->client, _errno_to_err(errno));
+            return;
+        }
+    }
+}
+
+static void _pcb_accept(tcp_pcb * lpcb){
+    for(int i = 0; i < 16 && !lpcb->dead; i++){
+        int fd = accept4(lpcb->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                log_e("accept: %d", errno);
+            }
+            return;
+        }
+        tcp_pcb * pcb = _pcb_new(fd, PCB_ESTABLISHED);
+        if(!pcb){
+            close(fd);
+            continue;
+        }
+        AsyncServer::_s_accept(lpcb->server, pcb, ERR_OK);
+    }
+}
+
+static void _pcb_handle(tcp_pcb * pcb, uint32_t events){
+    if(pcb->server){
+        _pcb_accept(pcb);
+        return;
+    }
+    if(pcb->closing){
+        if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+            _pcb_linger_read(pcb);
+        }
+        if(!pcb->dead){
+            _pcb_linger_step(pcb);
+        }
+        return;
+    }
+    if(!pcb->client){
+        return;
+    }
+    if(pcb->state == PCB_SYN_SENT){
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(pcb->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err){
+            AsyncClient::_s_error(pcb->client, _errno_to_err(err));
+        } else if(events & EPOLLOUT){
+            pcb->state = PCB_ESTABLISHED;
+            pcb->polled_at = millis();
+            _pcb_set_events(pcb, EPOLLIN | EPOLLRDHUP | (pcb->tx_head ? EPOLLOUT : 0));
+            AsyncClient::_s_connected(pcb->client, pcb, ERR_OK);
+        }
+        return;
+    }
+    if(events & EPOLLOUT){
+        int err = _pcb_flush(pcb);
+        if(err){
+            AsyncClient::_s_error(pcb->client, _errno_to_err(err));
+            return;
+        }
+    }
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+        _pcb_read(pcb);
+    }
+}
+
+static void _service_timers(){
+    uint32_t now = millis();
+    tcp_pcb * pcb = _pcbs;
+    while(pcb){
+        //pcbs closed by a callback stay allocated until _free_dead_pcbs(), so next stays valid
+        tcp_pcb * next = pcb->next;
+        if(pcb->closing){
+            _pcb_linger_step(pcb);
+        } else if(pcb->client && pcb->state == PCB_ESTABLISHED){
+            int err = pcb->tx_head ? _pcb_flush(pcb) : 0;
+            if(err){
+                AsyncClient::_s_error(pcb->client, _errno_to_err(err));
+            }
+            if(!pcb->dead){
+                _pcb_check_acks(pcb);
+            }
+            if(!pcb->dead && pcb->client && pcb->client->_poll_wanted && (now - pcb->polled_at) >= ASYNC_TCP_POSIX_POLL_MS){
+                pcb->polled_at = now;
+                AsyncClient::_s_poll(pcb->client, pcb);
+            }
+        }
+        pcb = next;
+    }
+}
+
+static int _service_timeout(){
+    uint32_t now = millis();
+    int timeout = ASYNC_TCP_POSIX_POLL_MS;
+    for(tcp_pcb * pcb = _pcbs; pcb; pcb = pcb->next){
+        if(pcb->closing && !pcb->tx_head){
+            //waits for the peer's FIN, which wakes us; else for the end of its linger time
+            uint32_t since = now - pcb->closing_at;
+            int left = (since >= ASYNC_TCP_POSIX_LINGER_MS) ? 0 : (int)(ASYNC_TCP_POSIX_LINGER_MS - since);
+            if(left < timeout){
+                timeout = left;
+            }
+            continue;
+        }
+        if(pcb->tx_written != pcb->tx_acked || pcb->tx_head){
+            return ASYNC_TCP_POSIX_ACK_MS;
+        }
+        if(pcb->client && pcb->client->_poll_wanted && pcb->state == PCB_ESTABLISHED){
+            uint32_t since = now - pcb->polled_at;
+            int left = (since >= ASYNC_TCP_POSIX_POLL_MS) ? 0 : (int)(ASYNC_TCP_POSIX_POLL_MS - since);
+            if(left < timeout){
+                timeout = left;
+            }
+        }
+    }
+    uint32_t left = _timers.nextTimeout(now);
+    if(left < (uint32_t)timeout){
+        timeout = left;
+    }
+    return timeout;
+}
+
+static void * _async_service_task(void *pvParameters){
+    struct epoll_event events[32];
+    int timeout = ASYNC_TCP_POSIX_POLL_MS;
+    for (;;) {
+        int n = epoll_wait(_epoll_fd, events, 32, timeout);
+        AsyncTCPCoreLock lock;
+        for(int i = 0; i < n; i++){
+            tcp_pcb * pcb = (tcp_pcb *)events[i].data.ptr;
+            if(!pcb){
+                uint64_t count;
+                if(read(_wake_fd, &count, sizeof(count)) < 0){
+                    //nothing to drain
+                }
+                continue;
+            }
+            if(!pcb->dead){
+                _pcb_handle(pcb, events[i].events);
+            }
+        }
+        _service_timers();
+        _run_timers();
+        _free_dead_pcbs();
+        timeout = _service_timeout();
+    }
+    return NULL;
+}
+
+static bool _start_async_task(){
+    AsyncTCPCoreLock lock;
+    if(_async_service_running){
+        return true;
+    }
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(_epoll_fd < 0 || _wake_fd < 0){
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &ev);
+    if(pthread_create(&_async_service_thread, NULL, _async_service_task, NULL) != 0){
+        return false;
+    }
+    _async_service_running = true;
+    return true;
+}
+
+/*
+  Async TCP Client
+ */
+
+AsyncClient::AsyncClient(tcp_pcb* pcb)
+: _connect_cb(0)
+, _connect_cb_arg(0)
+, _discard_cb(0)
+, _discard_cb_arg(0)
+, _sent_cb(0)
+, _sent_cb_arg(0)
+, _error_cb(0)
+, _error_cb_arg(0)
+, _recv_cb(0)
+, _recv_cb_arg(0)
+, _pb_cb(0)
+, _pb_cb_arg(0)
+, _timeout_cb(0)
+, _timeout_cb_arg(0)
+, _pcb_busy(false)
+, _pcb_sent_at(0)
+, _ack_pcb(true)
+, _rx_ack_len(0)
+, _rx_last_packet(0)
+, _rx_since_timeout(0)
+, _ack_timeout(ASYNC_MAX_ACK_TIME)
+, _connect_port(0)
+, _tx_refs(NULL)
+, _tx_refs_tail(NULL)
+, _tx_queued(0)
+, _tx_acked(0)
+, prev(NULL)
+, next(NULL)
+{
+    AsyncTCPCoreLock lock;
+    _pcb = pcb;
+    _closed_slot = -1;
+    _poll_queued = false;
+    _poll_wanted = false;
+    _sent_deferred = 0;
+    _timer = async_timer_node();
+    _timer.arg = this;
+    if(_pcb){
+        _rx_last_packet = millis();
+        _pcb->client = this;
+        _pcb_set_events(_pcb, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+AsyncClient::~AsyncClient(){
+    AsyncTCPCoreLock lock;
+    if(_pcb) {
+        _close();
+    }
+    _cancel_timer();
+    _release_tx_refs(true);
+}
+
+/*
+ * Operators
+ * */
+
+AsyncClient& AsyncClient::operator=(const AsyncClient& other){
+    AsyncTCPCoreLock lock;
+    if (_pcb) {
+        _close();
+    }
+    _pcb = other._pcb;
+    if (_pcb) {
+        _rx_last_packet = millis();
+        _pcb->client = this;
+    }
+    return *this;
+}
+
+bool AsyncClient::operator==(const AsyncClient &other) {
+    return _pcb == other._pcb;
+}
+
+AsyncClient & AsyncClient::operator+=(const AsyncClient &other) {
+    if(next == NULL){
+        next = (AsyncClient*)(&other);
+        next->prev = this;
+    } else {
+        AsyncClient *c = next;
+        while(c->next != NULL) {
+            c = c->next;
+        }
+        c->next =(AsyncClient*)(&other);
+        c->next->prev = c;
+    }
+    return *this;
+}
+
+/*
+ * Callback Setters
+ * */
+
+void AsyncClient::onConnect(AcConnectHandler cb, void* arg){
+    _connect_cb = cb;
+    _connect_cb_arg = arg;
+}
+
+void AsyncClient::onDisconnect(AcConnectHandler cb, void* arg){
+    _discard_cb = cb;
+    _discard_cb_arg = arg;
+}
+
+void AsyncClient::onAck(AcAckHandler cb, void* arg){
+    _sent_cb = cb;
+    _sent_cb_arg = arg;
+}
+
+void AsyncClient::onError(AcErrorHandler cb, void* arg){
+    _error_cb = cb;
+    _error_cb_arg = arg;
+}
+
+void AsyncClient::onData(AcDataHandler cb, void* arg){
+    _recv_cb = cb;
+    _recv_cb_arg = arg;
+}
+
+void AsyncClient::onPacket(AcPacketHandler cb, void* arg){
+    _pb_cb = cb;
+    _pb_cb_arg = arg;
+}
+
+void AsyncClient::onTimeout(AcTimeoutHandler cb, void* arg){
+    _timeout_cb = cb;
+    _timeout_cb_arg = arg;
+}
+
+void AsyncClient::onPoll(AcConnectHandler cb, void* arg){
+    _poll_cb = cb;
+    _poll_cb_arg = arg;
+    _poll_wanted = (bool)cb;
+}
+
+/*
+ * Main Public Methods
+ * */
+
+bool AsyncClient::connect(IPAddress ip, uint16_t port){
+    if(!_start_async_task()){
+        log_e("failed to start task");
+        return false;
+    }
+    AsyncTCPCoreLock lock;
+    if (_pcb){
+        log_w("already connected, state %d", _pcb->state);
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0){
+        log_e("socket: %d", errno);
+        return false;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    if(::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS){
+        log_e("connect: %d", errno);
+        close(fd);
+        return false;
+    }
+    _pcb = _pcb_new(fd, PCB_SYN_SENT);
+    if(!_pcb){
+        close(fd);
+        return false;
+    }
+    _pcb->client = this;
+    _pcb_set_events(_pcb, EPOLLOUT);
+    _wake_service_thread();
+    return true;
+}
+
+bool AsyncClient::connect(const char* host, uint16_t port){
+    //resolved synchronously; getaddrinfo() has no event driven variant in libc
+    struct addrinfo hints;
+    struct addrinfo * res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host, NULL, &hints, &res) != 0 || !res){
+        log_e("DNS failed for %s", host);
+        return false;
+    }
+    uint32_t ip = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return connect(IPAddress(ip), port);
+}
+
+//now: the socket is closed as soon as the queued data is in the kernel. Otherwise the peer gets our FIN
+//then and the socket lingers for its FIN, so that input still in flight does not reset the connection
+void AsyncClient::close(bool now){
+    AsyncTCPCoreLock lock;
+    if(_pcb && now){
+        _pcb->closing = PCB_CLOSE_NOW;
+    }
+    _close();
+}
+
+int8_t AsyncClient::abort(){
+    AsyncTCPCoreLock lock;
+    if(_pcb) {
+        _pcb_free(_pcb, true);
+        _pcb = NULL;
+        _release_tx_refs(true);
+    }
+    return ERR_ABRT;
+}
+
+size_t AsyncClient::space(){
+    AsyncTCPCoreLock lock;
+    if((_pcb != NULL) && (_pcb->state == PCB_ESTABLISHED)){
+        size_t used = _pcb->tx_pending + (_pcb->tx_written - _pcb->tx_acked);
+        return (used < CONFIG_ASYNC_TCP_POSIX_SND_BUF) ? (CONFIG_ASYNC_TCP_POSIX_SND_BUF - used) : 0;
+    }
+    return 0;
+}
+
+size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
+    if(!_pcb || size == 0 || data == NULL) {
+        return 0;
+    }
+    AsyncTCPCoreLock lock;
+    size_t room = space();
+    if(!room) {
+        return 0;
+    }
+    size_t will_send = (room < size) ? room : size;
+    if(!_pcb_queue(_pcb, data, will_send, apiflags & ASYNC_WRITE_FLAG_COPY)) {
+        return 0;
+    }
+    _tx_queued += will_send;
+    if(apiflags & ASYNC_WRITE_FLAG_COPY) {
+        _tx_bytes_copied += will_send;
+    } else {
+        _tx_bytes_referenced += will_send;
+    }
+    return will_send;
+}
+
+size_t AsyncClient::addRef(const char* data, size_t size, AcReleaseHandler cb, void* arg, uint8_t apiflags) {
+    AsyncTCPCoreLock lock;
+    if(!_pcb || size == 0 || data == NULL || space() < size) {
+        return 0;
+    }
+    async_tx_ref * ref = new (std::nothrow) async_tx_ref;
+    if(!ref) {
+        return 0;
+    }
+    if(!_pcb_queue(_pcb, data, size, false)) {
+        delete ref;
+        return 0;
+    }
+    _tx_bytes_referenced += size;
+    _tx_queued += size;
+    ref->next = NULL;
+    ref->end = _tx_queued;
+    ref->data = data;
+    ref->len = size;
+    ref->cb = cb;
+    ref->arg = arg;
+    if(_tx_refs_tail) {
+        _tx_refs_tail->next = ref;
+    } else {
+        _tx_refs = ref;
+    }
+    _tx_refs_tail = ref;
+    return size;
+}
+
+size_t AsyncClient::addv(const async_iovec_t* iov, size_t count) {
+    return _addv(iov, count, false);
+}
+
+size_t AsyncClient::writev(const async_iovec_t* iov, size_t count) {
+    return _addv(iov, count, true);
+}
+
+size_t AsyncClient::_addv(const async_iovec_t* iov, size_t count, bool output) {
+    AsyncTCPCoreLock lock;
+    if(!_pcb || iov == NULL) {
+        return 0;
+    }
+    size_t done = 0;
+    for(; done < count; done++) {
+        const async_iovec_t * v = &iov[done];
+        if(!v->len) {
+            continue;
+        }
+        //whole segments only
+        if(space() < v->len) {
+            break;
+        }
+        async_tx_ref * ref = NULL;
+        if(v->release) {
+            ref = new (std::nothrow) async_tx_ref;
+            if(!ref) {
+                break;
+            }
+        }
+        bool copy = !ref && (v->apiflags & ASYNC_WRITE_FLAG_COPY);
+        if(!_pcb_queue(_pcb, v->data, v->len, copy)) {
+            delete ref;
+            break;
+        }
+        _tx_queued += v->len;
+        if(copy) {
+            _tx_bytes_copied += v->len;
+        } else {
+            _tx_bytes_referenced += v->len;
+        }
+        if(ref) {
+            ref->next = NULL;
+            ref->end = _tx_queued;
+            ref->data = v->data;
+            ref->len = v->len;
+            ref->cb = v->release;
+            ref->arg = v->release_arg;
+            if(_tx_refs_tail) {
+                _tx_refs_tail->next = ref;
+            } else {
+                _tx_refs = ref;
+            }
+            _tx_refs_tail = ref;
+        }
+    }
+    if(output && done) {
+        send();
+    }
+    return done;
+}
+
+bool AsyncClient::send(){
+    AsyncTCPCoreLock lock;
+    if(!_pcb || _pcb->state != PCB_ESTABLISHED){
+        return false;
+    }
+    int err = _pcb_flush(_pcb);
+    if(err){
+        return false;
+    }
+    _pcb_busy = true;
+    _pcb_sent_at = millis();
+    _arm_timer();
+    _wake_service_thread();
+    return true;
+}
+
+size_t AsyncClient::ack(size_t len){
+    if(len > _rx_ack_len)
+        len = _rx_ack_len;
+    _rx_ack_len -= len;
+    return len;
+}
+
+void AsyncClient::ackPacket(struct pbuf * pb){
+    if(!pb){
+        return;
+    }
+    pbuf_free(pb);
+}
+
+/*
+ * Main Private Methods
+ * */
+
+int8_t AsyncClient::_close(){
+    int8_t err = ERR_OK;
+    _cancel_timer();
+    if(_pcb) {
+        tcp_pcb * pcb = _pcb;
+        _pcb = NULL;
+        //as on lwIP, buffers the caller gets back below must not be sent afterwards: referenced data resets the
+        //connection. Copied data is drained by the service thread
+        if(_tx_refs != NULL) {
+            _pcb_free(pcb, true);
+        } else if(pcb->state != PCB_ESTABLISHED) {
+            _pcb_free(pcb, false);
+        } else {
+            _pcb_linger(pcb, pcb->closing ? pcb->closing : PCB_CLOSE_LINGER);
+        }
+        _release_tx_refs(true);
+        if(_discard_cb) {
+            _discard_cb(_discard_cb_arg, this);
+        }
+    }
+    return err;
+}
+
+void AsyncClient::_release_tx_refs(bool all){
+    while(_tx_refs && (all || (int32_t)(_tx_acked - _tx_refs->end) >= 0)) {
+        async_tx_ref * ref = _tx_refs;
+        _tx_refs = ref->next;
+        if(!_tx_refs) {
+            _tx_refs_tail = NULL;
+        }
+        if(ref->cb) {
+            ref->cb(ref->arg, ref->data, ref->len);
+        }
+        delete ref;
+    }
+}
+
+/*
+ * Private Callbacks
+ * */
+
+int8_t AsyncClient::_connected(void* pcb, int8_t err){
+    _rx_last_packet = millis();
+    _pcb_busy = false;
+    _arm_timer();
+    if(_connect_cb) {
+        _connect_cb(_connect_cb_arg, this);
+    }
+    return ERR_OK;
+}
+
+void AsyncClient::_error(int8_t err) {
+    _cancel_timer();
+    if(_pcb){
+        _pcb_free(_pcb, true);
+        _pcb = NULL;
+    }
+    _release_tx_refs(true);
+    if(_error_cb) {
+        _error_cb(_error_cb_arg, this, err);
+    }
+    if(_discard_cb) {
+        _discard_cb(_discard_cb_arg, this);
+    }
+}
+
+int8_t AsyncClient::_fin(tcp_pcb* pcb, int8_t err) {
+    _cancel_timer();
+    if(_pcb){
+        //same as _lwip_fin: close our side right away, queued data still goes out after the peer's FIN
+        if(_tx_refs != NULL) {
+            _pcb_free(_pcb, true);
+        } else {
+            _pcb_linger(_pcb, PCB_CLOSE_NOW);
+        }
+        _pcb = NULL;
+    }
+    _release_tx_refs(true);
+    if(_discard_cb) {
+        _discard_cb(_discard_cb_arg, this);
+    }
+    return ERR_OK;
+}
+
+int8_t AsyncClient::_sent(tcp_pcb* pcb, uint16_t len) {
+    _rx_last_packet = millis();
+    _pcb_busy = false;
+    _tx_acked += len;
+    _release_tx_refs(false);
+    if(_sent_cb) {
+        _sent_cb(_sent_cb_arg, this, len, (millis() - _pcb_sent_at));
+    }
+    return ERR_OK;
+}
+
+int8_t AsyncClient::_recv(tcp_pcb* pcb, pbuf* pb, int8_t err) {
+    //pb wraps the service thread's read buffer
+    _rx_last_packet = millis();
+    _ack_pcb = true;
+    if(_pb_cb){
+        pbuf * copy = (pbuf *)malloc(sizeof(pbuf) + pb->len);
+        if(!copy){
+            return ERR_MEM;
+        }
+        copy->next = NULL;
+        copy->payload = copy + 1;
+        copy->tot_len = copy->len = pb->len;
+        memcpy(copy->payload, pb->payload, pb->len);
+        _pb_cb(_pb_cb_arg, this, copy);
+    } else {
+        if(_recv_cb) {
+            _recv_cb(_recv_cb_arg, this, pb->payload, pb->len);
+        }
+        if(!_ack_pcb) {
+            _rx_ack_len += pb->len;
+        }
+    }
+    return ERR_OK;
+}
+
+int8_t AsyncClient::_poll(tcp_pcb* pcb){
+    if(!_pcb){
+        log_w("pcb is NULL");
+        return ERR_OK;
+    }
+    if(_poll_cb) {
+        _poll_cb(_poll_cb_arg, this);
+    }
+    return ERR_OK;
+}
+
+//same as the lwIP backend: the deadlines only move back on activity, _timeout() checks again
+void AsyncClient::_arm_timer(){
+    AsyncTCPCoreLock lock;
+    if(!_pcb){
+        return;
+    }
+    uint32_t now = millis();
+    uint32_t delay = ASYNC_TIMER_NONE;
+    if(_pcb_busy && _ack_timeout){
+        uint32_t waited = now - _pcb_sent_at;
+        delay = (waited < _ack_timeout) ? (_ack_timeout - waited) : 0;
+    }
+    if(_rx_since_timeout){
+        uint32_t idle = now - _rx_last_packet;
+        uint32_t rx = (idle < _rx_since_timeout * 1000) ? (_rx_since_timeout * 1000 - idle) : 0;
+        if(rx < delay){
+            delay = rx;
+        }
+    }
+    if(delay != ASYNC_TIMER_NONE){
+        _timers_arm(&_timer, now, delay);
+    }
+}
+
+void AsyncClient::_cancel_timer(){
+    AsyncTCPCoreLock lock;
+    _timers.cancel(&_timer);
+}
+
+void AsyncClient::_timeout(){
+    if(!_pcb){
+        return;
+    }
+    uint32_t now = millis();
+
+    // ACK Timeout
+    if(_pcb_busy && _ack_timeout && (now - _pcb_sent_at) >= _ack_timeout){
+        _pcb_busy = false;
+        //before the callback, which may delete us
+        _arm_timer();
+        log_w("ack timeout %d", _pcb->state);
+        if(_timeout_cb)
+            _timeout_cb(_timeout_cb_arg, this, (now - _pcb_sent_at));
+        return;
+    }
+    // RX Timeout
+    if(_rx_since_timeout && (now - _rx_last_packet) >= (_rx_since_timeout * 1000)){
+        log_w("rx timeout %d", _pcb->state);
+        _close();
+        return;
+    }
+    _arm_timer();
+}
+
+/*
+ * Public Helper Methods
+ * */
+
+void AsyncClient::stop() {
+    close(false);
+}
+
+bool AsyncClient::free(){
+    if(!_pcb) {
+        return true;
+    }
+    if(_pcb->state == 0 || _pcb->state > 4) {
+        return true;
+    }
+    return false;
+}
+
+size_t AsyncClient::write(const char* data) {
+    if(data == NULL) {
+        return 0;
+    }
+    return write(data, strlen(data));
+}
+
+size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
+    size_t will_send = add(data, size, apiflags);
+    if(!will_send || !send()) {
+        return 0;
+    }
+    return will_send;
+}
+
+void AsyncClient::setRxTimeout(uint32_t timeout){
+    _rx_since_timeout = timeout;
+    _arm_timer();
+}
+
+uint32_t AsyncClient::getRxTimeout(){
+    return _rx_since_timeout;
+}
+
+uint32_t AsyncClient::getAckTimeout(){
+    return _ack_timeout;
+}
+
+void AsyncClient::setAckTimeout(uint32_t timeout){
+    _ack_timeout = timeout;
+    _arm_timer();
+}
+
+void AsyncClient::setNoDelay(bool nodelay){
+    AsyncTCPCoreLock lock;
+    if(!_pcb) {
+        return;
+    }
+    int flag = nodelay ? 1 : 0;
+    setsockopt(_pcb->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+bool AsyncClient::getNoDelay(){
+    AsyncTCPCoreLock lock;
+    if(!_pcb) {
+        return false;
+    }
+    int flag = 0;
+    socklen_t len = sizeof(flag);
+    getsockopt(_pcb->fd, IPPROTO_TCP, TCP_NODELAY, &flag, &len);
+    return flag != 0;
+}
+
+uint16_t AsyncClient::getMss(){
+    AsyncTCPCoreLock lock;
+    if(!_pcb) {
+        return 0;
+    }
+    int mss = 0;
+    socklen_t len = sizeof(mss);
+    getsockopt(_pcb->fd, IPPROTO_TCP, TCP_MAXSEG, &mss, &len);
+    return mss;
+}
+
+bool AsyncClient::getTransportInfo(async_tcp_info_t * info){
+    AsyncTCPCoreLock lock;
+    if(!_pcb || !info || _pcb->state != PCB_ESTABLISHED) {
+        return false;
+    }
+    struct tcp_info ti;
+    socklen_t len = sizeof(ti);
+    if(getsockopt(_pcb->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+        return false;
+    }
+    info->srtt_ms = ti.tcpi_rtt / 1000;
+    info->rttvar_ms = ti.tcpi_rttvar / 1000;
+    info->unacked = _pcb->tx_written - _pcb->tx_acked;
+    info->cwnd = ti.tcpi_snd_cwnd * ti.tcpi_snd_mss;
+    info->snd_wnd = 0; //not in glibc's struct tcp_info
+    info->snd_buf = space();
+    info->snd_queuelen = ti.tcpi_unacked;
+    info->mss = ti.tcpi_snd_mss;
+    info->nrtx = ti.tcpi_retransmits;
+    return true;
+}
+
+static bool _socket_address(tcp_pcb * pcb, bool remote, struct sockaddr_in * addr){
+    socklen_t len = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    if(!pcb || pcb->dead){
+        return false;
+    }
+    if(remote){
+        return getpeername(pcb->fd, (struct sockaddr *)addr, &len) == 0;
+    }
+    return getsockname(pcb->fd, (struct sockaddr *)addr, &len) == 0;
+}
+
+uint32_t AsyncClient::getRemoteAddress() {
+    AsyncTCPCoreLock lock;
+    struct sockaddr_in addr;
+    _socket_address(_pcb, true, &addr);
+    return addr.sin_addr.s_addr;
+}
+
+uint16_t AsyncClient::getRemotePort() {
+    AsyncTCPCoreLock lock;
+    struct sockaddr_in addr;
+    _socket_address(_pcb, true, &addr);
+    return ntohs(addr.sin_port);
+}
+
+uint32_t AsyncClient::getLocalAddress() {
+    AsyncTCPCoreLock lock;
+    struct sockaddr_in addr;
+    _socket_address(_pcb, false, &addr);
+    return addr.sin_addr.s_addr;
+}
+
+uint16_t AsyncClient::getLocalPort() {
+    AsyncTCPCoreLock lock;
+    struct sockaddr_in addr;
+    _socket_address(_pcb, false, &addr);
+    return ntohs(addr.sin_port);
+}
+
+IPAddress AsyncClient::remoteIP() {
+    return IPAddress(getRemoteAddress());
+}
+
+uint16_t AsyncClient::remotePort() {
+    return getRemotePort();
+}
+
+IPAddress AsyncClient::localIP() {
+    return IPAddress(getLocalAddress());
+}
+
+uint16_t AsyncClient::localPort() {
+    return getLocalPort();
+}
+
+uint8_t AsyncClient::state() {
+    if(!_pcb) {
+        return 0;
+    }
+    return _pcb->state;
+}
+
+bool AsyncClient::connected(){
+    if (!_pcb) {
+        return false;
+    }
+    return _pcb->state == PCB_ESTABLISHED;
+}
+
+bool AsyncClient::connecting(){
+    if (!_pcb) {
+        return false;
+    }
+    return _pcb->state > 0 && _pcb->state < 4;
+}
+
+bool AsyncClient::disconnecting(){
+    return false;
+}
+
+bool AsyncClient::disconnected(){
+    if (!_pcb) {
+        return true;
+    }
+    return _pcb->state == 0;
+}
+
+bool AsyncClient::freeable(){
+    if (!_pcb) {
+        return true;
+    }
+    return _pcb->state == 0 || _pcb->state > 4;
+}
+
+bool AsyncClient::canSend(){
+    return space() > 0;
+}
+
+const char * AsyncClient::errorToString(int8_t error){
+    switch(error){
+        case ERR_OK: return "OK";
+        case ERR_MEM: return "Out of memory error";
+        case ERR_BUF: return "Buffer error";
+        case ERR_TIMEOUT: return "Timeout";
+        case ERR_RTE: return "Routing problem";
+        case ERR_INPROGRESS: return "Operation in progress";
+        case ERR_VAL: return "Illegal value";
+        case ERR_WOULDBLOCK: return "Operation would block";
+        case ERR_USE: return "Address in use";
+        case ERR_ALREADY: return "Already connected";
+        case ERR_CONN: return "Not connected";
+        case ERR_IF: return "Low-level netif error";
+        case ERR_ABRT: return "Connection aborted";
+        case ERR_RST: return "Connection reset";
+        case ERR_CLSD: return "Connection closed";
+        case ERR_ARG: return "Illegal argument";
+        case -55: return "DNS failed";
+        default: return "UNKNOWN";
+    }
+}
+
+uint32_t AsyncClient::bytesCopied(){
+    AsyncTCPCoreLock lock;
+    return _tx_bytes_copied;
+}
+
+uint32_t AsyncClient::bytesReferenced(){
+    AsyncTCPCoreLock lock;
+    return _tx_bytes_referenced;
+}
+
+const char * AsyncClient::stateToString(){
+    switch(state()){
+        case 0: return "Closed";
+        case 1: return "Listen";
+        case 2: return "SYN Sent";
+        case 3: return "SYN Received";
+        case 4: return "Established";
+        case 5: return "FIN Wait 1";
+        case 6: return "FIN Wait 2";
+        case 7: return "Close Wait";
+        case 8: return "Closing";
+        case 9: return "Last ACK";
+        case 10: return "Time Wait";
+        default: return "UNKNOWN";
+    }
+}
+
+/*
+ * Static Callbacks (service thread to C++)
+ * */
+
+int8_t AsyncClient::_s_poll(void * arg, struct tcp_pcb * pcb) {
+    uint64_t started = _stats_now_us();
+    int8_t res = reinterpret_cast<AsyncClient*>(arg)->_poll(pcb);
+    _stats_handled(ASYNC_TCP_EV_POLL, started);
+    return res;
+}
+
+void AsyncClient::_s_timer(void * arg) {
+    uint64_t started = _stats_now_us();
+    reinterpret_cast<AsyncClient*>(arg)->_timeout();
+    _stats_handled(ASYNC_TCP_EV_TIMER, started);
+}
+
+int8_t AsyncClient::_s_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
+    uint64_t started = _stats_now_us();
+    int8_t res = reinterpret_cast<AsyncClient*>(arg)->_recv(pcb, pb, err);
+    _stats_handled(ASYNC_TCP_EV_RECV, started);
+    return res;
+}
+
+int8_t AsyncClient::_s_fin(void * arg, struct tcp_pcb * pcb, int8_t err) {
+    uint64_t started = _stats_now_us();
+    int8_t res = reinterpret_cast<AsyncClient*>(arg)->_fin(pcb, err);
+    _stats_handled(ASYNC_TCP_EV_FIN, started);
+    return res;
+}
+
+int8_t AsyncClient::_s_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
+    uint64_t started = _stats_now_us();
+    int8_t res = reinterpret_cast<AsyncClient*>(arg)->_sent(pcb, len);
+    _stats_handled(ASYNC_TCP_EV_SENT, started);
+    return res;
+}
+
+void AsyncClient::_s_error(void * arg, int8_t err) {
+    uint64_t started = _stats_now_us();
+    reinterpret_cast<AsyncClient*>(arg)->_error(err);
+    _stats_handled(ASYNC_TCP_EV_ERROR, started);
+}
+
+int8_t AsyncClient::_s_connected(void * arg, void * pcb, int8_t err){
+    uint64_t started = _stats_now_us();
+    int8_t res = reinterpret_cast<AsyncClient*>(arg)->_connected(pcb, err);
+    _stats_handled(ASYNC_TCP_EV_CONNECTED, started);
+    return res;
+}
+
+/*
+  Async TCP Server
+ */
+
+AsyncServer::AsyncServer(IPAddress addr, uint16_t port)
+: _port(port)
+, _addr(addr)
+, _noDelay(false)
+, _pcb(0)
+, _connect_cb(0)
+, _connect_cb_arg(0)
+{}
+
+AsyncServer::AsyncServer(uint16_t port)
+: _port(port)
+, _addr((uint32_t) INADDR_ANY)
+, _noDelay(false)
+, _pcb(0)
+, _connect_cb(0)
+, _connect_cb_arg(0)
+{}
+
+AsyncServer::~AsyncServer(){
+    end();
+}
+
+void AsyncServer::onClient(AcConnectHandler cb, void* arg){
+    _connect_cb = cb;
+    _connect_cb_arg = arg;
+}
+
+void AsyncServer::begin(){
+    if(_pcb) {
+        return;
+    }
+
+    if(!_start_async_task()){
+        log_e("failed to start task");
+        return;
+    }
+    AsyncTCPCoreLock lock;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0){
+        log_e("socket: %d", errno);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(_port);
+    local_addr.sin_addr.s_addr = (uint32_t) _addr;
+    if(bind(fd, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0){
+        log_e("bind error: %d", errno);
+        close(fd);
+        return;
+    }
+    if(listen(fd, CONFIG_ASYNC_TCP_POSIX_BACKLOG) < 0){
+        log_e("listen error: %d", errno);
+        close(fd);
+        return;
+    }
+    _pcb = _pcb_new(fd, PCB_LISTEN);
+    if(!_pcb){
+        close(fd);
+        return;
+    }
+    _pcb->server = this;
+    _pcb_set_events(_pcb, EPOLLIN);
+}
+
+void AsyncServer::end(){
+    AsyncTCPCoreLock lock;
+    if(_pcb){
+        _pcb_free(_pcb, false);
+        _pcb = NULL;
+    }
+}
+
+//runs on the service thread
+int8_t AsyncServer::_accept(tcp_pcb* pcb, int8_t err){
+    if(_connect_cb){
+        AsyncClient *c = new AsyncClient(pcb);
+        if(c){
+            c->setNoDelay(_noDelay);
+            return _accepted(c);
+        }
+    }
+    _pcb_free(pcb, false);
+    log_e("FAIL");
+    return ERR_OK;
+}
+
+int8_t AsyncServer::_accepted(AsyncClient* client){
+    if(_connect_cb){
+        _connect_cb(_connect_cb_arg, client);
+    }
+    return ERR_OK;
+}
+
+void AsyncServer::setNoDelay(bool nodelay){
+    _noDelay = nodelay;
+}
+
+bool AsyncServer::getNoDelay(){
+    return _noDelay;
+}
+
+uint8_t AsyncServer::status(){
+    if (!_pcb) {
+        return 0;
+    }
+    return _pcb->state;
+}
+
+int8_t AsyncServer::_s_accept(void * arg, tcp_pcb * pcb, int8_t err){
+    uint64_t started = _stats_now_us();
+    int8_t res = reinterpret_cast<AsyncServer*>(arg)->_accept(pcb, err);
+    _stats_handled(ASYNC_TCP_EV_ACCEPT, started);
+    return res;
+}
+
+int8_t AsyncServer::_s_accepted(void *arg, AsyncClient* client){
+    return reinterpret_cast<AsyncServer*>(arg)->_accepted(client);
+}
+
+/*
+ * Statistics API
+ * */
+
+void AsyncTCPStats::snapshot(async_tcp_stats_t * stats){
+    if(!stats){
+        return;
+    }
+    AsyncTCPCoreLock lock;
+    memcpy(stats, &_stats, sizeof(async_tcp_stats_t));
+}
+
+void AsyncTCPStats::reset(){
+    AsyncTCPCoreLock lock;
+    memset(&_stats, 0, sizeof(async_tcp_stats_t));
+}
+
+const char * AsyncTCPStats::eventName(uint8_t event){
+    switch(event){
+        case ASYNC_TCP_EV_SENT: return "sent";
+        case ASYNC_TCP_EV_RECV: return "recv";
+        case ASYNC_TCP_EV_FIN: return "fin";
+        case ASYNC_TCP_EV_ERROR: return "error";
+        case ASYNC_TCP_EV_POLL: return "poll";
+        case ASYNC_TCP_EV_CLEAR: return "clear";
+        case ASYNC_TCP_EV_ACCEPT: return "accept";
+        case ASYNC_TCP_EV_CONNECTED: return "connected";
+        case ASYNC_TCP_EV_DNS: return "dns";
+        case ASYNC_TCP_EV_TIMER: return "timer";
+        default: return "unknown";
+    }
+}
+
+#endif /* ASYNC_TCP_POSIX */
@@ -0,0 +1,186 @@
+/*
+  Asynchronous TCP library for Espressif MCUs
+
+  Hierarchical timer wheel for the connection timeouts
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "AsyncTimerWheel.h"
+
+#define ASYNC_TIMER_MASK (ASYNC_TIMER_SLOTS - 1)
+#define ASYNC_TIMER_MAX_TICKS ((1UL << (ASYNC_TIMER_LEVELS * ASYNC_TIMER_SLOT_BITS)) - 1)
+
+AsyncTimerWheel::AsyncTimerWheel(uint32_t tick_ms)
+: _tick_ms(tick_ms ? tick_ms : 1)
+, _now(0)
+, _base_ms(0)
+, _armed(0)
+, _occupied(0)
+, _expired(NULL)
+{
+    for(int i = 0; i < ASYNC_TIMER_LEVELS * ASYNC_TIMER_SLOTS; i++) {
+        _slots[i] = NULL;
+    }
+}
+
+void AsyncTimerWheel::arm(async_timer_node * n, uint32_t now_ms, uint32_t delay_ms){
+    cancel(n);
+    if(!_armed) {
+        //nothing to keep in step with, start counting from here
+        _base_ms = now_ms;
+    }
+    if(delay_ms > 0x7FFFFFFF) {
+        delay_ms = 0x7FFFFFFF;
+    }
+    int32_t ahead = (int32_t)(now_ms + delay_ms - _base_ms);
+    uint32_t ticks = (ahead > 0) ? ((uint32_t)ahead + _tick_ms - 1) / _tick_ms : 0;
+    if(ticks > ASYNC_TIMER_MAX_TICKS) {
+        ticks = ASYNC_TIMER_MAX_TICKS;
+    }
+    n->expires = _now + ticks;
+    n->expires_ms = now_ms + delay_ms;
+    n->armed = true;
+    _armed++;
+    _place(n);
+}
+
+void AsyncTimerWheel::cancel(async_timer_node * n){
+    if(!n->armed) {
+        return;
+    }
+    _unlink(n);
+    n->armed = false;
+    _armed--;
+}
+
+async_timer_node * AsyncTimerWheel::expired(uint32_t now_ms){
+    if(!_armed) {
+        _base_ms = now_ms;
+        return NULL;
+    }
+    while(!_expired) {
+        int32_t late = (int32_t)(now_ms - _base_ms);
+        if(late < 0) {
+            break;
+        }
+        uint32_t idx = _now & ASYNC_TIMER_MASK;
+        if(!_occupied && idx) {
+            //level 0 is empty up to the next cascade, skip to it (or to now)
+            uint32_t skip = ASYNC_TIMER_SLOTS - idx;
+            uint32_t due = (uint32_t)late / _tick_ms + 1;
+            if(skip > due) {
+                skip = due;
+            }
+            _now += skip;
+            _base_ms += skip * _tick_ms;
+            continue;
+        }
+        _tick();
+    }
+    async_timer_node * n = _expired;
+    if(n) {
+        _unlink(n);
+        n->armed = false;
+        _armed--;
+    }
+    return n;
+}
+
+uint32_t AsyncTimerWheel::nextTimeout(uint32_t now_ms) const {
+    if(!_armed) {
+        return ASYNC_TIMER_NONE;
+    }
+    if(_expired) {
+        return 0;
+    }
+    //the first busy level 0 slot, else the next cascade (which may bring timers down)
+    uint32_t idx = _now & ASYNC_TIMER_MASK;
+    uint64_t ahead = _occupied >> idx;
+    uint32_t ticks = ahead ? __builtin_ctzll(ahead) : (idx ? ASYNC_TIMER_SLOTS - idx : 0);
+    int32_t left = (int32_t)(_base_ms + ticks * _tick_ms - now_ms);
+    return (left > 0) ? left : 0;
+}
+
+void AsyncTimerWheel::_place(async_timer_node * n){
+    uint32_t delta = n->expires - _now;
+    uint8_t level = 0;
+    while(level < ASYNC_TIMER_LEVELS - 1 && delta >= (1UL << ((level + 1) * ASYNC_TIMER_SLOT_BITS))) {
+        level++;
+    }
+    uint32_t idx = (n->expires >> (level * ASYNC_TIMER_SLOT_BITS)) & ASYNC_TIMER_MASK;
+    _link(n, level * ASYNC_TIMER_SLOTS + idx);
+}
+
+void AsyncTimerWheel::_link(async_timer_node * n, uint16_t slot){
+    async_timer_node ** head = (slot == ASYNC_TIMER_EXPIRED) ? &_expired : &_slots[slot];
+    n->slot = slot;
+    n->prev = NULL;
+    n->next = *head;
+    if(*head) {
+        (*head)->prev = n;
+    }
+    *head = n;
+    if(slot < ASYNC_TIMER_SLOTS) {
+        _occupied |= (1ULL << slot);
+    }
+}
+
+void AsyncTimerWheel::_unlink(async_timer_node * n){
+    async_timer_node ** head = (n->slot == ASYNC_TIMER_EXPIRED) ? &_expired : &_slots[n->slot];
+    if(n->prev) {
+        n->prev->next = n->next;
+    } else {
+        *head = n->next;
+    }
+    if(n->next) {
+        n->next->prev = n->prev;
+    }
+    n->prev = NULL;
+    n->next = NULL;
+    if(n->slot < ASYNC_TIMER_SLOTS && !*head) {
+        _occupied &= ~(1ULL << n->slot);
+    }
+}
+
+//moves the level's current slot down, returns its index so the caller knows whether the level wrapped too
+uint32_t AsyncTimerWheel::_cascade(uint8_t level){
+    uint32_t idx = (_now >> (level * ASYNC_TIMER_SLOT_BITS)) & ASYNC_TIMER_MASK;
+    async_timer_node * n = _slots[level * ASYNC_TIMER_SLOTS + idx];
+    _slots[level * ASYNC_TIMER_SLOTS + idx] = NULL;
+    while(n) {
+        async_timer_node * next = n->next;
+        _place(n);
+        n = next;
+    }
+    return idx;
+}
+
+void AsyncTimerWheel::_tick(){
+    uint32_t idx = _now & ASYNC_TIMER_MASK;
+    if(!idx && !_cascade(1) && !_cascade(2)) {
+        _cascade(3);
+    }
+    async_timer_node * n = _slots[idx];
+    _slots[idx] = NULL;
+    _occupied &= ~(1ULL << idx);
+    while(n) {
+        async_timer_node * next = n->next;
+        _link(n, ASYNC_TIMER_EXPIRED);
+        n = next;
+    }
+    _now++;
+    _base_ms += _tick_ms;
+}
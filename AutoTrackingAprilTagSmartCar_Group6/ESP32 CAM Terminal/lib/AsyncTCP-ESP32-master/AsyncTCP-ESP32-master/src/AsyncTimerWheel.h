@@ -0,0 +1,77 @@
+/*
+  Asynchronous TCP library for Espressif MCUs
+
+  Hierarchical timer wheel for the connection timeouts
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ASYNCTIMERWHEEL_H_
+#define ASYNCTIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ASYNC_TIMER_LEVELS 4
+#define ASYNC_TIMER_SLOT_BITS 6
+#define ASYNC_TIMER_SLOTS (1 << ASYNC_TIMER_SLOT_BITS)
+#define ASYNC_TIMER_NONE 0xFFFFFFFF //nextTimeout() when nothing is armed
+#define ASYNC_TIMER_EXPIRED 0xFFFF
+
+//intrusive timer, embedded in its owner so arming never allocates
+struct async_timer_node {
+    async_timer_node * prev;
+    async_timer_node * next;
+    uint32_t expires;     //tick it is due in
+    uint32_t expires_ms;  //the time asked for in arm()
+    uint16_t slot;        //level * ASYNC_TIMER_SLOTS + index, or ASYNC_TIMER_EXPIRED
+    bool armed;
+    void * arg;           //owner, handed back by expired()
+};
+
+//Four levels of 64 slots, cascaded like the classic kernel timer wheel: arm and cancel are O(1),
+//a tick moves one slot (and every 64th tick one slot of the level above). Not thread safe, the caller locks.
+class AsyncTimerWheel {
+  public:
+    AsyncTimerWheel(uint32_t tick_ms);
+
+    void arm(async_timer_node * n, uint32_t now_ms, uint32_t delay_ms); //re-arms if already armed
+    void cancel(async_timer_node * n);
+    bool armed() const { return _armed != 0; }
+
+    //runs the ticks due by now_ms and returns one expired timer (disarmed), NULL when there are none left.
+    //Call until NULL, timers can be armed or cancelled in between.
+    async_timer_node * expired(uint32_t now_ms);
+
+    //ms until expired() has work again, ASYNC_TIMER_NONE if nothing is armed
+    uint32_t nextTimeout(uint32_t now_ms) const;
+
+  private:
+    uint32_t _tick_ms;
+    uint32_t _now;      //next tick to run
+    uint32_t _base_ms;  //time _now is due at
+    uint32_t _armed;
+    uint64_t _occupied; //level 0 slots that hold timers
+    async_timer_node * _slots[ASYNC_TIMER_LEVELS * ASYNC_TIMER_SLOTS];
+    async_timer_node * _expired;
+
+    void _place(async_timer_node * n);
+    void _link(async_timer_node * n, uint16_t slot);
+    void _unlink(async_timer_node * n);
+    uint32_t _cascade(uint8_t level);
+    void _tick();
+};
+
+#endif /* ASYNCTIMERWHEEL_H_ */
@@ -0,0 +1,145 @@
+/*
+ * Linux build: what a client still has queued when it closes must reach the peer.
+ *
+ * The server queues data with add() and closes before the service thread sent it.
+ * A plain socket reads the response and checks that it ends with a FIN, not a reset.
+ */
+
+#include "Arduino.h"
+#include "AsyncTCP.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <atomic>
+
+#define RESPONSE_SIZE (20 * 1024)
+
+enum { CLOSE_LINGER, CLOSE_NOW, CLOSE_REFERENCED, PEER_FIN };
+
+static std::atomic<int> mode;
+static char referenced[RESPONSE_SIZE];
+
+static char pattern(size_t i){
+    return 'a' + (i * 7) % 26;
+}
+
+static size_t queue(AsyncClient * c, const char * data, uint8_t flags){
+    size_t n = 0;
+    while(n < RESPONSE_SIZE){
+        size_t w = c->add(data + n, RESPONSE_SIZE - n, flags);
+        if(!w){
+            break;
+        }
+        n += w;
+    }
+    return n;
+}
+
+static void onClient(void * arg, AsyncClient * c){
+    static char copied[RESPONSE_SIZE];
+    for(size_t i = 0; i < RESPONSE_SIZE; i++){
+        copied[i] = referenced[i] = pattern(i);
+    }
+    c->onDisconnect([](void * arg, AsyncClient * c){ delete c; }, NULL);
+    switch(mode){
+    case CLOSE_LINGER:
+        queue(c, copied, ASYNC_WRITE_FLAG_COPY);
+        c->close();
+        break;
+    case CLOSE_NOW:
+        queue(c, copied, ASYNC_WRITE_FLAG_COPY);
+        c->close(true);
+        break;
+    case CLOSE_REFERENCED:
+        //the caller may reuse a buffer added without copy once the client is closed
+        queue(c, referenced, 0);
+        c->close();
+        memset(referenced, 0, sizeof(referenced));
+        break;
+    case PEER_FIN:
+        //sent once the peer has closed its side
+        c->onData([](void * arg, AsyncClient * c, void * data, size_t len){}, NULL);
+        queue(c, copied, ASYNC_WRITE_FLAG_COPY);
+        break;
+    }
+}
+
+//reads until the end of the stream; false on a reset or a wrong byte
+static bool readResponse(int fd, size_t * total){
+    char buf[4096];
+    *total = 0;
+    for(;;){
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if(r == 0){
+            return true;
+        }
+        if(r < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            fprintf(stderr, "recv: %s after %zu bytes\n", strerror(errno), *total);
+            return false;
+        }
+        for(ssize_t i = 0; i < r; i++){
+            if(buf[i] != pattern(*total + i)){
+                fprintf(stderr, "byte %zu differs\n", *total + i);
+                return false;
+            }
+        }
+        *total += r;
+    }
+}
+
+static bool runCase(uint16_t port, int m, const char * name){
+    mode = m;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    //a small window keeps the server's kernel buffer from taking the response at once
+    int rcvbuf = 2048;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = { 10, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        fprintf(stderr, "%s: connect: %s\n", name, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if(m == CLOSE_LINGER){
+        //input the server never reads must not reset the connection
+        delay(50);
+        char junk[1024] = {0};
+        send(fd, junk, sizeof(junk), MSG_NOSIGNAL);
+    } else if(m == PEER_FIN){
+        delay(50);
+        shutdown(fd, SHUT_WR);
+    }
+    size_t total;
+    bool ok = readResponse(fd, &total) && total == RESPONSE_SIZE;
+    close(fd);
+    printf("%-12s %s (%zu bytes)\n", name, ok ? "ok" : "FAILED", total);
+    return ok;
+}
+
+int main(){
+    uint16_t port = 20000 + getpid() % 20000;
+    AsyncServer server(port);
+    server.onClient(onClient, NULL);
+    server.begin();
+    if(!server.status()){
+        fprintf(stderr, "cannot listen on %u\n", port);
+        return 1;
+    }
+    int failed = 0;
+    failed += !runCase(port, CLOSE_LINGER, "close()");
+    failed += !runCase(port, CLOSE_NOW, "close(true)");
+    failed += !runCase(port, CLOSE_REFERENCED, "referenced");
+    failed += !runCase(port, PEER_FIN, "peer fin");
+    return failed ? 1 : 0;
+}
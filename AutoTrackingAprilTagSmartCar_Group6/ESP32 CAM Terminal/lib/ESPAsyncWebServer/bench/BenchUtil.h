@@ -0,0 +1,65 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Host benchmarks: clock and heap allocation counter. Include it from one file per program.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef BENCHUTIL_H_
+#define BENCHUTIL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+//malloc, calloc, realloc and operator new all count; String and the library's own buffers alike.
+//The sanitizers bring their own allocator, so there the count stays at 0.
+static uint64_t bench_allocs = 0;
+
+#if defined(__SANITIZE_ADDRESS__)
+#define BENCH_COUNTS_ALLOCS 0
+#else
+#define BENCH_COUNTS_ALLOCS 1
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t n){
+  bench_allocs++;
+  return __libc_malloc(n);
+}
+void* calloc(size_t n, size_t s){
+  bench_allocs++;
+  return __libc_calloc(n, s);
+}
+void* realloc(void* p, size_t n){
+  bench_allocs++;
+  return __libc_realloc(p, n);
+}
+void free(void* p){
+  __libc_free(p);
+}
+}
+#endif
+
+#endif /* BENCHUTIL_H_ */
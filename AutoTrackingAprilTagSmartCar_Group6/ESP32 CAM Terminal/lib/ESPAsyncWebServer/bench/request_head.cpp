@@ -0,0 +1,116 @@
+/*
+ * Request head parsing: requests per second and heap allocations per request.
+ *
+ * Each request is fed to a fresh AsyncWebServerRequest (see test/FeedClient.h), whole and then
+ * in 16 byte pieces, parsed, routed to its handler, and dropped by a remote close.
+ * Handlers read what a real one would (a parameter, a header or two); responses are not sent.
+ *
+ *   espasyncwebserver_request_head_bench [requests per case]
+ */
+
+#include "BenchUtil.h"
+#include "FeedClient.h"
+
+struct BenchRequest {
+  const char * name;
+  const char * text;
+};
+
+static const BenchRequest requests[] = {
+  { "browser GET",
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "If-None-Match: \"5f3a-1c\"\r\n"
+    "\r\n" },
+  { "api GET",
+    "GET /api/status?cam=1&quality=high&t=1712345678 HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Accept: application/json\r\n"
+    "\r\n" },
+  { "cmd POST",
+    "POST /cmd HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 37\r\n"
+    "\r\n"
+    "{\"cmd\":\"drive\",\"left\":80,\"right\":75}" },
+  { "form POST",
+    "POST /settings HTTP/1.1\r\n"
+    "Host: 192.168.4.1\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 41\r\n"
+    "\r\n"
+    "ssid=car&pass=secret%21&mode=ap&channel=6" },
+};
+
+static volatile size_t sink;
+
+static void setupServer(AsyncWebServer & server){
+  server.on("/index.html", HTTP_GET, [](AsyncWebServerRequest * request){
+    sink += request->hasHeader("If-None-Match");
+  });
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest * request){
+    if(request->hasParam("cam")){
+      sink += request->getParam("cam")->value().length();
+    }
+  });
+  server.on("/cmd", HTTP_POST, [](AsyncWebServerRequest * request){
+    sink += request->contentLength();
+  }, NULL, [](AsyncWebServerRequest * request, uint8_t * data, size_t len, size_t index, size_t total){
+    sink += len;
+  });
+  server.on("/settings", HTTP_POST, [](AsyncWebServerRequest * request){
+    if(request->hasParam("ssid", true)){
+      sink += request->getParam("ssid", true)->value().length();
+    }
+  });
+  //a typical page also carries routes it will not match
+  const char * others[] = { "/", "/stream", "/capture", "/jpg", "/api/config", "/api/log", "/edit", "/favicon.ico" };
+  for(const char * uri : others){
+    server.on(uri, HTTP_GET, [](AsyncWebServerRequest * request){ sink++; });
+  }
+}
+
+static void runOne(AsyncWebServer & server, const char * text, size_t len, size_t piece){
+  AsyncClient * c = FeedClient::accept(&server);
+  for(size_t i = 0; i < len; i += piece){
+    FeedClient::feed(c, text + i, (len - i < piece) ? len - i : piece);
+  }
+  FeedClient::end(c);
+}
+
+int main(int argc, char ** argv){
+  long count = (argc > 1) ? atol(argv[1]) : 200000;
+  if(count <= 0){
+    count = 1;
+  }
+  AsyncWebServer server(80);
+  setupServer(server);
+  printf("%-12s %6s %12s %10s %12s\n", "request", "piece", "requests/s", "ns/req", "allocs/req");
+  for(const BenchRequest & r : requests){
+    size_t len = strlen(r.text);
+    for(size_t piece : { len, (size_t)16 }){
+      runOne(server, r.text, len, piece);
+      uint64_t allocs = bench_allocs;
+      uint64_t start = bench_now_ns();
+      for(long i = 0; i < count; i++){
+        runOne(server, r.text, len, piece);
+      }
+      uint64_t ns = bench_now_ns() - start;
+      allocs = bench_allocs - allocs;
+      char allocText[16] = "n/a";
+      if(BENCH_COUNTS_ALLOCS){
+        snprintf(allocText, sizeof(allocText), "%.1f", (double)allocs / count);
+      }
+      printf("%-12s %6zu %12.0f %10.0f %12s\n", r.name, piece, count * 1e9 / ns, (double)ns / count, allocText);
+    }
+  }
+  return 0;
+}
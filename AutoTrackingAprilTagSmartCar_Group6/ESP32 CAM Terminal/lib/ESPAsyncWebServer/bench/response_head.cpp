@@ -0,0 +1,98 @@
+/*
+ * Response heads: responses per second and heap allocations per response.
+ *
+ * Each round constructs a response the way a handler does, puts its head together (as _respond
+ * does before the first write) and deletes it. Three default headers, as an app with CORS and a
+ * server name has; the connection is kept alive, so the Connection and Keep-Alive lines go out too.
+ *
+ *   espasyncwebserver_response_head_bench [responses per case]
+ */
+
+#include "BenchUtil.h"
+#include <ESPAsyncWebServer.h>
+
+static volatile size_t sink;
+
+//the keep-alive numbers _addConnectionHeader() takes from the request and the server
+class BenchResponse: public AsyncBasicResponse {
+  public:
+    BenchResponse(int code, const String& contentType, const String& content)
+      : AsyncBasicResponse(code, contentType, content)
+    {
+      _connection = 1;
+      _keepAliveTimeout = 5;
+      _keepAliveLeft = 99;
+    }
+};
+
+static AsyncWebServerResponse* textResponse(){
+  return new BenchResponse(200, "text/plain", "hello");
+}
+
+static AsyncWebServerResponse* jsonResponse(){
+  AsyncWebServerResponse* r = new BenchResponse(200, "application/json", "{\"motion\":\"Stop\",\"speed\":0,\"ts_ms\":123456}");
+  r->addHeader("Cache-Control", "no-store");
+  return r;
+}
+
+static AsyncWebServerResponse* notModified(){
+  AsyncWebServerResponse* r = new BenchResponse(304, String(), String());
+  r->addHeader("ETag", "\"5f3a-1c\"");
+  r->addHeader("Cache-Control", "max-age=86400");
+  return r;
+}
+
+struct BenchCase {
+  const char * name;
+  AsyncWebServerResponse* (*make)();
+};
+
+static const BenchCase cases[] = {
+  { "text 200", textResponse },
+  { "json 200", jsonResponse },
+  { "304", notModified },
+};
+
+int main(int argc, char ** argv){
+  long count = (argc > 1) ? atol(argv[1]) : 1000000;
+  if(count <= 0){
+    count = 1;
+  }
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type");
+  DefaultHeaders::Instance().addHeader("Server", "ESP32-CAM");
+
+  //the bytes, once
+  AsyncWebServerResponse* r = textResponse();
+  String head = r->_assembleHead(1);
+  delete r;
+  const char * expected = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Type: text/plain\r\n"
+    "Access-Control-Allow-Origin: *\r\nAccess-Control-Allow-Headers: Content-Type\r\nServer: ESP32-CAM\r\n"
+    "Connection: keep-alive\r\nKeep-Alive: timeout=5, max=99\r\nAccept-Ranges: none\r\n\r\n";
+  if(head != expected){
+    fprintf(stderr, "unexpected head:\n%s", head.c_str());
+    return 1;
+  }
+
+  printf("%-10s %6s %14s %10s %13s\n", "response", "bytes", "responses/s", "ns/resp", "allocs/resp");
+  for(const BenchCase & c : cases){
+    uint64_t allocs = bench_allocs;
+    uint64_t start = bench_now_ns();
+    size_t bytes = 0;
+    for(long i = 0; i < count; i++){
+      AsyncWebServerResponse* r = c.make();
+      String head = r->_assembleHead(1);
+      bytes = head.length();
+      sink += head[bytes - 3];
+      delete r;
+    }
+    uint64_t ns = bench_now_ns() - start;
+    allocs = bench_allocs - allocs;
+    char allocText[16] = "n/a";
+    if(BENCH_COUNTS_ALLOCS){
+      snprintf(allocText, sizeof(allocText), "%.1f", (double)allocs / count);
+    }
+    printf("%-10s %6zu %14.0f %10.0f %13s\n", c.name, bytes, count * 1e9 / ns, (double)ns / count, allocText);
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Handler dispatch: cost of a request against 12, 120 and 600 registered routes.
+ *
+ * Routes look like the app's API, "/api/v1/<resource>/<action>", each for GET or POST, plus a few
+ * wildcard and extension handlers that every request still has to try. A request is parsed and
+ * routed as in request_head.cpp; the time per request should not grow with the number of routes.
+ *
+ *   espasyncwebserver_route_tree_bench [requests per case]
+ */
+
+#include "BenchUtil.h"
+#include "FeedClient.h"
+
+static volatile size_t sink;
+
+static const char * resources[] = { "camera", "motor", "servo", "led", "tag", "track", "wifi", "system", "log", "battery",
+  "imu", "sonar", "map", "path", "pid", "config", "stream", "snapshot", "ota", "time",
+  "user", "session", "stats", "debug", "calib", "gpio", "i2c", "spi", "uart", "adc",
+  "pwm", "timer", "task", "heap", "fs", "net", "dns", "mdns", "ntp", "web",
+  "ws", "sse", "json", "auth", "token", "key", "cert", "policy", "audit", "alarm" };
+static const char * actions[] = { "get", "set", "list", "reset", "start", "stop", "status", "info", "save", "load", "enable", "disable" };
+
+static void addRoutes(AsyncWebServer & server, int count){
+  char uri[64];
+  for(int i = 0; i < count; i++){
+    snprintf(uri, sizeof(uri), "/api/v1/%s/%s", resources[i / 12], actions[i % 12]);
+    server.on(uri, (i & 1) ? HTTP_POST : HTTP_GET, [](AsyncWebServerRequest * request){ sink++; });
+  }
+  //handlers the tree cannot index
+  server.on("/files/*", HTTP_GET, [](AsyncWebServerRequest * request){ sink++; });
+  server.on("/*.jpg", HTTP_GET, [](AsyncWebServerRequest * request){ sink++; });
+  server.onNotFound([](AsyncWebServerRequest * request){ sink++; });
+}
+
+static double timeRequest(AsyncWebServer & server, const char * text, long count){
+  size_t len = strlen(text);
+  uint64_t start = bench_now_ns();
+  for(long i = 0; i < count; i++){
+    AsyncClient * c = FeedClient::accept(&server);
+    FeedClient::feed(c, text, len);
+    FeedClient::end(c);
+  }
+  return (double)(bench_now_ns() - start) / count;
+}
+
+int main(int argc, char ** argv){
+  long count = (argc > 1) ? atol(argv[1]) : 200000;
+  if(count <= 0){
+    count = 1;
+  }
+  printf("%6s %10s %10s %10s %10s %10s\n", "routes", "first", "middle", "last", "wildcard", "404");
+  for(int routes : { 12, 120, 600 }){
+    AsyncWebServer server(80);
+    addRoutes(server, routes);
+    char first[96], middle[96], last[96];
+    snprintf(first, sizeof(first), "GET /api/v1/%s/%s HTTP/1.1\r\nHost: car\r\n\r\n", resources[0], actions[0]);
+    int m = (routes / 2) & ~1;
+    snprintf(middle, sizeof(middle), "GET /api/v1/%s/%s HTTP/1.1\r\nHost: car\r\n\r\n", resources[m / 12], actions[m % 12]);
+    int l = routes - 2;
+    snprintf(last, sizeof(last), "GET /api/v1/%s/%s HTTP/1.1\r\nHost: car\r\n\r\n", resources[l / 12], actions[l % 12]);
+    const char * wildcard = "GET /files/logs/today.txt HTTP/1.1\r\nHost: car\r\n\r\n";
+    const char * missing = "GET /api/v1/none/get HTTP/1.1\r\nHost: car\r\n\r\n";
+    timeRequest(server, first, 1); //builds the tree
+    printf("%6d", routes);
+    for(const char * text : { (const char *)first, (const char *)middle, (const char *)last, wildcard, missing }){
+      printf(" %8.0fns", timeRequest(server, text, count));
+    }
+    printf("\n");
+  }
+  return 0;
+}
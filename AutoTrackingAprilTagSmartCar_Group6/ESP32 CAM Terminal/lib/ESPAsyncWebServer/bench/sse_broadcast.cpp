@@ -0,0 +1,232 @@
+/*
+ * Server-Sent Events broadcast: events per second sent to 16 subscribers, and how many reached them.
+ *
+ * The subscribers are FeedClient::connect() connections that went through the /events handshake,
+ * read by one thread as fast as the kernel hands the data over. AsyncEventSource::send() is called
+ * back to back, so the queues fill up (acks arrive every few milliseconds on the POSIX backend, as
+ * they do with the round trip on WiFi) and each queue policy shows what it keeps: events per second
+ * offered, the part every subscriber got, and what it dropped or merged. Small events fill the
+ * queue slots while they wait for their ack; 1 kB ones fill the send buffer first, so events wait
+ * unsent and QUEUE_COALESCE has something to merge.
+ *
+ * The events are sent from the service thread, BURST at a time, by a GET /burst on one more
+ * connection: it holds the core lock while a callback runs, so send() from another thread (the
+ * source's lock, then the core lock) would deadlock with an ack (the core lock, then the client's
+ * lock). On the ESP32 async_tcp holds nothing of lwIP while it runs a callback. Acks are handled
+ * between bursts; events per second counts the time spent in send() only.
+ *
+ *   espasyncwebserver_sse_broadcast_bench [events per case]
+ */
+
+#include "BenchUtil.h"
+#include "FeedClient.h"
+#include <poll.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#define SUBSCRIBERS 16
+#define BURST 16
+
+static std::atomic<uint64_t> received; //events, by their blank line, less the response heads
+static std::atomic<bool> draining;
+static std::atomic<int> peers[SUBSCRIBERS];
+static std::vector<AsyncEventSourceClient*> subscribed; //onConnect runs on the service thread
+static std::mutex subscribedLock;
+
+static size_t subscribers(){
+  std::lock_guard<std::mutex> l(subscribedLock);
+  return subscribed.size();
+}
+
+static void drain(){
+  static char buf[65536];
+  uint32_t tail[SUBSCRIBERS] = { 0 };
+  while(draining){
+    struct pollfd fds[SUBSCRIBERS];
+    int n = 0;
+    for(int i = 0; i < SUBSCRIBERS; i++){
+      if(peers[i] >= 0){
+        fds[n].fd = peers[i];
+        fds[n].events = POLLIN;
+        n++;
+      }
+    }
+    if(poll(fds, n, 10) <= 0){
+      continue;
+    }
+    for(int i = 0; i < n; i++){
+      if(!(fds[i].revents & POLLIN)){
+        continue;
+      }
+      int k = 0;
+      while(k < SUBSCRIBERS && peers[k] != fds[i].fd){
+        k++;
+      }
+      if(k == SUBSCRIBERS){
+        continue;
+      }
+      ssize_t r = read(fds[i].fd, buf, sizeof(buf));
+      for(ssize_t j = 0; j < r; j++){
+        tail[k] = (tail[k] << 8) | (uint8_t)buf[j];
+        if(tail[k] == 0x0d0a0d0a){
+          received++;
+        }
+      }
+    }
+  }
+}
+
+static bool get(AsyncWebServer* server, int* peer, const char * request){
+  if(*peer < 0 && !FeedClient::connect(server, peer)){
+    return false;
+  }
+  return write(*peer, request, strlen(request)) == (ssize_t)strlen(request);
+}
+
+//the response head of a GET /burst, which has no body
+static bool answered(int peer){
+  uint32_t tail = 0;
+  char c;
+  while(read(peer, &c, 1) == 1){
+    tail = (tail << 8) | (uint8_t)c;
+    if(tail == 0x0d0a0d0a){
+      return true;
+    }
+  }
+  return false;
+}
+
+//until the count stops moving
+static uint64_t settled(){
+  uint64_t last;
+  do {
+    last = received;
+    delay(50);
+  } while(received != last);
+  return last;
+}
+
+struct BenchCase {
+  const char * name;
+  AsyncQueuePolicy policy;
+  bool named; //events named by what they carry, so QUEUE_COALESCE has something to merge
+};
+
+static const BenchCase cases[] = {
+  { "drop-newest", QUEUE_DROP_NEWEST, false },
+  { "drop-oldest", QUEUE_DROP_OLDEST, false },
+  { "coalesce", QUEUE_COALESCE, true },
+};
+
+int main(int argc, char ** argv){
+  long count = (argc > 1) ? atol(argv[1]) : 2000;
+  count = (count > 0) ? (count + BURST - 1) / BURST * BURST : BURST;
+  static const char * names[] = { "pose", "tag", "battery", "speed" };
+  static char big[1024];
+  static const BenchCase * current;
+  static size_t size;
+  static long next;
+  static uint64_t sendNs;
+  memset(big, 'x', sizeof(big) - 1);
+  AsyncWebServer server(80);
+  AsyncEventSource* events = new AsyncEventSource("/events"); //the server deletes its handlers
+  events->setReplay(0);
+  events->onConnect([](AsyncEventSourceClient* c){
+    std::lock_guard<std::mutex> l(subscribedLock);
+    subscribed.push_back(c);
+  });
+  server.addHandler(events);
+  server.on("/burst", HTTP_GET, [events](AsyncWebServerRequest* request){
+    char message[64];
+    for(int n = 0; n < BURST; n++, next++){
+      long i = next;
+      snprintf(message, sizeof(message), "{\"x\":%ld,\"y\":%ld,\"heading\":%ld}", i & 1023, (i >> 3) & 1023, i % 360);
+      memcpy(big, message, strlen(message));
+      uint64_t start = bench_now_ns();
+      events->send((size > 40) ? big : message, current->named ? names[i & 3] : NULL, i + 1);
+      sendNs += bench_now_ns() - start;
+    }
+    request->send(204);
+  });
+  for(int i = 0; i < SUBSCRIBERS; i++){
+    peers[i] = -1;
+  }
+  draining = true;
+  std::thread drainer(drain);
+
+  int control = -1;
+  printf("%-12s %6s %12s %10s %10s %10s %10s\n", "policy", "bytes", "events/s", "ns/event", "delivered", "dropped", "coalesced");
+  int failed = 0;
+  for(const BenchCase & b : cases)
+  for(size_t s : { (size_t)40, sizeof(big) - 1 }){ //about 40: the telemetry itself
+    current = &b;
+    size = s;
+    events->setQueuePolicy(b.policy);
+    {
+      std::lock_guard<std::mutex> l(subscribedLock);
+      subscribed.clear();
+    }
+    for(int i = 0; i < SUBSCRIBERS; i++){
+      int peer = -1;
+      if(!get(&server, &peer, "GET /events HTTP/1.1\r\nHost: car\r\nAccept: text/event-stream\r\n\r\n")){
+        fprintf(stderr, "%s: subscriber %d did not connect\n", b.name, i);
+        return 1;
+      }
+      peers[i] = peer;
+    }
+    for(int i = 0; i < 2000 && subscribers() < SUBSCRIBERS; i++){
+      delay(1);
+    }
+    if(subscribers() != SUBSCRIBERS){
+      fprintf(stderr, "%s: %u subscribers, wanted %d\n", b.name, (unsigned)subscribers(), SUBSCRIBERS);
+      return 1;
+    }
+    uint64_t before = settled();
+
+    next = 0;
+    sendNs = 0;
+    while(next < count){
+      if(get(&server, &control, "GET /burst HTTP/1.1\r\nHost: car\r\n\r\n") && answered(control)){
+        continue;
+      }
+      //closed after its last keep-alive request: once more on a new connection
+      close(control);
+      control = -1;
+      if(!get(&server, &control, "GET /burst HTTP/1.1\r\nHost: car\r\n\r\n") || !answered(control)){
+        fprintf(stderr, "%s: no answer to GET /burst\n", b.name);
+        return 1;
+      }
+    }
+    uint64_t ns = sendNs;
+    uint64_t got = settled() - before; //the response heads are in before
+
+    uint32_t dropped = 0, coalesced = 0;
+    for(AsyncEventSourceClient* c : subscribed){
+      dropped += c->dropped();
+      coalesced += c->coalesced();
+    }
+    //whatever was not dropped or merged away got there
+    if(got + dropped + coalesced != (uint64_t)count * SUBSCRIBERS){
+      fprintf(stderr, "%s, %zu bytes: %llu delivered, %u dropped, %u coalesced of %ld x %d\n", b.name, size,
+        (unsigned long long)got, dropped, coalesced, count, SUBSCRIBERS);
+      failed = 1;
+    }
+    printf("%-12s %6zu %12.0f %10.0f %9.1f%% %9.1f%% %9.1f%%\n", b.name, size, count * 1e9 / ns, (double)ns / count,
+      100.0 * got / count / SUBSCRIBERS, 100.0 * dropped / count / SUBSCRIBERS, 100.0 * coalesced / count / SUBSCRIBERS);
+
+    //the remote close: the server deletes the clients
+    for(int i = 0; i < SUBSCRIBERS; i++){
+      int fd = peers[i];
+      peers[i] = -1;
+      close(fd);
+    }
+    for(int i = 0; i < 2000 && events->count(); i++){
+      delay(1);
+    }
+  }
+  close(control);
+  draining = false;
+  drainer.join();
+  return failed;
+}
@@ -0,0 +1,124 @@
+/*
+ * WebSocket unmasking: webSocketUnmask() against the byte at a time loop it replaced, in MB/s.
+ *
+ * Payloads of 64 bytes (a drive command), 1436 (one TCP segment) and 64 kB (a reassembled
+ * message), starting at each offset from a word boundary, since a payload sits wherever its
+ * frame header left it in the receive buffer. Then the whole receive path: masked binary frames
+ * fed to a streaming AsyncWebSocketClient, one frame per receive buffer.
+ *
+ *   espasyncwebserver_ws_unmask_bench [megabytes per case]
+ */
+
+#include "BenchUtil.h"
+#include "FeedClient.h"
+
+void webSocketUnmask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset);
+
+static volatile size_t sink;
+
+static const uint8_t key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+//as _onData did it before
+static void __attribute__((noinline)) unmaskBytes(uint8_t *data, size_t len, const uint8_t *mask, size_t offset){
+  for(size_t i = 0; i < len; i++)
+    data[i] ^= mask[(offset + i) % 4];
+}
+
+static double rate(uint64_t bytes, uint64_t ns){
+  return ns ? (double)bytes * 1000.0 / ns : 0;
+}
+
+static AsyncClient* connect(AsyncWebServer* server){
+  static const char handshake[] = "GET /ws HTTP/1.1\r\nHost: car\r\nConnection: Upgrade\r\nUpgrade: websocket\r\n"
+    "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+  AsyncClient* c = FeedClient::accept(server);
+  FeedClient::feed(c, handshake, sizeof(handshake) - 1);
+  FeedClient::ack(c, sizeof(handshake) - 1);
+  return c;
+}
+
+//a masked, final binary frame with a len byte payload
+static size_t makeFrame(uint8_t *out, size_t len){
+  size_t h = 0;
+  out[h++] = 0x82;
+  if(len < 126){
+    out[h++] = 0x80 | len;
+  } else {
+    out[h++] = 0x80 | 126;
+    out[h++] = len >> 8;
+    out[h++] = len;
+  }
+  memcpy(out + h, key, 4);
+  h += 4;
+  for(size_t i = 0; i < len; i++)
+    out[h + i] = (uint8_t)i ^ key[i & 3];
+  return h + len;
+}
+
+int main(int argc, char ** argv){
+  long mb = (argc > 1) ? atol(argv[1]) : 256;
+  if(mb <= 0){
+    mb = 1;
+  }
+  const uint64_t total = (uint64_t)mb << 20;
+  static uint8_t buf[65536 + 8], ref[65536];
+  for(size_t i = 0; i < sizeof(buf); i++)
+    buf[i] = (uint8_t)(i * 31);
+
+  //same result at every alignment and mask offset
+  for(size_t len : { (size_t)0, (size_t)1, (size_t)7, (size_t)64, (size_t)1436 }){
+    for(size_t align = 0; align < 8; align++){
+      for(size_t offset = 0; offset < 4; offset++){
+        memcpy(ref, buf + align, len);
+        unmaskBytes(ref, len, key, offset);
+        webSocketUnmask(buf + align, len, key, offset);
+        if(memcmp(ref, buf + align, len)){
+          fprintf(stderr, "webSocketUnmask differs: len %zu, alignment %zu, offset %zu\n", len, align, offset);
+          return 1;
+        }
+      }
+    }
+  }
+
+  printf("%6s %5s %12s %12s\n", "bytes", "align", "bytes MB/s", "words MB/s");
+  for(size_t len : { (size_t)64, (size_t)1436, (size_t)65536 }){
+    for(size_t align : { 0, 1, 2, 3, 5 }){
+      long rounds = total / len;
+      uint64_t start = bench_now_ns();
+      for(long r = 0; r < rounds; r++)
+        unmaskBytes(buf + align, len, key, r);
+      uint64_t bytesNs = bench_now_ns() - start;
+      start = bench_now_ns();
+      for(long r = 0; r < rounds; r++)
+        webSocketUnmask(buf + align, len, key, r);
+      uint64_t wordsNs = bench_now_ns() - start;
+      sink += buf[align];
+      printf("%6zu %5zu %12.0f %12.0f\n", len, align, rate((uint64_t)rounds * len, bytesNs), rate((uint64_t)rounds * len, wordsNs));
+    }
+  }
+
+  AsyncWebServer server(80);
+  AsyncWebSocket* ws = new AsyncWebSocket("/ws"); //the server deletes its handlers
+  ws->onEvent([](AsyncWebSocket * s, AsyncWebSocketClient * c, AwsEventType t, void * arg, uint8_t * data, size_t len){
+    if(t == WS_EVT_DATA){
+      sink += data[len / 2];
+    }
+  });
+  server.addHandler(ws);
+  printf("\n%6s %12s %10s\n", "frame", "recv MB/s", "allocs");
+  for(size_t len : { (size_t)64, (size_t)1436, (size_t)4096 }){
+    static uint8_t frame[4096 + 8];
+    size_t n = makeFrame(frame, len);
+    AsyncClient* c = connect(&server);
+    long rounds = total / len;
+    uint64_t allocs = bench_allocs;
+    uint64_t start = bench_now_ns();
+    for(long r = 0; r < rounds; r++)
+      FeedClient::feed(c, frame, n);
+    uint64_t ns = bench_now_ns() - start;
+    allocs = bench_allocs - allocs;
+    FeedClient::end(c);
+    printf("%6zu %12.0f %10.2f\n", len, rate((uint64_t)rounds * len, ns), (double)allocs / rounds);
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Host fuzzing: a driver for LLVMFuzzerTestOneInput() when libFuzzer is not available (gcc).
+  It runs every file of the corpus given on the command line, then -runs=N mutations of them.
+
+    <target> [-runs=N] [-seed=S] [-max_len=L] corpus_dir_or_file...
+
+  Built with ASYNC_HOST_LIBFUZZER=ON and clang, the targets link libFuzzer instead of this file.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+typedef std::vector<uint8_t> FuzzInput;
+
+static uint64_t fuzz_rng;
+
+static uint32_t fuzz_rand(uint32_t n){
+  fuzz_rng ^= fuzz_rng << 13;
+  fuzz_rng ^= fuzz_rng >> 7;
+  fuzz_rng ^= fuzz_rng << 17;
+  return n ? (uint32_t)(fuzz_rng % n) : 0;
+}
+
+static bool fuzz_load(const std::string& path, std::vector<FuzzInput>& corpus){
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0){
+    fprintf(stderr, "%s: not found\n", path.c_str());
+    return false;
+  }
+  if(S_ISDIR(st.st_mode)){
+    DIR* d = opendir(path.c_str());
+    if(!d){
+      return false;
+    }
+    std::vector<std::string> names;
+    while(struct dirent* e = readdir(d)){
+      if(e->d_name[0] != '.'){
+        names.push_back(e->d_name);
+      }
+    }
+    closedir(d);
+    bool ok = true;
+    for(const std::string& n : names){
+      ok &= fuzz_load(path + "/" + n, corpus);
+    }
+    return ok;
+  }
+  FILE* f = fopen(path.c_str(), "rb");
+  if(!f){
+    return false;
+  }
+  FuzzInput in;
+  uint8_t buf[4096];
+  size_t n;
+  while((n = fread(buf, 1, sizeof(buf), f)) > 0){
+    in.insert(in.end(), buf, buf + n);
+  }
+  fclose(f);
+  corpus.push_back(in);
+  return true;
+}
+
+static void fuzz_mutate(FuzzInput& in, const std::vector<FuzzInput>& corpus, size_t max_len){
+  static const char* tokens[] = { "\r\n", "\r\n\r\n", ": ", "HTTP/1.1", "HTTP/1.0", "Content-Length: ", "Transfer-Encoding: chunked",
+    "Connection: keep-alive", "Expect: 100-continue", "multipart/form-data; boundary=", "--", "?", "&", "=", "%", "/", "0", "-1", "4294967296" };
+  int ops = 1 + fuzz_rand(4);
+  for(int i = 0; i < ops; i++){
+    size_t pos = fuzz_rand(in.size() + 1);
+    switch(fuzz_rand(7)){
+      case 0: //flip a bit
+        if(!in.empty()){
+          in[fuzz_rand(in.size())] ^= 1 << fuzz_rand(8);
+        }
+        break;
+      case 1: //random byte
+        if(!in.empty()){
+          in[fuzz_rand(in.size())] = fuzz_rand(256);
+        }
+        break;
+      case 2: { //insert random bytes
+        size_t n = 1 + fuzz_rand(8);
+        for(size_t k = 0; k < n; k++){
+          in.insert(in.begin() + pos, (uint8_t)fuzz_rand(256));
+        }
+        break;
+      }
+      case 3: //delete a range
+        if(pos < in.size()){
+          size_t n = 1 + fuzz_rand(in.size() - pos);
+          in.erase(in.begin() + pos, in.begin() + pos + n);
+        }
+        break;
+      case 4: //repeat a range
+        if(pos < in.size()){
+          size_t n = 1 + fuzz_rand(in.size() - pos < 64 ? in.size() - pos : 64);
+          FuzzInput part(in.begin() + pos, in.begin() + pos + n);
+          in.insert(in.begin() + fuzz_rand(in.size() + 1), part.begin(), part.end());
+        }
+        break;
+      case 5: { //insert a token
+        const char* t = tokens[fuzz_rand(sizeof(tokens) / sizeof(tokens[0]))];
+        in.insert(in.begin() + pos, t, t + strlen(t));
+        break;
+      }
+      case 6: { //splice with another input
+        const FuzzInput& o = corpus[fuzz_rand(corpus.size())];
+        size_t from = fuzz_rand(o.size() + 1);
+        in.resize(pos);
+        in.insert(in.end(), o.begin() + from, o.end());
+        break;
+      }
+    }
+  }
+  if(in.size() > max_len){
+    in.resize(max_len);
+  }
+}
+
+int main(int argc, char** argv){
+  long runs = 0;
+  uint64_t seed = 1;
+  size_t max_len = 4096;
+  std::vector<FuzzInput> corpus;
+  for(int i = 1; i < argc; i++){
+    if(!strncmp(argv[i], "-runs=", 6)){
+      runs = atol(argv[i] + 6);
+    } else if(!strncmp(argv[i], "-seed=", 6)){
+      seed = strtoull(argv[i] + 6, NULL, 10);
+    } else if(!strncmp(argv[i], "-max_len=", 9)){
+      max_len = strtoul(argv[i] + 9, NULL, 10);
+    } else if(argv[i][0] == '-'){
+      //libFuzzer flags this driver does not know about
+    } else if(!fuzz_load(argv[i], corpus)){
+      return 2;
+    }
+  }
+  if(corpus.empty()){
+    corpus.push_back(FuzzInput());
+  }
+  for(const FuzzInput& in : corpus){
+    LLVMFuzzerTestOneInput(in.data(), in.size());
+  }
+  fuzz_rng = seed * 0x9E3779B97F4A7C15ull + 1;
+  for(long r = 0; r < runs; r++){
+    FuzzInput in = corpus[fuzz_rand(corpus.size())];
+    fuzz_mutate(in, corpus, max_len);
+    LLVMFuzzerTestOneInput(in.data(), in.size());
+  }
+  printf("%zu inputs, %ld mutations: ok\n", corpus.size(), runs);
+  return 0;
+}
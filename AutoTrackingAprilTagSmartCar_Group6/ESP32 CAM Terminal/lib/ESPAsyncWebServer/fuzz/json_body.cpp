@@ -0,0 +1,152 @@
+/*
+ * Fuzz target: JSON request bodies, as AsyncJsonBody parses them packet by packet with AsyncJsonParser.
+ *
+ * The first byte picks the packets: bits 0-4 cap them at 1 to 32 bytes, and the whole byte seeds
+ * their lengths, so the same body is cut at different places. The rest is the body, up to 256 bytes
+ * (ASYNC_JSON_MAX_TOKEN does not come into it). The body parsed in pieces must give what it gives in
+ * one piece, and a body it accepts must read the same with deserializeJson(), which is the reference
+ * here. ArduinoJson accepts more (comments, single quotes, NaN), so a body deserializeJson() takes and
+ * the tokenizer refuses is not an error. A root number, true, false or null is not compared: ArduinoJson
+ * 6.11 reads it up to the next delimiter, so "5 " is refused and "-1b" is null, where the tokenizer takes
+ * the value and skips the rest, as after any root value. Corpus: corpus/json_body/, one body per file.
+ */
+
+#include <Arduino.h>
+#include <AsyncJson.h>
+#include <math.h>
+#include <string>
+
+#define CAPACITY 8192 //more than 256 bytes of JSON can use, so neither side runs out
+
+static std::string serialized(JsonVariant v){
+  std::string s;
+  serializeJson(v, s);
+  return s;
+}
+
+//ArduinoJson 6.11 writes the halves of a surrogate pair as two 3-byte sequences: one code point of 4 bytes here
+static std::string joined(const std::string& s){
+  std::string out;
+  for(size_t i = 0; i < s.size(); i++){
+    const uint8_t* p = (const uint8_t*)s.data() + i;
+    if(i + 6 <= s.size() && p[0] == 0xED && (p[1] & 0xF0) == 0xA0 && p[3] == 0xED && (p[4] & 0xF0) == 0xB0){
+      uint32_t high = ((p[1] & 0x0F) << 6) | (p[2] & 0x3F), low = ((p[4] & 0x0F) << 6) | (p[5] & 0x3F);
+      uint32_t code = 0x10000 + (high << 10) + low;
+      out += (char)(0xF0 | (code >> 18));
+      out += (char)(0x80 | ((code >> 12) & 0x3F));
+      out += (char)(0x80 | ((code >> 6) & 0x3F));
+      out += (char)(0x80 | (code & 0x3F));
+      i += 5;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+//numbers may differ in the last bits: ArduinoJson has its own strtod()
+static bool same(JsonVariant a, JsonVariant b){
+  if(a.is<JsonObject>() || b.is<JsonObject>()){
+    if(!a.is<JsonObject>() || !b.is<JsonObject>()){
+      return false;
+    }
+    //b, from deserializeJson(), keeps the members of a repeated key; a has the first, which b[key] finds
+    JsonObject oa = a.as<JsonObject>(), ob = b.as<JsonObject>();
+    JsonObject::iterator i = oa.begin();
+    for(JsonObject::iterator j = ob.begin(); j != ob.end(); ++j){
+      bool repeated = false;
+      for(JsonObject::iterator k = ob.begin(); k != j && !repeated; ++k){
+        repeated = !strcmp(k->key().c_str(), j->key().c_str());
+      }
+      if(repeated){
+        continue;
+      }
+      if(i == oa.end() || i->key().c_str() != joined(j->key().c_str()) || !same(i->value(), j->value())){
+        return false;
+      }
+      ++i;
+    }
+    return i == oa.end();
+  }
+  if(a.is<JsonArray>() || b.is<JsonArray>()){
+    if(!a.is<JsonArray>() || !b.is<JsonArray>() || a.size() != b.size()){
+      return false;
+    }
+    for(size_t i = 0; i < a.size(); i++){
+      if(!same(a[i], b[i])){
+        return false;
+      }
+    }
+    return true;
+  }
+  if(a.is<long long>() && b.is<long long>()){
+    return a.as<long long>() == b.as<long long>();
+  }
+  if(a.is<double>() && !a.is<bool>() && b.is<double>() && !b.is<bool>()){
+    double x = a.as<double>(), y = b.as<double>();
+    if(isinf(y) && x == 0){
+      return true; //ArduinoJson 6.11 makes any exponent over 308 infinite, that of 0e400 too
+    }
+    if(isnan(x) || isnan(y) || isinf(x) || isinf(y)){
+      return (isnan(x) && isnan(y)) || x == y;
+    }
+    return fabs(x - y) <= 1e-9 * fmax(fabs(x), fabs(y));
+  }
+  return serialized(a) == joined(serialized(b));
+}
+
+static void fail(const char * what, const uint8_t* data, size_t size, JsonVariant got, JsonVariant want){
+  fprintf(stderr, "%s\nbody: ", what);
+  for(size_t i = 0; i < size; i++){
+    fprintf(stderr, (data[i] >= 0x20 && data[i] < 0x7F) ? "%c" : "\\x%02x", data[i]);
+  }
+  fprintf(stderr, "\ngot:  %s\nwant: %s\n", serialized(got).c_str(), serialized(want).c_str());
+  abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+  if(!size){
+    return 0;
+  }
+  uint32_t seed = data[0];
+  size_t piece = (data[0] & 0x1F) + 1;
+  data++;
+  size--;
+  if(size > 256){
+    size = 256;
+  }
+
+  AsyncJsonBody* whole = AsyncJsonBody::create(CAPACITY);
+  whole->feed(data, size, true);
+  AsyncJsonBody* pieces = AsyncJsonBody::create(CAPACITY);
+  size_t i = 0;
+  do {
+    seed = seed * 1103515245 + 12345;
+    size_t n = 1 + (seed >> 16) % piece;
+    if(n > size - i){
+      n = size - i;
+    }
+    pieces->feed(data + i, n, i + n == size);
+    i += n;
+  } while(i < size);
+
+  if(whole->ok() != pieces->ok() || (whole->ok() && serialized(whole->root()) != serialized(pieces->root()))){
+    fail("in pieces it parses differently", data, size, pieces->root(), whole->root());
+  }
+  JsonVariant root = whole->root();
+  bool word = !root.is<JsonObject>() && !root.is<JsonArray>() && !root.is<const char*>();
+  if(whole->ok() && !word){
+    DynamicJsonDocument doc(CAPACITY);
+    DeserializationError e = deserializeJson(doc, (const char*)data, size); //const: the strings are copied
+    if(e != DeserializationError::Ok){
+      fprintf(stderr, "deserializeJson(): %s\n", e.c_str());
+      fail("accepted, deserializeJson() refuses it", data, size, root, doc.as<JsonVariant>());
+    }
+    if(!same(root, doc.as<JsonVariant>())){
+      fail("not what deserializeJson() reads", data, size, root, doc.as<JsonVariant>());
+    }
+  }
+  free(whole);
+  free(pieces);
+  return 0;
+}
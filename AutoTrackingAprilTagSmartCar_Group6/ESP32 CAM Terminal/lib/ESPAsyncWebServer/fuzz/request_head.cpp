@@ -0,0 +1,82 @@
+/*
+ * Fuzz target: request head, parameters and bodies as AsyncWebServerRequest receives them.
+ *
+ * The first byte picks how the rest is cut into receive buffers (1 to 64 bytes, or all at once);
+ * the rest is the byte stream of one connection. The server has the kinds of routes the app
+ * uses: plain paths, a wildcard, a rewrite, body and upload handlers, digest auth and a 404.
+ * Corpus: corpus/request_head/, one connection per file.
+ */
+
+#include "FeedClient.h"
+
+static volatile size_t sink;
+
+static AsyncWebServer* fuzzServer(){
+  static AsyncWebServer* server = NULL;
+  if(server){
+    return server;
+  }
+  server = new AsyncWebServer(80);
+  server->on("/", HTTP_GET, [](AsyncWebServerRequest* request){
+    request->send(200, "text/plain", "ok");
+  });
+  server->on("/api/status", HTTP_GET | HTTP_HEAD, [](AsyncWebServerRequest* request){
+    //materialises every header and parameter
+    for(int i = 0; i < request->headers(); i++){
+      AsyncWebHeader* h = request->getHeader(i);
+      sink += h->name().length() + h->value().length();
+    }
+    for(int i = 0; i < request->params(); i++){
+      AsyncWebParameter* p = request->getParam(i);
+      sink += p->name().length() + p->value().length();
+    }
+    sink += request->host().length() + request->contentType().length();
+    request->send(200, "application/json", "{}");
+  });
+  server->on("/cmd", HTTP_POST, [](AsyncWebServerRequest* request){
+    request->send(200, "application/json", "{\"ok\":true}");
+  }, NULL, [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total){
+    for(size_t i = 0; i < len; i++){
+      sink += data[i];
+    }
+  });
+  server->on("/upload", HTTP_POST, [](AsyncWebServerRequest* request){
+    sink += request->hasParam("file", true, true);
+    request->send(200);
+  }, [](AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final){
+    sink += filename.length() + len + final;
+  });
+  server->on("/secure", HTTP_ANY, [](AsyncWebServerRequest* request){
+    if(!request->authenticate("admin", "secret")){
+      return request->requestAuthentication();
+    }
+    request->send(200);
+  });
+  server->on("/files/*", HTTP_GET, [](AsyncWebServerRequest* request){
+    sink += request->url().length();
+    request->send(404);
+  });
+  server->rewrite("/old", "/api/status?from=old");
+  server->onNotFound([](AsyncWebServerRequest* request){
+    request->send(404);
+  });
+  return server;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+  if(!size){
+    return 0;
+  }
+  size_t piece = (data[0] & 0x3F) + 1;
+  if(data[0] & 0x40){
+    piece = size;
+  }
+  data++;
+  size--;
+  AsyncClient* c = FeedClient::accept(fuzzServer());
+  for(size_t i = 0; i < size; i += piece){
+    FeedClient::feed(c, data + i, (size - i < piece) ? size - i : piece);
+  }
+  FeedClient::end(c);
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Fuzz target: WebSocket frames as AsyncWebSocketClient receives them after the handshake.
+ *
+ * The first byte picks the connection: bits 0-4 cut the rest into receive buffers of 1 to 32
+ * bytes (bit 5: all at once), bit 6 offers permessage-deflate, bit 7 connects to the socket that
+ * reassembles messages (4 kB cap) instead of the streaming one. The rest is what the browser
+ * sends: masked frames, fragments, control frames in between, compressed messages.
+ * Each input also checks webSocketUnmask() against a byte at a time XOR, at every alignment and
+ * mask offset. Corpus: corpus/ws_frames/, one connection per file.
+ */
+
+#include "FeedClient.h"
+
+void webSocketUnmask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset);
+
+static volatile size_t sink;
+static bool connected;
+
+static void onEvent(AsyncWebSocket* s, AsyncWebSocketClient* c, AwsEventType t, void* arg, uint8_t* data, size_t len){
+  if(t == WS_EVT_CONNECT){
+    connected = true;
+  } else if(t == WS_EVT_DATA){
+    AwsFrameInfo* info = (AwsFrameInfo*)arg;
+    for(size_t i = 0; i < len; i++){
+      sink += data[i];
+    }
+    //answers go to the queues, FeedClient never sends them
+    if(info->final && info->index + len == info->len){
+      if(info->opcode == WS_TEXT){
+        c->text((const char*)data, len);
+      } else {
+        c->binary(data, len);
+      }
+    }
+  }
+}
+
+static AsyncWebServer* fuzzServer(){
+  static AsyncWebServer* server = NULL;
+  if(server){
+    return server;
+  }
+  server = new AsyncWebServer(80);
+  AsyncWebSocket* ws = new AsyncWebSocket("/ws");
+  ws->setDeflate(true);
+  ws->onEvent(onEvent);
+  server->addHandler(ws);
+  AsyncWebSocket* wsr = new AsyncWebSocket("/wsr");
+  wsr->setDeflate(true);
+  wsr->setReassembly(4096);
+  wsr->onEvent(onEvent);
+  server->addHandler(wsr);
+  return server;
+}
+
+static void checkUnmask(const uint8_t* data, size_t size){
+  if(size < 4){
+    return;
+  }
+  static uint8_t buf[256 + 8], ref[256];
+  const uint8_t* mask = data;
+  size_t len = (size - 4 < 256) ? size - 4 : 256;
+  for(size_t align = 0; align < 8; align++){
+    for(size_t offset = 0; offset < 4; offset++){
+      memcpy(buf + align, data + 4, len);
+      for(size_t i = 0; i < len; i++){
+        ref[i] = data[4 + i] ^ mask[(offset + i) & 3];
+      }
+      webSocketUnmask(buf + align, len, mask, offset);
+      if(memcmp(buf + align, ref, len)){
+        fprintf(stderr, "webSocketUnmask differs: len %zu, alignment %zu, offset %zu\n", len, align, offset);
+        abort();
+      }
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+  if(!size){
+    return 0;
+  }
+  size_t piece = (data[0] & 0x1F) + 1;
+  if(data[0] & 0x20){
+    piece = size;
+  }
+  String handshake = (data[0] & 0x80) ? "GET /wsr" : "GET /ws";
+  handshake += " HTTP/1.1\r\nHost: car\r\nConnection: Upgrade\r\nUpgrade: websocket\r\n"
+    "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n";
+  if(data[0] & 0x40){
+    handshake += "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n";
+  }
+  handshake += "\r\n";
+  data++;
+  size--;
+  checkUnmask(data, size);
+
+  connected = false;
+  AsyncClient* c = FeedClient::accept(fuzzServer());
+  FeedClient::feed(c, handshake.c_str(), handshake.length());
+  FeedClient::ack(c, handshake.length());
+  if(!connected){
+    fprintf(stderr, "handshake failed\n");
+    abort();
+  }
+  for(size_t i = 0; i < size; i += piece){
+    FeedClient::feed(c, data + i, (size - i < piece) ? size - i : piece);
+  }
+  FeedClient::end(c);
+  return 0;
+}
@@ -20,116 +20,117 @@
 #include "Arduino.h"
 #include "AsyncEventSource.h"
 
-static String generateEventMessage(const char *message, const char *event, uint32_t id, uint32_t reconnect){
-  String ev = "";
-
-  if(reconnect){
-    ev += "retry: ";
-    ev += String(reconnect);
-    ev += "\r\n";
-  }
+static size_t eventPut(char *buf, size_t pos, const char *data, size_t len){
+  if(buf != NULL)
+    memcpy(buf + pos, data, len);
+  return pos + len;
+}
 
-  if(id){
-    ev += "id: ";
-    ev += String(id);
-    ev += "\r\n";
-  }
+static size_t eventField(char *buf, size_t pos, const char *name, uint32_t value){
+  char num[12];
+  const int n = snprintf(num, sizeof(num), "%lu", (unsigned long)value);
+  pos = eventPut(buf, pos, name, strlen(name));
+  pos = eventPut(buf, pos, num, n);
+  return eventPut(buf, pos, "\r\n", 2);
+}
 
+//writes the event to buf, or only measures it when buf is NULL. Every line of the message
+//(ended by CR, LF or CRLF) becomes a data field, and a blank line ends the event
+static size_t encodeEvent(char *buf, const char *message, const char *event, uint32_t id, uint32_t reconnect){
+  size_t pos = 0;
+  if(reconnect)
+    pos = eventField(buf, pos, "retry: ", reconnect);
+  if(id)
+    pos = eventField(buf, pos, "id: ", id);
   if(event != NULL){
-    ev += "event: ";
-    ev += String(event);
-    ev += "\r\n";
+    pos = eventPut(buf, pos, "event: ", 7);
+    pos = eventPut(buf, pos, event, strlen(event));
+    pos = eventPut(buf, pos, "\r\n", 2);
   }
-
   if(message != NULL){
-    size_t messageLen = strlen(message);
-    char * lineStart = (char *)message;
-    char * lineEnd;
-    do {
-      char * nextN = strchr(lineStart, '\n');
-      char * nextR = strchr(lineStart, '\r');
-      if(nextN == NULL && nextR == NULL){
-        size_t llen = ((char *)message + messageLen) - lineStart;
-        char * ldata = (char *)malloc(llen+1);
-        if(ldata != NULL){
-          memcpy(ldata, lineStart, llen);
-          ldata[llen] = 0;
-          ev += "data: ";
-          ev += ldata;
-          ev += "\r\n\r\n";
-          free(ldata);
-        }
-        lineStart = (char *)message + messageLen;
-      } else {
-        char * nextLine = NULL;
-        if(nextN != NULL && nextR != NULL){
-          if(nextR < nextN){
-            lineEnd = nextR;
-            if(nextN == (nextR + 1))
-              nextLine = nextN + 1;
-            else
-              nextLine = nextR + 1;
-          } else {
-            lineEnd = nextN;
-            if(nextR == (nextN + 1))
-              nextLine = nextR + 1;
-            else
-              nextLine = nextN + 1;
-          }
-        } else if(nextN != NULL){
-          lineEnd = nextN;
-          nextLine = nextN + 1;
-        } else {
-          lineEnd = nextR;
-          nextLine = nextR + 1;
-        }
-
-        size_t llen = lineEnd - lineStart;
-        char * ldata = (char *)malloc(llen+1);
-        if(ldata != NULL){
-          memcpy(ldata, lineStart, llen);
-          ldata[llen] = 0;
-          ev += "data: ";
-          ev += ldata;
-          ev += "\r\n";
-          free(ldata);
-        }
-        lineStart = nextLine;
-        if(lineStart == ((char *)message + messageLen))
-          ev += "\r\n";
-      }
-    } while(lineStart < ((char *)message + messageLen));
+    const char *line = message;
+    for(;;){
+      const size_t len = strcspn(line, "\r\n");
+      pos = eventPut(buf, pos, "data: ", 6);
+      pos = eventPut(buf, pos, line, len);
+      pos = eventPut(buf, pos, "\r\n", 2);
+      line += len;
+      if(line[0] == '\r' && line[1] == '\n')
+        line++;
+      if(*line == 0 || *++line == 0)
+        break;
+    }
+  }
+  return eventPut(buf, pos, "\r\n", 2);
+}
+
+//FNV-1a of the event name: events coalesce by name. 0 is kept for "no key"
+static uint32_t eventKey(const char *event){
+  if(event == NULL)
+    return 0;
+  uint32_t h = 2166136261u;
+  while(*event){
+    h ^= (uint8_t)*event++;
+    h *= 16777619u;
   }
+  return h ? h : 1;
+}
 
+static AsyncWebLock &_eventLock(){
+  static AsyncWebLock lock;
+  return lock;
+}
+
+// Event
+
+AsyncEventSourceEvent * AsyncEventSourceEvent::create(const char *message, const char *event, uint32_t id, uint32_t reconnect){
+  const size_t len = encodeEvent(NULL, message, event, id, reconnect);
+  void * mem = malloc(sizeof(AsyncEventSourceEvent) + len + 1);
+  if(mem == NULL)
+    return NULL;
+  AsyncEventSourceEvent * ev = new (mem) AsyncEventSourceEvent(len, id, eventKey(event));
+  char * buf = (char *)(ev + 1);
+  encodeEvent(buf, message, event, id, reconnect);
+  buf[len] = 0;
   return ev;
 }
 
-// Message
+AsyncEventSourceEvent * AsyncEventSourceEvent::raw(const char *data, size_t len, uint32_t key){
+  void * mem = malloc(sizeof(AsyncEventSourceEvent) + len + 1);
+  if(mem == NULL)
+    return NULL;
+  AsyncEventSourceEvent * ev = new (mem) AsyncEventSourceEvent(len, 0, key);
+  char * buf = (char *)(ev + 1);
+  memcpy(buf, data, len);
+  buf[len] = 0;
+  return ev;
+}
 
-AsyncEventSourceMessage::AsyncEventSourceMessage(const char * data, size_t len)
-: _data(nullptr), _len(len), _sent(0), _acked(0)
-{
-  _data = (uint8_t*)malloc(_len+1);
-  if(_data == nullptr){
-    _len = 0;
-  } else {
-    memcpy(_data, data, len);
-    _data[_len] = 0;
-  }
+void AsyncEventSourceEvent::retain(){
+  AsyncWebLockGuard l(_eventLock());
+  _refs++;
 }
 
-AsyncEventSourceMessage::~AsyncEventSourceMessage() {
-     if(_data != NULL)
-        free(_data);
+void AsyncEventSourceEvent::release(){
+  {
+    AsyncWebLockGuard l(_eventLock());
+    if(--_refs)
+      return;
+  }
+  this->~AsyncEventSourceEvent();
+  free(this);
 }
 
+// Message
+
 size_t AsyncEventSourceMessage::ack(size_t len, uint32_t time) {
   (void)time;
+  const size_t total = _event->length();
   // If the whole message is now acked...
-  if(_acked + len > _len){
+  if(_acked + len > total){
      // Return the number of extra bytes acked (they will be carried on to the next message)
-     const size_t extra = _acked + len - _len;
-     _acked = _len;
+     const size_t extra = _acked + len - total;
+     _acked = total;
      return extra;
   }
   // Return that no extra bytes left.
@@ -137,12 +138,23 @@ size_t AsyncEventSourceMessage::ack(size_t len, uint32_t time) {
   return 0;
 }
 
+//the event goes to the TCP stack by reference, so every client sends from the same buffer.
+//The stack holds a reference of its own until the peer has acked it
 size_t AsyncEventSourceMessage::send(AsyncClient *client) {
-  const size_t len = _len - _sent;
+  const size_t len = _event->length() - _sent;
   if(client->space() < len){
     return 0;
   }
-  size_t sent = client->add((const char *)_data, len);
+  _event->retain();
+  size_t sent = client->addRef(_event->data() + _sent, len, [](void *arg, const char *data, size_t len){
+    (void)data;
+    (void)len;
+    ((AsyncEventSourceEvent *)arg)->release();
+  }, _event);
+  if(sent == 0){
+    _event->release();
+    return 0;
+  }
   if(client->canSend())
     client->send();
   _sent += sent;
@@ -152,13 +164,15 @@ size_t AsyncEventSourceMessage::send(AsyncClient *client) {
 // Client
 
 AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, AsyncEventSource *server)
-: _messageQueue(LinkedList<AsyncEventSourceMessage *>([](AsyncEventSourceMessage *m){ delete  m; }))
 {
   _client = request->client();
   _server = server;
   _lastId = 0;
+  _queuePolicy = _server->queuePolicy();
+  _dropped = 0;
+  _coalesced = 0;
   if(request->hasHeader("Last-Event-ID"))
-    _lastId = atoi(request->getHeader("Last-Event-ID")->value().c_str());
+    _lastId = strtoul(request->getHeader("Last-Event-ID")->value().c_str(), NULL, 10);
     
   _client->setRxTimeout(0);
   _client->onError(NULL, NULL);
@@ -173,38 +187,59 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
 }
 
 AsyncEventSourceClient::~AsyncEventSourceClient(){
-   _messageQueue.free();
+  while(!_messageQueue.isEmpty())
+    _messageQueue.pop().event()->release();
   close();
 }
 
-void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage){
-  if(dataMessage == NULL)
-    return;
-  if(!connected()){
-    delete dataMessage;
+//events that went out in part or whole stay in the queue, the ones behind them make room by the policy
+void AsyncEventSourceClient::_queueEvent(AsyncEventSourceEvent *event){
+  if(event == NULL || !connected())
     return;
+  AsyncWebLockGuard l(_lock);
+  event->retain();
+  if(_queuePolicy == QUEUE_COALESCE && event->key()){
+    for(size_t i = 0; i < _messageQueue.length(); i++){
+      AsyncEventSourceMessage &m = _messageQueue[i];
+      if(m.key() == event->key() && !m.started()){
+        m.event()->release();
+        m = AsyncEventSourceMessage(event);
+        _coalesced++;
+        event = NULL;
+        break;
+      }
+    }
   }
-  if(_messageQueue.length() >= SSE_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
-      delete dataMessage;
-  } else {
-      _messageQueue.add(dataMessage);
+  if(event != NULL && _messageQueue.isFull() && _queuePolicy != QUEUE_DROP_NEWEST){
+    for(size_t i = 0; i < _messageQueue.length(); i++){
+      if(!_messageQueue[i].started()){
+        _messageQueue.removeAt(i).event()->release();
+        _dropped++;
+        break;
+      }
+    }
+  }
+  if(event != NULL && !_messageQueue.push(AsyncEventSourceMessage(event))){
+    event->release();
+    _dropped++;
   }
   if(_client->canSend())
     _runQueue();
 }
 
 void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
+  AsyncWebLockGuard l(_lock);
   while(len && !_messageQueue.isEmpty()){
-    len = _messageQueue.front()->ack(len, time);
-    if(_messageQueue.front()->finished())
-      _messageQueue.remove(_messageQueue.front());
+    len = _messageQueue.front().ack(len, time);
+    if(_messageQueue.front().finished())
+      _messageQueue.pop().event()->release();
   }
 
   _runQueue();
 }
 
 void AsyncEventSourceClient::_onPoll(){
+  AsyncWebLockGuard l(_lock);
   if(!_messageQueue.isEmpty()){
     _runQueue();
   }
@@ -225,24 +260,35 @@ void AsyncEventSourceClient::close(){
     _client->close();
 }
 
-void AsyncEventSourceClient::write(const char * message, size_t len){
-  _queueMessage(new AsyncEventSourceMessage(message, len));
+void AsyncEventSourceClient::write(const char * message, size_t len, uint32_t key){
+  AsyncEventSourceEvent *ev = AsyncEventSourceEvent::raw(message, len, key);
+  if(ev == NULL)
+    return;
+  _queueEvent(ev);
+  ev->release();
 }
 
 void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
-  String ev = generateEventMessage(message, event, id, reconnect);
-  _queueMessage(new AsyncEventSourceMessage(ev.c_str(), ev.length()));
+  AsyncEventSourceEvent *ev = AsyncEventSourceEvent::create(message, event, id, reconnect);
+  if(ev == NULL)
+    return;
+  _queueEvent(ev);
+  ev->release();
 }
 
+//under _lock. Events go out whole and in order: one that does not fit yet holds back the rest
 void AsyncEventSourceClient::_runQueue(){
-  while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
+  while(!_messageQueue.isEmpty() && _messageQueue.front().finished()){
+    _messageQueue.pop().event()->release();
   }
 
-  for(auto i = _messageQueue.begin(); i != _messageQueue.end(); ++i)
-  {
-    if(!(*i)->sent())
-      (*i)->send(_client);
+  for(size_t i = 0; i < _messageQueue.length(); i++){
+    AsyncEventSourceMessage &m = _messageQueue[i];
+    if(m.sent())
+      continue;
+    m.send(_client);
+    if(!m.sent())
+      break;
   }
 }
 
@@ -253,16 +299,34 @@ AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
   , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
   , _connectcb(NULL)
+  , _queuePolicy(QUEUE_DROP_NEWEST)
+  , _replayMax(SSE_REPLAY_EVENTS)
 {}
 
 AsyncEventSource::~AsyncEventSource(){
   close();
+  while(!_replay.isEmpty())
+    _replay.pop()->release();
 }
 
 void AsyncEventSource::onConnect(ArEventHandlerFunction cb){
   _connectcb = cb;
 }
 
+void AsyncEventSource::setQueuePolicy(AsyncQueuePolicy policy){
+  AsyncWebLockGuard l(_lock);
+  _queuePolicy = policy;
+  for(const auto &c: _clients)
+    c->setQueuePolicy(policy);
+}
+
+void AsyncEventSource::setReplay(size_t events){
+  AsyncWebLockGuard l(_lock);
+  _replayMax = events < SSE_REPLAY_EVENTS ? events : SSE_REPLAY_EVENTS;
+  while(_replay.length() > _replayMax)
+    _replay.pop()->release();
+}
+
 void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
   /*char * temp = (char *)malloc(2054);
   if(temp != NULL){
@@ -277,16 +341,28 @@ void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
     free(temp);
   }*/
   
-  _clients.add(client);
+  {
+    AsyncWebLockGuard l(_lock);
+    _clients.add(client);
+    //what it missed, before anything sent from now on
+    if(client->lastId()){
+      for(size_t i = 0; i < _replay.length(); i++){
+        if(_replay[i]->id() > client->lastId())
+          client->_queueEvent(_replay[i]);
+      }
+    }
+  }
   if(_connectcb)
     _connectcb(client);
 }
 
 void AsyncEventSource::_handleDisconnect(AsyncEventSourceClient * client){
+  AsyncWebLockGuard l(_lock);
   _clients.remove(client);
 }
 
 void AsyncEventSource::close(){
+  AsyncWebLockGuard l(_lock);
   for(const auto &c: _clients){
     if(c->connected())
       c->close();
@@ -295,6 +371,7 @@ void AsyncEventSource::close(){
 
 // pmb fix
 size_t AsyncEventSource::avgPacketsWaiting() const {
+  AsyncWebLockGuard l(_lock);
   if(_clients.isEmpty())
     return 0;
   
@@ -307,22 +384,36 @@ size_t AsyncEventSource::avgPacketsWaiting() const {
       ++nConnectedClients;
     }
   }
+  if(nConnectedClients == 0)
+    return 0;
 //  return aql / nConnectedClients;
   return ((aql) + (nConnectedClients/2))/(nConnectedClients); // round up
 }
 
+//encoded once; the clients and the replay ring all hold the same buffer
 void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
-
-
-  String ev = generateEventMessage(message, event, id, reconnect);
-  for(const auto &c: _clients){
-    if(c->connected()) {
-      c->write(ev.c_str(), ev.length());
+  AsyncEventSourceEvent *ev = AsyncEventSourceEvent::create(message, event, id, reconnect);
+  if(ev == NULL)
+    return;
+  {
+    AsyncWebLockGuard l(_lock);
+    if(id && _replayMax){
+      if(_replay.length() >= _replayMax)
+        _replay.pop()->release();
+      ev->retain();
+      _replay.push(ev);
+    }
+    for(const auto &c: _clients){
+      if(c->connected()) {
+        c->_queueEvent(ev);
+      }
     }
   }
+  ev->release();
 }
 
 size_t AsyncEventSource::count() const {
+  AsyncWebLockGuard l(_lock);
   return _clients.count_if([](AsyncEventSourceClient *c){
     return c->connected();
   });
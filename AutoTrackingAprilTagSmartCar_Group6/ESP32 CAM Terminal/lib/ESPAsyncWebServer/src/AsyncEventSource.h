@@ -21,13 +21,17 @@
 #define ASYNCEVENTSOURCE_H_
 
 #include <Arduino.h>
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
 #include <AsyncTCP.h>
-#define SSE_MAX_QUEUED_MESSAGES 32
+#ifndef SSE_MAX_QUEUED_MESSAGES
+#define SSE_MAX_QUEUED_MESSAGES 32 //slots in each client's message queue
+#endif
 #else
 #include <ESPAsyncTCP.h>
+#ifndef SSE_MAX_QUEUED_MESSAGES
 #define SSE_MAX_QUEUED_MESSAGES 8
 #endif
+#endif
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
@@ -39,31 +43,62 @@
 #endif
 #endif
 
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
 #define DEFAULT_MAX_SSE_CLIENTS 8
 #else
 #define DEFAULT_MAX_SSE_CLIENTS 4
 #endif
 
+#ifndef SSE_REPLAY_EVENTS
+#define SSE_REPLAY_EVENTS 16 //latest events with an id kept for clients that reconnect with Last-Event-ID
+#endif
+
 class AsyncEventSource;
 class AsyncEventSourceResponse;
 class AsyncEventSourceClient;
 typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
 
-class AsyncEventSourceMessage {
+/*
+ * SHARED EVENTS :: send() encodes an event once, in one allocation with its reference count in front.
+ * Every client queues a reference to it, and the server keeps the latest ones that have an id for
+ * clients that come back with Last-Event-ID. It is freed when the last of them lets go.
+ * */
+
+class AsyncEventSourceEvent {
   private:
-    uint8_t * _data; 
+    uint32_t _refs;
     size_t _len;
+    uint32_t _id;
+    uint32_t _key; //the event name hashed, for QUEUE_COALESCE. 0 for none
+    AsyncEventSourceEvent(size_t len, uint32_t id, uint32_t key): _refs(1), _len(len), _id(id), _key(key) {}
+  public:
+    //one reference, NULL if out of memory
+    static AsyncEventSourceEvent * create(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
+    static AsyncEventSourceEvent * raw(const char *data, size_t len, uint32_t key=0); //already encoded
+    void retain();
+    void release();
+    const char * data() const { return (const char *)(this + 1); }
+    size_t length() const { return _len; }
+    uint32_t id() const { return _id; }
+    uint32_t key() const { return _key; }
+};
+
+//a client's progress through one event, kept by value in its queue
+class AsyncEventSourceMessage {
+  private:
+    AsyncEventSourceEvent * _event;
     size_t _sent;
-    //size_t _ack;
     size_t _acked; 
   public:
-    AsyncEventSourceMessage(const char * data, size_t len);
-    ~AsyncEventSourceMessage();
+    AsyncEventSourceMessage(): _event(NULL), _sent(0), _acked(0) {}
+    AsyncEventSourceMessage(AsyncEventSourceEvent * event): _event(event), _sent(0), _acked(0) {}
+    AsyncEventSourceEvent * event() const { return _event; }
     size_t ack(size_t len, uint32_t time __attribute__((unused)));
     size_t send(AsyncClient *client);
-    bool finished(){ return _acked == _len; }
-    bool sent() { return _sent == _len; }
+    bool finished() const { return _acked == _event->length(); }
+    bool sent() const { return _sent == _event->length(); }
+    bool started() const { return _sent != 0; }
+    uint32_t key() const { return _event->key(); }
 };
 
 class AsyncEventSourceClient {
@@ -71,8 +106,11 @@ class AsyncEventSourceClient {
     AsyncClient *_client;
     AsyncEventSource *_server;
     uint32_t _lastId;
-    LinkedList<AsyncEventSourceMessage *> _messageQueue;
-    void _queueMessage(AsyncEventSourceMessage *dataMessage);
+    RingQueue<AsyncEventSourceMessage, SSE_MAX_QUEUED_MESSAGES> _messageQueue;
+    AsyncWebLock _lock; //the queue is filled from the sketch and drained from async_tcp
+    AsyncQueuePolicy _queuePolicy;
+    uint32_t _dropped;
+    uint32_t _coalesced;
     void _runQueue();
 
   public:
@@ -82,17 +120,24 @@ class AsyncEventSourceClient {
 
     AsyncClient* client(){ return _client; }
     void close();
-    void write(const char * message, size_t len);
+    void write(const char * message, size_t len, uint32_t key=0);
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     bool connected() const { return (_client != NULL) && _client->connected(); }
     uint32_t lastId() const { return _lastId; }
     size_t  packetsWaiting() const { return _messageQueue.length(); }
+    //what happens to events once SSE_MAX_QUEUED_MESSAGES are waiting (QUEUE_DROP_NEWEST by default).
+    //QUEUE_COALESCE replaces a waiting event with a newer one of the same event name
+    void setQueuePolicy(AsyncQueuePolicy policy){ _queuePolicy = policy; }
+    AsyncQueuePolicy queuePolicy() const { return _queuePolicy; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t coalesced() const { return _coalesced; }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
     void _onPoll(); 
     void _onTimeout(uint32_t time);
     void _onDisconnect();
+    void _queueEvent(AsyncEventSourceEvent *event); //takes a reference of its own
 };
 
 class AsyncEventSource: public AsyncWebHandler {
@@ -100,6 +145,10 @@ class AsyncEventSource: public AsyncWebHandler {
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
     ArEventHandlerFunction _connectcb;
+    AsyncQueuePolicy _queuePolicy;
+    AsyncWebLock _lock; //_clients and _replay: clients come and go on async_tcp, events come from the sketch
+    RingQueue<AsyncEventSourceEvent *, SSE_REPLAY_EVENTS> _replay;
+    size_t _replayMax;
   public:
     AsyncEventSource(const String& url);
     ~AsyncEventSource();
@@ -110,6 +159,12 @@ class AsyncEventSource: public AsyncWebHandler {
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     size_t count() const; //number clinets connected
     size_t  avgPacketsWaiting() const;
+    //queue policy of every client, the ones connected now and later
+    void setQueuePolicy(AsyncQueuePolicy policy);
+    AsyncQueuePolicy queuePolicy() const { return _queuePolicy; }
+    //how many of the latest events with an id are kept, up to SSE_REPLAY_EVENTS (default). A client that
+    //connects with Last-Event-ID gets the kept ones with a higher id first. 0 keeps none
+    void setReplay(size_t events);
 
     //system callbacks (do not call)
     void _addClient(AsyncEventSourceClient * client);
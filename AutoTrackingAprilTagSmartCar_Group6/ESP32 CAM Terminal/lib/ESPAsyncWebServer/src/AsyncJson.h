@@ -13,7 +13,7 @@
     JsonObject& nested = root.createNestedObject("nested");
     nested["key1"] = "key number one";
 
-    response->setLength();
+    response->setLength(); //ArduinoJson 5 needs it. With 6 it only adds a Content-Length, without it the response is chunked
     request->send(response);
   });
 
@@ -37,6 +37,10 @@
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <Print.h>
+#include <vector>
+#include <errno.h>
+#include <new>
+#include "AsyncJsonParser.h"
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
   #define ARDUINOJSON_5_COMPATIBILITY
@@ -79,6 +83,212 @@ class ChunkPrint : public Print {
     }
 };
 
+#ifndef ARDUINOJSON_5_COMPATIBILITY
+
+/*
+ * JSON CURSOR :: Serializes a document a buffer at a time and keeps its place in between, so every
+ * byte is produced once however many acks it takes. It writes what serializeJson() and
+ * serializeJsonPretty() would: containers are walked with a stack of iterators, strings are escaped
+ * as they go out, numbers and the like are small and go through ArduinoJson itself. What does not
+ * fit in one buffer waits in _spill for the next.
+ * */
+
+class JsonCursor {
+  private:
+    enum State { JSON_VALUE, JSON_ITEM, JSON_STRING, JSON_NEXT, JSON_DONE };
+    struct Frame {
+      bool object;
+      JsonObject::iterator member;
+      JsonArray::iterator element;
+    };
+    std::vector<Frame> _stack;
+    std::vector<uint8_t> _spill;
+    size_t _spillPos;
+    JsonVariant _value; //for JSON_VALUE
+    const char* _str;   //for JSON_STRING, up to the next character to escape
+    bool _strIsKey;
+    bool _pretty;
+    State _state;
+    uint8_t* _out;
+    size_t _pos;
+    size_t _len;
+
+    void _emit(const char* data, size_t len){
+      const size_t n = (_len - _pos < len) ? _len - _pos : len;
+      memcpy(_out + _pos, data, n);
+      _pos += n;
+      if(n < len)
+        _spill.insert(_spill.end(), (const uint8_t*)data + n, (const uint8_t*)data + len);
+    }
+    void _emit(const char* data){ _emit(data, strlen(data)); }
+    void _newline(){
+      if(!_pretty)
+        return;
+      _emit("\r\n", 2);
+      for(size_t i = 0; i < _stack.size(); i++)
+        _emit(ARDUINOJSON_TAB);
+    }
+    //one value, in whole unless it is an object, an array or a string
+    void _beginValue(JsonVariant v){
+      if(v.is<JsonObject>()){
+        JsonObject o = v.as<JsonObject>();
+        if(o.begin() == o.end()){
+          _emit("{}", 2);
+          _state = JSON_NEXT;
+          return;
+        }
+        _emit("{", 1);
+        _stack.push_back(Frame{true, o.begin(), JsonArray::iterator()});
+        _state = JSON_ITEM;
+      } else if(v.is<JsonArray>()){
+        JsonArray a = v.as<JsonArray>();
+        if(a.begin() == a.end()){
+          _emit("[]", 2);
+          _state = JSON_NEXT;
+          return;
+        }
+        _emit("[", 1);
+        _stack.push_back(Frame{false, JsonObject::iterator(), a.begin()});
+        _state = JSON_ITEM;
+      } else if(v.is<const char*>() && v.as<const char*>() != NULL){
+        _emit("\"", 1);
+        _str = v.as<const char*>();
+        _strIsKey = false;
+        _state = JSON_STRING;
+      } else {
+        const size_t len = measureJson(v);
+        const size_t room = _len - _pos;
+        ChunkPrint dest(_out + _pos, 0, room);
+        serializeJson(v, dest);
+        if(len > room){
+          _spill.resize(_spill.size() + len - room);
+          ChunkPrint rest(_spill.data() + _spill.size() - (len - room), room, len - room);
+          serializeJson(v, rest);
+          _pos = _len;
+        } else {
+          _pos += len;
+        }
+        _state = JSON_NEXT;
+      }
+    }
+    void _item(){
+      _newline();
+      Frame &f = _stack.back();
+      if(f.object){
+        _str = (*f.member).key().c_str();
+        if(_str == NULL){ //a key that did not fit in the document
+          _emit("null");
+          _key();
+          return;
+        }
+        _emit("\"", 1);
+        _strIsKey = true;
+        _state = JSON_STRING;
+      } else {
+        _value = *f.element;
+        _state = JSON_VALUE;
+      }
+    }
+    static char _escape(char c){
+      switch(c){
+        case '"': return '"';
+        case '\\': return '\\';
+        case '\b': return 'b';
+        case '\f': return 'f';
+        case '\n': return 'n';
+        case '\r': return 'r';
+        case '\t': return 't';
+        default: return 0;
+      }
+    }
+    //escaped like ArduinoJson does, stopping once the buffer is full
+    void _string(){
+      while(*_str && _pos < _len){
+        const char c = *_str++;
+        const char e = _escape(c);
+        if(e){
+          const char esc[2] = { '\\', e };
+          _emit(esc, 2);
+        } else {
+          _out[_pos++] = c;
+        }
+      }
+      if(*_str)
+        return;
+      _emit("\"", 1);
+      if(_strIsKey)
+        _key();
+      else
+        _state = JSON_NEXT;
+    }
+    void _key(){
+      _emit(_pretty ? ": " : ":");
+      _value = (*_stack.back().member).value();
+      _state = JSON_VALUE;
+    }
+    //the value just written was the last of its container, or the one before a comma
+    void _next(){
+      if(_stack.empty()){
+        _state = JSON_DONE;
+        return;
+      }
+      Frame &f = _stack.back();
+      const bool more = f.object ? (++f.member != JsonObject::iterator()) : (++f.element != JsonArray::iterator());
+      if(more){
+        _emit(",", 1);
+        _state = JSON_ITEM;
+        return;
+      }
+      const bool object = f.object;
+      _stack.pop_back();
+      _newline();
+      _emit(object ? "}" : "]", 1);
+    }
+
+  public:
+    JsonCursor(): _spillPos(0), _str(NULL), _strIsKey(false), _pretty(false), _state(JSON_DONE), _out(NULL), _pos(0), _len(0) {}
+    void begin(JsonVariant root, bool pretty){
+      _stack.clear();
+      _spill.clear();
+      _spillPos = 0;
+      _value = root;
+      _pretty = pretty;
+      _state = JSON_VALUE;
+    }
+    //the next bytes of the document, up to len. 0 once it is all out
+    size_t fill(uint8_t* data, size_t len){
+      _out = data;
+      _len = len;
+      _pos = 0;
+      if(!_spill.empty()){
+        _pos = (_spill.size() - _spillPos < len) ? _spill.size() - _spillPos : len;
+        memcpy(data, _spill.data() + _spillPos, _pos);
+        _spillPos += _pos;
+        if(_spillPos == _spill.size()){
+          _spill.clear();
+          _spillPos = 0;
+        }
+      }
+      while(_pos < _len && _spill.empty() && _state != JSON_DONE){
+        switch(_state){
+          case JSON_VALUE: _beginValue(_value); break;
+          case JSON_ITEM: _item(); break;
+          case JSON_STRING: _string(); break;
+          default: _next(); break;
+        }
+      }
+      return _pos;
+    }
+};
+
+#endif
+
+/*
+ * With ArduinoJson 6 the response is sent with chunked transfer encoding straight from a JsonCursor,
+ * one pass over the document. setLength() is still there for a Content-Length: it measures the
+ * document once more but the content is sent the same way.
+ * */
+
 class AsyncJsonResponse: public AsyncAbstractResponse {
   protected:
 
@@ -86,6 +296,7 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
     DynamicJsonBuffer _jsonBuffer;
 #else
     DynamicJsonDocument _jsonBuffer;
+    JsonCursor _cursor;
 #endif
 
     JsonVariant _root;
@@ -103,13 +314,17 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
         _root = _jsonBuffer.createObject();
     }
 #else
-    AsyncJsonResponse(bool isArray=false, size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE) : _jsonBuffer(maxJsonBufferSize), _isValid{false} {
+    AsyncJsonResponse(bool isArray=false, size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE) : _jsonBuffer(maxJsonBufferSize), _isValid{true} {
       _code = 200;
       _contentType = JSON_MIMETYPE;
+      _contentLength = 0;
+      _sendContentLength = false;
+      _chunked = true;
       if(isArray)
         _root = _jsonBuffer.createNestedArray();
       else
         _root = _jsonBuffer.createNestedObject();
+      _cursor.begin(_root, false);
     }
 #endif
 
@@ -122,6 +337,8 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
       _contentLength = _root.measureLength();
 #else
       _contentLength = measureJson(_root);
+      _sendContentLength = true;
+      _chunked = false;
 #endif
 
       if (_contentLength) { _isValid = true; }
@@ -131,14 +348,13 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
    size_t getSize() { return _jsonBuffer.size(); }
 
     size_t _fillBuffer(uint8_t *data, size_t len){
-      ChunkPrint dest(data, _sentLength, len);
-
 #ifdef ARDUINOJSON_5_COMPATIBILITY      
+      ChunkPrint dest(data, _sentLength, len);
       _root.printTo( dest ) ;
+      return len;
 #else
-      serializeJson(_root, dest);
+      return _cursor.fill(data, len);
 #endif
-      return len;
     }
 };
 
@@ -147,28 +363,156 @@ public:
 #ifdef ARDUINOJSON_5_COMPATIBILITY
 	PrettyAsyncJsonResponse (bool isArray=false) : AsyncJsonResponse{isArray} {}
 #else
-	PrettyAsyncJsonResponse (bool isArray=false, size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE) : AsyncJsonResponse{isArray, maxJsonBufferSize} {}
+	PrettyAsyncJsonResponse (bool isArray=false, size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE) : AsyncJsonResponse{isArray, maxJsonBufferSize} {
+		_cursor.begin(_root, true);
+	}
 #endif
 	size_t setLength () {
 #ifdef ARDUINOJSON_5_COMPATIBILITY
 		_contentLength = _root.measurePrettyLength ();
 #else
 		_contentLength = measureJsonPretty(_root);
+		_sendContentLength = true;
+		_chunked = false;
 #endif
 		if (_contentLength) {_isValid = true;}
 		return _contentLength;
 	}
+#ifdef ARDUINOJSON_5_COMPATIBILITY
 	size_t _fillBuffer (uint8_t *data, size_t len) {
 		ChunkPrint dest (data, _sentLength, len);
-#ifdef ARDUINOJSON_5_COMPATIBILITY
 		_root.prettyPrintTo (dest);
-#else
-		serializeJsonPretty(_root, dest);
-#endif
 		return len;
 	}
+#endif
 };
 
+/*
+ * Json Request
+ * */
+
+#ifndef ARDUINOJSON_5_COMPATIBILITY
+
+#ifndef ASYNC_JSON_MAX_TOKEN
+#define ASYNC_JSON_MAX_TOKEN 512 //longest key plus string or number value a JSON body may have
+#endif
+
+//a document over memory it is given, so that it needs no destructor
+class AsyncJsonBodyDocument: public JsonDocument {
+  public:
+    AsyncJsonBodyDocument(char *buf, size_t capa): JsonDocument(buf, capa) {}
+};
+
+/*
+ * JSON BODY :: A request body parsed into a document as it arrives, one chunk at a time, so the raw
+ * body is never kept. The parser, its token buffer and the document's memory are one malloc, which
+ * fits in request->_tempObject and goes away with the request's free().
+ * */
+
+class AsyncJsonBody {
+  private:
+    AsyncJsonParser _parser;
+    AsyncJsonBodyDocument _doc;
+    JsonVariant _stack[ASYNC_JSON_MAX_DEPTH]; //the open containers
+    uint8_t _skip; //1 + the depth of a container under a repeated key, whose tokens are dropped; 0: none
+    bool _noMemory;
+
+    AsyncJsonBody(char *token, char *pool, size_t capacity)
+      : _parser(token, ASYNC_JSON_MAX_TOKEN), _doc(pool, capacity), _skip(0), _noMemory(false) {}
+
+    //the slot the value just parsed goes to
+    JsonVariant _slot(){
+      const uint8_t depth = _parser.depth();
+      if(depth == 0)
+        return _doc.to<JsonVariant>();
+      JsonVariant parent = _stack[depth - 1];
+      if(_parser.key() != NULL)
+        return parent.as<JsonObject>().getOrAddMember((char *)_parser.key());
+      return parent.as<JsonArray>().addElement();
+    }
+    //a key the object already has: its first value stays, which is the one deserializeJson() finds
+    bool _repeated(){
+      const uint8_t depth = _parser.depth();
+      return depth && _parser.key() != NULL && _stack[depth - 1].as<JsonObject>().containsKey((char *)_parser.key());
+    }
+    void _token(AsyncJsonToken t){
+      if(_noMemory)
+        return;
+      if(_skip){
+        if((t == JSON_OBJECT_END || t == JSON_ARRAY_END) && _parser.depth() == _skip - 1)
+          _skip = 0;
+        return;
+      }
+      if(t == JSON_OBJECT_END || t == JSON_ARRAY_END)
+        return;
+      if(_repeated()){
+        if(t == JSON_OBJECT_BEGIN || t == JSON_ARRAY_BEGIN)
+          _skip = _parser.depth() + 1;
+        return;
+      }
+      JsonVariant slot = _slot();
+      bool ok = true;
+      switch(t){
+        case JSON_OBJECT_BEGIN:
+          _stack[_parser.depth()] = slot;
+          ok = !slot.to<JsonObject>().isNull();
+          break;
+        case JSON_ARRAY_BEGIN:
+          _stack[_parser.depth()] = slot;
+          ok = !slot.to<JsonArray>().isNull();
+          break;
+        case JSON_STRING:
+          ok = slot.set((char *)_parser.value());
+          break;
+        case JSON_NUMBER: {
+          const char *v = _parser.value();
+          if(strpbrk(v, ".eE") == NULL){
+            errno = 0;
+            const long long n = strtoll(v, NULL, 10);
+            if(errno != ERANGE){
+              ok = slot.set(n);
+              break;
+            }
+          }
+          ok = slot.set(strtod(v, NULL));
+          break;
+        }
+        case JSON_TRUE:
+        case JSON_FALSE:
+          ok = slot.set(t == JSON_TRUE);
+          break;
+        default:
+          break;
+      }
+      if(!ok)
+        _noMemory = true;
+    }
+
+  public:
+    //capacity as for a DynamicJsonDocument. NULL if out of memory
+    static AsyncJsonBody * create(size_t capacity){
+      const size_t token = (ASYNC_JSON_MAX_TOKEN + 7) & ~(size_t)7;
+      void *mem = malloc(sizeof(AsyncJsonBody) + token + capacity);
+      if(mem == NULL)
+        return NULL;
+      char *buf = (char *)mem + sizeof(AsyncJsonBody);
+      return new (mem) AsyncJsonBody(buf, buf + token, capacity);
+    }
+    //final: this is the body's last chunk
+    void feed(const uint8_t *data, size_t len, bool final){
+      AsyncJsonToken t;
+      while((t = _parser.next(data, len)) != JSON_NEED_MORE)
+        _token(t);
+      if(final && (t = _parser.finish()) != JSON_NEED_MORE)
+        _token(t);
+    }
+    //the whole body was JSON and all of it is in the document
+    bool ok() const { return _parser.done() && _parser.error() == JSON_OK && !_noMemory; }
+    JsonVariant root(){ return _doc.as<JsonVariant>(); }
+};
+
+#endif
+
 typedef std::function<void(AsyncWebServerRequest *request, JsonVariant &json)> ArJsonRequestHandlerFunction;
 
 class AsyncCallbackJsonWebHandler: public AsyncWebHandler {
@@ -221,10 +565,9 @@ public:
         JsonVariant json = jsonBuffer.parse((uint8_t*)(request->_tempObject));
         if (json.success()) {
 #else
-        DynamicJsonDocument jsonBuffer(this->maxJsonBufferSize);
-        DeserializationError error = deserializeJson(jsonBuffer, (uint8_t*)(request->_tempObject));
-        if(!error) {
-          JsonVariant json = jsonBuffer.as<JsonVariant>();
+        AsyncJsonBody *body = (AsyncJsonBody*)(request->_tempObject);
+        if(body->ok()) {
+          JsonVariant json = body->root();
 #endif
 
           _onRequest(request, json);
@@ -241,12 +584,22 @@ public:
   virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override final {
     if (_onRequest) {
       _contentLength = total;
+#ifdef ARDUINOJSON_5_COMPATIBILITY
       if (total > 0 && request->_tempObject == NULL && total < _maxContentLength) {
         request->_tempObject = malloc(total);
       }
       if (request->_tempObject != NULL) {
         memcpy((uint8_t*)(request->_tempObject) + index, data, len);
       }
+#else
+      //parsed as it comes, the body itself is not kept
+      if (total > 0 && request->_tempObject == NULL && total < _maxContentLength) {
+        request->_tempObject = AsyncJsonBody::create(this->maxJsonBufferSize);
+      }
+      if (request->_tempObject != NULL) {
+        ((AsyncJsonBody*)(request->_tempObject))->feed(data, len, index + len == total);
+      }
+#endif
     }
   }
   virtual bool isRequestHandlerTrivial() override final {return _onRequest ? false : true;}
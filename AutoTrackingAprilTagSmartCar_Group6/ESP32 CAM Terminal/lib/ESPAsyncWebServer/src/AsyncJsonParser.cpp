@@ -0,0 +1,340 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "AsyncJsonParser.h"
+#include <stdlib.h>
+
+#if ASYNC_JSON_MAX_DEPTH > 32
+#error "ASYNC_JSON_MAX_DEPTH is at most 32"
+#endif
+
+enum { EXPECT_VALUE, EXPECT_FIRST_VALUE, EXPECT_KEY, EXPECT_FIRST_KEY, EXPECT_COLON, EXPECT_COMMA };
+enum { LEX_NONE, LEX_STRING, LEX_ESCAPE, LEX_UNICODE, LEX_NUMBER, LEX_LITERAL };
+
+static const char * const _literals[] = { "true", "false", "null" };
+
+static int8_t hexValue(char c){
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static bool isNumberChar(char c){
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+AsyncJsonParser::AsyncJsonParser(char *token, size_t size)
+  : _token(token)
+  , _size(size)
+  , _len(0)
+  , _keyLen(0)
+  , _valueStart(0)
+  , _objects(0)
+  , _depth(0)
+  , _tokenDepth(0)
+  , _expect(EXPECT_VALUE)
+  , _lex(LEX_NONE)
+  , _literal(0)
+  , _literalPos(0)
+  , _hex(0)
+  , _code(0)
+  , _high(0)
+  , _keyed(false)
+  , _tokenKeyed(false)
+  , _isKey(false)
+  , _done(false)
+  , _error(JSON_OK)
+{
+  if(_size)
+    _token[0] = 0;
+}
+
+const char *AsyncJsonParser::errorString() const {
+  switch(_error){
+    case JSON_OK: return "Ok";
+    case JSON_INVALID: return "InvalidInput";
+    case JSON_TOO_DEEP: return "TooDeep";
+    case JSON_TOO_LONG: return "TooLong";
+    default: return "IncompleteInput";
+  }
+}
+
+//one byte more, keeping room for the terminator
+bool AsyncJsonParser::_put(char c){
+  if(_len + 1 >= _size){
+    _fail(JSON_TOO_LONG);
+    return false;
+  }
+  _token[_len++] = c;
+  return true;
+}
+
+bool AsyncJsonParser::_putCode(uint32_t code){
+  if(code < 0x80)
+    return _put(code);
+  if(code < 0x800)
+    return _put(0xC0 | (code >> 6)) && _put(0x80 | (code & 0x3F));
+  if(code < 0x10000)
+    return _put(0xE0 | (code >> 12)) && _put(0x80 | ((code >> 6) & 0x3F)) && _put(0x80 | (code & 0x3F));
+  return _put(0xF0 | (code >> 18)) && _put(0x80 | ((code >> 12) & 0x3F)) && _put(0x80 | ((code >> 6) & 0x3F)) && _put(0x80 | (code & 0x3F));
+}
+
+AsyncJsonToken AsyncJsonParser::_fail(AsyncJsonError error){
+  if(_error == JSON_OK)
+    _error = error;
+  return JSON_NEED_MORE;
+}
+
+//a scalar is complete
+AsyncJsonToken AsyncJsonParser::_value(AsyncJsonToken token){
+  _tokenDepth = _depth;
+  _tokenKeyed = _keyed;
+  if(_depth == 0)
+    _done = true;
+  else
+    _expect = EXPECT_COMMA;
+  return token;
+}
+
+AsyncJsonToken AsyncJsonParser::_open(bool object){
+  if(_depth == ASYNC_JSON_MAX_DEPTH)
+    return _fail(JSON_TOO_DEEP);
+  _tokenDepth = _depth;
+  _tokenKeyed = _keyed;
+  if(object)
+    _objects |= 1UL << _depth;
+  else
+    _objects &= ~(1UL << _depth);
+  _depth++;
+  _expect = object ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE;
+  return object ? JSON_OBJECT_BEGIN : JSON_ARRAY_BEGIN;
+}
+
+AsyncJsonToken AsyncJsonParser::_close(bool object){
+  _depth--;
+  _keyed = false;
+  _value(JSON_NULL);
+  return object ? JSON_OBJECT_END : JSON_ARRAY_END;
+}
+
+//c is the first byte of a value
+AsyncJsonToken AsyncJsonParser::_beginValue(char c){
+  _keyed = _inObject();
+  _valueStart = _keyed ? _keyLen + 1 : 0;
+  _len = _valueStart;
+  switch(c){
+    case '{': return _open(true);
+    case '[': return _open(false);
+    case '"':
+      _lex = LEX_STRING;
+      _isKey = false;
+      return JSON_NEED_MORE;
+    case 't': _literal = 0; break;
+    case 'f': _literal = 1; break;
+    case 'n': _literal = 2; break;
+    default:
+      if(c == '-' || (c >= '0' && c <= '9')){
+        _lex = LEX_NUMBER;
+        _put(c);
+        return JSON_NEED_MORE;
+      }
+      return _fail(JSON_INVALID);
+  }
+  _lex = LEX_LITERAL;
+  _literalPos = 1;
+  return JSON_NEED_MORE;
+}
+
+AsyncJsonToken AsyncJsonParser::_endString(){
+  if(_high){
+    if(!_putCode(_high))
+      return JSON_NEED_MORE;
+    _high = 0;
+  }
+  _token[_len] = 0;
+  _lex = LEX_NONE;
+  if(_isKey){
+    _keyLen = _len;
+    _expect = EXPECT_COLON;
+    return JSON_NEED_MORE;
+  }
+  return _value(JSON_STRING);
+}
+
+AsyncJsonToken AsyncJsonParser::_endNumber(){
+  _token[_len] = 0;
+  _lex = LEX_NONE;
+  char *end;
+  strtod(value(), &end);
+  if(end != _token + _len)
+    return _fail(JSON_INVALID);
+  return _value(JSON_NUMBER);
+}
+
+AsyncJsonToken AsyncJsonParser::next(const uint8_t *&data, size_t &len){
+  while(len){
+    if(_error != JSON_OK || _done){
+      data += len;
+      len = 0;
+      break;
+    }
+    const char c = *data;
+    if(_lex == LEX_NUMBER){
+      if(isNumberChar(c)){
+        data++;
+        len--;
+        _put(c);
+        continue;
+      }
+      //the byte after a number is read again as what follows it
+      AsyncJsonToken t = _endNumber();
+      if(t != JSON_NEED_MORE)
+        return t;
+      continue;
+    }
+    data++;
+    len--;
+    AsyncJsonToken t = JSON_NEED_MORE;
+    switch(_lex){
+      case LEX_STRING:
+        if(c == '"')
+          t = _endString();
+        else if(c == '\\')
+          _lex = LEX_ESCAPE;
+        else if((uint8_t)c < 0x20) //control characters are escaped in JSON, and a NUL would cut the value short
+          _fail(JSON_INVALID);
+        else if(!_high || _putCode(_high)){
+          _high = 0;
+          _put(c);
+        }
+        break;
+      case LEX_ESCAPE: {
+        const char *esc = "\"\"\\\\//b\bf\fn\nr\rt\t";
+        while(*esc && *esc != c)
+          esc += 2;
+        _lex = LEX_STRING;
+        if(c == 'u'){
+          _lex = LEX_UNICODE;
+          _hex = 0;
+          _code = 0;
+        } else if(!*esc){
+          _fail(JSON_INVALID);
+        } else if(!_high || _putCode(_high)){
+          _high = 0;
+          _put(esc[1]);
+        }
+        break;
+      }
+      case LEX_UNICODE: {
+        const int8_t v = hexValue(c);
+        if(v < 0){
+          _fail(JSON_INVALID);
+          break;
+        }
+        _code = (_code << 4) | v;
+        if(++_hex < 4)
+          break;
+        _lex = LEX_STRING;
+        if(_high && _code >= 0xDC00 && _code < 0xE000){
+          _putCode(0x10000 + ((uint32_t)(_high - 0xD800) << 10) + (_code - 0xDC00));
+          _high = 0;
+        } else if(!_high || _putCode(_high)){
+          _high = 0;
+          if(_code >= 0xD800 && _code < 0xDC00)
+            _high = _code;
+          else
+            _putCode(_code);
+        }
+        break;
+      }
+      case LEX_LITERAL: {
+        const char *literal = _literals[_literal];
+        if(c != literal[_literalPos]){
+          _fail(JSON_INVALID);
+          break;
+        }
+        if(literal[++_literalPos] == 0){
+          _lex = LEX_NONE;
+          t = _value((AsyncJsonToken)(JSON_TRUE + _literal));
+        }
+        break;
+      }
+      default:
+        if(c == ' ' || c == '\t' || c == '\n' || c == '\r')
+          break;
+        switch(_expect){
+          case EXPECT_FIRST_VALUE:
+            if(c == ']'){
+              t = _close(false);
+              break;
+            }
+            //fall through
+          case EXPECT_VALUE:
+            t = _beginValue(c);
+            break;
+          case EXPECT_FIRST_KEY:
+            if(c == '}'){
+              t = _close(true);
+              break;
+            }
+            //fall through
+          case EXPECT_KEY:
+            if(c != '"'){
+              _fail(JSON_INVALID);
+              break;
+            }
+            _lex = LEX_STRING;
+            _isKey = true;
+            _len = 0;
+            break;
+          case EXPECT_COLON:
+            if(c != ':')
+              _fail(JSON_INVALID);
+            else
+              _expect = EXPECT_VALUE;
+            break;
+          default:
+            if(c == ',')
+              _expect = _inObject() ? EXPECT_KEY : EXPECT_VALUE;
+            else if(c == (_inObject() ? '}' : ']'))
+              t = _close(_inObject());
+            else
+              _fail(JSON_INVALID);
+            break;
+        }
+        break;
+    }
+    if(t != JSON_NEED_MORE)
+      return t;
+  }
+  return JSON_NEED_MORE;
+}
+
+AsyncJsonToken AsyncJsonParser::finish(){
+  if(_error != JSON_OK || _done)
+    return JSON_NEED_MORE;
+  if(_lex == LEX_NUMBER && _depth == 0)
+    return _endNumber();
+  return _fail(JSON_INCOMPLETE);
+}
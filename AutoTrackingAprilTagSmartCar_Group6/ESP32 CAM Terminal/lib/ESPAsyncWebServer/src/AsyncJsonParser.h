@@ -0,0 +1,116 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCJSONPARSER_H_
+#define ASYNCJSONPARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef ASYNC_JSON_MAX_DEPTH
+#define ASYNC_JSON_MAX_DEPTH 10 //nested objects and arrays, the same limit as deserializeJson()
+#endif
+
+/*
+ * JSON PARSER :: Tokenizes JSON a piece at a time, as the body of a request comes in. Nothing but
+ * the token being read is kept: the key and the string or number after it go to a buffer the caller
+ * gives, everything else is a state of a few bytes. There is no callback: next() is called until it
+ * has used up the input, and every token it returns says where it is with depth() and key().
+ * The parser holds no memory of its own, so it may live in a block that is just free()'d.
+ * */
+
+typedef enum {
+  JSON_NEED_MORE = 0, //the input given is used up
+  JSON_OBJECT_BEGIN,
+  JSON_OBJECT_END,
+  JSON_ARRAY_BEGIN,
+  JSON_ARRAY_END,
+  JSON_STRING,
+  JSON_NUMBER,
+  JSON_TRUE,
+  JSON_FALSE,
+  JSON_NULL
+} AsyncJsonToken;
+
+typedef enum {
+  JSON_OK = 0,
+  JSON_INVALID,    //not JSON
+  JSON_TOO_DEEP,   //more than ASYNC_JSON_MAX_DEPTH levels
+  JSON_TOO_LONG,   //a key and its value do not fit in the token buffer
+  JSON_INCOMPLETE  //the input ended before the root value did
+} AsyncJsonError;
+
+class AsyncJsonParser {
+  private:
+    char *_token;
+    size_t _size;
+    size_t _len;        //bytes in _token
+    size_t _keyLen;     //the last key, at the start of _token
+    size_t _valueStart; //where a string or number goes: after the key in an object, at 0 in an array
+    uint32_t _objects;  //one bit per open container, set for an object
+    uint8_t _depth;
+    uint8_t _tokenDepth;
+    uint8_t _expect;
+    uint8_t _lex;
+    uint8_t _literal;   //LEX_LITERAL: the token it is spelling, and how far
+    uint8_t _literalPos;
+    uint8_t _hex;
+    uint16_t _code;
+    uint16_t _high;     //a high surrogate waiting for its low half
+    bool _keyed;        //the value being read has a key
+    bool _tokenKeyed;
+    bool _isKey;
+    bool _done;
+    AsyncJsonError _error;
+
+    bool _inObject() const { return _depth && (_objects & (1UL << (_depth - 1))); }
+    bool _put(char c);
+    bool _putCode(uint32_t code);
+    AsyncJsonToken _fail(AsyncJsonError error);
+    AsyncJsonToken _value(AsyncJsonToken token);
+    AsyncJsonToken _open(bool object);
+    AsyncJsonToken _close(bool object);
+    AsyncJsonToken _beginValue(char c);
+    AsyncJsonToken _endString();
+    AsyncJsonToken _endNumber();
+
+  public:
+    //token is where keys, strings and numbers are put together, size bytes with the terminators
+    AsyncJsonParser(char *token, size_t size);
+    //consumes data up to the end of the next token and returns it, moving data and len past it.
+    //JSON_NEED_MORE once len is 0. After an error, or once the root value is done, the rest is skipped
+    AsyncJsonToken next(const uint8_t *&data, size_t &len);
+    //after the last byte: a number that ended with the input is returned here, and a root
+    //value that is not complete becomes JSON_INCOMPLETE
+    AsyncJsonToken finish();
+
+    //the string (unescaped, UTF-8) or the number just returned, NUL terminated
+    const char *value() const { return _token + _valueStart; }
+    size_t valueLength() const { return _len - _valueStart; }
+    //the member name of the value or container just returned, NULL in an array, at the root or for an end
+    const char *key() const { return _tokenKeyed ? _token : NULL; }
+    //containers around the token just returned: 0 for the root and its end, 1 for its members...
+    uint8_t depth() const { return _tokenDepth; }
+    bool done() const { return _done; }
+    AsyncJsonError error() const { return _error; }
+    const char *errorString() const;
+};
+
+#endif /* ASYNCJSONPARSER_H_ */
@@ -63,12 +63,7 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
 
   if(len > space) len = space;
 
-  uint8_t *buf = (uint8_t*)malloc(headLen);
-  if(buf == NULL){
-    //os_printf("could not malloc %u bytes for frame header\n", headLen);
-    return 0;
-  }
-
+  uint8_t buf[8];
   buf[0] = opcode & 0x0F;
   if(final)
     buf[0] |= 0x80;
@@ -82,30 +77,52 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   if(len && mask){
     buf[1] |= 0x80;
     memcpy(buf + (headLen - 4), mbuf, 4);
-  }
-  if(client->add((const char *)buf, headLen) != headLen){
-    //os_printf("error adding %lu header bytes\n", headLen);
-    free(buf);
+    size_t i;
+    for(i=0;i<len;i++)
+      data[i] = data[i] ^ mbuf[i%4];
+  }
+
+  //header and payload go to the tcpip thread in one call
+  async_iovec_t iov[2] = {
+    { (const char *)buf, headLen, ASYNC_WRITE_FLAG_COPY, nullptr, NULL },
+    { (const char *)data, len, ASYNC_WRITE_FLAG_COPY, nullptr, NULL }
+  };
+  size_t segments = len ? 2 : 1;
+  if(client->writev(iov, segments) != segments){
+    //os_printf("error sending frame: %lu\n", headLen+len);
     return 0;
   }
-  free(buf);
+  return len;
+}
 
-  if(len){
-    if(len && mask){
-      size_t i;
-      for(i=0;i<len;i++)
-        data[i] = data[i] ^ mbuf[i%4];
-    }
-    if(client->add((const char *)data, len) != len){
-      //os_printf("error adding %lu data bytes\n", len);
-      return 0;
-    }
+
+typedef size_t __attribute__((__may_alias__)) webSocketWord_t;
+
+//XORs len bytes with the mask, the first one with mask[offset % 4]. A few bytes until data is
+//word aligned, then a machine word (32 bits on the ESP32, 64 on a Linux host) per step
+void webSocketUnmask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset){
+  size_t i = 0;
+  offset &= 3;
+  while(i < len && ((uintptr_t)(data + i) & (sizeof(webSocketWord_t) - 1))){
+    data[i++] ^= mask[offset];
+    offset = (offset + 1) & 3;
   }
-  if(!client->send()){
-    //os_printf("error sending frame: %lu\n", headLen+len);
-    return 0;
+  const size_t words = (len - i) / sizeof(webSocketWord_t);
+  if(words){
+    uint8_t m[sizeof(webSocketWord_t)];
+    for(size_t j = 0; j < sizeof(m); j++)
+      m[j] = mask[(offset + j) & 3];
+    webSocketWord_t key;
+    memcpy(&key, m, sizeof(key));
+    webSocketWord_t *w = (webSocketWord_t *)(data + i);
+    for(size_t j = 0; j < words; j++)
+      w[j] ^= key;
+    i += words * sizeof(webSocketWord_t); //a whole number of mask periods, offset stays
+  }
+  while(i < len){
+    data[i++] ^= mask[offset];
+    offset = (offset + 1) & 3;
   }
-  return len;
 }
 
 
@@ -457,22 +474,216 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
 }
 
 
+/*
+ * Shared broadcast frame
+ */
+
+//refs and the free list are touched from the sending task as well as from async_tcp
+static AsyncWebLock &_frameLock(){
+  static AsyncWebLock lock;
+  return lock;
+}
+
+static void * _spareFrameMessages = NULL; //chained through their first word
+static uint8_t _spareFrameMessageCount = 0;
+
+static uint8_t webSocketServerHeaderLen(size_t len){
+  if(len > 0xFFFF)
+    return 10;
+  if(len > 125)
+    return 4;
+  return 2;
+}
+
+//a final, unmasked frame header; first carries the opcode and RSV bits
+static void webSocketServerHeader(uint8_t * buf, uint8_t first, size_t len){
+  const uint8_t headLen = webSocketServerHeaderLen(len);
+  buf[0] = 0x80 | first;
+  if(len < 126){
+    buf[1] = len;
+  } else if(headLen == 4){
+    buf[1] = 126;
+    buf[2] = (uint8_t)(len >> 8);
+    buf[3] = (uint8_t)len;
+  } else {
+    buf[1] = 127;
+    uint64_t l = len;
+    for(int i = 9; i > 1; i--){
+      buf[i] = (uint8_t)l;
+      l >>= 8;
+    }
+  }
+}
+
+AsyncWebSocketSharedFrame * AsyncWebSocketSharedFrame::create(uint8_t opcode, const uint8_t * data, size_t len){
+  const uint8_t headLen = webSocketServerHeaderLen(len);
+  void * mem = malloc(sizeof(AsyncWebSocketSharedFrame) + headLen + len);
+  if(mem == NULL)
+    return NULL;
+  AsyncWebSocketSharedFrame * frame = new (mem) AsyncWebSocketSharedFrame(headLen + len);
+  uint8_t * buf = (uint8_t *)(frame + 1);
+  webSocketServerHeader(buf, opcode & 0x0F, len);
+  if(len)
+    memcpy(buf + headLen, data, len);
+  return frame;
+}
+
+//compressed behind room for the longest header, which then moves up to the real one.
+//Nothing is compressed when the memory is not there, so the history only has what was sent
+AsyncWebSocketSharedFrame * AsyncWebSocketSharedFrame::deflate(AsyncWebSocketDeflater * deflater, uint8_t opcode, const uint8_t * data, size_t len){
+  const size_t bound = AsyncWebSocketDeflater::bound(len);
+  uint8_t * mem = (uint8_t *)malloc(sizeof(AsyncWebSocketSharedFrame) + 10 + bound);
+  if(mem == NULL)
+    return NULL;
+  uint8_t * buf = mem + sizeof(AsyncWebSocketSharedFrame);
+  const size_t plen = deflater->compress(data, len, buf + 10);
+  const uint8_t headLen = webSocketServerHeaderLen(plen);
+  memmove(buf + headLen, buf + 10, plen);
+  webSocketServerHeader(buf, 0x40 | (opcode & 0x0F), plen);
+  uint8_t * shrunk = (uint8_t *)realloc(mem, sizeof(AsyncWebSocketSharedFrame) + headLen + plen);
+  if(shrunk != NULL)
+    mem = shrunk;
+  return new (mem) AsyncWebSocketSharedFrame(headLen + plen);
+}
+
+void AsyncWebSocketSharedFrame::retain(){
+  AsyncWebLockGuard l(_frameLock());
+  _refs++;
+}
+
+void AsyncWebSocketSharedFrame::release(){
+  {
+    AsyncWebLockGuard l(_frameLock());
+    if(--_refs)
+      return;
+  }
+  this->~AsyncWebSocketSharedFrame();
+  free(this);
+}
+
+AsyncWebSocketFrameMessage::AsyncWebSocketFrameMessage(AsyncWebSocketSharedFrame * frame, AsyncWebSocketClient * deflateFor)
+  :_frame(frame)
+  ,_sent(0)
+  ,_acked(0)
+  ,_deflateFor(deflateFor)
+{
+  _opcode = frame->data()[0] & 0x07;
+  _mask = false;
+  _status = WS_MSG_SENDING;
+  _frame->retain();
+}
+
+AsyncWebSocketFrameMessage::~AsyncWebSocketFrameMessage(){
+  _frame->release();
+}
+
+void * AsyncWebSocketFrameMessage::operator new(size_t size) noexcept {
+  {
+    AsyncWebLockGuard l(_frameLock());
+    if(_spareFrameMessages){
+      void * p = _spareFrameMessages;
+      _spareFrameMessages = *(void **)p;
+      _spareFrameMessageCount--;
+      return p;
+    }
+  }
+  return malloc(size);
+}
+
+void AsyncWebSocketFrameMessage::operator delete(void * p){
+  if(p == NULL)
+    return;
+  {
+    AsyncWebLockGuard l(_frameLock());
+    if(_spareFrameMessageCount < WS_SPARE_FRAME_MESSAGES){
+      *(void **)p = _spareFrameMessages;
+      _spareFrameMessages = p;
+      _spareFrameMessageCount++;
+      return;
+    }
+  }
+  free(p);
+}
+
+void AsyncWebSocketFrameMessage::ack(size_t len, uint32_t time){
+  (void)time;
+  _acked += len;
+  if(_sent == _frame->length() && _acked >= _sent)
+    _status = WS_MSG_SENT;
+}
+
+//the frame is already encoded, so it goes out in as few writes as the window allows and
+//control frames wait until it is complete. The TCP layer points into the frame instead of copying
+//it, and holds a reference until that slice is acked
+size_t AsyncWebSocketFrameMessage::send(AsyncClient *client){
+  if(_status != WS_MSG_SENDING || _acked < _sent || !client->canSend())
+    return 0;
+  if(_deflateFor != NULL){
+    AsyncWebSocketSharedFrame * deflated = _deflateFor->_deflateQueued(_frame);
+    _deflateFor = NULL;
+    if(deflated != NULL){
+      _frame->release();
+      _frame = deflated;
+    }
+  }
+  size_t toSend = _frame->length() - _sent;
+  size_t space = client->space();
+  if(toSend > space)
+    toSend = space;
+  if(toSend == 0)
+    return 0;
+  _frame->retain();
+  size_t sent = client->addRef((const char *)_frame->data() + _sent, toSend, [](void *arg, const char *data, size_t len){
+    (void)data;
+    (void)len;
+    ((AsyncWebSocketSharedFrame *)arg)->release();
+  }, _frame);
+  if(sent == 0){
+    _frame->release();
+    return 0;
+  }
+  client->send();
+  _sent += sent;
+  return sent;
+}
+
+
 /*
  * Async WebSocket Client
  */
  const char * AWSC_PING_PAYLOAD = "ESPAsyncWebServer-PING";
  const size_t AWSC_PING_PAYLOAD_LEN = 22;
 
-AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server)
+AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server, uint8_t deflateBits, bool deflateTakeover)
   : _controlQueue(LinkedList<AsyncWebSocketControl *>([](AsyncWebSocketControl *c){ delete  c; }))
-  , _messageQueue(LinkedList<AsyncWebSocketMessage *>([](AsyncWebSocketMessage *m){ delete  m; }))
   , _tempObject(NULL)
 {
   _client = request->client();
   _server = server;
   _clientId = _server->_getNextId();
   _status = WS_CONNECTED;
+  _queuePolicy = _server->queuePolicy();
+  _dropped = 0;
+  _coalesced = 0;
   _pstate = 0;
+  memset(&_pinfo, 0, sizeof(_pinfo));
+  _pheadLen = 0;
+  _pmessage = false;
+  _pctl = NULL;
+  _prx = NULL;
+  _prxLen = 0;
+  _pinflate = false;
+  _deflateBits = deflateBits;
+  _deflateTakeover = deflateTakeover;
+  _deflater = NULL;
+  //the shared compressor fits unless this client keeps context or asked for a smaller window
+  if(_deflateBits && (_deflateTakeover || _deflateBits < _server->_deflateWindowBits())){
+    _deflater = new AsyncWebSocketDeflater(_deflateBits);
+    if(_deflater != NULL && !_deflater->valid()){
+      delete _deflater;
+      _deflater = NULL;
+    }
+  }
   _lastMessageTime = millis();
   _keepAlivePeriod = 0;
   _client->setRxTimeout(0);
@@ -488,28 +699,42 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
 }
 
 AsyncWebSocketClient::~AsyncWebSocketClient(){
-  _messageQueue.free();
+  while(!_messageQueue.isEmpty())
+    delete _messageQueue.pop();
   _controlQueue.free();
+  free(_pctl);
+  free(_prx);
+  delete _deflater;
   _server->_handleEvent(this, WS_EVT_DISCONNECT, NULL, NULL, 0);
 }
 
 void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
   _lastMessageTime = millis();
-  if(!_controlQueue.isEmpty()){
-    auto head = _controlQueue.front();
-    if(head->finished()){
-      len -= head->len();
-      if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
-        _controlQueue.remove(head);
-        _status = WS_DISCONNECTED;
-        _client->close(true);
-        return;
+  bool closing = false;
+  {
+    AsyncWebLockGuard l(_lock);
+    if(!_controlQueue.isEmpty()){
+      auto head = _controlQueue.front();
+      if(head->finished()){
+        len -= head->len();
+        if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
+          _controlQueue.remove(head);
+          _status = WS_DISCONNECTED;
+          closing = true;
+          len = 0;
+        } else {
+          _controlQueue.remove(head);
+        }
       }
-      _controlQueue.remove(head);
+    }
+    if(len && !_messageQueue.isEmpty()){
+      _messageQueue.front()->ack(len, time);
     }
   }
-  if(len && !_messageQueue.isEmpty()){
-    _messageQueue.front()->ack(len, time);
+  //not under the lock, the disconnect that follows deletes this client
+  if(closing){
+    _client->close(true);
+    return;
   }
   _server->_cleanBuffers(); 
   _runQueue();
@@ -524,42 +749,121 @@ void AsyncWebSocketClient::_onPoll(){
 }
 
 void AsyncWebSocketClient::_runQueue(){
+  AsyncWebLockGuard l(_lock);
   while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
+    delete _messageQueue.pop();
   }
 
-  if(!_controlQueue.isEmpty() && (_messageQueue.isEmpty() || _messageQueue.front()->betweenFrames()) && webSocketSendFrameWindow(_client) > (size_t)(_controlQueue.front()->len() - 1)){
+  //a sent control frame stays at the front until it is acked, it must not go out twice
+  if(!_controlQueue.isEmpty() && !_controlQueue.front()->finished() && (_messageQueue.isEmpty() || _messageQueue.front()->betweenFrames()) && webSocketSendFrameWindow(_client) > (size_t)(_controlQueue.front()->len() - 1)){
     _controlQueue.front()->send(_client);
-  } else if(!_messageQueue.isEmpty() && _messageQueue.front()->betweenFrames() && webSocketSendFrameWindow(_client)){
+  } else if(!_messageQueue.isEmpty() && _messageQueue.front()->acked() && webSocketSendFrameWindow(_client)){
     _messageQueue.front()->send(_client);
   }
 }
 
 bool AsyncWebSocketClient::queueIsFull(){
-  if((_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES) || (_status != WS_CONNECTED) ) return true;
+  if(_messageQueue.isFull() || (_status != WS_CONNECTED) ) return true;
   return false;
 }
 
-void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
+//the front may be on the wire already and stays, any message behind it can make room by the policy
+void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage, uint32_t key){
   if(dataMessage == NULL)
     return;
+  if(key)
+    dataMessage->setKey(key);
+  AsyncWebLockGuard l(_lock);
   if(_status != WS_CONNECTED){
     delete dataMessage;
     return;
   }
-  if(_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
-      delete dataMessage;
-  } else {
-      _messageQueue.add(dataMessage);
+  if(_queuePolicy == QUEUE_COALESCE && dataMessage->key()){
+    for(size_t i = 1; i < _messageQueue.length(); i++){
+      if(_messageQueue[i]->key() == dataMessage->key()){
+        delete _messageQueue[i];
+        _messageQueue[i] = dataMessage;
+        _coalesced++;
+        dataMessage = NULL;
+        break;
+      }
+    }
+  }
+  if(dataMessage != NULL && _messageQueue.isFull() && _queuePolicy != QUEUE_DROP_NEWEST && _messageQueue.length() > 1){
+    delete _messageQueue.removeAt(1);
+    _dropped++;
+  }
+  if(dataMessage != NULL && !_messageQueue.push(dataMessage)){
+    delete dataMessage;
+    _dropped++;
   }
   if(_client->canSend())
     _runQueue();
 }
 
+bool AsyncWebSocketClient::_deflateMessage(uint8_t opcode, const uint8_t *data, size_t len, uint32_t key, AsyncWebSocketSharedFrame **shared, AsyncWebSocketSharedFrame **plain){
+  if(!_deflateBits || !_server->deflateEnabled())
+    return false;
+  if(len < _server->deflateThreshold()){
+    _server->_deflateSkipped();
+    return false;
+  }
+  AsyncWebSocketSharedFrame *frame = NULL;
+  if(_deflater == NULL){
+    //no history to keep in step, a message that is dropped or goes plain does no harm
+    if(_deflateBits < _server->_deflateWindowBits())
+      return false; //setDeflate() made the window bigger than this client accepted
+    if(shared != NULL && *shared != NULL){
+      frame = *shared;
+    } else {
+      frame = _server->_deflateShared(opcode, data, len);
+      if(frame == NULL){
+        _server->_deflateSkipped();
+        return false;
+      }
+      if(shared != NULL)
+        *shared = frame;
+    }
+    _queueMessage(new AsyncWebSocketFrameMessage(frame), key);
+    if(shared == NULL)
+      frame->release();
+    return true;
+  }
+  //the peer inflates in the order the messages go out, so they are queued plain and compressed
+  //one by one as they start to go out. What the queue policy drops was never compressed
+  if(plain != NULL && *plain != NULL){
+    frame = *plain;
+  } else {
+    frame = AsyncWebSocketSharedFrame::create(opcode, data, len);
+    if(frame == NULL)
+      return false;
+    if(plain != NULL)
+      *plain = frame;
+  }
+  _queueMessage(new AsyncWebSocketFrameMessage(frame, this), key);
+  if(plain == NULL)
+    frame->release();
+  return true;
+}
+
+//under _lock, for the frame at the front of the queue before any of it is written.
+//NULL when it has to go as it is
+AsyncWebSocketSharedFrame * AsyncWebSocketClient::_deflateQueued(const AsyncWebSocketSharedFrame *frame){
+  if(_deflater == NULL)
+    return NULL;
+  if(!_deflateTakeover)
+    _deflater->reset();
+  const uint8_t headLen = frame->headLength();
+  AsyncWebSocketSharedFrame *deflated = _server->_deflateFrame(_deflater, frame->data()[0] & 0x0F, frame->data() + headLen, frame->length() - headLen);
+  if(deflated == NULL)
+    _server->_deflateSkipped();
+  return deflated;
+}
+
 void AsyncWebSocketClient::_queueControl(AsyncWebSocketControl *controlMessage){
   if(controlMessage == NULL)
     return;
+  AsyncWebLockGuard l(_lock);
   _controlQueue.add(controlMessage);
   if(_client->canSend())
     _runQueue();
@@ -607,92 +911,244 @@ void AsyncWebSocketClient::_onDisconnect(){
   _server->_handleDisconnect(this);
 }
 
-void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
-  _lastMessageTime = millis();
-  uint8_t *data = (uint8_t*)pbuf;
-  while(plen > 0){
-    if(!_pstate){
-      const uint8_t *fdata = data;
-      _pinfo.index = 0;
-      _pinfo.final = (fdata[0] & 0x80) != 0;
-      _pinfo.opcode = fdata[0] & 0x0F;
-      _pinfo.masked = (fdata[1] & 0x80) != 0;
-      _pinfo.len = fdata[1] & 0x7F;
-      data += 2;
-      plen -= 2;
-      if(_pinfo.len == 126){
-        _pinfo.len = fdata[3] | (uint16_t)(fdata[2]) << 8;
-        data += 2;
-        plen -= 2;
-      } else if(_pinfo.len == 127){
-        _pinfo.len = fdata[9] | (uint16_t)(fdata[8]) << 8 | (uint32_t)(fdata[7]) << 16 | (uint32_t)(fdata[6]) << 24 | (uint64_t)(fdata[5]) << 32 | (uint64_t)(fdata[4]) << 40 | (uint64_t)(fdata[3]) << 48 | (uint64_t)(fdata[2]) << 56;
-        data += 8;
-        plen -= 8;
-      }
+//frame header: 2 bytes, the extended length and the mask key
+static size_t webSocketHeaderLen(const uint8_t *head){
+  size_t len = 2;
+  if((head[1] & 0x7F) == 126)
+    len += 2;
+  else if((head[1] & 0x7F) == 127)
+    len += 8;
+  if(head[1] & 0x80)
+    len += 4;
+  return len;
+}
+
+//returns the close code for a frame the protocol does not allow, 0 if it is fine
+uint16_t AsyncWebSocketClient::_parseHeader(const uint8_t *head){
+  _pinfo.index = 0;
+  _pinfo.final = (head[0] & 0x80) != 0;
+  _pinfo.opcode = head[0] & 0x0F;
+  _pinfo.masked = (head[1] & 0x80) != 0;
+  _pinfo.len = head[1] & 0x7F;
+  const uint8_t *p = head + 2;
+  if(_pinfo.len == 126){
+    _pinfo.len = (uint16_t)(p[0] << 8) | p[1];
+    p += 2;
+  } else if(_pinfo.len == 127){
+    _pinfo.len = 0;
+    for(uint8_t i = 0; i < 8; i++)
+      _pinfo.len = (_pinfo.len << 8) | p[i];
+    p += 8;
+  }
+  if(_pinfo.masked)
+    memcpy(_pinfo.mask, p, 4);
+
+  //RSV1 marks a compressed message, on its first frame only
+  uint8_t rsv = head[0] & 0x70;
+  if(rsv == 0x40 && _deflateBits && (_pinfo.opcode == WS_TEXT || _pinfo.opcode == WS_BINARY))
+    rsv = 0;
+  if(rsv || (_pinfo.len >> 63))
+    return 1002;
+  if(_pinfo.opcode & 0x08){
+    if(_pinfo.opcode > WS_PONG || !_pinfo.final || _pinfo.len > 125)
+      return 1002;
+    return 0;
+  }
+  if(_pinfo.opcode > WS_BINARY || (_pinfo.opcode == WS_CONTINUATION) != _pmessage)
+    return 1002;
+  if(_pinfo.opcode){
+    _pinfo.message_opcode = _pinfo.opcode;
+    _pinfo.num = 0;
+    _pinflate = (head[0] & 0x40) != 0;
+  } else {
+    _pinfo.num += 1;
+  }
+  _pmessage = !_pinfo.final;
+  return 0;
+}
 
-      if(_pinfo.masked){
-        memcpy(_pinfo.mask, data, 4);
-        data += 4;
-        plen -= 4;
+//stops reading, whatever else the peer sends is dropped until the connection goes.
+//The peer's close reply would be dropped too, so the socket closes once ours is acked
+void AsyncWebSocketClient::_failRx(uint16_t code){
+  _pstate = 2;
+  free(_prx);
+  _prx = NULL;
+  _prxLen = 0;
+  free(_pctl);
+  _pctl = NULL;
+  close(code);
+  AsyncWebLockGuard l(_lock);
+  if(_status == WS_CONNECTED)
+    _status = WS_DISCONNECTING;
+}
+
+//the whole payload of a control frame. false once the connection is being dropped
+bool AsyncWebSocketClient::_handleControl(uint8_t *data, size_t datalen){
+  if(_pinfo.opcode == WS_DISCONNECT){
+    if(datalen >= 2){
+      uint16_t reasonCode = (uint16_t)(data[0] << 8) + data[1];
+      char reasonString[124];
+      memcpy(reasonString, data + 2, datalen - 2);
+      reasonString[datalen - 2] = 0;
+      if(reasonCode > 1001){
+        _server->_handleEvent(this, WS_EVT_ERROR, (void *)&reasonCode, (uint8_t*)reasonString, datalen - 2);
       }
     }
-
-    const size_t datalen = std::min((size_t)(_pinfo.len - _pinfo.index), plen);
-    const auto datalast = data[datalen];
-
-    if(_pinfo.masked){
-      for(size_t i=0;i<datalen;i++)
-        data[i] ^= _pinfo.mask[(_pinfo.index+i)%4];
+    if(_status == WS_DISCONNECTING){
+      _status = WS_DISCONNECTED;
+      _client->close(true);
+      return false;
     }
+    _status = WS_DISCONNECTING;
+    _client->ackLater();
+    _queueControl(new AsyncWebSocketControl(WS_DISCONNECT, data, datalen));
+  } else if(_pinfo.opcode == WS_PING){
+    _queueControl(new AsyncWebSocketControl(WS_PONG, data, datalen));
+  } else if(_pinfo.opcode == WS_PONG){
+    if(datalen != AWSC_PING_PAYLOAD_LEN || memcmp(AWSC_PING_PAYLOAD, data, AWSC_PING_PAYLOAD_LEN) != 0)
+      _server->_handleEvent(this, WS_EVT_PONG, NULL, data, datalen);
+  }
+  return true;
+}
 
-    if((datalen + _pinfo.index) < _pinfo.len){
-      _pstate = 1;
+//a piece of a text/binary frame, already unmasked, with avail bytes of the packet left from data.
+//Streams it, or collects the message when reassembling or inflating
+bool AsyncWebSocketClient::_handleData(uint8_t *data, size_t datalen, size_t avail){
+  size_t maxLen = _server->reassembly();
+  const bool frameEnd = (_pinfo.index + datalen == _pinfo.len);
+  if(_pinflate){
+    //compressed messages are handed over whole, also when streaming
+    if(maxLen == 0)
+      maxLen = WS_INFLATE_MAX_MESSAGE;
+  } else if(maxLen == 0 || (_prx == NULL && _pinfo.final && _pinfo.opcode && _pinfo.index == 0 && frameEnd)){
+    //streaming, or a whole message in one packet: handed over in place
+    //the byte after the data belongs to the next frame when there is one
+    const bool more = datalen < avail;
+    const auto datalast = more ? data[datalen] : 0;
+    _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, data, datalen);
+    // restore byte as _handleEvent may have added a null terminator i.e., data[len] = 0;
+    if(more)
+      data[datalen] = datalast;
+    return true;
+  }
+  if(_pinfo.index == 0){
+    //one more frame of the message, room for all of it and a terminator
+    if(_prxLen + _pinfo.len > maxLen){
+      _failRx(1009);
+      return false;
+    }
+    uint8_t *buf = (uint8_t*)realloc(_prx, _prxLen + _pinfo.len + 1);
+    if(buf == NULL){
+      _failRx(1011);
+      return false;
+    }
+    _prx = buf;
+  }
+  memcpy(_prx + _prxLen + _pinfo.index, data, datalen);
+  if(!frameEnd)
+    return true;
+  _prxLen += _pinfo.len;
+  if(!_pinfo.final)
+    return true;
+  AwsFrameInfo info = _pinfo;
+  info.opcode = info.message_opcode;
+  info.num = 0;
+  info.index = 0;
+  info.len = _prxLen;
+  uint8_t *buf = _prx;
+  _prx = NULL;
+  _prxLen = 0;
+  if(_pinflate){
+    size_t len = 0;
+    uint16_t code = 0;
+    uint8_t *out = _server->_inflate(buf, info.len, maxLen, &len, &code);
+    free(buf);
+    if(out == NULL){
+      _failRx(code);
+      return false;
+    }
+    buf = out;
+    info.len = len;
+  } else {
+    buf[info.len] = 0;
+  }
+  _server->_handleEvent(this, WS_EVT_DATA, (void *)&info, buf, info.len);
+  free(buf);
+  return true;
+}
 
-      if(_pinfo.index == 0){
-        if(_pinfo.opcode){
-          _pinfo.message_opcode = _pinfo.opcode;
-          _pinfo.num = 0;
-        } else _pinfo.num += 1;
+void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
+  _lastMessageTime = millis();
+  uint8_t *data = (uint8_t*)pbuf;
+  while(plen > 0 && _pstate != 2){
+    if(_pstate == 0){
+      const uint8_t *head = data;
+      if(_pheadLen == 0 && plen >= 2 && plen >= webSocketHeaderLen(data)){
+        const size_t headLen = webSocketHeaderLen(data);
+        data += headLen;
+        plen -= headLen;
+      } else {
+        //the header is split between packets
+        size_t need = (_pheadLen < 2) ? 2 : webSocketHeaderLen(_phead);
+        size_t take = std::min(need - _pheadLen, plen);
+        memcpy(_phead + _pheadLen, data, take);
+        _pheadLen += take;
+        data += take;
+        plen -= take;
+        if(_pheadLen == 2){
+          need = webSocketHeaderLen(_phead);
+          take = std::min(need - _pheadLen, plen);
+          memcpy(_phead + _pheadLen, data, take);
+          _pheadLen += take;
+          data += take;
+          plen -= take;
+        }
+        if(_pheadLen < need)
+          return;
+        head = _phead;
+        _pheadLen = 0;
+      }
+      uint16_t code = _parseHeader(head);
+      if(code){
+        _failRx(code);
+        return;
       }
-      _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, (uint8_t*)data, datalen);
+      _pstate = 1;
+    }
 
-      _pinfo.index += datalen;
-    } else if((datalen + _pinfo.index) == _pinfo.len){
-      _pstate = 0;
-      if(_pinfo.opcode == WS_DISCONNECT){
-        if(datalen){
-          uint16_t reasonCode = (uint16_t)(data[0] << 8) + data[1];
-          char * reasonString = (char*)(data+2);
-          if(reasonCode > 1001){
-            _server->_handleEvent(this, WS_EVT_ERROR, (void *)&reasonCode, (uint8_t*)reasonString, strlen(reasonString));
-          }
-        }
-        if(_status == WS_DISCONNECTING){
-          _status = WS_DISCONNECTED;
-          _client->close(true);
-        } else {
-          _status = WS_DISCONNECTING;
-          _client->ackLater();
-          _queueControl(new AsyncWebSocketControl(WS_DISCONNECT, data, datalen));
+    const size_t datalen = std::min((size_t)(_pinfo.len - _pinfo.index), plen);
+    if(_pinfo.masked)
+      webSocketUnmask(data, datalen, _pinfo.mask, _pinfo.index);
+    const bool frameEnd = (_pinfo.index + datalen == _pinfo.len);
+
+    if(_pinfo.opcode & 0x08){
+      uint8_t *payload = data;
+      if(!frameEnd || _pinfo.index){
+        //control frames are at most 125 bytes, collected if they come in pieces
+        if(_pctl == NULL)
+          _pctl = (uint8_t*)malloc(125);
+        if(_pctl == NULL){
+          _failRx(1011);
+          return;
         }
-      } else if(_pinfo.opcode == WS_PING){
-        _queueControl(new AsyncWebSocketControl(WS_PONG, data, datalen));
-      } else if(_pinfo.opcode == WS_PONG){
-        if(datalen != AWSC_PING_PAYLOAD_LEN || memcmp(AWSC_PING_PAYLOAD, data, AWSC_PING_PAYLOAD_LEN) != 0)
-          _server->_handleEvent(this, WS_EVT_PONG, NULL, data, datalen);
-      } else if(_pinfo.opcode < 8){//continuation or text/binary frame
-        _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, data, datalen);
+        memcpy(_pctl + _pinfo.index, data, datalen);
+        payload = _pctl;
       }
-    } else {
-      //os_printf("frame error: len: %u, index: %llu, total: %llu\n", datalen, _pinfo.index, _pinfo.len);
-      //what should we do?
-      break;
+      if(frameEnd){
+        uint8_t *ctl = _pctl;
+        _pctl = NULL;
+        bool open = _handleControl(payload, _pinfo.len);
+        free(ctl);
+        if(!open)
+          return;
+      }
+    } else if(!_handleData(data, datalen, plen)){
+      return;
     }
 
-    // restore byte as _handleEvent may have added a null terminator i.e., data[len] = 0;
-    if (datalen > 0)
-      data[datalen] = datalast;
-
+    _pinfo.index += datalen;
+    if(frameEnd)
+      _pstate = 0;
     data += datalen;
     plen -= datalen;
   }
@@ -728,7 +1184,7 @@ size_t AsyncWebSocketClient::printf(const char *format, ...) {
   return len;
 }
 
-#ifndef ESP32
+#if !defined(ESP32) && !defined(__linux__)
 size_t AsyncWebSocketClient::printf_P(PGM_P formatP, ...) {
   va_list arg;
   va_start(arg, formatP);
@@ -760,8 +1216,10 @@ size_t AsyncWebSocketClient::printf_P(PGM_P formatP, ...) {
 }
 #endif
 
-void AsyncWebSocketClient::text(const char * message, size_t len){
-  _queueMessage(new AsyncWebSocketBasicMessage(message, len));
+void AsyncWebSocketClient::text(const char * message, size_t len, uint32_t key){
+  if(_deflateMessage(WS_TEXT, (const uint8_t *)message, len, key))
+    return;
+  _queueMessage(new AsyncWebSocketBasicMessage(message, len), key);
 }
 void AsyncWebSocketClient::text(const char * message){
   text(message, strlen(message));
@@ -796,8 +1254,10 @@ void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer * buffer)
   _queueMessage(new AsyncWebSocketMultiMessage(buffer));
 }
 
-void AsyncWebSocketClient::binary(const char * message, size_t len){
-  _queueMessage(new AsyncWebSocketBasicMessage(message, len, WS_BINARY));
+void AsyncWebSocketClient::binary(const char * message, size_t len, uint32_t key){
+  if(_deflateMessage(WS_BINARY, (const uint8_t *)message, len, key))
+    return;
+  _queueMessage(new AsyncWebSocketBasicMessage(message, len, WS_BINARY), key);
 }
 void AsyncWebSocketClient::binary(const char * message){
   binary(message, strlen(message));
@@ -834,6 +1294,13 @@ IPAddress AsyncWebSocketClient::remoteIP() {
     return _client->remoteIP();
 }
 
+bool AsyncWebSocketClient::transportInfo(async_tcp_info_t * info) {
+    if(!_client) {
+        return false;
+    }
+    return _client->getTransportInfo(info);
+}
+
 uint16_t AsyncWebSocketClient::remotePort() {
     if(!_client) {
         return 0;
@@ -852,12 +1319,100 @@ AsyncWebSocket::AsyncWebSocket(const String& url)
   ,_clients(LinkedList<AsyncWebSocketClient *>([](AsyncWebSocketClient *c){ delete c; }))
   ,_cNextId(1)
   ,_enabled(true)
+  ,_maxMessage(0)
+  ,_deflateBits(0)
+  ,_deflateMin(WS_DEFLATE_THRESHOLD)
+  ,_deflateTakeover(true)
+  ,_deflater(NULL)
+  ,_queuePolicy(QUEUE_DROP_NEWEST)
   ,_buffers(LinkedList<AsyncWebSocketMessageBuffer *>([](AsyncWebSocketMessageBuffer *b){ delete b; }))
 {
   _eventHandler = NULL;
+  memset(&_deflateStats, 0, sizeof(_deflateStats));
+}
+
+AsyncWebSocket::~AsyncWebSocket(){
+  delete _deflater;
+}
+
+void AsyncWebSocket::setDeflate(bool enable, size_t threshold, uint8_t windowBits, bool contextTakeover){
+  if(windowBits < WS_DEFLATE_MIN_WINDOW_BITS)
+    windowBits = WS_DEFLATE_MIN_WINDOW_BITS;
+  if(windowBits > WS_DEFLATE_MAX_WINDOW_BITS)
+    windowBits = WS_DEFLATE_MAX_WINDOW_BITS;
+  AsyncWebLockGuard l(_lock);
+  _deflateBits = enable ? windowBits : 0;
+  _deflateMin = threshold;
+  _deflateTakeover = contextTakeover;
+  if(_deflater != NULL && _deflater->windowBits() != _deflateBits){
+    delete _deflater;
+    _deflater = NULL;
+  }
+}
+
+void AsyncWebSocket::deflateStats(AwsDeflateStats * stats){
+  if(stats == NULL)
+    return;
+  AsyncWebLockGuard l(_statsLock);
+  memcpy(stats, &_deflateStats, sizeof(AwsDeflateStats));
 }
 
-AsyncWebSocket::~AsyncWebSocket(){}
+void AsyncWebSocket::resetDeflateStats(){
+  AsyncWebLockGuard l(_statsLock);
+  memset(&_deflateStats, 0, sizeof(AwsDeflateStats));
+}
+
+void AsyncWebSocket::_deflateSkipped(){
+  AsyncWebLockGuard l(_statsLock);
+  _deflateStats.skipped++;
+}
+
+AsyncWebSocketSharedFrame * AsyncWebSocket::_deflateFrame(AsyncWebSocketDeflater * deflater, uint8_t opcode, const uint8_t * data, size_t len){
+  uint32_t started = micros();
+  AsyncWebSocketSharedFrame * frame = AsyncWebSocketSharedFrame::deflate(deflater, opcode, data, len);
+  uint32_t us = micros() - started;
+  if(frame == NULL)
+    return NULL;
+  AsyncWebLockGuard l(_statsLock);
+  _deflateStats.deflated++;
+  _deflateStats.deflate_in += len;
+  _deflateStats.deflate_out += frame->length() - frame->headLength();
+  _deflateStats.deflate_us += us;
+  if(us > _deflateStats.deflate_max_us)
+    _deflateStats.deflate_max_us = us;
+  return frame;
+}
+
+AsyncWebSocketSharedFrame * AsyncWebSocket::_deflateShared(uint8_t opcode, const uint8_t * data, size_t len){
+  AsyncWebLockGuard l(_lock);
+  if(_deflater == NULL && _deflateBits){
+    _deflater = new AsyncWebSocketDeflater(_deflateBits);
+    if(_deflater != NULL && !_deflater->valid()){
+      delete _deflater;
+      _deflater = NULL;
+    }
+  }
+  if(_deflater == NULL)
+    return NULL;
+  _deflater->reset();
+  return _deflateFrame(_deflater, opcode, data, len);
+}
+
+uint8_t * AsyncWebSocket::_inflate(const uint8_t * data, size_t len, size_t maxLen, size_t * outLen, uint16_t * error){
+  uint32_t started = micros();
+  uint8_t * out = AsyncWebSocketInflater::inflate(data, len, maxLen, outLen, error);
+  uint32_t us = micros() - started;
+  if(out == NULL)
+    return NULL;
+  AsyncWebLockGuard l(_statsLock);
+  _deflateStats.inflated++;
+  _deflateStats.inflate_in += len;
+  _deflateStats.inflate_out += *outLen;
+  _deflateStats.inflate_us += us;
+  if(us > _deflateStats.inflate_max_us)
+    _deflateStats.inflate_max_us = us;
+  return out;
+}
 
 void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len){
   if(_eventHandler != NULL){
@@ -866,11 +1421,12 @@ void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType ty
 }
 
 void AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
+  AsyncWebLockGuard l(_lock);
   _clients.add(client);
 }
 
 void AsyncWebSocket::_handleDisconnect(AsyncWebSocketClient * client){
-  
+  AsyncWebLockGuard l(_lock);
   _clients.remove_first([=](AsyncWebSocketClient * c){
     return c->id() == client->id();
   });
@@ -932,6 +1488,13 @@ void AsyncWebSocket::ping(uint32_t id, uint8_t *data, size_t len){
     c->ping(data, len);
 }
 
+void AsyncWebSocket::setQueuePolicy(AsyncQueuePolicy policy){
+  AsyncWebLockGuard l(_lock);
+  _queuePolicy = policy;
+  for(const auto& c: _clients)
+    c->setQueuePolicy(policy);
+}
+
 void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
@@ -939,50 +1502,59 @@ void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
   }
 }
 
-void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
+void AsyncWebSocket::text(uint32_t id, const char * message, size_t len, uint32_t key){
   AsyncWebSocketClient * c = client(id);
   if(c)
-    c->text(message, len);
+    c->text(message, len, key);
 }
 
-void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
-  if (!buffer) return;
-  buffer->lock(); 
-  for(const auto& c: _clients){
-    if(c->status() == WS_CONNECTED){
-        c->text(buffer);
+//clients with permessage-deflate get a compressed frame, the rest share the plain one
+void AsyncWebSocket::_frameAll(uint8_t opcode, const uint8_t * data, size_t len, uint32_t key){
+  AsyncWebSocketSharedFrame * frame = NULL;
+  AsyncWebSocketSharedFrame * deflated = NULL;
+  {
+    AsyncWebLockGuard l(_lock);
+    for(const auto& c: _clients){
+      if(c->status() != WS_CONNECTED || c->_deflateMessage(opcode, data, len, key, &deflated, &frame))
+        continue;
+      if(frame == NULL)
+        frame = AsyncWebSocketSharedFrame::create(opcode, data, len);
+      if(frame == NULL)
+        break;
+      c->message(new AsyncWebSocketFrameMessage(frame), key);
     }
   }
-  buffer->unlock();
+  if(frame != NULL)
+    frame->release();
+  if(deflated != NULL)
+    deflated->release();
+}
+
+void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
+  if (!buffer) return;
+  _frameAll(WS_TEXT, buffer->get(), buffer->length(), 0);
   _cleanBuffers(); 
 }
 
 
-void AsyncWebSocket::textAll(const char * message, size_t len){
-  AsyncWebSocketMessageBuffer * WSBuffer = makeBuffer((uint8_t *)message, len); 
-    textAll(WSBuffer); 
+void AsyncWebSocket::textAll(const char * message, size_t len, uint32_t key){
+  _frameAll(WS_TEXT, (const uint8_t *)message, len, key);
 }
 
-void AsyncWebSocket::binary(uint32_t id, const char * message, size_t len){
+void AsyncWebSocket::binary(uint32_t id, const char * message, size_t len, uint32_t key){
   AsyncWebSocketClient * c = client(id);
   if(c)
-    c->binary(message, len);
+    c->binary(message, len, key);
 }
 
-void AsyncWebSocket::binaryAll(const char * message, size_t len){
-  AsyncWebSocketMessageBuffer * buffer = makeBuffer((uint8_t *)message, len); 
-  binaryAll(buffer); 
+void AsyncWebSocket::binaryAll(const char * message, size_t len, uint32_t key){
+  _frameAll(WS_BINARY, (const uint8_t *)message, len, key);
 }
 
 void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 {
   if (!buffer) return;
-  buffer->lock(); 
-    for(const auto& c: _clients){
-    if(c->status() == WS_CONNECTED)
-      c->binary(buffer);
-  }
-  buffer->unlock(); 
+  _frameAll(WS_BINARY, buffer->get(), buffer->length(), 0);
   _cleanBuffers(); 
 }
 
@@ -1036,7 +1608,7 @@ size_t AsyncWebSocket::printfAll(const char *format, ...) {
   return len;
 }
 
-#ifndef ESP32
+#if !defined(ESP32) && !defined(__linux__)
 size_t AsyncWebSocket::printf_P(uint32_t id, PGM_P formatP, ...){
   AsyncWebSocketClient * c = client(id);
   if(c != NULL){
@@ -1151,6 +1723,7 @@ const char * WS_STR_ORIGIN = "Origin";
 const char * WS_STR_VERSION = "Sec-WebSocket-Version";
 const char * WS_STR_KEY = "Sec-WebSocket-Key";
 const char * WS_STR_PROTOCOL = "Sec-WebSocket-Protocol";
+const char * WS_STR_EXTENSIONS = "Sec-WebSocket-Extensions";
 const char * WS_STR_ACCEPT = "Sec-WebSocket-Accept";
 const char * WS_STR_UUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
@@ -1167,9 +1740,90 @@ bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request){
   request->addInterestingHeader(WS_STR_VERSION);
   request->addInterestingHeader(WS_STR_KEY);
   request->addInterestingHeader(WS_STR_PROTOCOL);
+  request->addInterestingHeader(WS_STR_EXTENSIONS);
   return true;
 }
 
+static bool webSocketTokenIs(const char * s, const char * e, const char * token){
+  size_t len = strlen(token);
+  return (size_t)(e - s) == len && strncasecmp(s, token, len) == 0;
+}
+
+//window bits parameter value, optionally quoted. 0 if it is not 8..15
+static uint8_t webSocketWindowBits(const char * s, const char * e){
+  if(e - s >= 2 && *s == '"' && e[-1] == '"'){
+    s++;
+    e--;
+  }
+  if(e - s < 1 || e - s > 2)
+    return 0;
+  uint8_t bits = 0;
+  for(; s < e; s++){
+    if(*s < '0' || *s > '9')
+      return 0;
+    bits = bits * 10 + (*s - '0');
+  }
+  return (bits >= 8 && bits <= 15) ? bits : 0;
+}
+
+//one extension offer: "permessage-deflate" and ;-separated parameters. false if it is another
+//extension or has a parameter we cannot honour
+static bool webSocketDeflateOffer(const char * p, const char * end, uint8_t * bits, bool * takeover){
+  bool name = true;
+  while(p < end){
+    const char * next = (const char *)memchr(p, ';', end - p);
+    if(next == NULL)
+      next = end;
+    const char * s = p;
+    const char * e = next;
+    while(s < e && (*s == ' ' || *s == '\t')) s++;
+    while(e > s && (e[-1] == ' ' || e[-1] == '\t')) e--;
+    const char * eq = (const char *)memchr(s, '=', e - s);
+    const char * ne = eq ? eq : e;
+    while(ne > s && (ne[-1] == ' ' || ne[-1] == '\t')) ne--;
+    const char * v = eq ? eq + 1 : e;
+    while(v < e && (*v == ' ' || *v == '\t')) v++;
+    if(name){
+      if(eq || !webSocketTokenIs(s, ne, "permessage-deflate"))
+        return false;
+      name = false;
+    } else if(webSocketTokenIs(s, ne, "server_no_context_takeover") && !eq){
+      *takeover = false;
+    } else if(webSocketTokenIs(s, ne, "client_no_context_takeover") && !eq){
+      //asked for anyway
+    } else if(webSocketTokenIs(s, ne, "server_max_window_bits") && eq){
+      uint8_t b = webSocketWindowBits(v, e);
+      if(b == 0)
+        return false;
+      if(b < *bits)
+        *bits = b;
+    } else if(webSocketTokenIs(s, ne, "client_max_window_bits")){
+      if(eq && webSocketWindowBits(v, e) == 0)
+        return false;
+    } else {
+      return false;
+    }
+    p = next + 1;
+  }
+  return !name;
+}
+
+//the first offer of Sec-WebSocket-Extensions we can take, within the server's window and takeover
+static bool webSocketNegotiateDeflate(const char * offers, uint8_t maxBits, bool maxTakeover, uint8_t * bits, bool * takeover){
+  const char * p = offers;
+  while(*p){
+    const char * end = strchr(p, ',');
+    if(end == NULL)
+      end = p + strlen(p);
+    *bits = maxBits;
+    *takeover = maxTakeover;
+    if(webSocketDeflateOffer(p, end, bits, takeover))
+      return true;
+    p = *end ? end + 1 : end;
+  }
+  return false;
+}
+
 void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
   if(!request->hasHeader(WS_STR_VERSION) || !request->hasHeader(WS_STR_KEY)){
     request->send(400);
@@ -1186,7 +1840,13 @@ void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
     return;
   }
   AsyncWebHeader* key = request->getHeader(WS_STR_KEY);
-  AsyncWebServerResponse *response = new AsyncWebSocketResponse(key->value(), this);
+  AsyncWebSocketResponse *response = new AsyncWebSocketResponse(key->value(), this);
+  if(_deflateBits && request->hasHeader(WS_STR_EXTENSIONS)){
+    uint8_t bits;
+    bool takeover;
+    if(webSocketNegotiateDeflate(request->getHeader(WS_STR_EXTENSIONS)->value().c_str(), _deflateBits, _deflateTakeover, &bits, &takeover))
+      response->setDeflate(bits, takeover);
+  }
   if(request->hasHeader(WS_STR_PROTOCOL)){
     AsyncWebHeader* protocol = request->getHeader(WS_STR_PROTOCOL);
     //ToDo: check protocol
@@ -1219,13 +1879,14 @@ AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(uint8_t * data, size_t
 
 void AsyncWebSocket::_cleanBuffers()
 {
+  //only client text(buffer)/binary(buffer) keep buffers alive now, usually there is nothing to scan
+  if(_buffers.isEmpty())
+    return;
   AsyncWebLockGuard l(_lock);
 
-  for(AsyncWebSocketMessageBuffer * c: _buffers){
-    if(c && c->canDelete()){
-        _buffers.remove(c);
-    }
-  }
+  _buffers.remove_if([](AsyncWebSocketMessageBuffer * c){
+    return c && c->canDelete();
+  });
 }
 
 AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() const {
@@ -1239,6 +1900,8 @@ AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() cons
 
 AsyncWebSocketResponse::AsyncWebSocketResponse(const String& key, AsyncWebSocket *server){
   _server = server;
+  _deflateBits = 0;
+  _deflateTakeover = false;
   _code = 101;
   _sendContentLength = false;
 
@@ -1275,6 +1938,20 @@ AsyncWebSocketResponse::AsyncWebSocketResponse(const String& key, AsyncWebSocket
   free(hash);
 }
 
+//received messages are inflated one at a time, so the client never keeps context
+void AsyncWebSocketResponse::setDeflate(uint8_t windowBits, bool takeover){
+  _deflateBits = windowBits;
+  _deflateTakeover = takeover;
+  String value = "permessage-deflate; client_no_context_takeover";
+  if(!takeover)
+    value += "; server_no_context_takeover";
+  if(windowBits < WS_DEFLATE_MAX_WINDOW_BITS){
+    value += "; server_max_window_bits=";
+    value += (unsigned int)windowBits;
+  }
+  addHeader(WS_STR_EXTENSIONS, value);
+}
+
 void AsyncWebSocketResponse::_respond(AsyncWebServerRequest *request){
   if(_state == RESPONSE_FAILED){
     request->client()->close(true);
@@ -1288,7 +1965,7 @@ void AsyncWebSocketResponse::_respond(AsyncWebServerRequest *request){
 size_t AsyncWebSocketResponse::_ack(AsyncWebServerRequest *request, size_t len, uint32_t time){
   (void)time;
   if(len){
-    new AsyncWebSocketClient(request, _server);
+    new AsyncWebSocketClient(request, _server, _deflateBits, _deflateTakeover);
   }
   return 0;
 }
@@ -22,16 +22,21 @@
 #define ASYNCWEBSOCKET_H_
 
 #include <Arduino.h>
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
 #include <AsyncTCP.h>
-#define WS_MAX_QUEUED_MESSAGES 32
+#ifndef WS_MAX_QUEUED_MESSAGES
+#define WS_MAX_QUEUED_MESSAGES 32 //slots in each client's message queue
+#endif
 #else
 #include <ESPAsyncTCP.h>
+#ifndef WS_MAX_QUEUED_MESSAGES
 #define WS_MAX_QUEUED_MESSAGES 8
 #endif
+#endif
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncWebSocketDeflate.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -40,7 +45,23 @@
 #endif
 #endif
 
-#ifdef ESP32
+#ifndef WS_SPARE_FRAME_MESSAGES
+#define WS_SPARE_FRAME_MESSAGES 16 //freed broadcast messages kept for the next textAll()/binaryAll()
+#endif
+
+#ifndef WS_DEFLATE_WINDOW_BITS
+#define WS_DEFLATE_WINDOW_BITS 11 //2KB of history, 12KB per client with context takeover
+#endif
+
+#ifndef WS_DEFLATE_THRESHOLD
+#define WS_DEFLATE_THRESHOLD 64 //shorter messages are sent as they are
+#endif
+
+#ifndef WS_INFLATE_MAX_MESSAGE
+#define WS_INFLATE_MAX_MESSAGE 8192 //cap on a received compressed message when setReassembly() is off
+#endif
+
+#if defined(ESP32) || defined(__linux__)
 #define DEFAULT_MAX_WS_CLIENTS 8
 #else
 #define DEFAULT_MAX_WS_CLIENTS 4
@@ -75,6 +96,20 @@ typedef struct {
     uint64_t index;
 } AwsFrameInfo;
 
+typedef struct {
+    uint32_t deflated;        //messages sent compressed, a broadcast to clients without context takeover counts once
+    uint32_t skipped;         //messages to clients with permessage-deflate sent as they were (threshold, memory)
+    uint64_t deflate_in;      //payload bytes before compression
+    uint64_t deflate_out;     //and after
+    uint64_t deflate_us;      //time spent compressing
+    uint32_t deflate_max_us;
+    uint32_t inflated;        //compressed messages received
+    uint64_t inflate_in;
+    uint64_t inflate_out;
+    uint64_t inflate_us;
+    uint32_t inflate_max_us;
+} AwsDeflateStats;
+
 typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus;
 typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
 typedef enum { WS_MSG_SENDING, WS_MSG_SENT, WS_MSG_ERROR } AwsMessageStatus;
@@ -113,13 +148,17 @@ class AsyncWebSocketMessage {
     uint8_t _opcode;
     bool _mask;
     AwsMessageStatus _status;
+    uint32_t _key; //a newer message with the same key replaces this one under QUEUE_COALESCE, 0 never
   public:
-    AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR){}
+    AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR),_key(0){}
     virtual ~AsyncWebSocketMessage(){}
+    uint32_t key() const { return _key; }
+    void setKey(uint32_t key){ _key = key; }
     virtual void ack(size_t len __attribute__((unused)), uint32_t time __attribute__((unused))){}
     virtual size_t send(AsyncClient *client __attribute__((unused))){ return 0; }
     virtual bool finished(){ return _status != WS_MSG_SENDING; }
-    virtual bool betweenFrames() const { return false; }
+    virtual bool betweenFrames() const { return false; } //a control frame may go out now
+    virtual bool acked() const { return betweenFrames(); } //everything written so far has been acked
 };
 
 class AsyncWebSocketBasicMessage: public AsyncWebSocketMessage {
@@ -154,6 +193,46 @@ public:
     virtual size_t send(AsyncClient *client) override ;
 };
 
+/*
+ * BROADCAST :: textAll() and binaryAll() encode the server frame (header and payload) once.
+ * Every client queues a small message holding a reference to it and hands slices of it to its
+ * TCP window by reference. The frame is freed when the last client has it acked or drops it.
+ * */
+
+class AsyncWebSocketSharedFrame {
+  private:
+    uint32_t _refs;
+    size_t _len;
+    AsyncWebSocketSharedFrame(size_t len): _refs(1), _len(len) {}
+  public:
+    static AsyncWebSocketSharedFrame * create(uint8_t opcode, const uint8_t * data, size_t len); //one reference, NULL if out of memory
+    //the payload compressed for permessage-deflate, with RSV1 set
+    static AsyncWebSocketSharedFrame * deflate(AsyncWebSocketDeflater * deflater, uint8_t opcode, const uint8_t * data, size_t len);
+    void retain();
+    void release();
+    const uint8_t * data() const { return (const uint8_t *)(this + 1); }
+    size_t length() const { return _len; }
+    uint8_t headLength() const { const uint8_t l = data()[1] & 0x7F; return (l == 127) ? 10 : (l == 126) ? 4 : 2; }
+};
+
+class AsyncWebSocketFrameMessage: public AsyncWebSocketMessage {
+  private:
+    AsyncWebSocketSharedFrame * _frame;
+    size_t _sent;
+    size_t _acked;
+    AsyncWebSocketClient * _deflateFor; //compresses the frame as it starts to go out, in the order the peer inflates
+  public:
+    AsyncWebSocketFrameMessage(AsyncWebSocketSharedFrame * frame, AsyncWebSocketClient * deflateFor=NULL);
+    virtual ~AsyncWebSocketFrameMessage() override;
+    virtual bool betweenFrames() const override { return _sent == 0; }
+    virtual bool acked() const override { return _acked >= _sent; }
+    virtual void ack(size_t len, uint32_t time) override ;
+    virtual size_t send(AsyncClient *client) override ;
+    //recycled through a free list, a broadcast allocates nothing per client once it is warm
+    static void * operator new(size_t size) noexcept;
+    static void operator delete(void * p);
+};
+
 class AsyncWebSocketClient {
   private:
     AsyncClient *_client;
@@ -162,22 +241,41 @@ class AsyncWebSocketClient {
     AwsClientStatus _status;
 
     LinkedList<AsyncWebSocketControl *> _controlQueue;
-    LinkedList<AsyncWebSocketMessage *> _messageQueue;
+    RingQueue<AsyncWebSocketMessage *, WS_MAX_QUEUED_MESSAGES> _messageQueue;
+    AsyncWebLock _lock; //the queues are filled from the sketch and drained from async_tcp
+    AsyncQueuePolicy _queuePolicy;
+    uint32_t _dropped;   //messages thrown away because the queue was full
+    uint32_t _coalesced; //waiting messages replaced by a newer one with the same key
 
-    uint8_t _pstate;
+    uint8_t _pstate; //0 header, 1 payload, 2 protocol error, the rest is dropped
     AwsFrameInfo _pinfo;
+    uint8_t _phead[14]; //a header split between packets
+    uint8_t _pheadLen;
+    bool _pmessage;     //a fragmented message is waiting for its final frame
+    uint8_t *_pctl;     //a control frame split between packets
+    uint8_t *_prx;      //the message so far, when the server reassembles
+    size_t _prxLen;
+    bool _pinflate;     //the message is compressed, it is collected and inflated when complete
+
+    uint8_t _deflateBits;               //window negotiated for permessage-deflate, 0 without it
+    bool _deflateTakeover;              //our history carries over to the next message
+    AsyncWebSocketDeflater *_deflater;  //NULL when the server's shared one will do
 
     uint32_t _lastMessageTime;
     uint32_t _keepAlivePeriod;
 
-    void _queueMessage(AsyncWebSocketMessage *dataMessage);
+    void _queueMessage(AsyncWebSocketMessage *dataMessage, uint32_t key=0);
     void _queueControl(AsyncWebSocketControl *controlMessage);
     void _runQueue();
+    uint16_t _parseHeader(const uint8_t *head);
+    void _failRx(uint16_t code);
+    bool _handleControl(uint8_t *data, size_t datalen);
+    bool _handleData(uint8_t *data, size_t datalen, size_t avail);
 
   public:
     void *_tempObject;
 
-    AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server);
+    AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server, uint8_t deflateBits=0, bool deflateTakeover=false);
     ~AsyncWebSocketClient();
 
     //client id increments for the given server
@@ -186,9 +284,11 @@ class AsyncWebSocketClient {
     AsyncClient* client(){ return _client; }
     AsyncWebSocket *server(){ return _server; }
     AwsFrameInfo const &pinfo() const { return _pinfo; }
+    bool deflate() const { return _deflateBits != 0; } //permessage-deflate was negotiated
 
     IPAddress remoteIP();
     uint16_t  remotePort();
+    bool transportInfo(async_tcp_info_t * info);//RTT, unacked bytes and windows of the connection, for rate decisions
 
     //control frames
     void close(uint16_t code=0, const char * message=NULL);
@@ -203,14 +303,20 @@ class AsyncWebSocketClient {
     }
 
     //data packets
-    void message(AsyncWebSocketMessage *message){ _queueMessage(message); }
+    void message(AsyncWebSocketMessage *message, uint32_t key=0){ _queueMessage(message, key); }
     bool queueIsFull();
+    //what happens to messages once WS_MAX_QUEUED_MESSAGES are waiting (QUEUE_DROP_NEWEST by default).
+    //Keys are given with text(), binary() and message(); 0 is no key
+    void setQueuePolicy(AsyncQueuePolicy policy){ _queuePolicy = policy; }
+    AsyncQueuePolicy queuePolicy() const { return _queuePolicy; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t coalesced() const { return _coalesced; }
 
     size_t printf(const char *format, ...)  __attribute__ ((format (printf, 2, 3)));
-#ifndef ESP32
+#if !defined(ESP32) && !defined(__linux__)
     size_t printf_P(PGM_P formatP, ...)  __attribute__ ((format (printf, 2, 3)));
 #endif
-    void text(const char * message, size_t len);
+    void text(const char * message, size_t len, uint32_t key=0);
     void text(const char * message);
     void text(uint8_t * message, size_t len);
     void text(char * message);
@@ -218,7 +324,7 @@ class AsyncWebSocketClient {
     void text(const __FlashStringHelper *data);
     void text(AsyncWebSocketMessageBuffer *buffer); 
 
-    void binary(const char * message, size_t len);
+    void binary(const char * message, size_t len, uint32_t key=0);
     void binary(const char * message);
     void binary(uint8_t * message, size_t len);
     void binary(char * message);
@@ -226,7 +332,7 @@ class AsyncWebSocketClient {
     void binary(const __FlashStringHelper *data, size_t len);
     void binary(AsyncWebSocketMessageBuffer *buffer); 
 
-    bool canSend() { return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
+    bool canSend() { return !_messageQueue.isFull(); }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -235,6 +341,11 @@ class AsyncWebSocketClient {
     void _onTimeout(uint32_t time);
     void _onDisconnect();
     void _onData(void *pbuf, size_t plen);
+    //queues the message to go out compressed, false if it has to go as it is. A broadcast passes *shared
+    //to compress once for all clients without context takeover and *plain for the frame clients with
+    //their own history compress as it goes out, and releases both afterwards
+    bool _deflateMessage(uint8_t opcode, const uint8_t *data, size_t len, uint32_t key=0, AsyncWebSocketSharedFrame **shared=NULL, AsyncWebSocketSharedFrame **plain=NULL);
+    AsyncWebSocketSharedFrame * _deflateQueued(const AsyncWebSocketSharedFrame *frame);
 };
 
 typedef std::function<void(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len)> AwsEventHandler;
@@ -249,7 +360,17 @@ class AsyncWebSocket: public AsyncWebHandler {
     uint32_t _cNextId;
     AwsEventHandler _eventHandler;
     bool _enabled;
+    size_t _maxMessage;
     AsyncWebLock _lock;
+    uint8_t _deflateBits;
+    size_t _deflateMin;
+    bool _deflateTakeover;
+    AsyncWebSocketDeflater *_deflater; //no context takeover: one history for all, reset per message, under _lock
+    AwsDeflateStats _deflateStats;
+    AsyncWebLock _statsLock;
+    AsyncQueuePolicy _queuePolicy;
+
+    void _frameAll(uint8_t opcode, const uint8_t * data, size_t len, uint32_t key);
 
   public:
     AsyncWebSocket(const String& url);
@@ -257,6 +378,25 @@ class AsyncWebSocket: public AsyncWebHandler {
     const char * url() const { return _url.c_str(); }
     void enable(bool e){ _enabled = e; }
     bool enabled() const { return _enabled; }
+    //hand every text/binary message to WS_EVT_DATA in one piece (info->index 0, info->len the whole
+    //message), up to maxLen bytes. Bigger ones close the connection with 1009.
+    //0 streams frames as they arrive (default)
+    void setReassembly(size_t maxLen){ _maxMessage = maxLen; }
+    size_t reassembly() const { return _maxMessage; }
+    //RFC 7692 permessage-deflate for clients that offer it. Text and binary messages of at least
+    //threshold bytes are compressed with a 2^windowBits (8..15) history. With context takeover each
+    //client keeps its own history (6 * 2^windowBits bytes) and later messages refer back to earlier
+    //ones; without it one compressor serves everyone and a broadcast is compressed once.
+    //Clients are asked not to keep context, so received messages are inflated whole, up to
+    //reassembly() or WS_INFLATE_MAX_MESSAGE bytes. Applies to clients that connect afterwards
+    void setDeflate(bool enable, size_t threshold=WS_DEFLATE_THRESHOLD, uint8_t windowBits=WS_DEFLATE_WINDOW_BITS, bool contextTakeover=true);
+    bool deflateEnabled() const { return _deflateBits != 0; }
+    size_t deflateThreshold() const { return _deflateMin; }
+    void deflateStats(AwsDeflateStats * stats);
+    void resetDeflateStats();
+    //queue policy of every client, the ones connected now and later
+    void setQueuePolicy(AsyncQueuePolicy policy);
+    AsyncQueuePolicy queuePolicy() const { return _queuePolicy; }
     bool availableForWriteAll();
     bool availableForWrite(uint32_t id);
 
@@ -271,14 +411,14 @@ class AsyncWebSocket: public AsyncWebHandler {
     void ping(uint32_t id, uint8_t *data=NULL, size_t len=0);
     void pingAll(uint8_t *data=NULL, size_t len=0); //  done
 
-    void text(uint32_t id, const char * message, size_t len);
+    void text(uint32_t id, const char * message, size_t len, uint32_t key=0);
     void text(uint32_t id, const char * message);
     void text(uint32_t id, uint8_t * message, size_t len);
     void text(uint32_t id, char * message);
     void text(uint32_t id, const String &message);
     void text(uint32_t id, const __FlashStringHelper *message);
 
-    void textAll(const char * message, size_t len);
+    void textAll(const char * message, size_t len, uint32_t key=0);
     void textAll(const char * message);
     void textAll(uint8_t * message, size_t len);
     void textAll(char * message);
@@ -286,14 +426,14 @@ class AsyncWebSocket: public AsyncWebHandler {
     void textAll(const __FlashStringHelper *message); //  need to convert
     void textAll(AsyncWebSocketMessageBuffer * buffer); 
 
-    void binary(uint32_t id, const char * message, size_t len);
+    void binary(uint32_t id, const char * message, size_t len, uint32_t key=0);
     void binary(uint32_t id, const char * message);
     void binary(uint32_t id, uint8_t * message, size_t len);
     void binary(uint32_t id, char * message);
     void binary(uint32_t id, const String &message);
     void binary(uint32_t id, const __FlashStringHelper *message, size_t len);
 
-    void binaryAll(const char * message, size_t len);
+    void binaryAll(const char * message, size_t len, uint32_t key=0);
     void binaryAll(const char * message);
     void binaryAll(uint8_t * message, size_t len);
     void binaryAll(char * message);
@@ -306,7 +446,7 @@ class AsyncWebSocket: public AsyncWebHandler {
 
     size_t printf(uint32_t id, const char *format, ...)  __attribute__ ((format (printf, 3, 4)));
     size_t printfAll(const char *format, ...)  __attribute__ ((format (printf, 2, 3)));
-#ifndef ESP32
+#if !defined(ESP32) && !defined(__linux__)
     size_t printf_P(uint32_t id, PGM_P formatP, ...)  __attribute__ ((format (printf, 3, 4)));
 #endif
     size_t printfAll_P(PGM_P formatP, ...)  __attribute__ ((format (printf, 2, 3)));
@@ -321,6 +461,11 @@ class AsyncWebSocket: public AsyncWebHandler {
     void _addClient(AsyncWebSocketClient * client);
     void _handleDisconnect(AsyncWebSocketClient * client);
     void _handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len);
+    uint8_t _deflateWindowBits() const { return _deflateBits; }
+    AsyncWebSocketSharedFrame * _deflateFrame(AsyncWebSocketDeflater * deflater, uint8_t opcode, const uint8_t * data, size_t len);
+    AsyncWebSocketSharedFrame * _deflateShared(uint8_t opcode, const uint8_t * data, size_t len);
+    uint8_t * _inflate(const uint8_t * data, size_t len, size_t maxLen, size_t * outLen, uint16_t * error);
+    void _deflateSkipped();
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
 
@@ -339,8 +484,11 @@ class AsyncWebSocketResponse: public AsyncWebServerResponse {
   private:
     String _content;
     AsyncWebSocket *_server;
+    uint8_t _deflateBits;
+    bool _deflateTakeover;
   public:
     AsyncWebSocketResponse(const String& key, AsyncWebSocket *server);
+    void setDeflate(uint8_t windowBits, bool takeover); //accepts permessage-deflate with these parameters
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return true; }
@@ -0,0 +1,575 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "AsyncWebSocketDeflate.h"
+
+#define WS_DEFLATE_NIL 0xFFFF //no position; 2 * 2^15 - 1 is never hashed, it has no 3 bytes after it
+#define WS_DEFLATE_MIN_MATCH 3
+#define WS_DEFLATE_MAX_MATCH 258
+#define WS_DEFLATE_STORED_MAX 65535
+
+//RFC 1951 3.2.5: base value and extra bits of the length and distance codes
+static const uint16_t _lenBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t _lenExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t _distBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+  4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t _distExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static uint16_t _reverse(uint16_t code, uint8_t len){
+  uint16_t r = 0;
+  while(len--){
+    r = (r << 1) | (code & 1);
+    code >>= 1;
+  }
+  return r;
+}
+
+//the fixed Huffman code, bit reversed for an LSB first writer, and length/distance to code lookups
+struct AsyncWebSocketDeflateTables {
+  uint16_t literal[288];
+  uint8_t literalLen[288];
+  uint8_t lenCode[256];   //match length - 3
+  uint8_t distCode[512];  //distance - 1 below 256, else 256 + ((distance - 1) >> 7)
+  uint8_t distReversed[30];
+
+  AsyncWebSocketDeflateTables(){
+    for(uint16_t s = 0; s < 288; s++){
+      uint16_t code;
+      uint8_t len;
+      if(s < 144){ code = 0x30 + s; len = 8; }
+      else if(s < 256){ code = 0x190 + s - 144; len = 9; }
+      else if(s < 280){ code = s - 256; len = 7; }
+      else { code = 0xC0 + s - 280; len = 8; }
+      literal[s] = _reverse(code, len);
+      literalLen[s] = len;
+    }
+    uint8_t c = 0;
+    for(uint16_t l = 0; l < 256; l++){
+      while(c < 28 && l + 3 >= _lenBase[c + 1])
+        c++;
+      lenCode[l] = c;
+    }
+    c = 0;
+    for(uint16_t d = 0; d < 256; d++){
+      while(d + 1 >= _distBase[c + 1])
+        c++;
+      distCode[d] = c;
+    }
+    for(uint16_t d = 0; d < 256; d++){
+      uint32_t dist = ((uint32_t)d << 7) + 1;
+      while(c < 29 && dist >= _distBase[c + 1])
+        c++;
+      distCode[256 + d] = c;
+    }
+    for(uint8_t i = 0; i < 30; i++)
+      distReversed[i] = _reverse(i, 5);
+  }
+};
+
+static const AsyncWebSocketDeflateTables &_tables(){
+  static AsyncWebSocketDeflateTables tables;
+  return tables;
+}
+
+/*
+ * Deflater
+ */
+
+AsyncWebSocketDeflater::AsyncWebSocketDeflater(uint8_t windowBits)
+  :_bits(windowBits)
+  ,_buf(NULL)
+  ,_head(NULL)
+  ,_prev(NULL)
+  ,_len(0)
+  ,_out(NULL)
+  ,_outLen(0)
+  ,_bitBuf(0)
+  ,_bitCount(0)
+{
+  if(_bits < WS_DEFLATE_MIN_WINDOW_BITS)
+    _bits = WS_DEFLATE_MIN_WINDOW_BITS;
+  if(_bits > WS_DEFLATE_MAX_WINDOW_BITS)
+    _bits = WS_DEFLATE_MAX_WINDOW_BITS;
+  _wsize = (size_t)1 << _bits;
+  _tables();
+  _buf = (uint8_t*)malloc(2 * _wsize);
+  _head = (uint16_t*)malloc(_wsize * sizeof(uint16_t));
+  _prev = (uint16_t*)malloc(_wsize * sizeof(uint16_t));
+  if(_buf == NULL || _head == NULL || _prev == NULL){
+    free(_buf);
+    free(_head);
+    free(_prev);
+    _buf = NULL;
+    _head = NULL;
+    _prev = NULL;
+    return;
+  }
+  reset();
+}
+
+AsyncWebSocketDeflater::~AsyncWebSocketDeflater(){
+  free(_buf);
+  free(_head);
+  free(_prev);
+}
+
+void AsyncWebSocketDeflater::reset(){
+  _len = 0;
+  //_prev is only reached through _head, entries from before are never read
+  if(_head != NULL)
+    memset(_head, 0xFF, _wsize * sizeof(uint16_t));
+}
+
+//drops the older half of the buffer, positions in the tables move with it
+void AsyncWebSocketDeflater::_slide(){
+  memmove(_buf, _buf + _wsize, _wsize);
+  _len -= _wsize;
+  for(size_t i = 0; i < _wsize; i++){
+    _head[i] = (_head[i] != WS_DEFLATE_NIL && _head[i] >= _wsize) ? _head[i] - _wsize : WS_DEFLATE_NIL;
+    _prev[i] = (_prev[i] != WS_DEFLATE_NIL && _prev[i] >= _wsize) ? _prev[i] - _wsize : WS_DEFLATE_NIL;
+  }
+}
+
+static inline size_t _hash(const uint8_t *p, uint8_t bits){
+  uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  return (v * 2654435761u) >> (32 - bits);
+}
+
+void AsyncWebSocketDeflater::_insert(size_t pos){
+  size_t h = _hash(_buf + pos, _bits);
+  _prev[pos & (_wsize - 1)] = _head[h];
+  _head[h] = pos;
+}
+
+size_t AsyncWebSocketDeflater::_longest(size_t pos, size_t end, size_t *dist) const {
+  size_t maxLen = end - pos;
+  if(maxLen > WS_DEFLATE_MAX_MATCH)
+    maxLen = WS_DEFLATE_MAX_MATCH;
+  if(maxLen < WS_DEFLATE_MIN_MATCH)
+    return 0;
+  const uint8_t *p = _buf + pos;
+  size_t best = WS_DEFLATE_MIN_MATCH - 1;
+  uint16_t cand = _head[_hash(p, _bits)];
+  uint16_t chain = WS_DEFLATE_MAX_CHAIN;
+  //a slot of _prev is reused _wsize positions later, so the walk stops before that distance
+  while(cand != WS_DEFLATE_NIL && cand < pos && pos - cand < _wsize && chain--){
+    const uint8_t *c = _buf + cand;
+    if(c[best] == p[best] && c[0] == p[0] && c[1] == p[1]){
+      size_t n = 2;
+      while(n < maxLen && c[n] == p[n])
+        n++;
+      if(n > best){
+        best = n;
+        *dist = pos - cand;
+        if(n == maxLen)
+          break;
+      }
+    }
+    cand = _prev[cand & (_wsize - 1)];
+  }
+  return (best >= WS_DEFLATE_MIN_MATCH) ? best : 0;
+}
+
+void AsyncWebSocketDeflater::_putBits(uint32_t value, uint8_t count){
+  _bitBuf |= value << _bitCount;
+  _bitCount += count;
+  while(_bitCount >= 8){
+    _out[_outLen++] = (uint8_t)_bitBuf;
+    _bitBuf >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+void AsyncWebSocketDeflater::_putLiteral(uint16_t sym){
+  const AsyncWebSocketDeflateTables &t = _tables();
+  _putBits(t.literal[sym], t.literalLen[sym]);
+}
+
+void AsyncWebSocketDeflater::_putMatch(size_t len, size_t dist){
+  const AsyncWebSocketDeflateTables &t = _tables();
+  uint8_t lc = t.lenCode[len - WS_DEFLATE_MIN_MATCH];
+  _putLiteral(257 + lc);
+  if(_lenExtra[lc])
+    _putBits(len - _lenBase[lc], _lenExtra[lc]);
+  uint8_t dc = (dist <= 256) ? t.distCode[dist - 1] : t.distCode[256 + ((dist - 1) >> 7)];
+  _putBits(t.distReversed[dc], 5);
+  if(_distExtra[dc])
+    _putBits(dist - _distBase[dc], _distExtra[dc]);
+}
+
+//len bytes as stored blocks and the empty one of the sync flush, whose LEN/NLEN are left out
+size_t AsyncWebSocketDeflater::_putStored(const uint8_t *data, size_t len){
+  _outLen = 0;
+  while(len){
+    size_t n = (len > WS_DEFLATE_STORED_MAX) ? WS_DEFLATE_STORED_MAX : len;
+    _out[_outLen++] = 0; //not final, stored, padding
+    _out[_outLen++] = (uint8_t)n;
+    _out[_outLen++] = (uint8_t)(n >> 8);
+    _out[_outLen++] = (uint8_t)~n;
+    _out[_outLen++] = (uint8_t)(~n >> 8);
+    memcpy(_out + _outLen, data, n);
+    _outLen += n;
+    data += n;
+    len -= n;
+  }
+  _out[_outLen++] = 0;
+  return _outLen;
+}
+
+size_t AsyncWebSocketDeflater::compress(const uint8_t *data, size_t len, uint8_t *out){
+  if(!valid())
+    return 0;
+  const uint8_t *message = data;
+  const size_t messageLen = len;
+  _out = out;
+  _outLen = 0;
+  _bitBuf = 0;
+  _bitCount = 0;
+  _putBits(2, 3); //not final, fixed Huffman
+
+  while(len){
+    if(_len == 2 * _wsize)
+      _slide();
+    size_t chunk = 2 * _wsize - _len;
+    if(chunk > len)
+      chunk = len;
+    memcpy(_buf + _len, data, chunk);
+    size_t pos = _len;
+    const size_t end = _len + chunk;
+    while(pos < end){
+      size_t dist = 0;
+      size_t n = _longest(pos, end, &dist);
+      if(n){
+        _putMatch(n, dist);
+        for(size_t i = 0; i < n; i++, pos++){
+          if(pos + WS_DEFLATE_MIN_MATCH <= end)
+            _insert(pos);
+        }
+      } else {
+        _putLiteral(_buf[pos]);
+        if(pos + WS_DEFLATE_MIN_MATCH <= end)
+          _insert(pos);
+        pos++;
+      }
+    }
+    _len = end;
+    data += chunk;
+    len -= chunk;
+  }
+
+  _putLiteral(256);
+  _putBits(0, 3); //the sync flush: an empty stored block, byte aligned
+  if(_bitCount)
+    _putBits(0, 8 - _bitCount);
+
+  size_t stored = messageLen + 5 * ((messageLen + WS_DEFLATE_STORED_MAX - 1) / WS_DEFLATE_STORED_MAX) + 1;
+  if(_outLen > stored)
+    return _putStored(message, messageLen);
+  return _outLen;
+}
+
+/*
+ * Inflater
+ */
+
+typedef struct {
+  uint16_t count[16];  //codes per length
+  uint16_t symbol[320];//symbols ordered by code
+} AsyncWebSocketHuffman;
+
+typedef struct {
+  const uint8_t *in;
+  size_t inLen;
+  size_t pos;          //the 4 tail bytes follow the input
+  uint32_t bitBuf;
+  uint8_t bitCount;
+  uint8_t *out;
+  size_t outLen;
+  size_t outCap;
+  size_t maxLen;
+  uint16_t error;
+} AsyncWebSocketInflateState;
+
+static const uint8_t _syncTail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+static uint32_t _bits(AsyncWebSocketInflateState *s, uint8_t need){
+  while(s->bitCount < need){
+    if(s->pos >= s->inLen + 4){
+      s->error = 1007;
+      return 0;
+    }
+    uint8_t b = (s->pos < s->inLen) ? s->in[s->pos] : _syncTail[s->pos - s->inLen];
+    s->pos++;
+    s->bitBuf |= (uint32_t)b << s->bitCount;
+    s->bitCount += 8;
+  }
+  uint32_t v = s->bitBuf & ((1UL << need) - 1);
+  s->bitBuf >>= need;
+  s->bitCount -= need;
+  return v;
+}
+
+//false if the lengths over-subscribe the code; incomplete codes are fine until a missing one is read
+static bool _build(AsyncWebSocketHuffman *h, const uint8_t *lengths, uint16_t n){
+  uint16_t offs[16];
+  memset(h->count, 0, sizeof(h->count));
+  for(uint16_t s = 0; s < n; s++)
+    h->count[lengths[s]]++;
+  int32_t left = 1;
+  for(uint8_t len = 1; len < 16; len++){
+    left <<= 1;
+    left -= h->count[len];
+    if(left < 0)
+      return false;
+  }
+  offs[1] = 0;
+  for(uint8_t len = 1; len < 15; len++)
+    offs[len + 1] = offs[len] + h->count[len];
+  for(uint16_t s = 0; s < n; s++){
+    if(lengths[s])
+      h->symbol[offs[lengths[s]]++] = s;
+  }
+  return true;
+}
+
+static int32_t _decode(AsyncWebSocketInflateState *s, const AsyncWebSocketHuffman *h){
+  int32_t code = 0, first = 0, index = 0;
+  for(uint8_t len = 1; len < 16; len++){
+    code |= _bits(s, 1);
+    if(s->error)
+      return -1;
+    int32_t count = h->count[len];
+    if(code - count < first)
+      return h->symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  s->error = 1007;
+  return -1;
+}
+
+static bool _reserve(AsyncWebSocketInflateState *s, size_t more){
+  if(s->outLen + more <= s->outCap)
+    return true;
+  if(s->outLen + more > s->maxLen){
+    s->error = 1009;
+    return false;
+  }
+  size_t cap = s->outCap * 2;
+  if(cap < s->outLen + more)
+    cap = s->outLen + more;
+  if(cap > s->maxLen)
+    cap = s->maxLen;
+  uint8_t *out = (uint8_t*)realloc(s->out, cap + 1);
+  if(out == NULL){
+    s->error = 1011;
+    return false;
+  }
+  s->out = out;
+  s->outCap = cap;
+  return true;
+}
+
+static bool _stored(AsyncWebSocketInflateState *s){
+  s->bitBuf = 0;
+  s->bitCount = 0;
+  uint32_t len = _bits(s, 16);
+  uint32_t nlen = _bits(s, 16);
+  if(s->error || len != (~nlen & 0xFFFF)){
+    s->error = 1007;
+    return false;
+  }
+  if(!_reserve(s, len))
+    return false;
+  while(len--){
+    uint8_t b = (uint8_t)_bits(s, 8);
+    if(s->error)
+      return false;
+    s->out[s->outLen++] = b;
+  }
+  return true;
+}
+
+static bool _codes(AsyncWebSocketInflateState *s, const AsyncWebSocketHuffman *lencode, const AsyncWebSocketHuffman *distcode){
+  for(;;){
+    int32_t sym = _decode(s, lencode);
+    if(sym < 0)
+      return false;
+    if(sym < 256){
+      if(!_reserve(s, 1))
+        return false;
+      s->out[s->outLen++] = sym;
+    } else if(sym == 256){
+      return true;
+    } else {
+      sym -= 257;
+      if(sym >= 29){
+        s->error = 1007;
+        return false;
+      }
+      size_t len = _lenBase[sym] + _bits(s, _lenExtra[sym]);
+      int32_t dsym = _decode(s, distcode);
+      if(dsym < 0 || dsym >= 30){
+        s->error = 1007;
+        return false;
+      }
+      size_t dist = _distBase[dsym] + _bits(s, _distExtra[dsym]);
+      if(s->error || dist > s->outLen){
+        s->error = 1007; //no context takeover, nothing before the message
+        return false;
+      }
+      if(!_reserve(s, len))
+        return false;
+      uint8_t *p = s->out + s->outLen;
+      for(size_t i = 0; i < len; i++)
+        p[i] = p[i - dist];
+      s->outLen += len;
+    }
+  }
+}
+
+struct AsyncWebSocketFixedCodes {
+  AsyncWebSocketHuffman len;
+  AsyncWebSocketHuffman dist;
+
+  AsyncWebSocketFixedCodes(){
+    uint8_t lengths[288];
+    uint16_t s = 0;
+    for(; s < 144; s++) lengths[s] = 8;
+    for(; s < 256; s++) lengths[s] = 9;
+    for(; s < 280; s++) lengths[s] = 7;
+    for(; s < 288; s++) lengths[s] = 8;
+    _build(&len, lengths, 288);
+    for(s = 0; s < 30; s++) lengths[s] = 5;
+    _build(&dist, lengths, 30);
+  }
+};
+
+static bool _fixed(AsyncWebSocketInflateState *s){
+  static AsyncWebSocketFixedCodes codes;
+  return _codes(s, &codes.len, &codes.dist);
+}
+
+static bool _dynamic(AsyncWebSocketInflateState *s){
+  static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+  uint8_t lengths[320];
+  AsyncWebSocketHuffman lencode, distcode;
+  uint16_t nlen = _bits(s, 5) + 257;
+  uint16_t ndist = _bits(s, 5) + 1;
+  uint16_t ncode = _bits(s, 4) + 4;
+  if(s->error || nlen > 286 || ndist > 30){
+    s->error = 1007;
+    return false;
+  }
+  memset(lengths, 0, sizeof(lengths));
+  for(uint16_t i = 0; i < ncode; i++)
+    lengths[order[i]] = _bits(s, 3);
+  if(s->error || !_build(&lencode, lengths, 19)){
+    s->error = 1007;
+    return false;
+  }
+  uint16_t index = 0;
+  while(index < nlen + ndist){
+    int32_t sym = _decode(s, &lencode);
+    if(sym < 0)
+      return false;
+    if(sym < 16){
+      lengths[index++] = sym;
+      continue;
+    }
+    uint8_t len = 0;
+    uint16_t repeat;
+    if(sym == 16){
+      if(index == 0){
+        s->error = 1007;
+        return false;
+      }
+      len = lengths[index - 1];
+      repeat = 3 + _bits(s, 2);
+    } else if(sym == 17){
+      repeat = 3 + _bits(s, 3);
+    } else {
+      repeat = 11 + _bits(s, 7);
+    }
+    if(s->error || index + repeat > nlen + ndist){
+      s->error = 1007;
+      return false;
+    }
+    while(repeat--)
+      lengths[index++] = len;
+  }
+  if(lengths[256] == 0 || !_build(&lencode, lengths, nlen) || !_build(&distcode, lengths + nlen, ndist)){
+    s->error = 1007;
+    return false;
+  }
+  return _codes(s, &lencode, &distcode);
+}
+
+uint8_t * AsyncWebSocketInflater::inflate(const uint8_t *data, size_t len, size_t maxLen, size_t *outLen, uint16_t *error){
+  AsyncWebSocketInflateState s;
+  memset(&s, 0, sizeof(s));
+  s.in = data;
+  s.inLen = len;
+  s.maxLen = maxLen;
+  s.outCap = (len < 64) ? 256 : len * 4;
+  if(s.outCap > maxLen)
+    s.outCap = maxLen;
+  s.out = (uint8_t*)malloc(s.outCap + 1);
+  if(s.out == NULL){
+    *error = 1011;
+    return NULL;
+  }
+  bool last = false;
+  //the tail is an empty stored block that ends on the last byte, so running out there is the end
+  while(!last && !s.error && s.pos < s.inLen + 4){
+    last = _bits(&s, 1);
+    uint8_t type = _bits(&s, 2);
+    if(s.error)
+      break;
+    if(type == 0)
+      _stored(&s);
+    else if(type == 1)
+      _fixed(&s);
+    else if(type == 2)
+      _dynamic(&s);
+    else
+      s.error = 1007;
+  }
+  if(s.error){
+    free(s.out);
+    *error = s.error;
+    return NULL;
+  }
+  s.out[s.outLen] = 0;
+  *outLen = s.outLen;
+  return s.out;
+}
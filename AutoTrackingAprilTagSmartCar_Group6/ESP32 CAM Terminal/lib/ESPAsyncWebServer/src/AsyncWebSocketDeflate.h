@@ -0,0 +1,85 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBSOCKETDEFLATE_H_
+#define ASYNCWEBSOCKETDEFLATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WS_DEFLATE_MIN_WINDOW_BITS 8
+#define WS_DEFLATE_MAX_WINDOW_BITS 15
+
+#ifndef WS_DEFLATE_MAX_CHAIN
+#define WS_DEFLATE_MAX_CHAIN 32 //older positions tried per match, ratio against CPU time
+#endif
+
+/*
+ * PERMESSAGE-DEFLATE :: RFC 7692 message compression without zlib.
+ * The deflater does LZ77 over a 2^windowBits history with hash chains and writes one fixed-Huffman
+ * block per message, so its memory is the history and two index tables, nothing per message.
+ * The inflater takes whole messages and decodes all block types.
+ * */
+
+class AsyncWebSocketDeflater {
+  private:
+    uint8_t _bits;
+    size_t _wsize;   //longest distance + 1
+    uint8_t *_buf;   //2 * _wsize: the history, then the message being compressed
+    uint16_t *_head; //newest position per hash
+    uint16_t *_prev; //the position before it with the same hash, per position modulo _wsize
+    size_t _len;     //bytes used in _buf
+    uint8_t *_out;
+    size_t _outLen;
+    uint32_t _bitBuf;
+    uint8_t _bitCount;
+
+    void _slide();
+    void _insert(size_t pos);
+    size_t _longest(size_t pos, size_t end, size_t *dist) const;
+    void _putBits(uint32_t value, uint8_t count);
+    void _putLiteral(uint16_t sym);
+    void _putMatch(size_t len, size_t dist);
+    size_t _putStored(const uint8_t *data, size_t len);
+
+  public:
+    AsyncWebSocketDeflater(uint8_t windowBits);
+    ~AsyncWebSocketDeflater();
+    bool valid() const { return _buf != NULL; }
+    uint8_t windowBits() const { return _bits; }
+    size_t memory() const { return 2 * _wsize + 2 * _wsize * sizeof(uint16_t); }
+    void reset(); //forget the history, for no context takeover
+
+    //output of compress() for len bytes is never longer than this
+    static size_t bound(size_t len){ return len + (len >> 3) + 8; }
+    //one message, ending in a sync flush without its 00 00 ff ff. Data that does not compress
+    //goes out as stored blocks, so the history stays the same as the peer's either way
+    size_t compress(const uint8_t *data, size_t len, uint8_t *out);
+};
+
+class AsyncWebSocketInflater {
+  public:
+    //one message compressed without context takeover; the 00 00 ff ff tail is added here.
+    //Returns a malloc'ed buffer with a terminator after *outLen bytes, or NULL and the close code
+    //in *error: 1007 bad data, 1009 longer than maxLen, 1011 out of memory
+    static uint8_t * inflate(const uint8_t *data, size_t len, size_t maxLen, size_t *outLen, uint16_t *error);
+};
+
+#endif /* ASYNCWEBSOCKETDEFLATE_H_ */
@@ -1,7 +1,7 @@
 #ifndef ASYNCWEBSYNCHRONIZATION_H_
 #define ASYNCWEBSYNCHRONIZATION_H_
 
-// Synchronisation is only available on ESP32, as the ESP8266 isn't using FreeRTOS by default
+// Synchronisation is only available on ESP32 and Linux hosts, as the ESP8266 isn't using FreeRTOS by default
 
 #include <ESPAsyncWebServer.h>
 
@@ -41,6 +41,44 @@ public:
   }
 };
 
+#elif defined(__linux__)
+
+#include <pthread.h>
+
+// Host version of the Sync Lock, same semantics as the ESP32 one: a thread that already holds it does not lock again
+class AsyncWebLock
+{
+private:
+  mutable pthread_mutex_t _lock;
+  mutable pthread_t _lockedBy;
+  mutable bool _locked;
+
+public:
+  AsyncWebLock() {
+    pthread_mutex_init(&_lock, NULL);
+    _locked = false;
+  }
+
+  ~AsyncWebLock() {
+    pthread_mutex_destroy(&_lock);
+  }
+
+  bool lock() const {
+    if (_locked && pthread_equal(_lockedBy, pthread_self())) {
+      return false;
+    }
+    pthread_mutex_lock(&_lock);
+    _lockedBy = pthread_self();
+    _locked = true;
+    return true;
+  }
+
+  void unlock() const {
+    _locked = false;
+    pthread_mutex_unlock(&_lock);
+  }
+};
+
 #else
 
 // This is the 8266 version of the Sync Lock which is currently unimplemented
@@ -34,6 +34,8 @@
 #elif defined(ESP8266)
 #include <ESP8266WiFi.h>
 #include <ESPAsyncTCP.h>
+#elif defined(__linux__)
+#include <AsyncTCP.h> //POSIX backend, needs a host Arduino core (String, Stream, FS)
 #else
 #error Platform not supported
 #endif
@@ -55,7 +57,22 @@ class AsyncWebRewrite;
 class AsyncWebHandler;
 class AsyncStaticWebHandler;
 class AsyncCallbackWebHandler;
+class AsyncAssetWebHandler;
 class AsyncResponseStream;
+class AsyncWebRouter;
+
+//a file compiled into flash, usually gzipped, with its response headers worked out at build time
+typedef struct {
+  const char* uri;
+  const uint8_t* data;
+  size_t len;
+  const char* etag;    //quoted, as in the ETag header
+  const char* headers; //"Name: value\r\n" lines: Content-Length, Content-Type, Content-Encoding, ETag, Cache-Control
+} AsyncWebAsset;
+
+//what a WebSocket or EventSource client does with a message when its queue is full.
+//QUEUE_COALESCE also replaces a waiting message with the same key whether full or not
+typedef enum { QUEUE_DROP_NEWEST, QUEUE_DROP_OLDEST, QUEUE_COALESCE } AsyncQueuePolicy;
 
 #ifndef WEBSERVER_H
 typedef enum {
@@ -128,6 +145,30 @@ class AsyncWebHeader {
 
 typedef enum { RCT_NOT_USED = -1, RCT_DEFAULT = 0, RCT_HTTP, RCT_WS, RCT_EVENT, RCT_MAX } RequestedConnectionType;
 
+#ifndef ASYNCWEBSERVER_HEADER_SLICES
+#define ASYNCWEBSERVER_HEADER_SLICES 24 //headers kept unparsed per request, any more become AsyncWebHeaders right away
+#endif
+
+//a request header still in the request's head buffer: offsets of its NUL terminated name and value.
+//name is 0 once the header was turned into an AsyncWebHeader (taken, kept in _headers) or dropped as not interesting
+typedef struct {
+  uint16_t name;
+  uint16_t value;
+  AsyncWebHeader* taken;
+} AsyncWebHeaderSlice;
+
+#ifndef ASYNCWEBSERVER_KEEPALIVE_TIMEOUT
+#define ASYNCWEBSERVER_KEEPALIVE_TIMEOUT 5 //seconds an idle persistent connection is kept, 0 closes after every response
+#endif
+#ifndef ASYNCWEBSERVER_KEEPALIVE_MAX
+#define ASYNCWEBSERVER_KEEPALIVE_MAX 100 //requests answered on one connection
+#endif
+#ifndef ASYNCWEBSERVER_PIPELINE_MAX
+#define ASYNCWEBSERVER_PIPELINE_MAX 4096 //bytes of pipelined requests held while one is answered
+#endif
+
+struct AsyncWebRequestFrame;
+
 typedef std::function<size_t(uint8_t*, size_t, size_t)> AwsResponseFiller;
 typedef std::function<String(const String&)> AwsTemplateProcessor;
 
@@ -136,6 +177,7 @@ class AsyncWebServerRequest {
   using FS = fs::FS;
   friend class AsyncWebServer;
   friend class AsyncCallbackWebHandler;
+  friend class AsyncWebServerResponse;
   private:
     AsyncClient* _client;
     AsyncWebServer* _server;
@@ -147,6 +189,19 @@ class AsyncWebServerRequest {
     String _temp;
     uint8_t _parseState;
 
+    char* _head;        //request line and headers as received, split in place by the parser
+    size_t _headLen;
+    size_t _headSize;
+    size_t _lineStart;  //where the line being received starts in _head
+    mutable AsyncWebHeaderSlice _headerSlices[ASYNCWEBSERVER_HEADER_SLICES];
+    uint8_t _headerSliceCount;
+
+    AsyncWebRequestFrame* _frames; //our callbacks on the stack, told when we get deleted under them
+    char* _pipe;        //pipelined requests received while this one is answered
+    size_t _pipeLen;
+    uint16_t _served;   //requests answered on this connection
+    bool _keepAlive;
+
     uint8_t _version;
     WebRequestMethodComposite _method;
     String _url;
@@ -163,7 +218,7 @@ class AsyncWebServerRequest {
     size_t _contentLength;
     size_t _parsedLength;
 
-    LinkedList<AsyncWebHeader *> _headers;
+    mutable LinkedList<AsyncWebHeader *> _headers; //headers asked for so far, see _takeHeader()
     LinkedList<AsyncWebParameter *> _params;
     LinkedList<String *> _pathParams;
 
@@ -185,13 +240,19 @@ class AsyncWebServerRequest {
     void _onTimeout(uint32_t time);
     void _onDisconnect();
     void _onData(void *buf, size_t len);
+    void _ackResponse(size_t len, uint32_t time);
+    bool _queuePipelined(const char* data, size_t len);
+    void _recycle();
 
     void _addParam(AsyncWebParameter*);
     void _addPathParam(const char *param);
 
-    bool _parseReqHead();
-    bool _parseReqHeader();
-    void _parseLine();
+    bool _appendHead(const char* data, size_t len);
+    void _parseReqHead(char* line);
+    void _parseReqHeader(char* line);
+    void _parseLine(char* line, size_t len);
+    int _findHeaderSlice(const char* name) const;
+    AsyncWebHeader* _takeHeader(int slice) const;
     void _parsePlainPostChar(uint8_t data);
     void _parseMultipartPostByte(uint8_t data, bool last);
     void _addGetParams(const String& params);
@@ -218,6 +279,7 @@ class AsyncWebServerRequest {
     const char * methodToString() const;
     const char * requestedConnTypeToString() const;
     RequestedConnectionType requestedConnType() const { return _reqconntype; }
+    bool keepAlive() const { return _keepAlive; } //connection stays open for the next request
     bool isExpectedRequestedConnType(RequestedConnectionType erct1, RequestedConnectionType erct2 = RCT_NOT_USED, RequestedConnectionType erct3 = RCT_NOT_USED);
     void onDisconnect (ArDisconnectHandler fn);
 
@@ -277,7 +339,7 @@ class AsyncWebServerRequest {
     bool hasArg(const char* name) const;         // check if argument exists
     bool hasArg(const __FlashStringHelper * data) const;         // check if F(argument) exists
 
-    const String& ASYNCWEBSERVER_REGEX_ATTRIBUTE pathArg(size_t i) const;
+    const String& pathArg(size_t i) const;           // get "{name}" or regex path segment by number
 
     const String& header(const char* name) const;// get request header value by name
     const String& header(const __FlashStringHelper * data) const;// get request header value by F(name)    
@@ -345,6 +407,9 @@ class AsyncWebHandler {
     virtual void handleUpload(AsyncWebServerRequest *request  __attribute__((unused)), const String& filename __attribute__((unused)), size_t index __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), bool final  __attribute__((unused))){}
     virtual void handleBody(AsyncWebServerRequest *request __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), size_t index __attribute__((unused)), size_t total __attribute__((unused))){}
     virtual bool isRequestHandlerTrivial(){return true;}
+    //the path this handler only matches at or below, so the server can file it in its route tree.
+    //false (the default) and it is asked about every request
+    virtual bool _routeKey(const char** uri __attribute__((unused)), size_t* len __attribute__((unused)), WebRequestMethodComposite* method __attribute__((unused))){ return false; }
 };
 
 /*
@@ -368,7 +433,12 @@ class AsyncWebServerResponse {
     size_t _ackedLength;
     size_t _writtenLength;
     WebResponseState _state;
+    const char* _fixedHeaders;  //serialized header lines that live as long as the program, may be NULL
+    int8_t _connection;         //-1: the response writes its own, 0: close, 1: keep-alive
+    uint16_t _keepAliveTimeout;
+    uint16_t _keepAliveLeft;    //requests the client may still send on this connection
     const char* _responseCodeToString(int code);
+    void _addConnectionHeader(AsyncWebServerRequest *request, bool delimited); //delimited: the client can tell where the body ends
 
   public:
     AsyncWebServerResponse();
@@ -400,6 +470,11 @@ class AsyncWebServer {
     LinkedList<AsyncWebRewrite*> _rewrites;
     LinkedList<AsyncWebHandler*> _handlers;
     AsyncCallbackWebHandler* _catchAllHandler;
+    AsyncWebRouter* _router;
+    uint16_t _keepAliveTimeout;
+    uint16_t _keepAliveMax;
+    uint32_t _connections;
+    uint32_t _requests;
 
   public:
     AsyncWebServer(uint16_t port);
@@ -426,12 +501,20 @@ class AsyncWebServer {
     AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody);
 
     AsyncStaticWebHandler& serveStatic(const char* uri, fs::FS& fs, const char* path, const char* cache_control = NULL);
+    AsyncAssetWebHandler& serveAsset(const AsyncWebAsset* asset);
 
     void onNotFound(ArRequestHandlerFunction fn);  //called when handler is not assigned
     void onFileUpload(ArUploadHandlerFunction fn); //handle file uploads
     void onRequestBody(ArBodyHandlerFunction fn); //handle posts with plain body content (JSON often transmitted this way as a request)
 
     void reset(); //remove all writers and handlers, with onNotFound/onFileUpload/onRequestBody 
+
+    //HTTP/1.1 persistent connections: idle timeout in seconds and requests per connection, 0 for either turns them off
+    void setKeepAlive(uint16_t timeout, uint16_t maxRequests){ _keepAliveTimeout = timeout; _keepAliveMax = maxRequests; }
+    uint16_t keepAliveTimeout() const { return _keepAliveTimeout; }
+    uint16_t keepAliveMax() const { return _keepAliveMax; }
+    uint32_t connectionCount() const { return _connections; } //accepted so far
+    uint32_t requestCount() const { return _requests; }       //parsed so far, the difference is handshakes saved
   
     void _handleDisconnect(AsyncWebServerRequest *request);
     void _attachHandler(AsyncWebServerRequest *request);
@@ -441,17 +524,25 @@ class AsyncWebServer {
 class DefaultHeaders {
   using headers_t = LinkedList<AsyncWebHeader *>;
   headers_t _headers;
-  
+  String _serialized; //"Name: value\r\n" for all of them, pasted into every response head
+
   DefaultHeaders()
   :_headers(headers_t([](AsyncWebHeader *h){ delete h; }))
   {}
+  ~DefaultHeaders(){ _headers.free(); }
 public:
   using ConstIterator = headers_t::ConstIterator;
 
   void addHeader(const String& name, const String& value){
     _headers.add(new AsyncWebHeader(name, value));
-  }  
-  
+    _serialized.reserve(_serialized.length() + name.length() + value.length() + 4);
+    _serialized.concat(name);
+    _serialized.concat(": ");
+    _serialized.concat(value);
+    _serialized.concat("\r\n");
+  }
+
+  const String& serialized() const { return _serialized; }
   ConstIterator begin() const { return _headers.begin(); }
   ConstIterator end() const { return _headers.end(); }
 
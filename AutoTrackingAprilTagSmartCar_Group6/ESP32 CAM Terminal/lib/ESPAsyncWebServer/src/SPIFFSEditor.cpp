@@ -266,6 +266,13 @@ const uint8_t edit_htm_gz[] PROGMEM = {
  0xE8, 0x9D, 0x36, 0x92, 0x29, 0x00, 0x00
 };
 
+#define edit_htm_gz_etag "\"4e7f3540\"" //FNV-1a of the bytes above
+static const AsyncWebAsset edit_htm_asset = {
+  "/edit", edit_htm_gz, edit_htm_gz_len, edit_htm_gz_etag,
+  "Content-Length: 4151\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\nETag: " edit_htm_gz_etag "\r\n"
+  "Last-Modified: " __DATE__ " " __TIME__ " GMT\r\n"
+};
+
 #define SPIFFS_MAXLENGTH_FILEPATH 32
 const char *excludeListFile = "/.exclude.files";
 
@@ -325,7 +332,7 @@ static void loadExcludeList(fs::FS &_fs, const char *filename){
         //addExclude("/*.js.gz");
         return;
     }
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
     if(excludeFile.isDirectory()){
       excludeFile.close();
       return;
@@ -376,7 +383,7 @@ static bool isExcluded(fs::FS &_fs, const char *filename) {
 
 // WEB HANDLER IMPLEMENTATION
 
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
 SPIFFSEditor::SPIFFSEditor(const fs::FS& fs, const String& username, const String& password)
 #else
 SPIFFSEditor::SPIFFSEditor(const String& username, const String& password, const fs::FS& fs)
@@ -398,7 +405,7 @@ bool SPIFFSEditor::canHandle(AsyncWebServerRequest *request){
         if(!request->_tempFile){
           return false;
         }
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
         if(request->_tempFile.isDirectory()){
           request->_tempFile.close();
           return false;
@@ -410,7 +417,7 @@ bool SPIFFSEditor::canHandle(AsyncWebServerRequest *request){
         if(!request->_tempFile){
           return false;
         }
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
         if(request->_tempFile.isDirectory()){
           request->_tempFile.close();
           return false;
@@ -418,6 +425,7 @@ bool SPIFFSEditor::canHandle(AsyncWebServerRequest *request){
 #endif
       }
       request->addInterestingHeader("If-Modified-Since");
+      request->addInterestingHeader("If-None-Match");
       return true;
     }
     else if(request->method() == HTTP_POST)
@@ -439,14 +447,14 @@ void SPIFFSEditor::handleRequest(AsyncWebServerRequest *request){
   if(request->method() == HTTP_GET){
     if(request->hasParam("list")){
       String path = request->getParam("list")->value();
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
       File dir = _fs.open(path);
 #else
       Dir dir = _fs.openDir(path);
 #endif
       path = String();
       String output = "[";
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
       File entry = dir.openNextFile();
       while(entry){
 #else
@@ -454,7 +462,7 @@ void SPIFFSEditor::handleRequest(AsyncWebServerRequest *request){
         fs::File entry = dir.openFile("r");
 #endif
         if (isExcluded(_fs, entry.name())) {
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
             entry = dir.openNextFile();
 #endif
             continue;
@@ -467,13 +475,13 @@ void SPIFFSEditor::handleRequest(AsyncWebServerRequest *request){
         output += "\",\"size\":";
         output += String(entry.size());
         output += "}";
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
         entry = dir.openNextFile();
 #else
         entry.close();
 #endif
       }
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
       dir.close();
 #endif
       output += "]";
@@ -485,14 +493,9 @@ void SPIFFSEditor::handleRequest(AsyncWebServerRequest *request){
     }
     else {
       const char * buildTime = __DATE__ " " __TIME__ " GMT";
-      if (request->header("If-Modified-Since").equals(buildTime)) {
-        request->send(304);
-      } else {
-        AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", edit_htm_gz, edit_htm_gz_len);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Last-Modified", buildTime);
-        request->send(response);
-      }
+      bool notModified = request->header("If-Modified-Since").equals(buildTime)
+        || request->header("If-None-Match").indexOf(edit_htm_gz_etag) >= 0;
+      request->send(new AsyncAssetResponse(&edit_htm_asset, notModified ? 304 : 200));
     }
   } else if(request->method() == HTTP_DELETE){
     if(request->hasParam("path", true)){
@@ -22,6 +22,8 @@
 #define STRINGARRAY_H_
 
 #include "stddef.h"
+#include <new>
+#include <functional>
 #include "WString.h"
 
 template <typename T>
@@ -35,6 +37,10 @@ class LinkedListNode {
     T& value(){ return _value; }
 };
 
+#ifndef LINKEDLIST_SPARE_NODES
+#define LINKEDLIST_SPARE_NODES 4 //freed nodes each list keeps for its next add()
+#endif
+
 template <typename T, template<typename> class Item = LinkedListNode>
 class LinkedList {
   public:
@@ -43,6 +49,10 @@ class LinkedList {
     typedef std::function<bool(const T&)> Predicate;
   private:
     ItemType* _root;
+    ItemType* _last;
+    size_t _count;
+    ItemType* _spare; //destroyed nodes, chained through next
+    uint8_t _spareCount;
     OnRemove _onRemove;
 
     class Iterator {
@@ -55,23 +65,87 @@ class LinkedList {
       const T& operator * () const { return _node->value(); }
       const T* operator -> () const { return &_node->value(); }
     };
+
+    ItemType* _newItem(const T& t){
+      if(_spare){
+        ItemType* it = _spare;
+        _spare = _spare->next;
+        _spareCount--;
+        return new (it) ItemType(t);
+      }
+      return new ItemType(t);
+    }
+    //unlinks it (prev is the node before it, NULL for the root) and hands the value to _onRemove
+    void _drop(ItemType* prev, ItemType* it){
+      if(prev)
+        prev->next = it->next;
+      else
+        _root = it->next;
+      if(it == _last)
+        _last = prev;
+      _count--;
+      if (_onRemove) {
+        _onRemove(it->value());
+      }
+      if(_spareCount < LINKEDLIST_SPARE_NODES){
+        it->~ItemType();
+        it->next = _spare;
+        _spare = it;
+        _spareCount++;
+      } else {
+        delete it;
+      }
+    }
+    //releases the nodes without _onRemove: what the values point to belongs to whoever fills the list
+    void _clear(){
+      while(_root){
+        ItemType* it = _root;
+        _root = it->next;
+        delete it;
+      }
+      _last = nullptr;
+      _count = 0;
+    }
+    void _freeSpare(){
+      while(_spare){
+        ItemType* it = _spare;
+        _spare = _spare->next;
+        ::operator delete(it);
+      }
+      _spareCount = 0;
+    }
     
   public:
     typedef const Iterator ConstIterator;
     ConstIterator begin() const { return ConstIterator(_root); }
     ConstIterator end() const { return ConstIterator(nullptr); }
 
-    LinkedList(OnRemove onRemove) : _root(nullptr), _onRemove(onRemove) {}
-    ~LinkedList(){}
+    LinkedList(OnRemove onRemove) : _root(nullptr), _last(nullptr), _count(0), _spare(nullptr), _spareCount(0), _onRemove(onRemove) {}
+    //copies get nodes of their own (getClients() hands out snapshots like that), so the original
+    //can change under them; values are copied as they are, pointers still point to the same objects
+    LinkedList(const LinkedList& l) : _root(nullptr), _last(nullptr), _count(0), _spare(nullptr), _spareCount(0), _onRemove(l._onRemove) {
+      for(const auto& t : l)
+        add(t);
+    }
+    LinkedList& operator=(const LinkedList& l){
+      if(this != &l){
+        _clear();
+        _onRemove = l._onRemove;
+        for(const auto& t : l)
+          add(t);
+      }
+      return *this;
+    }
+    ~LinkedList(){ _clear(); _freeSpare(); }
     void add(const T& t){
-      auto it = new ItemType(t);
+      auto it = _newItem(t);
       if(!_root){
         _root = it;
       } else {
-        auto i = _root;
-        while(i->next) i = i->next;
-        i->next = it;
+        _last->next = it;
       }
+      _last = it;
+      _count++;
     }
     T& front() const {
       return _root->value();
@@ -81,22 +155,16 @@ class LinkedList {
       return _root == nullptr;
     }
     size_t length() const {
-      size_t i = 0;
-      auto it = _root;
-      while(it){
-        i++;
-        it = it->next;
-      }
-      return i;
+      return _count;
     }
     size_t count_if(Predicate predicate) const {
+      if (!predicate){
+        return _count;
+      }
       size_t i = 0;
       auto it = _root;
       while(it){
-        if (!predicate){
-          i++;
-        }
-        else if (predicate(it->value())) {
+        if (predicate(it->value())) {
           i++;
         }
         it = it->next;
@@ -104,31 +172,21 @@ class LinkedList {
       return i;
     }
     const T* nth(size_t N) const {
-      size_t i = 0;
+      if(N >= _count)
+        return nullptr;
+      if(N == _count - 1)
+        return &(_last->value());
       auto it = _root;
-      while(it){
-        if(i++ == N)
-          return &(it->value());
+      while(N--)
         it = it->next;
-      }
-      return nullptr;
+      return &(it->value());
     }
     bool remove(const T& t){
+      ItemType* pit = nullptr;
       auto it = _root;
-      auto pit = _root;
       while(it){
         if(it->value() == t){
-          if(it == _root){
-            _root = _root->next;
-          } else {
-            pit->next = it->next;
-          }
-          
-          if (_onRemove) {
-            _onRemove(it->value());
-          }
-          
-          delete it;
+          _drop(pit, it);
           return true;
         }
         pit = it;
@@ -137,19 +195,11 @@ class LinkedList {
       return false;
     }
     bool remove_first(Predicate predicate){
+      ItemType* pit = nullptr;
       auto it = _root;
-      auto pit = _root;
       while(it){
         if(predicate(it->value())){
-          if(it == _root){
-            _root = _root->next;
-          } else {
-            pit->next = it->next;
-          }
-          if (_onRemove) {
-            _onRemove(it->value());
-          }
-          delete it;
+          _drop(pit, it);
           return true;
         }
         pit = it;
@@ -157,17 +207,68 @@ class LinkedList {
       }
       return false;
     }
+    //one pass, unlike calling remove() from inside a range-for (which reads the node it just freed)
+    size_t remove_if(Predicate predicate){
+      size_t removed = 0;
+      ItemType* pit = nullptr;
+      auto it = _root;
+      while(it){
+        auto next = it->next;
+        if(predicate(it->value())){
+          _drop(pit, it);
+          removed++;
+        } else {
+          pit = it;
+        }
+        it = next;
+      }
+      return removed;
+    }
     
     void free(){
       while(_root != nullptr){
-        auto it = _root;
-        _root = _root->next;
-        if (_onRemove) {
-          _onRemove(it->value());
-        }
-        delete it;
+        _drop(nullptr, _root);
       }
-      _root = nullptr;
+    }
+};
+
+//a FIFO in a fixed array of N slots, nothing is allocated once it exists.
+//It holds values only: what is popped or removed is the caller's to free
+template <typename T, size_t N>
+class RingQueue {
+  private:
+    T _items[N];
+    size_t _head;
+    size_t _count;
+  public:
+    RingQueue() : _head(0), _count(0) {}
+    static size_t capacity(){ return N; }
+    size_t length() const { return _count; }
+    bool isEmpty() const { return _count == 0; }
+    bool isFull() const { return _count == N; }
+    T& front(){ return _items[_head]; }
+    //i-th from the front
+    T& operator[](size_t i){ return _items[(_head + i) % N]; }
+    bool push(const T& t){
+      if(_count == N)
+        return false;
+      _items[(_head + _count) % N] = t;
+      _count++;
+      return true;
+    }
+    T pop(){
+      T t = _items[_head];
+      _head = (_head + 1) % N;
+      _count--;
+      return t;
+    }
+    //takes the i-th from the front out, the ones behind it move up
+    T removeAt(size_t i){
+      T t = (*this)[i];
+      for(; i + 1 < _count; i++)
+        (*this)[i] = (*this)[i + 1];
+      _count--;
+      return t;
     }
 };
 
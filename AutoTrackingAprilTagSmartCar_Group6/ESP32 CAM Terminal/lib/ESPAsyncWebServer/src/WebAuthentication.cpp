@@ -20,7 +20,7 @@
 */
 #include "WebAuthentication.h"
 #include <libb64/cencode.h>
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
 #include "mbedtls/md5.h"
 #else
 #include "md5.h"
@@ -59,30 +59,30 @@ bool checkBasicAuthentication(const char * hash, const char * username, const ch
 }
 
 static bool getMD5(uint8_t * data, uint16_t len, char * output){//33 bytes or more
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
     mbedtls_md5_context _ctx;
 #else
     md5_context_t _ctx;
 #endif
+  static const char hex[] = "0123456789abcdef";
   uint8_t i;
-  uint8_t * _buf = (uint8_t*)malloc(16);
-  if(_buf == NULL)
-    return false;
-  memset(_buf, 0x00, 16);
-#ifdef ESP32
+  uint8_t _buf[16];
+#if defined(ESP32) || defined(__linux__)
   mbedtls_md5_init(&_ctx);
   mbedtls_md5_starts_ret(&_ctx);
   mbedtls_md5_update_ret(&_ctx, data, len);
   mbedtls_md5_finish_ret(&_ctx, _buf);
+  mbedtls_md5_free(&_ctx);
 #else
   MD5Init(&_ctx);
   MD5Update(&_ctx, data, len);
   MD5Final(_buf, &_ctx);
 #endif
   for(i = 0; i < 16; i++) {
-    sprintf(output + (i * 2), "%02x", _buf[i]);
+    output[i * 2] = hex[_buf[i] >> 4];
+    output[i * 2 + 1] = hex[_buf[i] & 0x0F];
   }
-  free(_buf);
+  output[32] = 0;
   return true;
 }
 
@@ -141,6 +141,84 @@ String requestDigestAuthentication(const char * realm){
   return header;
 }
 
+/*
+ * DIGEST SESSIONS :: A client answers one challenge for many requests, counting them with nc.
+ * Once a nonce and opaque have been verified, HA1 and the HA2 of the last method and uri are
+ * kept with the counts already used, so a client polling the same url costs one MD5, and a
+ * request played again with a count it used before is refused. The least recently used
+ * session makes room for a new one. Only the async_tcp task authenticates, so there is no lock.
+ * */
+
+typedef struct {
+  String nonce;
+  String opaque;
+  uint64_t credentials; //fingerprint of what ha1 was made from, never the password itself
+  String ha1;
+  String request;     //the method:uri ha2 was made from
+  String ha2;
+  uint32_t nc;        //the highest nonce count used
+  uint32_t ncSeen;    //bit n: nc - n was used
+  uint32_t used;
+} AsyncDigestSession;
+
+//FNV-1a over the strings ha1 comes from, each with its terminator. Only tells the handlers of
+//one device apart, it protects nothing: ha1 itself is kept next to it
+static uint64_t digestCredentials(bool passwordIsHash, const char * username, const char * realm, const char * password){
+  uint64_t h = passwordIsHash ? 0xcbf29ce484222325ULL : 0x84222325cbf29ce4ULL;
+  const char * parts[3] = { username, realm, password };
+  for(uint8_t i = 0; i < 3; i++){
+    const char * p = parts[i];
+    do {
+      h = (h ^ (uint8_t)*p) * 0x100000001b3ULL;
+    } while(*p++);
+  }
+  return h;
+}
+
+static AsyncDigestSession _digestSessions[DIGEST_AUTH_SESSIONS];
+static uint32_t _digestUsed = 0;
+
+static AsyncDigestSession * findDigestSession(const String& nonce, const String& opaque){
+  for(uint8_t i = 0; i < DIGEST_AUTH_SESSIONS; i++){
+    AsyncDigestSession * s = &_digestSessions[i];
+    if(s->nonce.length() && s->nonce.equals(nonce) && s->opaque.equals(opaque))
+      return s;
+  }
+  return NULL;
+}
+
+static AsyncDigestSession * addDigestSession(const String& nonce, const String& opaque){
+  AsyncDigestSession * oldest = &_digestSessions[0];
+  for(uint8_t i = 1; i < DIGEST_AUTH_SESSIONS; i++){
+    if((uint32_t)(_digestUsed - _digestSessions[i].used) > (uint32_t)(_digestUsed - oldest->used))
+      oldest = &_digestSessions[i];
+  }
+  oldest->nonce = nonce;
+  oldest->opaque = opaque;
+  oldest->nc = 0;
+  oldest->ncSeen = 0;
+  return oldest;
+}
+
+//false if nc was used before, or is too far behind to tell
+static bool digestCountFresh(const AsyncDigestSession * s, uint32_t nc){
+  if(nc > s->nc)
+    return true;
+  uint32_t behind = s->nc - nc;
+  return behind < 32 && !(s->ncSeen & (1UL << behind));
+}
+
+static void digestCountUse(AsyncDigestSession * s, uint32_t nc){
+  if(nc > s->nc){
+    uint32_t ahead = nc - s->nc;
+    s->ncSeen = (ahead < 32) ? ((s->ncSeen << ahead) | 1) : 1;
+    s->nc = nc;
+  } else {
+    s->ncSeen |= 1UL << (s->nc - nc);
+  }
+  s->used = ++_digestUsed;
+}
+
 bool checkDigestAuthentication(const char * header, const char * method, const char * username, const char * password, const char * realm, bool passwordIsHash, const char * nonce, const char * opaque, const char * uri){
   if(username == NULL || password == NULL || header == NULL || method == NULL){
     //os_printf("AUTH FAIL: missing requred fields\n");
@@ -157,6 +235,7 @@ bool checkDigestAuthentication(const char * header, const char * method, const c
   String myUsername = String();
   String myRealm = String();
   String myNonce = String();
+  String myOpaque = String();
   String myUri = String();
   String myResponse = String();
   String myQop = String();
@@ -204,6 +283,7 @@ bool checkDigestAuthentication(const char * header, const char * method, const c
         //os_printf("AUTH FAIL: opaque\n");
         return false;
       }
+      myOpaque = avLine;
     } else if(varName.equals("uri")){
       if(uri != NULL && !avLine.equals(uri)){
         //os_printf("AUTH FAIL: uri\n");
@@ -221,11 +301,33 @@ bool checkDigestAuthentication(const char * header, const char * method, const c
     }
   } while(nextBreak > 0);
 
-  String ha1 = (passwordIsHash) ? String(password) : stringMD5(myUsername + ":" + myRealm + ":" + String(password));
-  String ha2 = String(method) + ":" + myUri;
-  String response = ha1 + ":" + myNonce + ":" + myNc + ":" + myCnonce + ":" + myQop + ":" + stringMD5(ha2);
+  //a client counting its requests with nc may have a session with this challenge already
+  uint32_t nc = myNc.length() ? strtoul(myNc.c_str(), NULL, 16) : 0;
+  AsyncDigestSession * session = (nc > 0) ? findDigestSession(myNonce, myOpaque) : NULL;
+  if(session != NULL && !digestCountFresh(session, nc)){
+    //os_printf("AUTH FAIL: nc replayed\n");
+    return false;
+  }
+
+  uint64_t credentials = digestCredentials(passwordIsHash, myUsername.c_str(), myRealm.c_str(), password);
+  String request = String(method) + ":" + myUri;
+  bool known = session != NULL && session->credentials == credentials;
+  String ha1 = known ? session->ha1 : (passwordIsHash) ? String(password) : stringMD5(myUsername + ":" + myRealm + ":" + String(password));
+  String ha2 = (known && session->request.equals(request)) ? session->ha2 : stringMD5(request);
+  String response = ha1 + ":" + myNonce + ":" + myNc + ":" + myCnonce + ":" + myQop + ":" + ha2;
 
   if(myResponse.equals(stringMD5(response))){
+    if(nc > 0){
+      if(session == NULL)
+        session = addDigestSession(myNonce, myOpaque);
+      if(!known){
+        session->credentials = credentials;
+        session->ha1 = ha1;
+      }
+      session->request = request;
+      session->ha2 = ha2;
+      digestCountUse(session, nc);
+    }
     //os_printf("AUTH SUCCESS\n");
     return true;
   }
@@ -24,6 +24,10 @@
 
 #include "Arduino.h"
 
+#ifndef DIGEST_AUTH_SESSIONS
+#define DIGEST_AUTH_SESSIONS 4 //clients whose digest challenge is remembered
+#endif
+
 bool checkBasicAuthentication(const char * header, const char * username, const char * password);
 String requestDigestAuthentication(const char * realm);
 bool checkDigestAuthentication(const char * header, const char * method, const char * username, const char * password, const char * realm, bool passwordIsHash, const char * nonce, const char * opaque, const char * uri);
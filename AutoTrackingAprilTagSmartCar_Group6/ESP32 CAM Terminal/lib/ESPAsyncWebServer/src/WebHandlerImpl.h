@@ -29,6 +29,34 @@
 #include "stddef.h"
 #include <time.h>
 
+//LRU set of small files kept in RAM for one AsyncStaticWebHandler, within a byte budget
+class AsyncStaticFileCache {
+   using File = fs::File;
+  private:
+    LinkedList<AsyncStaticCacheEntry*> _entries; //least recently used first
+    size_t _budget;
+    size_t _maxFile;
+    size_t _used;
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _notModified;
+    void _evict(AsyncStaticCacheEntry* entry);
+  public:
+    AsyncStaticFileCache(size_t budget, size_t maxFile);
+    ~AsyncStaticFileCache();
+    AsyncStaticCacheEntry* find(const String& url, bool touch=true);
+    //reads the whole file, NULL if it is too big or there is no memory for it
+    AsyncStaticCacheEntry* insert(const String& url, const String& path, File& file);
+    void clear();
+    void countNotModified(){ _notModified++; }
+
+    size_t used() const { return _used; }
+    size_t count() const { return _entries.length(); }
+    uint32_t hits() const { return _hits; }
+    uint32_t misses() const { return _misses; }
+    uint32_t notModified() const { return _notModified; } //304s sent from the cached ETag
+};
+
 class AsyncStaticWebHandler: public AsyncWebHandler {
    using File = fs::File;
    using FS = fs::FS;
@@ -36,6 +64,7 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     bool _getFile(AsyncWebServerRequest *request);
     bool _fileExists(AsyncWebServerRequest *request, const String& path);
     uint8_t _countBits(const uint8_t value) const;
+    bool _sendCached(AsyncWebServerRequest *request, String& filename);
   protected:
     FS _fs;
     String _uri;
@@ -47,8 +76,10 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     bool _isDir;
     bool _gzipFirst;
     uint8_t _gzipStats;
+    AsyncStaticFileCache* _fileCache;
   public:
     AsyncStaticWebHandler(const char* uri, FS& fs, const char* path, const char* cache_control);
+    ~AsyncStaticWebHandler();
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
     AsyncStaticWebHandler& setIsDir(bool isDir);
@@ -61,6 +92,20 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     AsyncStaticWebHandler& setLastModified(); //sets to current time. Make sure sntp is runing and time is updated
   #endif
     AsyncStaticWebHandler& setTemplateProcessor(AwsTemplateProcessor newCallback) {_callback = newCallback; return *this;}
+    //keep files up to maxFileSize bytes in RAM, budget bytes in all. 0 turns it off
+    AsyncStaticWebHandler& setFileCache(size_t budget, size_t maxFileSize=8192);
+    const AsyncStaticFileCache* fileCache() const { return _fileCache; }
+};
+
+class AsyncAssetWebHandler: public AsyncWebHandler {
+  private:
+    const AsyncWebAsset* _asset;
+  public:
+    AsyncAssetWebHandler(const AsyncWebAsset* asset) : _asset(asset) {}
+    virtual bool canHandle(AsyncWebServerRequest *request) override final;
+    virtual void handleRequest(AsyncWebServerRequest *request) override final;
+    virtual bool isRequestHandlerTrivial() override final {return true;}
+    virtual bool _routeKey(const char** uri, size_t* len, WebRequestMethodComposite* method) override final;
 };
 
 class AsyncCallbackWebHandler: public AsyncWebHandler {
@@ -72,11 +117,14 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
     ArUploadHandlerFunction _onUpload;
     ArBodyHandlerFunction _onBody;
     bool _isRegex;
+    bool _hasParams;
+    bool _matchParams(AsyncWebServerRequest *request);
   public:
-    AsyncCallbackWebHandler() : _uri(), _method(HTTP_ANY), _onRequest(NULL), _onUpload(NULL), _onBody(NULL), _isRegex(false) {}
+    AsyncCallbackWebHandler() : _uri(), _method(HTTP_ANY), _onRequest(NULL), _onUpload(NULL), _onBody(NULL), _isRegex(false), _hasParams(false) {}
     void setUri(const String& uri){ 
       _uri = uri; 
       _isRegex = uri.startsWith("^") && uri.endsWith("$");
+      _hasParams = !_isRegex && !uri.endsWith("*") && uri.indexOf("/{") >= 0;
     }
     void setMethod(WebRequestMethodComposite method){ _method = method; }
     void onRequest(ArRequestHandlerFunction fn){ _onRequest = fn; }
@@ -105,6 +153,11 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
         }
       } else 
 #endif
+      if (_hasParams) {
+        if (!_matchParams(request))
+          return false;
+      }
+      else
       if (_uri.length() && _uri.startsWith("/*.")) {
          String uriTemplate = String (_uri);
          uriTemplate = uriTemplate.substring(uriTemplate.lastIndexOf("."));
@@ -146,6 +199,7 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
         _onBody(request, data, len, index, total);
     }
     virtual bool isRequestHandlerTrivial() override final {return _onRequest ? false : true;}
+    virtual bool _routeKey(const char** uri, size_t* len, WebRequestMethodComposite* method) override final;
 };
 
 #endif /* ASYNCWEBSERVERHANDLERIMPL_H_ */
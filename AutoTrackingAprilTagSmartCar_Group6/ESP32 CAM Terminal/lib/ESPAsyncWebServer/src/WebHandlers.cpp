@@ -21,8 +21,92 @@
 #include "ESPAsyncWebServer.h"
 #include "WebHandlerImpl.h"
 
+AsyncStaticFileCache::AsyncStaticFileCache(size_t budget, size_t maxFile)
+  : _entries(LinkedList<AsyncStaticCacheEntry*>(nullptr))
+  , _budget(budget)
+  , _maxFile(maxFile)
+  , _used(0)
+  , _hits(0)
+  , _misses(0)
+  , _notModified(0)
+{}
+
+AsyncStaticFileCache::~AsyncStaticFileCache(){
+  clear();
+}
+
+void AsyncStaticFileCache::_evict(AsyncStaticCacheEntry* entry){
+  _entries.remove(entry);
+  _used -= entry->len;
+  entry->cached = false;
+  entry->refs++;
+  entry->release(); //frees it unless a response is still sending it
+}
+
+void AsyncStaticFileCache::clear(){
+  while(!_entries.isEmpty())
+    _evict(_entries.front());
+}
+
+AsyncStaticCacheEntry* AsyncStaticFileCache::find(const String& url, bool touch){
+  for(const auto& e: _entries){
+    if(e->url != url)
+      continue;
+    if(touch){
+      AsyncStaticCacheEntry* entry = e;
+      _hits++;
+      _entries.remove(entry);
+      _entries.add(entry);
+      return entry;
+    }
+    return e;
+  }
+  return NULL;
+}
+
+AsyncStaticCacheEntry* AsyncStaticFileCache::insert(const String& url, const String& path, File& file){
+  _misses++;
+  size_t len = file.size();
+  if(len > _maxFile || len > _budget)
+    return NULL;
+  uint8_t* data = (uint8_t*)malloc(len ? len : 1);
+  if(data == NULL)
+    return NULL;
+  size_t got = 0;
+  while(got < len){
+    size_t r = file.read(data + got, len - got);
+    if(r == 0)
+      break;
+    got += r;
+  }
+  AsyncStaticCacheEntry* entry = (got == len) ? new (std::nothrow) AsyncStaticCacheEntry() : NULL;
+  if(entry == NULL){
+    free(data);
+    file.seek(0);
+    return NULL;
+  }
+  //FNV-1a, the ETag changes whenever the bytes do
+  uint32_t hash = 2166136261u;
+  for(size_t i = 0; i < len; i++)
+    hash = (hash ^ data[i]) * 16777619u;
+  snprintf(entry->etag, sizeof(entry->etag), "\"%08x\"", (unsigned int)hash);
+  entry->url = url;
+  entry->path = path;
+  entry->data = data;
+  entry->len = len;
+  entry->gzip = String(file.name()).endsWith(".gz") && !path.endsWith(".gz");
+  entry->cached = true;
+  entry->refs = 0;
+
+  while(_used + len > _budget && !_entries.isEmpty())
+    _evict(_entries.front());
+  _entries.add(entry);
+  _used += len;
+  return entry;
+}
+
 AsyncStaticWebHandler::AsyncStaticWebHandler(const char* uri, FS& fs, const char* path, const char* cache_control)
-  : _fs(fs), _uri(uri), _path(path), _default_file("index.htm"), _cache_control(cache_control), _last_modified(""), _callback(nullptr)
+  : _fs(fs), _uri(uri), _path(path), _default_file("index.htm"), _cache_control(cache_control), _last_modified(""), _callback(nullptr), _fileCache(NULL)
 {
   // Ensure leading '/'
   if (_uri.length() == 0 || _uri[0] != '/') _uri = "/" + _uri;
@@ -42,6 +126,16 @@ AsyncStaticWebHandler::AsyncStaticWebHandler(const char* uri, FS& fs, const char
   _gzipStats = 0xF8;
 }
 
+AsyncStaticWebHandler::~AsyncStaticWebHandler(){
+  delete _fileCache;
+}
+
+AsyncStaticWebHandler& AsyncStaticWebHandler::setFileCache(size_t budget, size_t maxFileSize){
+  delete _fileCache;
+  _fileCache = budget ? new AsyncStaticFileCache(budget, maxFileSize) : NULL;
+  return *this;
+}
+
 AsyncStaticWebHandler& AsyncStaticWebHandler::setIsDir(bool isDir){
   _isDir = isDir;
   return *this;
@@ -87,12 +181,13 @@ bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request){
   ){
     return false;
   }
-  if (_getFile(request)) {
+  // A file held in RAM is answered without opening anything
+  if ((_fileCache && !_callback && _fileCache->find(request->url(), false)) || _getFile(request)) {
     // We interested in "If-Modified-Since" header to check if file was modified
     if (_last_modified.length())
       request->addInterestingHeader("If-Modified-Since");
 
-    if(_cache_control.length())
+    if(_cache_control.length() || _fileCache)
       request->addInterestingHeader("If-None-Match");
 
     DEBUGF("[AsyncStaticWebHandler::canHandle] TRUE\n");
@@ -128,7 +223,7 @@ bool AsyncStaticWebHandler::_getFile(AsyncWebServerRequest *request)
   return _fileExists(request, path);
 }
 
-#ifdef ESP32
+#if defined(ESP32) || defined(__linux__)
 #define FILE_IS_REAL(f) (f == true && !f.isDirectory())
 #else
 #define FILE_IS_REAL(f) (f == true)
@@ -184,15 +279,62 @@ uint8_t AsyncStaticWebHandler::_countBits(const uint8_t value) const
   return n;
 }
 
+//answers from the RAM cache, reading the file into it first if it is not there yet.
+//false leaves the request to the filesystem path, with filename and _tempFile set if there is a file
+bool AsyncStaticWebHandler::_sendCached(AsyncWebServerRequest *request, String& filename)
+{
+  AsyncStaticCacheEntry* entry = _fileCache->find(request->url());
+  if (entry == NULL) {
+    if (request->_tempFile != true) {
+      // canHandle() saw it in the cache, it has been pushed out since
+      if (!_getFile(request))
+        return false;
+      filename = String((char*)request->_tempObject);
+      free(request->_tempObject);
+      request->_tempObject = NULL;
+    }
+    entry = _fileCache->insert(request->url(), filename, request->_tempFile);
+    if (entry == NULL)
+      return false;
+    request->_tempFile.close();
+  }
+
+  if (_last_modified.length() && _last_modified == request->header("If-Modified-Since")) {
+    _fileCache->countNotModified();
+    request->send(304); // Not modified
+    return true;
+  }
+  AsyncWebServerResponse * response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(entry->etag) >= 0) {
+    _fileCache->countNotModified();
+    response = new AsyncBasicResponse(304); // Not modified
+  } else {
+    response = new AsyncStaticCacheResponse(entry);
+    if (_last_modified.length())
+      response->addHeader("Last-Modified", _last_modified);
+  }
+  if (_cache_control.length())
+    response->addHeader("Cache-Control", _cache_control);
+  response->addHeader("ETag", entry->etag);
+  request->send(response);
+  return true;
+}
+
 void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
 {
   // Get the filename from request->_tempObject and free it
-  String filename = String((char*)request->_tempObject);
-  free(request->_tempObject);
-  request->_tempObject = NULL;
+  String filename;
+  if (request->_tempObject) {
+    filename = String((char*)request->_tempObject);
+    free(request->_tempObject);
+    request->_tempObject = NULL;
+  }
   if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
       return request->requestAuthentication();
 
+  if (_fileCache && !_callback && _sendCached(request, filename))
+    return;
+
   if (request->_tempFile == true) {
     String etag = String(request->_tempFile.size());
     if (_last_modified.length() && _last_modified == request->header("If-Modified-Since")) {
@@ -218,3 +360,84 @@ void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
     request->send(404);
   }
 }
+
+bool AsyncAssetWebHandler::canHandle(AsyncWebServerRequest *request){
+  if(request->method() != HTTP_GET
+    || request->url() != _asset->uri
+    || !request->isExpectedRequestedConnType(RCT_DEFAULT, RCT_HTTP)
+  ){
+    return false;
+  }
+  request->addInterestingHeader("If-None-Match");
+  return true;
+}
+
+void AsyncAssetWebHandler::handleRequest(AsyncWebServerRequest *request){
+  if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
+    return request->requestAuthentication();
+  bool notModified = request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(_asset->etag) >= 0;
+  request->send(new AsyncAssetResponse(_asset, notModified ? 304 : 200));
+}
+
+bool AsyncAssetWebHandler::_routeKey(const char** uri, size_t* len, WebRequestMethodComposite* method){
+  if(_asset->uri[0] != '/')
+    return false;
+  *uri = _asset->uri;
+  *len = strlen(_asset->uri);
+  *method = HTTP_GET;
+  return true;
+}
+
+#define ASYNCWEBSERVER_PATH_PARAMS 8
+
+//"/sensor/{id}": literal segments compare as they are, "{name}" takes any one non-empty segment.
+//Like plain uris the url may go on below the last segment
+bool AsyncCallbackWebHandler::_matchParams(AsyncWebServerRequest *request){
+  const String& url = request->url();
+  const char* u = _uri.c_str();
+  const char* p = url.c_str();
+  size_t starts[ASYNCWEBSERVER_PATH_PARAMS];
+  size_t ends[ASYNCWEBSERVER_PATH_PARAMS];
+  uint8_t found = 0;
+  while(*u){
+    if(*u != '/' || *p != '/')
+      return false;
+    u++;
+    p++;
+    const char* ue = strchr(u, '/');
+    const char* pe = strchr(p, '/');
+    if(ue == NULL) ue = u + strlen(u);
+    if(pe == NULL) pe = p + strlen(p);
+    if(ue - u >= 2 && u[0] == '{' && ue[-1] == '}'){
+      if(pe == p || found == ASYNCWEBSERVER_PATH_PARAMS)
+        return false;
+      starts[found] = p - url.c_str();
+      ends[found++] = pe - url.c_str();
+    } else if(ue - u != pe - p || memcmp(u, p, ue - u) != 0){
+      return false;
+    }
+    u = ue;
+    p = pe;
+  }
+  if(*p != 0 && *p != '/')
+    return false;
+  for(uint8_t i = 0; i < found; i++)
+    request->_addPathParam(url.substring(starts[i], ends[i]).c_str());
+  return true;
+}
+
+bool AsyncCallbackWebHandler::_routeKey(const char** uri, size_t* len, WebRequestMethodComposite* method){
+  if(_isRegex || !_uri.length() || _uri[0] != '/' || _uri.startsWith("/*."))
+    return false;
+  size_t l = _uri.length();
+  if(_uri.endsWith("*")){
+    //"/dir/*" stays on a segment boundary, "/dir*" would match "/directory" too
+    if(l < 2 || _uri[l - 2] != '/' || _uri.indexOf('*') != (int)l - 1)
+      return false;
+    l -= 2;
+  }
+  *uri = _uri.c_str();
+  *len = l;
+  *method = _method;
+  return true;
+}
@@ -30,8 +30,18 @@ static const String SharedEmptyString = String();
 
 #define __is_param_char(c) ((c) && ((c) != '{') && ((c) != '[') && ((c) != '&') && ((c) != '='))
 
+#define ASYNCWEBSERVER_HEAD_SIZE 512 //first allocation for the request head, doubled as needed
+#define ASYNCWEBSERVER_HEAD_MAX 0xFFFF //header slices keep 16 bit offsets
+
 enum { PARSE_REQ_START, PARSE_REQ_HEADERS, PARSE_REQ_BODY, PARSE_REQ_END, PARSE_REQ_FAIL };
 
+// A handler or response can delete the request under us (close, websocket takeover).
+// Every callback that calls out keeps one of these on its stack and checks gone afterwards
+struct AsyncWebRequestFrame {
+  AsyncWebRequestFrame* outer;
+  bool gone;
+};
+
 AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   : _client(c)
   , _server(s)
@@ -39,6 +49,16 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _response(NULL)
   , _temp()
   , _parseState(0)
+  , _head(NULL)
+  , _headLen(0)
+  , _headSize(0)
+  , _lineStart(0)
+  , _headerSliceCount(0)
+  , _frames(NULL)
+  , _pipe(NULL)
+  , _pipeLen(0)
+  , _served(0)
+  , _keepAlive(false)
   , _version(0)
   , _method(HTTP_ANY)
   , _url()
@@ -96,75 +116,86 @@ AsyncWebServerRequest::~AsyncWebServerRequest(){
   if(_tempFile){
     _tempFile.close();
   }
+
+  free(_head);
+  free(_pipe);
+  free(_itemBuffer);
+
+  for(AsyncWebRequestFrame* f = _frames; f; f = f->outer){
+    f->gone = true;
+  }
 }
 
 void AsyncWebServerRequest::_onData(void *buf, size_t len){
+  AsyncWebRequestFrame frame = { _frames, false };
+  _frames = &frame;
   size_t i = 0;
-  while (true) {
+  while (len) {
 
   if(_parseState < PARSE_REQ_BODY){
-    // Find new line in buf
+    // Copy up to the end of the line into _head, complete lines are parsed in place there
     char *str = (char*)buf;
-    for (i = 0; i < len; i++) {
-      if (str[i] == '\n') {
-        break;
-      }
+    char *nl = (char*)memchr(str, '\n', len);
+    i = nl ? (nl - str + 1) : len;
+    if(!_appendHead(str, i)){
+      // Answered rather than closed here, closing would delete us while the client still runs this callback
+      _parseState = PARSE_REQ_FAIL;
+      send(400);
+      if(frame.gone) return;
+      break;
     }
-    if (i == len) { // No new line, just add the buffer in _temp
-      char ch = str[len-1];
-      str[len-1] = 0;
-      _temp.reserve(_temp.length()+len);
-      _temp.concat(str);
-      _temp.concat(ch);
-    } else { // Found new line - extract it and parse
-      str[i] = 0; // Terminate the string at the end of the line.
-      _temp.concat(str);
-      _temp.trim();
-      _parseLine();
-      if (++i < len) {
-        // Still have more buffer to process
-        buf = str+i;
-        len-= i;
-        continue;
-      }
+    if(nl){
+      char *line = _head + _lineStart;
+      size_t lineLen = _headLen - 1 - _lineStart;
+      _head[_headLen - 1] = 0;
+      _lineStart = _headLen;
+      _parseLine(line, lineLen);
+      if(frame.gone) return;
     }
+    buf = str+i;
+    len-= i;
   } else if(_parseState == PARSE_REQ_BODY){
     // A handler should be already attached at this point in _parseLine function.
     // If handler does nothing (_onRequest is NULL), we don't need to really parse the body.
     const bool needParse = _handler && !_handler->isRequestHandlerTrivial();
+    // Anything past the body is the next request
+    size_t take = _contentLength - _parsedLength;
+    if(take > len) take = len;
     if(_isMultipart){
       if(needParse){
         size_t i;
-        for(i=0; i<len; i++){
-          _parseMultipartPostByte(((uint8_t*)buf)[i], i == len - 1);
+        for(i=0; i<take; i++){
+          _parseMultipartPostByte(((uint8_t*)buf)[i], i == take - 1);
+          if(frame.gone) return;
           _parsedLength++;
         }
       } else
-          _parsedLength += len;
+          _parsedLength += take;
     } else {
       if(_parsedLength == 0){
         if(_contentType.startsWith("application/x-www-form-urlencoded")){
           _isPlainPost = true;
         } else if(_contentType == "text/plain" && __is_param_char(((char*)buf)[0])){
           size_t i = 0;
-          while (i<len && __is_param_char(((char*)buf)[i++]));
-          if(i < len && ((char*)buf)[i-1] == '='){
+          while (i<take && __is_param_char(((char*)buf)[i++]));
+          if(i < take && ((char*)buf)[i-1] == '='){
             _isPlainPost = true;
           }
         }
       }
       if(!_isPlainPost) {
         //check if authenticated before calling the body
-        if(_handler) _handler->handleBody(this, (uint8_t*)buf, len, _parsedLength, _contentLength);
-        _parsedLength += len;
+        if(_handler) _handler->handleBody(this, (uint8_t*)buf, take, _parsedLength, _contentLength);
+        if(frame.gone) return;
+        _parsedLength += take;
       } else if(needParse) {
         size_t i;
-        for(i=0; i<len; i++){
+        for(i=0; i<take; i++){
           _parsedLength++;
           _parsePlainPostChar(((uint8_t*)buf)[i]);
         }
       } else {
-        _parsedLength += len;
+        _parsedLength += take;
       }
     }
     if(_parsedLength == _contentLength){
@@ -172,38 +203,162 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       //check if authenticated before calling handleRequest and request auth instead
       if(_handler) _handler->handleRequest(this);
       else send(501);
+      if(frame.gone) return;
+    }
+    buf = (uint8_t*)buf + take;
+    len -= take;
+  } else {
+    // Pipelined: held until the response is out, then parsed by _recycle()
+    if(_parseState == PARSE_REQ_END && _keepAlive && !_queuePipelined((const char*)buf, len)){
+      _client->close();
+      if(frame.gone) return;
     }
+    break;
   }
-  break;
   }
+  _frames = frame.outer;
+}
+
+bool AsyncWebServerRequest::_queuePipelined(const char* data, size_t len){
+  if(_pipeLen + len > ASYNCWEBSERVER_PIPELINE_MAX){
+    return false;
+  }
+  char *pipe = (char*)realloc(_pipe, _pipeLen + len);
+  if(!pipe){
+    return false;
+  }
+  memcpy(pipe + _pipeLen, data, len);
+  _pipe = pipe;
+  _pipeLen += len;
+  return true;
 }
 
 void AsyncWebServerRequest::_removeNotInterestingHeaders(){
   if (_interestingHeaders.containsIgnoreCase("ANY")) return; // nothing to do
-  for(const auto& header: _headers){
-      if(!_interestingHeaders.containsIgnoreCase(header->name().c_str())){
-        _headers.remove(header);
+  for(uint8_t i = 0; i < _headerSliceCount; i++){
+    if(!_headerSlices[i].name) continue;
+    bool interesting = false;
+    for(const auto& name: _interestingHeaders){
+      if(!strcasecmp(name.c_str(), _head + _headerSlices[i].name)){
+        interesting = true;
+        break;
       }
+    }
+    if(!interesting) _headerSlices[i].name = 0;
   }
+  _headers.remove_if([this](AsyncWebHeader* header){
+    if(_interestingHeaders.containsIgnoreCase(header->name().c_str())) return false;
+    for(uint8_t i = 0; i < _headerSliceCount; i++){
+      if(_headerSlices[i].taken == header) _headerSlices[i].taken = nullptr;
+    }
+    return true;
+  });
 }
 
 void AsyncWebServerRequest::_onPoll(){
   //os_printf("p\n");
   if(_response != NULL && _client != NULL && _client->canSend() && !_response->_finished()){
-    _response->_ack(this, 0, 0);
+    _ackResponse(0, 0);
   }
 }
 
 void AsyncWebServerRequest::_onAck(size_t len, uint32_t time){
   //os_printf("a:%u:%u\n", len, time);
   if(_response != NULL){
-    if(!_response->_finished()){
-      _response->_ack(this, len, time);
+    _ackResponse(len, time);
+  }
+}
+
+void AsyncWebServerRequest::_ackResponse(size_t len, uint32_t time){
+  AsyncWebRequestFrame frame = { _frames, false };
+  _frames = &frame;
+  if(!_response->_finished()){
+    _response->_ack(this, len, time);
+    if(frame.gone) return;
+  }
+  if(_response->_finished()){
+    bool failed = _response->_failed();
+    AsyncWebServerResponse* r = _response;
+    _response = NULL;
+    delete r;
+    // A body still coming in (answered early) or a broken response can't be followed by another request
+    if(_keepAlive && !failed && _parseState == PARSE_REQ_END){
+      _recycle();
     } else {
-      AsyncWebServerResponse* r = _response;
-      _response = NULL;
-      delete r;
+      _client->close();
     }
+    if(frame.gone) return;
+  }
+  _frames = frame.outer;
+}
+
+// The response is out, start over on the same connection
+void AsyncWebServerRequest::_recycle(){
+  if(_onDisconnectfn){
+    // Bound to the request that is over, it would never see its own disconnect
+    ArDisconnectHandler fn = _onDisconnectfn;
+    _onDisconnectfn = NULL;
+    fn();
+  }
+  _served++;
+  _handler = NULL;
+  _temp = String();
+  _parseState = PARSE_REQ_START;
+  if(_headSize > ASYNCWEBSERVER_HEAD_SIZE * 4){
+    free(_head);
+    _head = NULL;
+    _headSize = 0;
+  }
+  _headLen = 0;
+  _lineStart = 0;
+  _headerSliceCount = 0;
+  _keepAlive = false;
+  _version = 0;
+  _method = HTTP_ANY;
+  _url = String();
+  _host = String();
+  _contentType = String();
+  _boundary = String();
+  _authorization = String();
+  _reqconntype = RCT_HTTP;
+  _isDigest = false;
+  _isMultipart = false;
+  _isPlainPost = false;
+  _expectingContinue = false;
+  _contentLength = 0;
+  _parsedLength = 0;
+  _headers.free();
+  _params.free();
+  _pathParams.free();
+  _interestingHeaders.free();
+  _multiParseState = 0;
+  _boundaryPosition = 0;
+  _itemStartIndex = 0;
+  _itemSize = 0;
+  _itemName = String();
+  _itemFilename = String();
+  _itemType = String();
+  _itemValue = String();
+  free(_itemBuffer);
+  _itemBuffer = NULL;
+  _itemBufferIndex = 0;
+  _itemIsFile = false;
+  if(_tempObject != NULL){
+    free(_tempObject);
+    _tempObject = NULL;
+  }
+  if(_tempFile){
+    _tempFile.close();
+  }
+  _client->setRxTimeout(_server->keepAliveTimeout());
+
+  if(_pipeLen){
+    char *data = _pipe;
+    size_t len = _pipeLen;
+    _pipe = NULL;
+    _pipeLen = 0;
+    _onData(data, len); // may answer and delete us, data is ours either way
+    free(data);
   }
 }
 
@@ -251,104 +406,124 @@ void AsyncWebServerRequest::_addGetParams(const String& params){
   }
 }
 
-bool AsyncWebServerRequest::_parseReqHead(){
-  // Split the head into method, url and version
-  int index = _temp.indexOf(' ');
-  String m = _temp.substring(0, index);
-  index = _temp.indexOf(' ', index+1);
-  String u = _temp.substring(m.length()+1, index);
-  _temp = _temp.substring(index+1);
+bool AsyncWebServerRequest::_appendHead(const char* data, size_t len){
+  size_t need = _headLen + len;
+  if(need > ASYNCWEBSERVER_HEAD_MAX){
+    return false;
+  }
+  if(need > _headSize){
+    size_t size = _headSize ? _headSize : ASYNCWEBSERVER_HEAD_SIZE;
+    while(size < need) size <<= 1;
+    char *head = (char*)realloc(_head, size);
+    if(!head){
+      return false;
+    }
+    _head = head;
+    _headSize = size;
+  }
+  memcpy(_head + _headLen, data, len);
+  _headLen = need;
+  return true;
+}
 
-  if(m == "GET"){
+void AsyncWebServerRequest::_parseReqHead(char* line){
+  // Split the head into method, url and version
+  char *u = strchr(line, ' ');
+  if(u) *u++ = 0;
+  else u = line + strlen(line);
+  char *v = strchr(u, ' ');
+  if(v) *v++ = 0;
+  else v = u + strlen(u);
+
+  if(!strcmp(line, "GET")){
     _method = HTTP_GET;
-  } else if(m == "POST"){
+  } else if(!strcmp(line, "POST")){
     _method = HTTP_POST;
-  } else if(m == "DELETE"){
+  } else if(!strcmp(line, "DELETE")){
     _method = HTTP_DELETE;
-  } else if(m == "PUT"){
+  } else if(!strcmp(line, "PUT")){
     _method = HTTP_PUT;
-  } else if(m == "PATCH"){
+  } else if(!strcmp(line, "PATCH")){
     _method = HTTP_PATCH;
-  } else if(m == "HEAD"){
+  } else if(!strcmp(line, "HEAD")){
     _method = HTTP_HEAD;
-  } else if(m == "OPTIONS"){
+  } else if(!strcmp(line, "OPTIONS")){
     _method = HTTP_OPTIONS;
   }
 
-  String g = String();
-  index = u.indexOf('?');
-  if(index > 0){
-    g = u.substring(index +1);
-    u = u.substring(0, index);
+  char *g = strchr(u, '?');
+  if(g && g != u){
+    *g++ = 0;
+  } else {
+    g = NULL;
   }
-  _url = urlDecode(u);
-  _addGetParams(g);
+  _url = urlDecode(String(u));
+  if(g) _addGetParams(String(g));
 
-  if(!_temp.startsWith("HTTP/1.0"))
+  if(strncmp(v, "HTTP/1.0", 8))
     _version = 1;
-
-  _temp = String();
-  return true;
+  // Persistent by default from HTTP/1.1 on, a Connection header can still say otherwise
+  _keepAlive = _version == 1;
 }
 
-bool strContains(String src, String find, bool mindcase = true) {
-  int pos=0, i=0;
-  const int slen = src.length();
-  const int flen = find.length();
-
-  if (slen < flen) return false;
-  while (pos <= (slen - flen)) {
-    for (i=0; i < flen; i++) {
-      if (mindcase) {
-        if (src[pos+i] != find[i]) i = flen + 1; // no match
-      } else if (tolower(src[pos+i]) != tolower(find[i])) i = flen + 1; // no match
-    }
-    if (i == flen) return true;
-    pos++;
+void AsyncWebServerRequest::_parseReqHeader(char* line){
+  char *value = strchr(line, ':');
+  if(!value || value == line){
+    return;
   }
-  return false;
-}
-
-bool AsyncWebServerRequest::_parseReqHeader(){
-  int index = _temp.indexOf(':');
-  if(index){
-    String name = _temp.substring(0, index);
-    String value = _temp.substring(index + 2);
-    if(name.equalsIgnoreCase("Host")){
-      _host = value;
-    } else if(name.equalsIgnoreCase("Content-Type")){
-	  _contentType = value.substring(0, value.indexOf(';'));
-      if (value.startsWith("multipart/")){
-        _boundary = value.substring(value.indexOf('=')+1);
-        _boundary.replace("\"","");
-        _isMultipart = true;
-      }
-    } else if(name.equalsIgnoreCase("Content-Length")){
-      _contentLength = atoi(value.c_str());
-    } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
-      _expectingContinue = true;
-    } else if(name.equalsIgnoreCase("Authorization")){
-      if(value.length() > 5 && value.substring(0,5).equalsIgnoreCase("Basic")){
-        _authorization = value.substring(6);
-      } else if(value.length() > 6 && value.substring(0,6).equalsIgnoreCase("Digest")){
-        _isDigest = true;
-        _authorization = value.substring(7);
-      }
+  *value++ = 0;
+  while(*value == ' ' || *value == '\t') value++;
+  const char *name = line;
+  if(!strcasecmp(name, "Host")){
+    _host = value;
+  } else if(!strcasecmp(name, "Content-Type")){
+    _contentType = value;
+    const char *semi = strchr(value, ';');
+    if(semi) _contentType.remove(semi - value);
+    if (!strncmp(value, "multipart/", 10)){
+      const char *eq = strchr(value, '=');
+      _boundary = eq ? eq + 1 : value;
+      _boundary.replace("\"","");
+      _isMultipart = true;
+    }
+  } else if(!strcasecmp(name, "Content-Length")){
+    _contentLength = atoi(value);
+  } else if(!strcasecmp(name, "Connection")){
+    if(strcasestr(value, "close")){
+      _keepAlive = false;
+    } else if(strcasestr(value, "keep-alive")){
+      _keepAlive = true;
+    }
+  } else if(!strcasecmp(name, "Expect") && !strcmp(value, "100-continue")){
+    _expectingContinue = true;
+  } else if(!strcasecmp(name, "Authorization")){
+    size_t len = strlen(value);
+    if(len > 5 && !strncasecmp(value, "Basic", 5)){
+      _authorization = value + 6;
+    } else if(len > 6 && !strncasecmp(value, "Digest", 6)){
+      _isDigest = true;
+      _authorization = value + 7;
+    }
+  } else {
+    if(!strcasecmp(name, "Upgrade") && !strcasecmp(value, "websocket")){
+      // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
+      _reqconntype = RCT_WS;
     } else {
-      if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
-        // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
-        _reqconntype = RCT_WS;
-      } else {
-        if(name.equalsIgnoreCase("Accept") && strContains(value, "text/event-stream", false)){
-          // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
-          _reqconntype = RCT_EVENT;
-        }
+      if(!strcasecmp(name, "Accept") && strcasestr(value, "text/event-stream")){
+        // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
+        _reqconntype = RCT_EVENT;
       }
     }
-    _headers.add(new AsyncWebHeader(name, value));
   }
-  _temp = String();
-  return true;
+  // Kept as a slice until a handler asks for it
+  if(_headerSliceCount < ASYNCWEBSERVER_HEADER_SLICES){
+    _headerSlices[_headerSliceCount].name = name - _head;
+    _headerSlices[_headerSliceCount].value = value - _head;
+    _headerSlices[_headerSliceCount].taken = nullptr;
+    _headerSliceCount++;
+  } else {
+    _headers.add(new AsyncWebHeader(String(name), String(value)));
+  }
 }
 
 void AsyncWebServerRequest::_parsePlainPostChar(uint8_t data){
@@ -367,6 +542,9 @@ void AsyncWebServerRequest::_parsePlainPostChar(uint8_t data){
 }
 
 void AsyncWebServerRequest::_handleUploadByte(uint8_t data, bool last){
+  //a malformed body can go on after the file part ended and its buffer was freed
+  if(_itemBuffer == NULL)
+    return;
   _itemBuffer[_itemBufferIndex++] = data;
 
   if(last || _itemBufferIndex == 1460){
@@ -551,21 +729,30 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
   }
 }
 
-void AsyncWebServerRequest::_parseLine(){
+//one line of the head; the caller checks its frame afterwards, a handled request may have deleted us
+void AsyncWebServerRequest::_parseLine(char* line, size_t len){
+  while(len && isspace((unsigned char)line[len - 1])) line[--len] = 0;
+  while(len && isspace((unsigned char)*line)){
+    line++;
+    len--;
+  }
+
   if(_parseState == PARSE_REQ_START){
-    if(!_temp.length()){
-      _parseState = PARSE_REQ_FAIL;
-      _client->close();
-    } else {
-      _parseReqHead();
-      _parseState = PARSE_REQ_HEADERS;
+    // Empty lines before the request line are ignored (RFC 7230 3.5)
+    if(!len){
+      return;
     }
+    _parseReqHead(line);
+    _parseState = PARSE_REQ_HEADERS;
     return;
   }
 
   if(_parseState == PARSE_REQ_HEADERS){
-    if(!_temp.length()){
+    if(!len){
       //end of headers
+      if(_reqconntype != RCT_HTTP || !_server->keepAliveTimeout() || _served + 1 >= _server->keepAliveMax()){
+        _keepAlive = false;
+      }
       _server->_rewriteRequest(this);
       _server->_attachHandler(this);
       _removeNotInterestingHeaders();
@@ -581,12 +768,33 @@ void AsyncWebServerRequest::_parseLine(){
         if(_handler) _handler->handleRequest(this);
         else send(501);
       }
-    } else _parseReqHeader();
+    } else _parseReqHeader(line);
+  }
+}
+
+int AsyncWebServerRequest::_findHeaderSlice(const char* name) const {
+  for(uint8_t i = 0; i < _headerSliceCount; i++){
+    if(_headerSlices[i].name && !strcasecmp(_head + _headerSlices[i].name, name)){
+      return i;
+    }
   }
+  return -1;
+}
+
+AsyncWebHeader* AsyncWebServerRequest::_takeHeader(int slice) const {
+  AsyncWebHeader* h = new AsyncWebHeader(String(_head + _headerSlices[slice].name), String(_head + _headerSlices[slice].value));
+  _headerSlices[slice].name = 0;
+  _headerSlices[slice].taken = h;
+  _headers.add(h);
+  return h;
 }
 
 size_t AsyncWebServerRequest::headers() const{
-  return _headers.length();
+  size_t count = _headers.length();
+  for(uint8_t i = 0; i < _headerSliceCount; i++){
+    if(_headerSlices[i].name) count++;
+  }
+  return count;
 }
 
 bool AsyncWebServerRequest::hasHeader(const String& name) const {
@@ -595,7 +803,7 @@ bool AsyncWebServerRequest::hasHeader(const String& name) const {
       return true;
     }
   }
-  return false;
+  return _findHeaderSlice(name.c_str()) >= 0;
 }
 
 bool AsyncWebServerRequest::hasHeader(const __FlashStringHelper * data) const {
@@ -624,7 +832,8 @@ AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
       return h;
     }
   }
-  return nullptr;
+  int slice = _findHeaderSlice(name.c_str());
+  return (slice >= 0) ? _takeHeader(slice) : nullptr;
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * data) const {
@@ -642,8 +851,20 @@ AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * dat
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(size_t num) const {
-  auto header = _headers.nth(num);
-  return header ? *header : nullptr;
+  // In the order they came in: the slices, taken or not, then the ones that did not fit
+  for(uint8_t i = 0; i < _headerSliceCount; i++){
+    if(!_headerSlices[i].name && !_headerSlices[i].taken) continue; //dropped
+    if(!num--) return _headerSlices[i].taken ? _headerSlices[i].taken : _takeHeader(i);
+  }
+  if(_headerSliceCount < ASYNCWEBSERVER_HEADER_SLICES) return nullptr; //no overflow, _headers only holds taken slices
+  for(const auto& h: _headers){
+    bool taken = false;
+    for(uint8_t i = 0; i < _headerSliceCount && !taken; i++){
+      taken = _headerSlices[i].taken == h;
+    }
+    if(!taken && !num--) return h;
+  }
+  return nullptr;
 }
 
 size_t AsyncWebServerRequest::params() const {
@@ -29,6 +29,50 @@
 #include <vector>
 // It is possible to restore these defines, but one can use _min and _max instead. Or std::min, std::max.
 
+#ifndef ASYNCWEBSERVER_SENDBUF_SIZE
+#ifdef TCP_SND_BUF
+#define ASYNCWEBSERVER_SENDBUF_SIZE TCP_SND_BUF //one full send window
+#else
+#define ASYNCWEBSERVER_SENDBUF_SIZE 5744
+#endif
+#endif
+
+#ifndef ASYNCWEBSERVER_SENDBUF_COUNT
+#define ASYNCWEBSERVER_SENDBUF_COUNT 4 //responses that can stream out of a pooled buffer at once, at least 1
+#endif
+
+/*
+ * SEND BUFFERS :: Streaming responses fill their packets in one of these instead of a malloc per ack.
+ * A response keeps its buffer until it is done. When all of them are out, it falls back to malloc
+ * and the miss is counted.
+ * */
+
+class AsyncWebSendBuffers {
+  private:
+    uint8_t* _free[ASYNCWEBSERVER_SENDBUF_COUNT];
+    uint8_t _freeCount;
+    uint8_t _allocated;
+    uint8_t _inUse;
+    uint8_t _peak;
+    uint32_t _taken;
+    uint32_t _exhausted;
+
+    AsyncWebSendBuffers();
+  public:
+    AsyncWebSendBuffers(AsyncWebSendBuffers const &) = delete;
+    AsyncWebSendBuffers &operator=(AsyncWebSendBuffers const &) = delete;
+    static AsyncWebSendBuffers &Instance();
+
+    uint8_t* take(); //NULL when every buffer is out
+    void give(uint8_t* buf);
+
+    uint8_t allocated() const { return _allocated; }
+    uint8_t inUse() const { return _inUse; }
+    uint8_t peak() const { return _peak; }
+    uint32_t taken() const { return _taken; }
+    uint32_t exhausted() const { return _exhausted; } //times a response had to malloc its own
+};
+
 class AsyncBasicResponse: public AsyncWebServerResponse {
   private:
     String _content;
@@ -42,17 +86,19 @@ class AsyncBasicResponse: public AsyncWebServerResponse {
 class AsyncAbstractResponse: public AsyncWebServerResponse {
   private:
     String _head;
+    uint8_t* _sendBuf; //from AsyncWebSendBuffers, held until the last byte is written
     // Data is inserted into cache at begin(). 
     // This is inefficient with vector, but if we use some other container, 
     // we won't be able to access it as contiguous array of bytes when reading from it,
     // so by gaining performance in one place, we'll lose it in another.
     std::vector<uint8_t> _cache;
     size_t _readDataFromCacheOrContent(uint8_t* data, const size_t len);
-    size_t _fillBufferAndProcessTemplates(uint8_t* buf, size_t maxLen);
   protected:
     AwsTemplateProcessor _callback;
+    virtual size_t _fillBufferAndProcessTemplates(uint8_t* buf, size_t maxLen);
   public:
     AsyncAbstractResponse(AwsTemplateProcessor callback=nullptr);
+    ~AsyncAbstractResponse();
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return false; }
@@ -64,13 +110,74 @@ class AsyncAbstractResponse: public AsyncWebServerResponse {
 #endif
 
 #define TEMPLATE_PARAM_NAME_LENGTH 32
+
+#ifndef ASYNCWEBSERVER_TEMPLATE_CACHE
+#define ASYNCWEBSERVER_TEMPLATE_CACHE 4 //template files whose index is kept, at least 1
+#endif
+
+/*
+ * TEMPLATE INDEX :: A template file cut into literal spans and placeholder names, built on the first
+ * request for it. Serving reads the spans straight from the file and calls the processor only where a
+ * placeholder was. "%name%" takes 1 to TEMPLATE_PARAM_NAME_LENGTH bytes without a '%' in between,
+ * "%%" is a single '%', any other '%' is sent as is.
+ * */
+
+typedef struct {
+  uint32_t len; //file bytes it stands for, the spans follow each other through the whole file
+  char* name;   //NULL for literal text, "" for "%%"
+} AsyncTemplateSpan;
+
+struct AsyncTemplateIndex {
+  String path;
+  size_t size;
+  time_t mtime;
+  AsyncTemplateSpan* spans;
+  uint32_t count;
+  uint16_t refs;   //responses serving from it
+  bool cached;     //false once replaced or evicted, freed by the last response to let go
+};
+
+class AsyncTemplateCache {
+  using File = fs::File;
+  private:
+    AsyncTemplateIndex* _entries[ASYNCWEBSERVER_TEMPLATE_CACHE]; //most recently used first
+    uint32_t _hits;
+    uint32_t _builds;
+
+    AsyncTemplateCache();
+    void _detach(AsyncTemplateIndex* index);
+    static AsyncTemplateIndex* _build(const String& path, File& file);
+    static void _free(AsyncTemplateIndex* index);
+  public:
+    AsyncTemplateCache(AsyncTemplateCache const &) = delete;
+    AsyncTemplateCache &operator=(AsyncTemplateCache const &) = delete;
+    static AsyncTemplateCache &Instance();
+
+    //the index for path, built if the file is new or changed size or mtime. NULL when out of memory
+    AsyncTemplateIndex* acquire(const String& path, File& file);
+    void release(AsyncTemplateIndex* index);
+    void invalidate(AsyncTemplateIndex* index); //the file no longer matches it
+    void clear();
+
+    uint32_t hits() const { return _hits; }
+    uint32_t builds() const { return _builds; }
+};
+
 class AsyncFileResponse: public AsyncAbstractResponse {
   using File = fs::File;
   using FS = fs::FS;
   private:
     File _content;
     String _path;
+    AsyncTemplateIndex* _tpl;
+    bool _tplTried;
+    uint32_t _tplSpan;     //next span to send
+    uint32_t _tplPos;      //bytes of it already sent
+    String _tplValue;      //processor output not sent yet
+    size_t _tplValuePos;
     void _setContentType(const String& path);
+  protected:
+    size_t _fillBufferAndProcessTemplates(uint8_t* buf, size_t maxLen) override;
   public:
     AsyncFileResponse(FS &fs, const String& path, const String& contentType=String(), bool download=false, AwsTemplateProcessor callback=nullptr);
     AsyncFileResponse(File content, const String& path, const String& contentType=String(), bool download=false, AwsTemplateProcessor callback=nullptr);
@@ -118,6 +225,53 @@ class AsyncProgmemResponse: public AsyncAbstractResponse {
     virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
 };
 
+/*
+ * STATIC FILE CACHE :: A whole file as it sits in the filesystem (gzipped or not), read once by an
+ * AsyncStaticWebHandler and answered from RAM after that. Responses take a reference, an entry
+ * dropped from its cache lives on until the last one is done with it.
+ * */
+
+struct AsyncStaticCacheEntry {
+  String url;       //request url it answers
+  String path;      //file it was read from, without ".gz"
+  uint8_t* data;
+  size_t len;
+  char etag[11];    //quoted hash of data
+  bool gzip;
+  bool cached;
+  uint16_t refs;
+
+  void release(){
+    if(--refs == 0 && !cached){
+      free(data);
+      delete this;
+    }
+  }
+};
+
+class AsyncStaticCacheResponse: public AsyncAbstractResponse {
+  private:
+    AsyncStaticCacheEntry* _entry;
+    size_t _readLength;
+  public:
+    AsyncStaticCacheResponse(AsyncStaticCacheEntry* entry);
+    ~AsyncStaticCacheResponse();
+    bool _sourceValid() const { return true; }
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+};
+
+class AsyncAssetResponse: public AsyncWebServerResponse {
+  private:
+    const AsyncWebAsset* _asset;
+    String _head;
+    size_t _headSent;
+  public:
+    AsyncAssetResponse(const AsyncWebAsset* asset, int code=200); //304 sends the same headers and no body
+    void _respond(AsyncWebServerRequest *request);
+    size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
+    bool _sourceValid() const { return true; }
+};
+
 class cbuf;
 
 class AsyncResponseStream: public AsyncAbstractResponse, public Print {
@@ -94,11 +94,11 @@ AsyncWebServerResponse::AsyncWebServerResponse()
   , _ackedLength(0)
   , _writtenLength(0)
   , _state(RESPONSE_SETUP)
-{
-  for(auto header: DefaultHeaders::Instance()) {
-    _headers.add(new AsyncWebHeader(header->name(), header->value()));
-  }
-}
+  , _fixedHeaders(NULL)
+  , _connection(-1)
+  , _keepAliveTimeout(0)
+  , _keepAliveLeft(0)
+{}
 
 AsyncWebServerResponse::~AsyncWebServerResponse(){
   _headers.free();
@@ -123,31 +123,56 @@ void AsyncWebServerResponse::addHeader(const String& name, const String& value){
   _headers.add(new AsyncWebHeader(name, value));
 }
 
+//the status line, Content-Length and whatever was added to this response are the only parts
+//put together per request. The default headers come as one ready made block, the rest are literals
 String AsyncWebServerResponse::_assembleHead(uint8_t version){
-  if(version){
-    addHeader("Accept-Ranges","none");
-    if(_chunked)
-      addHeader("Transfer-Encoding","chunked");
-  }
-  String out = String();
-  int bufSize = 300;
-  char buf[bufSize];
+  const String& defaults = DefaultHeaders::Instance().serialized();
+  const char* reason = _responseCodeToString(_code);
+  size_t len = 160 + strlen(reason) + _contentType.length() + defaults.length() + (_fixedHeaders ? strlen(_fixedHeaders) : 0);
+  for(const auto& header: _headers)
+    len += header->name().length() + header->value().length() + 4;
 
-  snprintf(buf, bufSize, "HTTP/1.%d %d %s\r\n", version, _code, _responseCodeToString(_code));
-  out.concat(buf);
+  String out = String();
+  out.reserve(len);
+  out.concat(version ? "HTTP/1.1 " : "HTTP/1.0 ");
+  out.concat(_code);
+  out.concat(' ');
+  out.concat(reason);
+  out.concat("\r\n");
 
-  if(_sendContentLength) {
-    snprintf(buf, bufSize, "Content-Length: %d\r\n", _contentLength);
-    out.concat(buf);
+  if(_sendContentLength){
+    out.concat("Content-Length: ");
+    out.concat((unsigned long)_contentLength);
+    out.concat("\r\n");
   }
-  if(_contentType.length()) {
-    snprintf(buf, bufSize, "Content-Type: %s\r\n", _contentType.c_str());
-    out.concat(buf);
+  if(_contentType.length()){
+    out.concat("Content-Type: ");
+    out.concat(_contentType);
+    out.concat("\r\n");
+  }
+  if(_fixedHeaders)
+    out.concat(_fixedHeaders);
+  out.concat(defaults);
+  if(_connection == 0){
+    out.concat("Connection: close\r\n");
+  } else if(_connection > 0){
+    out.concat("Connection: keep-alive\r\nKeep-Alive: timeout=");
+    out.concat((unsigned int)_keepAliveTimeout);
+    out.concat(", max=");
+    out.concat((unsigned int)_keepAliveLeft);
+    out.concat("\r\n");
+  }
+  if(version){
+    out.concat("Accept-Ranges: none\r\n");
+    if(_chunked)
+      out.concat("Transfer-Encoding: chunked\r\n");
   }
 
   for(const auto& header: _headers){
-    snprintf(buf, bufSize, "%s: %s\r\n", header->name().c_str(), header->value().c_str());
-    out.concat(buf);
+    out.concat(header->name());
+    out.concat(": ");
+    out.concat(header->value());
+    out.concat("\r\n");
   }
   _headers.free();
 
@@ -156,6 +181,17 @@ String AsyncWebServerResponse::_assembleHead(uint8_t version){
   return out;
 }
 
+void AsyncWebServerResponse::_addConnectionHeader(AsyncWebServerRequest *request, bool delimited){
+  if(!request->_keepAlive || !delimited){
+    request->_keepAlive = false;
+    _connection = 0;
+    return;
+  }
+  _connection = 1;
+  _keepAliveTimeout = request->_server->keepAliveTimeout();
+  _keepAliveLeft = request->_server->keepAliveMax() - request->_served - 1;
+}
+
 bool AsyncWebServerResponse::_started() const { return _state > RESPONSE_SETUP; }
 bool AsyncWebServerResponse::_finished() const { return _state > RESPONSE_WAIT_ACK; }
 bool AsyncWebServerResponse::_failed() const { return _state == RESPONSE_FAILED; }
@@ -175,10 +211,10 @@ AsyncBasicResponse::AsyncBasicResponse(int code, const String& contentType, cons
     if(!_contentType.length())
       _contentType = "text/plain";
   }
-  addHeader("Connection","close");
 }
 
 void AsyncBasicResponse::_respond(AsyncWebServerRequest *request){
+  _addConnectionHeader(request, true);
   _state = RESPONSE_HEADERS;
   String out = _assembleHead(request->version());
   size_t outLen = out.length();
@@ -244,7 +280,53 @@ size_t AsyncBasicResponse::_ack(AsyncWebServerRequest *request, size_t len, uint
  * Abstract Response
  * */
 
-AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _callback(callback)
+/*
+ * Send Buffer Pool
+ * */
+AsyncWebSendBuffers::AsyncWebSendBuffers()
+  : _freeCount(0)
+  , _allocated(0)
+  , _inUse(0)
+  , _peak(0)
+  , _taken(0)
+  , _exhausted(0)
+{}
+
+AsyncWebSendBuffers &AsyncWebSendBuffers::Instance(){
+  static AsyncWebSendBuffers instance;
+  return instance;
+}
+
+uint8_t* AsyncWebSendBuffers::take(){
+  uint8_t* buf = NULL;
+  if(_freeCount){
+    buf = _free[--_freeCount];
+  } else if(_allocated < ASYNCWEBSERVER_SENDBUF_COUNT){
+    buf = (uint8_t*)malloc(ASYNCWEBSERVER_SENDBUF_SIZE);
+    if(buf)
+      _allocated++;
+  }
+  if(buf == NULL){
+    _exhausted++;
+    return NULL;
+  }
+  _taken++;
+  if(++_inUse > _peak)
+    _peak = _inUse;
+  return buf;
+}
+
+void AsyncWebSendBuffers::give(uint8_t* buf){
+  if(buf == NULL)
+    return;
+  _free[_freeCount++] = buf;
+  _inUse--;
+}
+
+/*
+ * Abstract Response
+ * */
+AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _sendBuf(NULL), _callback(callback)
 {
   // In case of template processing, we're unable to determine real response size
   if(callback) {
@@ -254,8 +336,15 @@ AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _ca
   }
 }
 
+AsyncAbstractResponse::~AsyncAbstractResponse(){
+  AsyncWebSendBuffers::Instance().give(_sendBuf);
+}
+
 void AsyncAbstractResponse::_respond(AsyncWebServerRequest *request){
-  addHeader("Connection","close");
+  //HTTP/1.0 has no chunks: the content goes out as is and closing the connection ends it
+  if(_chunked && !request->version())
+    _chunked = false;
+  _addConnectionHeader(request, _sendContentLength || (_chunked && request->version()));
   _head = _assembleHead(request->version());
   _state = RESPONSE_HEADERS;
   _ack(request, 0, 0);
@@ -297,10 +386,20 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
       outLen = ((_contentLength - _sentLength) > space)?space:(_contentLength - _sentLength);
     }
 
-    uint8_t *buf = (uint8_t *)malloc(outLen+headLen);
-    if (!buf) {
-      // os_printf("_ack malloc %d failed\n", outLen+headLen);
-      return 0;
+    //the pooled buffer holds a whole window. The head only comes along on the first write,
+    //one too big to leave room for content goes out of a buffer of its own
+    if(_sendBuf == NULL && headLen + 16 < ASYNCWEBSERVER_SENDBUF_SIZE)
+      _sendBuf = AsyncWebSendBuffers::Instance().take();
+    uint8_t *buf = _sendBuf;
+    if(buf){
+      if(outLen + headLen > ASYNCWEBSERVER_SENDBUF_SIZE)
+        outLen = ASYNCWEBSERVER_SENDBUF_SIZE - headLen;
+    } else {
+      buf = (uint8_t *)malloc(outLen+headLen);
+      if (!buf) {
+        // os_printf("_ack malloc %d failed\n", outLen+headLen);
+        return 0;
+      }
     }
 
     if(headLen){
@@ -314,10 +413,11 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
       // See RFC2616 sections 2, 3.6.1.
       readLen = _fillBufferAndProcessTemplates(buf+headLen+6, outLen - 8);
       if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
+          if(buf != _sendBuf)
+            free(buf);
           return 0;
       }
-      outLen = sprintf((char*)buf+headLen, "%x", readLen) + headLen;
+      outLen = sprintf((char*)buf+headLen, "%x", (unsigned)readLen) + headLen;
       while(outLen < headLen + 4) buf[outLen++] = ' ';
       buf[outLen++] = '\r';
       buf[outLen++] = '\n';
@@ -327,7 +427,8 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
     } else {
       readLen = _fillBufferAndProcessTemplates(buf+headLen, outLen);
       if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
+          if(buf != _sendBuf)
+            free(buf);
           return 0;
       }
       outLen = readLen + headLen;
@@ -347,10 +448,13 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
         _sentLength += outLen - headLen;
     }
 
-    free(buf);
+    if(buf != _sendBuf)
+      free(buf);
 
     if((_chunked && readLen == 0) || (!_sendContentLength && outLen == 0) || (!_chunked && _sentLength == _contentLength)){
       _state = RESPONSE_WAIT_ACK;
+      AsyncWebSendBuffers::Instance().give(_sendBuf);
+      _sendBuf = NULL;
     }
     return outLen;
 
@@ -396,7 +500,7 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
     // If closing placeholder is found:
     if(pTemplateEnd) {
       // prepare argument to callback
-      const size_t paramNameLength = std::min(sizeof(buf) - 1, (unsigned int)(pTemplateEnd - pTemplateStart - 1));
+      const size_t paramNameLength = std::min(sizeof(buf) - 1, (size_t)(pTemplateEnd - pTemplateStart - 1));
       if(paramNameLength) {
         memcpy(buf, pTemplateStart + 1, paramNameLength);
         buf[paramNameLength] = 0;
@@ -473,38 +577,268 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
 }
 
 
+/*
+ * Template Index
+ * */
+
+AsyncTemplateCache::AsyncTemplateCache()
+  : _hits(0)
+  , _builds(0)
+{
+  memset(_entries, 0, sizeof(_entries));
+}
+
+AsyncTemplateCache &AsyncTemplateCache::Instance(){
+  static AsyncTemplateCache instance;
+  return instance;
+}
+
+void AsyncTemplateCache::_free(AsyncTemplateIndex* index){
+  for(uint32_t i = 0; i < index->count; i++)
+    free(index->spans[i].name);
+  free(index->spans);
+  delete index;
+}
+
+void AsyncTemplateCache::_detach(AsyncTemplateIndex* index){
+  index->cached = false;
+  if(index->refs == 0)
+    _free(index);
+}
+
+static bool _addSpan(AsyncTemplateIndex* index, uint32_t* cap, uint32_t len, const char* name, size_t nameLen){
+  if(index->count == *cap){
+    uint32_t n = *cap ? *cap * 2 : 16;
+    AsyncTemplateSpan* spans = (AsyncTemplateSpan*)realloc(index->spans, n * sizeof(AsyncTemplateSpan));
+    if(spans == NULL)
+      return false;
+    index->spans = spans;
+    *cap = n;
+  }
+  AsyncTemplateSpan* span = &index->spans[index->count];
+  span->len = len;
+  span->name = NULL;
+  if(name){
+    span->name = (char*)malloc(nameLen + 1);
+    if(span->name == NULL)
+      return false;
+    memcpy(span->name, name, nameLen);
+    span->name[nameLen] = 0;
+  }
+  index->count++;
+  return true;
+}
+
+AsyncTemplateIndex* AsyncTemplateCache::_build(const String& path, File& file){
+  AsyncTemplateIndex* index = new (std::nothrow) AsyncTemplateIndex();
+  if(index == NULL)
+    return NULL;
+  index->path = path;
+  index->size = file.size();
+  index->mtime = file.getLastWrite();
+  index->spans = NULL;
+  index->count = 0;
+  index->refs = 0;
+  index->cached = false;
+
+  uint8_t buf[128];
+  char name[TEMPLATE_PARAM_NAME_LENGTH];
+  uint32_t cap = 0;
+  uint32_t pos = 0;
+  uint32_t literal = 0; //where the literal text being collected starts
+  uint32_t start = 0;   //of the placeholder being read
+  int nameLen = -1;     //-1 outside of a placeholder
+  bool ok = file.seek(0);
+  while(ok){
+    size_t len = file.read(buf, sizeof(buf));
+    if(len == 0)
+      break;
+    for(size_t i = 0; ok && i < len; i++, pos++){
+      uint8_t c = buf[i];
+      if(nameLen < 0){
+        if(c == TEMPLATE_PLACEHOLDER){
+          start = pos;
+          nameLen = 0;
+        }
+      } else if(c == TEMPLATE_PLACEHOLDER){
+        if(start > literal)
+          ok = _addSpan(index, &cap, start - literal, NULL, 0);
+        ok = ok && _addSpan(index, &cap, pos + 1 - start, name, nameLen);
+        literal = pos + 1;
+        nameLen = -1;
+      } else if(nameLen == TEMPLATE_PARAM_NAME_LENGTH){
+        nameLen = -1; //too long for a name, the '%' is text
+      } else {
+        name[nameLen++] = c;
+      }
+    }
+  }
+  if(ok && pos > literal)
+    ok = _addSpan(index, &cap, pos - literal, NULL, 0);
+  if(!ok || pos != index->size || !file.seek(0)){
+    _free(index);
+    file.seek(0);
+    return NULL;
+  }
+  return index;
+}
+
+AsyncTemplateIndex* AsyncTemplateCache::acquire(const String& path, File& file){
+  uint8_t i = 0;
+  while(i < ASYNCWEBSERVER_TEMPLATE_CACHE && _entries[i] && _entries[i]->path != path)
+    i++;
+  AsyncTemplateIndex* index = (i < ASYNCWEBSERVER_TEMPLATE_CACHE) ? _entries[i] : NULL;
+  if(index && (index->size != file.size() || index->mtime != file.getLastWrite())){
+    invalidate(index); //out now, the new one may not get built
+    index = NULL;
+  }
+  if(index){
+    _hits++;
+  } else {
+    index = _build(path, file);
+    if(index == NULL)
+      return NULL;
+    _builds++;
+    index->cached = true;
+    i = 0;
+    while(i < ASYNCWEBSERVER_TEMPLATE_CACHE - 1 && _entries[i])
+      i++;
+    if(_entries[i]) //full, the least recently used one goes
+      _detach(_entries[i]);
+  }
+  //move to the front, the slot at i is the one being replaced
+  for(; i > 0; i--)
+    _entries[i] = _entries[i - 1];
+  _entries[0] = index;
+  index->refs++;
+  return index;
+}
+
+void AsyncTemplateCache::release(AsyncTemplateIndex* index){
+  if(index == NULL)
+    return;
+  index->refs--;
+  if(!index->cached && index->refs == 0)
+    _free(index);
+}
+
+void AsyncTemplateCache::invalidate(AsyncTemplateIndex* index){
+  for(uint8_t i = 0; i < ASYNCWEBSERVER_TEMPLATE_CACHE; i++){
+    if(_entries[i] != index)
+      continue;
+    for(; i + 1 < ASYNCWEBSERVER_TEMPLATE_CACHE; i++)
+      _entries[i] = _entries[i + 1];
+    _entries[i] = NULL;
+    _detach(index);
+    return;
+  }
+}
+
+void AsyncTemplateCache::clear(){
+  for(uint8_t i = 0; i < ASYNCWEBSERVER_TEMPLATE_CACHE; i++){
+    if(_entries[i])
+      _detach(_entries[i]);
+    _entries[i] = NULL;
+  }
+}
+
 /*
  * File Response
  * */
 
 AsyncFileResponse::~AsyncFileResponse(){
+  AsyncTemplateCache::Instance().release(_tpl);
   if(_content)
     _content.close();
 }
 
+size_t AsyncFileResponse::_fillBufferAndProcessTemplates(uint8_t* data, size_t len){
+  if(!_callback)
+    return _fillBuffer(data, len);
+  if(!_tplTried){
+    _tplTried = true;
+    _tpl = AsyncTemplateCache::Instance().acquire(_path, _content);
+  }
+  if(_tpl == NULL)
+    return AsyncAbstractResponse::_fillBufferAndProcessTemplates(data, len);
+
+  size_t out = 0;
+  while(out < len){
+    if(_tplValuePos < _tplValue.length()){
+      size_t n = std::min(len - out, _tplValue.length() - _tplValuePos);
+      memcpy(data + out, _tplValue.c_str() + _tplValuePos, n);
+      _tplValuePos += n;
+      out += n;
+      continue;
+    }
+    if(_tplSpan == _tpl->count)
+      break;
+    const AsyncTemplateSpan& span = _tpl->spans[_tplSpan];
+    if(span.name){
+      //read past it, it has to be where the index says
+      uint8_t skip[TEMPLATE_PARAM_NAME_LENGTH + 2];
+      if(_content.read(skip, span.len) != span.len || skip[0] != TEMPLATE_PLACEHOLDER || skip[span.len - 1] != TEMPLATE_PLACEHOLDER){
+        AsyncTemplateCache::Instance().invalidate(_tpl);
+        _tplSpan = _tpl->count;
+        break;
+      }
+      _tplSpan++;
+      if(span.name[0] == 0){
+        data[out++] = TEMPLATE_PLACEHOLDER;
+        continue;
+      }
+      _tplValue = _callback(String(span.name));
+      _tplValuePos = 0;
+      continue;
+    }
+    size_t n = _content.read(data + out, std::min(len - out, (size_t)(span.len - _tplPos)));
+    if(n == 0){ //the file got shorter under us, end the page here
+      _tplSpan = _tpl->count;
+      break;
+    }
+    out += n;
+    _tplPos += n;
+    if(_tplPos == span.len){
+      _tplSpan++;
+      _tplPos = 0;
+    }
+  }
+  return out;
+}
+
+static const char* _fileContentType(const String& path){
+  if (path.endsWith(".html")) return "text/html";
+  else if (path.endsWith(".htm")) return "text/html";
+  else if (path.endsWith(".css")) return "text/css";
+  else if (path.endsWith(".json")) return "application/json";
+  else if (path.endsWith(".js")) return "application/javascript";
+  else if (path.endsWith(".png")) return "image/png";
+  else if (path.endsWith(".gif")) return "image/gif";
+  else if (path.endsWith(".jpg")) return "image/jpeg";
+  else if (path.endsWith(".ico")) return "image/x-icon";
+  else if (path.endsWith(".svg")) return "image/svg+xml";
+  else if (path.endsWith(".eot")) return "font/eot";
+  else if (path.endsWith(".woff")) return "font/woff";
+  else if (path.endsWith(".woff2")) return "font/woff2";
+  else if (path.endsWith(".ttf")) return "font/ttf";
+  else if (path.endsWith(".xml")) return "text/xml";
+  else if (path.endsWith(".pdf")) return "application/pdf";
+  else if (path.endsWith(".zip")) return "application/zip";
+  else if (path.endsWith(".gz")) return "application/x-gzip";
+  else return "text/plain";
+}
+
 void AsyncFileResponse::_setContentType(const String& path){
-  if (path.endsWith(".html")) _contentType = "text/html";
-  else if (path.endsWith(".htm")) _contentType = "text/html";
-  else if (path.endsWith(".css")) _contentType = "text/css";
-  else if (path.endsWith(".json")) _contentType = "application/json";
-  else if (path.endsWith(".js")) _contentType = "application/javascript";
-  else if (path.endsWith(".png")) _contentType = "image/png";
-  else if (path.endsWith(".gif")) _contentType = "image/gif";
-  else if (path.endsWith(".jpg")) _contentType = "image/jpeg";
-  else if (path.endsWith(".ico")) _contentType = "image/x-icon";
-  else if (path.endsWith(".svg")) _contentType = "image/svg+xml";
-  else if (path.endsWith(".eot")) _contentType = "font/eot";
-  else if (path.endsWith(".woff")) _contentType = "font/woff";
-  else if (path.endsWith(".woff2")) _contentType = "font/woff2";
-  else if (path.endsWith(".ttf")) _contentType = "font/ttf";
-  else if (path.endsWith(".xml")) _contentType = "text/xml";
-  else if (path.endsWith(".pdf")) _contentType = "application/pdf";
-  else if (path.endsWith(".zip")) _contentType = "application/zip";
-  else if(path.endsWith(".gz")) _contentType = "application/x-gzip";
-  else _contentType = "text/plain";
-}
-
-AsyncFileResponse::AsyncFileResponse(FS &fs, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback){
+  _contentType = _fileContentType(path);
+}
+
+AsyncFileResponse::AsyncFileResponse(FS &fs, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback)
+  , _tpl(NULL)
+  , _tplTried(false)
+  , _tplSpan(0)
+  , _tplPos(0)
+  , _tplValuePos(0)
+{
   _code = 200;
   _path = path;
 
@@ -538,7 +872,13 @@ AsyncFileResponse::AsyncFileResponse(FS &fs, const String& path, const String& c
   addHeader("Content-Disposition", buf);
 }
 
-AsyncFileResponse::AsyncFileResponse(File content, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback){
+AsyncFileResponse::AsyncFileResponse(File content, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback)
+  , _tpl(NULL)
+  , _tplTried(false)
+  , _tplSpan(0)
+  , _tplPos(0)
+  , _tplValuePos(0)
+{
   _code = 200;
   _path = path;
 
@@ -573,6 +913,94 @@ size_t AsyncFileResponse::_fillBuffer(uint8_t *data, size_t len){
   return _content.read(data, len);
 }
 
+/*
+ * Static Cache Response
+ * */
+
+AsyncStaticCacheResponse::AsyncStaticCacheResponse(AsyncStaticCacheEntry* entry): AsyncAbstractResponse(){
+  _entry = entry;
+  _entry->refs++;
+  _readLength = 0;
+  _code = 200;
+  _contentLength = entry->len;
+  _contentType = _fileContentType(entry->path);
+  if(entry->gzip)
+    addHeader("Content-Encoding", "gzip");
+
+  int filenameStart = entry->path.lastIndexOf('/') + 1;
+  addHeader("Content-Disposition", "inline; filename=\"" + entry->path.substring(filenameStart) + "\"");
+}
+
+AsyncStaticCacheResponse::~AsyncStaticCacheResponse(){
+  _entry->release();
+}
+
+size_t AsyncStaticCacheResponse::_fillBuffer(uint8_t *data, size_t len){
+  size_t left = _contentLength - _readLength;
+  if(len > left)
+    len = left;
+  memcpy(data, _entry->data + _readLength, len);
+  _readLength += len;
+  return len;
+}
+
+/*
+ * Asset Response
+ * */
+
+AsyncAssetResponse::AsyncAssetResponse(const AsyncWebAsset* asset, int code){
+  _asset = asset;
+  _code = code;
+  _fixedHeaders = asset->headers; //Content-Length and the rest come from the build
+  _sendContentLength = false;
+  _contentLength = (code == 304) ? 0 : asset->len;
+  _headSent = 0;
+}
+
+void AsyncAssetResponse::_respond(AsyncWebServerRequest *request){
+  _addConnectionHeader(request, true);
+  _head = _assembleHead(request->version());
+  _state = RESPONSE_HEADERS;
+  _ack(request, 0, 0);
+}
+
+size_t AsyncAssetResponse::_ack(AsyncWebServerRequest *request, size_t len, uint32_t time){
+  (void)time;
+  _ackedLength += len;
+  AsyncClient* client = request->client();
+  size_t written = 0;
+  if(_state == RESPONSE_HEADERS){
+    size_t n = std::min(client->space(), _head.length() - _headSent);
+    if(n){
+      n = client->write(_head.c_str() + _headSent, n);
+      _headSent += n;
+      written += n;
+    }
+    if(_headSent < _head.length()){
+      _writtenLength += written;
+      return written;
+    }
+    _head = String();
+    _state = RESPONSE_CONTENT;
+  }
+  if(_state == RESPONSE_CONTENT){
+    //the body never moves, lwIP can send it from flash without a copy
+    size_t n = std::min(client->space(), _contentLength - _sentLength);
+    if(n){
+      n = client->write((const char*)_asset->data + _sentLength, n, 0);
+      _sentLength += n;
+      written += n;
+    }
+    if(_sentLength == _contentLength)
+      _state = RESPONSE_WAIT_ACK;
+    _writtenLength += written;
+    return written;
+  }
+  if(_state == RESPONSE_WAIT_ACK && _ackedLength >= _writtenLength)
+    _state = RESPONSE_END;
+  return 0;
+}
+
 /*
  * Stream Response
  * */
@@ -0,0 +1,243 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "ESPAsyncWebServer.h"
+#include "WebRouterImpl.h"
+
+static AsyncWebRouteNode* _newNode(const char* segment, size_t len){
+  AsyncWebRouteNode* node = (AsyncWebRouteNode*)calloc(1, sizeof(AsyncWebRouteNode));
+  if(node == NULL)
+    return NULL;
+  node->segment = (char*)malloc(len + 1);
+  if(node->segment == NULL){
+    free(node);
+    return NULL;
+  }
+  memcpy(node->segment, segment, len);
+  node->segment[len] = 0;
+  node->len = len;
+  return node;
+}
+
+static void _freeNode(AsyncWebRouteNode* node){
+  if(node == NULL)
+    return;
+  for(uint16_t i = 0; i < node->childCount; i++)
+    _freeNode(node->children[i]);
+  _freeNode(node->param);
+  free(node->children);
+  free(node->routes);
+  free(node->segment);
+  free(node);
+}
+
+//binary search of the children, pos is where a missing segment would go
+static AsyncWebRouteNode* _findChild(AsyncWebRouteNode* node, const char* segment, size_t len, uint16_t* pos){
+  uint16_t lo = 0, hi = node->childCount;
+  while(lo < hi){
+    uint16_t mid = (lo + hi) / 2;
+    AsyncWebRouteNode* child = node->children[mid];
+    int cmp = (child->len != len) ? (int)child->len - (int)len : memcmp(child->segment, segment, len);
+    if(cmp == 0)
+      return child;
+    if(cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if(pos)
+    *pos = lo;
+  return NULL;
+}
+
+static bool _addChild(AsyncWebRouteNode* node, AsyncWebRouteNode* child, uint16_t pos){
+  AsyncWebRouteNode** children = (AsyncWebRouteNode**)realloc(node->children, (node->childCount + 1) * sizeof(AsyncWebRouteNode*));
+  if(children == NULL)
+    return false;
+  memmove(children + pos + 1, children + pos, (node->childCount - pos) * sizeof(AsyncWebRouteNode*));
+  children[pos] = child;
+  node->children = children;
+  node->childCount++;
+  return true;
+}
+
+static bool _addRoute(AsyncWebRouteNode* node, const AsyncWebRoute& route){
+  AsyncWebRoute* routes = (AsyncWebRoute*)realloc(node->routes, (node->routeCount + 1) * sizeof(AsyncWebRoute));
+  if(routes == NULL)
+    return false;
+  routes[node->routeCount++] = route;
+  node->routes = routes;
+  return true;
+}
+
+static AsyncWebHandler* _scanHandlers(const LinkedList<AsyncWebHandler*>& handlers, AsyncWebServerRequest* request){
+  for(const auto& h: handlers){
+    if (h->filter(request) && h->canHandle(request))
+      return h;
+  }
+  return NULL;
+}
+
+AsyncWebRouter::AsyncWebRouter()
+  : _root(NULL)
+  , _linear(NULL)
+  , _linearCount(0)
+  , _dirty(true)
+  , _scan(false)
+{}
+
+AsyncWebRouter::~AsyncWebRouter(){
+  _clear();
+}
+
+void AsyncWebRouter::_clear(){
+  _freeNode(_root);
+  _root = NULL;
+  free(_linear);
+  _linear = NULL;
+  _linearCount = 0;
+}
+
+bool AsyncWebRouter::_build(const LinkedList<AsyncWebHandler*>& handlers){
+  _clear();
+  _root = _newNode("", 0);
+  if(_root == NULL)
+    return false;
+  size_t total = handlers.length();
+  if(total){
+    _linear = (AsyncWebRoute*)malloc(total * sizeof(AsyncWebRoute));
+    if(_linear == NULL)
+      return false;
+  }
+  uint16_t order = 0;
+  for(const auto& h: handlers){
+    AsyncWebRoute route = { h, order++, HTTP_ANY };
+    const char* uri;
+    size_t len;
+    if(h->_routeKey(&uri, &len, &route.method)){
+      AsyncWebRouteNode* node = _insert(uri, len);
+      if(node == NULL || !_addRoute(node, route))
+        return false;
+    } else {
+      _linear[_linearCount++] = route;
+    }
+  }
+  return true;
+}
+
+AsyncWebRouteNode* AsyncWebRouter::_insert(const char* uri, size_t len){
+  AsyncWebRouteNode* node = _root;
+  if(len == 0) //"/*"
+    return node;
+  const char* p = uri + 1;
+  const char* end = uri + len;
+  while(true){
+    const char* q = (const char*)memchr(p, '/', end - p);
+    if(q == NULL)
+      q = end;
+    size_t l = q - p;
+    AsyncWebRouteNode* child;
+    if(l >= 2 && p[0] == '{' && p[l - 1] == '}'){
+      if(node->param == NULL)
+        node->param = _newNode(p, l);
+      child = node->param;
+    } else {
+      uint16_t pos = 0;
+      child = _findChild(node, p, l, &pos);
+      if(child == NULL){
+        child = _newNode(p, l);
+        if(child && !_addChild(node, child, pos)){
+          _freeNode(child);
+          child = NULL;
+        }
+      }
+    }
+    if(child == NULL)
+      return NULL;
+    node = child;
+    if(q == end)
+      return node;
+    p = q + 1;
+  }
+}
+
+//every route on the way down can match: "/foo" takes "/foo/bar" too. p is NULL once the url ran out
+void AsyncWebRouter::_collect(AsyncWebRouteNode* node, const char* p, const char* end, AsyncWebRoute** out, uint8_t* count){
+  for(uint16_t i = 0; i < node->routeCount; i++){
+    if(*count >= ASYNCWEBSERVER_ROUTE_CANDIDATES){
+      *count = ASYNCWEBSERVER_ROUTE_CANDIDATES + 1;
+      return;
+    }
+    out[(*count)++] = &node->routes[i];
+  }
+  if(p == NULL)
+    return;
+  const char* q = (const char*)memchr(p, '/', end - p);
+  const char* next = q ? q + 1 : NULL;
+  if(q == NULL)
+    q = end;
+  AsyncWebRouteNode* child = _findChild(node, p, q - p, NULL);
+  if(child)
+    _collect(child, next, end, out, count);
+  if(node->param && *count <= ASYNCWEBSERVER_ROUTE_CANDIDATES)
+    _collect(node->param, next, end, out, count);
+}
+
+AsyncWebHandler* AsyncWebRouter::find(const LinkedList<AsyncWebHandler*>& handlers, AsyncWebServerRequest* request){
+  if(_dirty){
+    _dirty = false;
+    _scan = !_build(handlers);
+    if(_scan)
+      _clear();
+  }
+  if(_scan)
+    return _scanHandlers(handlers, request);
+
+  AsyncWebRoute* hits[ASYNCWEBSERVER_ROUTE_CANDIDATES + 1];
+  uint8_t count = 0;
+  const String& url = request->url();
+  if(url.length() && url[0] == '/')
+    _collect(_root, url.c_str() + 1, url.c_str() + url.length(), hits, &count);
+  if(count > ASYNCWEBSERVER_ROUTE_CANDIDATES)
+    return _scanHandlers(handlers, request);
+
+  //hits come out in tree order, the handlers are tried in the order they were added
+  for(uint8_t i = 1; i < count; i++){
+    AsyncWebRoute* r = hits[i];
+    uint8_t j = i;
+    while(j && hits[j - 1]->order > r->order){
+      hits[j] = hits[j - 1];
+      j--;
+    }
+    hits[j] = r;
+  }
+  uint8_t i = 0;
+  uint16_t j = 0;
+  while(i < count || j < _linearCount){
+    AsyncWebRoute* r;
+    if(j == _linearCount || (i < count && hits[i]->order < _linear[j].order))
+      r = hits[i++];
+    else
+      r = &_linear[j++];
+    if((r->method & request->method()) && r->handler->filter(request) && r->handler->canHandle(request))
+      return r->handler;
+  }
+  return NULL;
+}
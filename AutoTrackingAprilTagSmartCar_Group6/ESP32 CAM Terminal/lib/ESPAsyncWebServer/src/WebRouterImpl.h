@@ -0,0 +1,70 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBSERVERROUTERIMPL_H_
+#define ASYNCWEBSERVERROUTERIMPL_H_
+
+#ifndef ASYNCWEBSERVER_ROUTE_CANDIDATES
+#define ASYNCWEBSERVER_ROUTE_CANDIDATES 16 //routes one url can hit before falling back to the plain scan
+#endif
+
+typedef struct {
+  AsyncWebHandler* handler;
+  uint16_t order; //position in the server's handler list
+  WebRequestMethodComposite method;
+} AsyncWebRoute;
+
+struct AsyncWebRouteNode {
+  char* segment;
+  uint16_t len;
+  uint16_t childCount;
+  AsyncWebRouteNode** children; //sorted by length, then bytes
+  AsyncWebRouteNode* param;     //"{name}" segments, any one segment goes
+  AsyncWebRoute* routes;
+  uint16_t routeCount;
+};
+
+/*
+ * ROUTER :: Handlers with a plain path are kept in a tree with one edge per path segment.
+ * Finding the ones a url can hit costs one child lookup per segment, however many routes there are.
+ * Everything else (regex, "*.ext" suffixes, static files, websockets, custom handlers) is tried on every
+ * request. Candidates are still checked with filter() and canHandle(), in the order they were added.
+ * */
+
+class AsyncWebRouter {
+  private:
+    AsyncWebRouteNode* _root;
+    AsyncWebRoute* _linear; //handlers that have to see every request
+    uint16_t _linearCount;
+    bool _dirty;
+    bool _scan;             //out of memory while building, do what the server always did
+
+    void _clear();
+    bool _build(const LinkedList<AsyncWebHandler*>& handlers);
+    AsyncWebRouteNode* _insert(const char* uri, size_t len);
+    void _collect(AsyncWebRouteNode* node, const char* p, const char* end, AsyncWebRoute** out, uint8_t* count);
+  public:
+    AsyncWebRouter();
+    ~AsyncWebRouter();
+    void invalidate(){ _dirty = true; } //rebuilt on the next request
+    AsyncWebHandler* find(const LinkedList<AsyncWebHandler*>& handlers, AsyncWebServerRequest* request);
+};
+
+#endif /* ASYNCWEBSERVERROUTERIMPL_H_ */
@@ -20,7 +20,9 @@
 */
 #include "ESPAsyncWebServer.h"
 #include "WebHandlerImpl.h"
+#include "WebRouterImpl.h"
 
+#if defined(ESP32) || defined(ESP8266)
 bool ON_STA_FILTER(AsyncWebServerRequest *request) {
   return WiFi.localIP() == request->client()->localIP();
 }
@@ -28,12 +30,27 @@ bool ON_STA_FILTER(AsyncWebServerRequest *request) {
 bool ON_AP_FILTER(AsyncWebServerRequest *request) {
   return WiFi.localIP() != request->client()->localIP();
 }
+#else
+//no soft AP on a host build: every interface counts as station
+bool ON_STA_FILTER(AsyncWebServerRequest *request) {
+  return true;
+}
+
+bool ON_AP_FILTER(AsyncWebServerRequest *request) {
+  return false;
+}
+#endif
 
 
 AsyncWebServer::AsyncWebServer(uint16_t port)
   : _server(port)
   , _rewrites(LinkedList<AsyncWebRewrite*>([](AsyncWebRewrite* r){ delete r; }))
   , _handlers(LinkedList<AsyncWebHandler*>([](AsyncWebHandler* h){ delete h; }))
+  , _router(new AsyncWebRouter())
+  , _keepAliveTimeout(ASYNCWEBSERVER_KEEPALIVE_TIMEOUT)
+  , _keepAliveMax(ASYNCWEBSERVER_KEEPALIVE_MAX)
+  , _connections(0)
+  , _requests(0)
 {
   _catchAllHandler = new AsyncCallbackWebHandler();
   if(_catchAllHandler == NULL)
@@ -42,6 +59,7 @@ AsyncWebServer::AsyncWebServer(uint16_t port)
     if(c == NULL)
       return;
     c->setRxTimeout(3);
+    ((AsyncWebServer*)s)->_connections++;
     AsyncWebServerRequest *r = new AsyncWebServerRequest((AsyncWebServer*)s, c);
     if(r == NULL){
       c->close(true);
@@ -55,6 +73,7 @@ AsyncWebServer::~AsyncWebServer(){
   reset();  
   end();
   if(_catchAllHandler) delete _catchAllHandler;
+  if(_router) delete _router;
 }
 
 AsyncWebRewrite& AsyncWebServer::addRewrite(AsyncWebRewrite* rewrite){
@@ -72,10 +91,12 @@ AsyncWebRewrite& AsyncWebServer::rewrite(const char* from, const char* to){
 
 AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler){
   _handlers.add(handler);
+  if(_router) _router->invalidate();
   return *handler;
 }
 
 bool AsyncWebServer::removeHandler(AsyncWebHandler *handler){
+  if(_router) _router->invalidate();
   return _handlers.remove(handler);
 }
 
@@ -112,11 +133,20 @@ void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *request){
 }
 
 void AsyncWebServer::_attachHandler(AsyncWebServerRequest *request){
-  for(const auto& h: _handlers){
-    if (h->filter(request) && h->canHandle(request)){
+  _requests++;
+  if(_router){
+    AsyncWebHandler* h = _router->find(_handlers, request);
+    if(h){
       request->setHandler(h);
       return;
     }
+  } else {
+    for(const auto& h: _handlers){
+      if (h->filter(request) && h->canHandle(request)){
+        request->setHandler(h);
+        return;
+      }
+    }
   }
   
   request->addInterestingHeader("ANY");
@@ -168,6 +198,12 @@ AsyncStaticWebHandler& AsyncWebServer::serveStatic(const char* uri, fs::FS& fs,
   return *handler;
 }
 
+AsyncAssetWebHandler& AsyncWebServer::serveAsset(const AsyncWebAsset* asset){
+  AsyncAssetWebHandler* handler = new AsyncAssetWebHandler(asset);
+  addHandler(handler);
+  return *handler;
+}
+
 void AsyncWebServer::onNotFound(ArRequestHandlerFunction fn){
   _catchAllHandler->onRequest(fn);
 }
@@ -183,6 +219,7 @@ void AsyncWebServer::onRequestBody(ArBodyHandlerFunction fn){
 void AsyncWebServer::reset(){
   _rewrites.free();
   _handlers.free();
+  if(_router) _router->invalidate();
   
   if (_catchAllHandler != NULL){
     _catchAllHandler->onRequest(NULL);
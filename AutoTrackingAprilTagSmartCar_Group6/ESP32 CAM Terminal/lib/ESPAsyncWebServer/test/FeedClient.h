@@ -0,0 +1,113 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Host tests: drives an AsyncWebServerRequest without a socket
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef FEEDCLIENT_H_
+#define FEEDCLIENT_H_
+
+#include <ESPAsyncWebServer.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+//An AsyncClient without a pcb: bytes handed to feed() reach the onData() handler as if received,
+//writes are refused (space() is 0), so a response never leaves; ack() plays the peer acking it,
+//which is what turns a WebSocket handshake into an AsyncWebSocketClient. end() plays the remote close,
+//which deletes the request and the client the way AsyncWebServer does on a real connection.
+//connect() is the same over a loopback socket, for what needs a connected() client that can send.
+class FeedClient: public AsyncClient {
+  public:
+    //a new connection, owned by the request it starts
+    static AsyncClient* accept(AsyncWebServer* server){
+      AsyncClient* c = new AsyncClient(NULL);
+      new AsyncWebServerRequest(server, c);
+      return c;
+    }
+    //like accept(), but connected through the POSIX backend, whose service thread then runs every callback:
+    //the request is written to *peer, a plain socket the caller also reads and closes (the remote close),
+    //instead of going through feed(), which would race with that thread. NULL if it did not connect
+    static AsyncClient* connect(AsyncWebServer* server, int* peer){
+      static int listener = -1;
+      static uint16_t port = 0;
+      if(listener < 0){
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0 || bind(fd, (struct sockaddr*)&addr, len) || listen(fd, 64) || getsockname(fd, (struct sockaddr*)&addr, &len)){
+          if(fd >= 0){
+            ::close(fd);
+          }
+          return NULL;
+        }
+        listener = fd;
+        port = ntohs(addr.sin_port);
+      }
+      AsyncClient* c = new AsyncClient();
+      if(!c->connect(IPAddress(127, 0, 0, 1), port)){
+        delete c;
+        return NULL;
+      }
+      *peer = ::accept(listener, NULL, NULL);
+      for(int i = 0; i < 2000 && *peer >= 0 && !c->connected(); i++){
+        delay(1);
+      }
+      if(*peer < 0 || !c->connected()){
+        if(*peer >= 0){
+          ::close(*peer);
+        }
+        delete c;
+        return NULL;
+      }
+      new AsyncWebServerRequest(server, c);
+      return c;
+    }
+    //handlers may write to a receive buffer, so the data goes through a copy, as from a socket
+    static void feed(AsyncClient* c, const void* data, size_t len){
+      static char rx[8192];
+      AcDataHandler AsyncClient::* cb = &FeedClient::_recv_cb;
+      void* AsyncClient::* arg = &FeedClient::_recv_cb_arg;
+      while(len && c->*cb){
+        size_t n = (len < sizeof(rx)) ? len : sizeof(rx);
+        memcpy(rx, data, n);
+        data = (const char*)data + n;
+        len -= n;
+        (c->*cb)(c->*arg, c, rx, n);
+      }
+    }
+    static void ack(AsyncClient* c, size_t len){
+      AcAckHandler AsyncClient::* cb = &FeedClient::_sent_cb;
+      void* AsyncClient::* arg = &FeedClient::_sent_cb_arg;
+      if(c->*cb){
+        (c->*cb)(c->*arg, c, len, 0);
+      }
+    }
+    static void end(AsyncClient* c){
+      AcConnectHandler AsyncClient::* cb = &FeedClient::_discard_cb;
+      void* AsyncClient::* arg = &FeedClient::_discard_cb_arg;
+      if(c->*cb){
+        (c->*cb)(c->*arg, c);
+      } else {
+        delete c;
+      }
+    }
+};
+
+#endif /* FEEDCLIENT_H_ */
@@ -0,0 +1,185 @@
+/*
+ * Server for the end-to-end scripts in this directory, on the Linux build.
+ *
+ *   espasyncwebserver_host_server <port>
+ *
+ * Prints "ready" once it listens. Keep-alive is limited to 10 requests and 2 seconds of idle time,
+ * so the scripts can check both limits. Every response carries the default header X-Host-Test.
+ *
+ *   GET  /               "hello"
+ *   GET  /params         the query parameters as name=value lines
+ *   GET  /headers        the request headers as name: value lines, in order (X-Pick asked for by name first)
+ *   POST /echo           the request body (up to 64 kB)
+ *   GET  /chunked?n=N    N bytes of a repeating pattern, chunked
+ *   GET  /static/...     files under $ASYNC_HOST_FS_ROOT/static/, files up to 4 kB kept in an 8 kB cache
+ *   GET  /fs             filesystem accesses and file cache counts, as name=value lines
+ *   GET  /asset/...      flash assets: hello.txt "hello", app.js gzipped, big.bin 100000 bytes of the pattern
+ *   GET  /ws             WebSocket echo, permessage-deflate and 1 MB reassembly. "all:..." goes to every
+ *                        client, "burst <newest|oldest|coalesce> N" sets this client's queue policy and sends
+ *                        "0" to "N-1" in one go (keys 1 to 4 in turn), "stats" answers "dropped=D coalesced=C"
+ */
+
+#include <ESPAsyncWebServer.h>
+#include <signal.h>
+
+#define ECHO_MAX (64 * 1024)
+
+struct EchoBody {
+  size_t len;
+  char data[];
+};
+
+static void chunkPattern(uint8_t * buf, size_t len, size_t index){
+  for(size_t i = 0; i < len; i++){
+    buf[i] = 'a' + (index + i) % 26;
+  }
+}
+
+//its headers as tools/embed_assets.py writes them, the ETag being the FNV-1a of the bytes
+static AsyncWebAsset makeAsset(const char * uri, const uint8_t * data, size_t len, const char * type, bool gzipped){
+  uint32_t h = 2166136261u;
+  for(size_t i = 0; i < len; i++){
+    h = (h ^ data[i]) * 16777619u;
+  }
+  char etag[16], headers[256];
+  snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned)h);
+  snprintf(headers, sizeof(headers), "Content-Length: %u\r\nContent-Type: %s\r\n%sETag: %s\r\nCache-Control: no-cache\r\n",
+    (unsigned)len, type, gzipped ? "Content-Encoding: gzip\r\n" : "", etag);
+  return { uri, data, len, strdup(etag), strdup(headers) }; //for as long as the server runs
+}
+
+//gzip.compress(b"console.log('car');\n" * 200, 9, mtime=0)
+static const uint8_t appJsGz[] = {
+  0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xED, 0xC8, 0xB1, 0x09, 0xC0, 0x20,
+  0x10, 0x00, 0xC0, 0x3E, 0x8B, 0x98, 0x34, 0x2E, 0xE0, 0x34, 0xF2, 0x04, 0x1B, 0xF1, 0x21, 0xEE,
+  0x0F, 0xD9, 0xC2, 0xEA, 0xAE, 0xBC, 0xC8, 0xB5, 0x73, 0xBE, 0x75, 0xE6, 0xB8, 0x4B, 0xF4, 0xAF,
+  0x3C, 0xED, 0x0A, 0xE7, 0x9C, 0x73, 0xCE, 0x39, 0xE7, 0x9C, 0x73, 0xCE, 0x1D, 0xBD, 0x1F, 0xC7,
+  0xA8, 0xD3, 0xB1, 0xA0, 0x0F, 0x00, 0x00,
+};
+
+int main(int argc, char ** argv){
+  uint16_t port = (argc > 1) ? atoi(argv[1]) : 18080;
+  setvbuf(stdout, NULL, _IONBF, 0);
+  signal(SIGPIPE, SIG_IGN);
+
+  static AsyncWebServer server(port);
+  static AsyncWebSocket ws("/ws");
+  server.setKeepAlive(2, 10);
+  DefaultHeaders::Instance().addHeader("X-Host-Test", "1");
+
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest * request){
+    request->send(200, "text/plain", "hello");
+  });
+  server.on("/params", HTTP_GET, [](AsyncWebServerRequest * request){
+    String out;
+    for(int i = 0; i < request->params(); i++){
+      AsyncWebParameter * p = request->getParam(i);
+      out += p->name() + "=" + p->value() + "\n";
+    }
+    request->send(200, "text/plain", out);
+  });
+  server.on("/headers", HTTP_GET, [](AsyncWebServerRequest * request){
+    request->getHeader("X-Pick");
+    String out;
+    for(size_t i = 0; i < request->headers(); i++){
+      out += request->headerName(i) + ": " + request->header(i) + "\n";
+    }
+    request->send(200, "text/plain", out);
+  });
+  server.on("/echo", HTTP_POST, [](AsyncWebServerRequest * request){
+    EchoBody * body = (EchoBody *)request->_tempObject;
+    if(!body){
+      request->send(request->contentLength() ? 413 : 200, "text/plain", "");
+      return;
+    }
+    request->send(200, "application/octet-stream", String(body->data, body->len));
+  }, NULL, [](AsyncWebServerRequest * request, uint8_t * data, size_t len, size_t index, size_t total){
+    if(total > ECHO_MAX){
+      return;
+    }
+    if(!index){
+      request->_tempObject = malloc(sizeof(EchoBody) + total);
+      if(request->_tempObject){
+        ((EchoBody *)request->_tempObject)->len = 0;
+      }
+    }
+    EchoBody * body = (EchoBody *)request->_tempObject;
+    if(body && index + len <= total){
+      memcpy(body->data + index, data, len);
+      body->len = index + len;
+    }
+  });
+  server.on("/chunked", HTTP_GET, [](AsyncWebServerRequest * request){
+    size_t n = request->hasParam("n") ? request->getParam("n")->value().toInt() : 1000;
+    request->send(request->beginChunkedResponse("text/plain", [n](uint8_t * buf, size_t maxLen, size_t index) -> size_t {
+      size_t len = (n - index < maxLen) ? n - index : maxLen;
+      chunkPattern(buf, len, index);
+      return len;
+    }));
+  });
+
+  static fs::FS hostFS;
+  static AsyncStaticWebHandler& files = server.serveStatic("/static/", hostFS, "/static/").setFileCache(8192, 4096);
+  server.on("/fs", HTTP_GET, [](AsyncWebServerRequest * request){
+    const AsyncStaticFileCache * cache = files.fileCache();
+    char out[128];
+    snprintf(out, sizeof(out), "opens=%lu\nhits=%u\nmisses=%u\nnotModified=%u\n", fs::FS::opens(),
+      (unsigned)cache->hits(), (unsigned)cache->misses(), (unsigned)cache->notModified());
+    request->send(200, "text/plain", out);
+  });
+
+  static uint8_t big[100000];
+  chunkPattern(big, sizeof(big), 0);
+  static const AsyncWebAsset assets[] = {
+    makeAsset("/asset/hello.txt", (const uint8_t *)"hello", 5, "text/plain", false),
+    makeAsset("/asset/app.js", appJsGz, sizeof(appJsGz), "application/javascript", true),
+    makeAsset("/asset/big.bin", big, sizeof(big), "application/octet-stream", false),
+  };
+  for(const AsyncWebAsset & a : assets){
+    server.serveAsset(&a);
+  }
+
+  ws.setDeflate(true);
+  ws.setReassembly(1024 * 1024);
+  ws.onEvent([](AsyncWebSocket * s, AsyncWebSocketClient * c, AwsEventType t, void * arg, uint8_t * data, size_t len){
+    if(t != WS_EVT_DATA){
+      return;
+    }
+    AwsFrameInfo * info = (AwsFrameInfo *)arg;
+    if(info->index || info->len != len || !info->final){
+      return;
+    }
+    char cmd[64] = "";
+    if(info->opcode == WS_TEXT && len < sizeof(cmd)){
+      memcpy(cmd, data, len);
+      cmd[len] = 0;
+    }
+    char policy[16];
+    int n;
+    if(len > 4 && !memcmp(data, "all:", 4)){
+      s->textAll((const char *)data + 4, len - 4);
+    } else if(sscanf(cmd, "burst %15s %d", policy, &n) == 2){
+      //on the service thread: no ack comes in before the last one is queued
+      c->setQueuePolicy(!strcmp(policy, "oldest") ? QUEUE_DROP_OLDEST : !strcmp(policy, "coalesce") ? QUEUE_COALESCE : QUEUE_DROP_NEWEST);
+      for(int i = 0; i < n; i++){
+        char m[16];
+        c->text(m, snprintf(m, sizeof(m), "%d", i), i % 4 + 1);
+      }
+    } else if(!strcmp(cmd, "stats")){
+      char out[64];
+      c->text(out, snprintf(out, sizeof(out), "dropped=%u coalesced=%u", (unsigned)c->dropped(), (unsigned)c->coalesced()));
+    } else if(info->opcode == WS_TEXT){
+      c->text((const char *)data, len);
+    } else {
+      c->binary((const char *)data, len);
+    }
+  });
+  server.addHandler(&ws);
+
+  server.begin();
+  printf("ready\n");
+  for(;;){
+    delay(1000);
+  }
+  return 0;
+}
@@ -0,0 +1,322 @@
+# Keep-alive and pipelining against test/host_server.cpp, over real sockets.
+#
+#   python3 keepalive.py <path to espasyncwebserver_host_server> [mutated streams]
+#
+# Starts the server on a free port, checks connection reuse, pipelined requests (a POST body and
+# the next request in one packet), HTTP/1.0, a request sent one byte at a time, chunked responses,
+# header order by index (with more headers than ASYNCWEBSERVER_HEADER_SLICES), flash assets byte for
+# byte and their 304s,
+# the request and idle limits (10 requests, 2 s), then throws mutated pipelined streams at it and
+# checks that it still answers. Exits non-zero on the first failure.
+import gzip
+import random
+import socket
+import subprocess
+import sys
+import time
+
+
+def free_port():
+    s = socket.socket()
+    s.bind(("127.0.0.1", 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+class Response:
+    def __init__(self, status, headers, body):
+        self.status = status
+        self.headers = headers
+        self.body = body
+
+
+class Conn:
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b""
+
+    def send(self, data):
+        self.sock.sendall(data)
+
+    def _fill(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError("connection closed")
+        self.buf += data
+
+    def _take(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        out, self.buf = self.buf[:n], self.buf[n:]
+        return out
+
+    def _line(self):
+        while b"\r\n" not in self.buf:
+            self._fill()
+        line, self.buf = self.buf.split(b"\r\n", 1)
+        return line
+
+    def response(self):
+        status = self._line().split(b" ", 2)
+        headers = {}
+        while True:
+            line = self._line()
+            if not line:
+                break
+            name, value = line.split(b":", 1)
+            headers[name.strip().lower().decode()] = value.strip().decode()
+        code = int(status[1])
+        if code in (204, 304):
+            body = b""  # a 304 may carry the Content-Length of the 200, never a body
+        elif "content-length" in headers:
+            body = self._take(int(headers["content-length"]))
+        elif headers.get("transfer-encoding") == "chunked":
+            body = b""
+            while True:
+                size = int(self._line().split(b";")[0], 16)
+                body += self._take(size)
+                self._line()
+                if not size:
+                    break
+        else:
+            body = self.buf
+            self.buf = b""
+            try:
+                while True:
+                    self._fill()
+                    body += self.buf
+                    self.buf = b""
+            except EOFError:
+                pass
+        return Response(code, headers, body)
+
+    def closed(self, timeout=5):
+        # True once the server closed its side, without data in between
+        self.sock.settimeout(timeout)
+        try:
+            return self.buf == b"" and self.sock.recv(1) == b""
+        except (socket.timeout, ConnectionResetError):
+            return False
+
+    def close(self):
+        self.sock.close()
+
+
+def get(path, extra=""):
+    return ("GET %s HTTP/1.1\r\nHost: car\r\n%s\r\n" % (path, extra)).encode()
+
+
+def post(path, body):
+    return ("POST %s HTTP/1.1\r\nHost: car\r\nContent-Length: %d\r\n\r\n" % (path, len(body))).encode() + body
+
+
+def pattern(n):
+    return bytes(ord("a") + i % 26 for i in range(n))
+
+
+def expect(cond, what):
+    if not cond:
+        raise AssertionError(what)
+
+
+def check(r, status, body=None):
+    expect(r.status == status, "status %d, wanted %d" % (r.status, status))
+    expect(r.headers.get("x-host-test") == "1", "default header missing")
+    if body is not None:
+        expect(r.body == body, "body %r, wanted %r" % (r.body[:60], body[:60]))
+
+
+def test_reuse(port):
+    c = Conn(port)
+    for i in range(5):
+        c.send(get("/params?i=%d" % i))
+        r = c.response()
+        check(r, 200, b"i=%d\n" % i)
+        expect(r.headers.get("connection") == "keep-alive", "not kept alive")
+    c.close()
+
+
+def test_pipelined(port):
+    c = Conn(port)
+    body = b'{"cmd":"drive","left":80}'
+    c.send(get("/") + post("/echo", body) + get("/params?a=1&b=%20x") + post("/echo", b"") + get("/chunked?n=3000"))
+    check(c.response(), 200, b"hello")
+    check(c.response(), 200, body)
+    check(c.response(), 200, b"a=1\nb= x\n")
+    check(c.response(), 200, b"")
+    check(c.response(), 200, pattern(3000))
+    c.close()
+
+
+def test_http10(port):
+    c = Conn(port)
+    c.send(b"GET / HTTP/1.0\r\n\r\n")
+    r = c.response()
+    check(r, 200, b"hello")
+    expect(c.closed(), "HTTP/1.0 connection left open")
+    c.close()
+
+
+def test_bytewise(port):
+    c = Conn(port)
+    for b in post("/echo", b"x" * 100) + get("/"):
+        c.send(bytes([b]))
+    check(c.response(), 200, b"x" * 100)
+    check(c.response(), 200, b"hello")
+    c.close()
+
+
+def test_chunked(port):
+    c = Conn(port)
+    for n in (0, 1, 1460, 100000):
+        c.send(get("/chunked?n=%d" % n))
+        check(c.response(), 200, pattern(n))
+    c.close()
+
+
+def test_header_order(port):
+    c = Conn(port)
+    for n in (3, 40):
+        names = ["X-H%d" % i for i in range(n)]
+        names.insert(n // 2, "X-Pick")
+        c.send(get("/headers", "".join("%s: v%d\r\n" % (name, i) for i, name in enumerate(names))))
+        sent = ["Host: car"] + ["%s: v%d" % (name, i) for i, name in enumerate(names)]
+        r = c.response()
+        check(r, 200)
+        expect(r.body.decode().splitlines() == sent, "%d headers out of order: %r" % (n + 2, r.body[:120]))
+    c.close()
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return '"%08x"' % h
+
+
+def test_assets(port):
+    # one connection: a 304 that left its Content-Length of body bytes behind would break the next response
+    c = Conn(port)
+    js = b"console.log('car');\n" * 200
+    for path, plain, gzipped in (("/asset/hello.txt", b"hello", False), ("/asset/app.js", js, True),
+                                 ("/asset/big.bin", pattern(100000), False)):
+        c.send(get(path))
+        r = c.response()
+        check(r, 200)
+        expect(int(r.headers.get("content-length", -1)) == len(r.body), path + ": Content-Length")
+        expect((r.headers.get("content-encoding") == "gzip") == gzipped, path + ": Content-Encoding")
+        expect((gzip.decompress(r.body) if gzipped else r.body) == plain, path + ": not the bytes built in")
+        etag = r.headers.get("etag")
+        expect(etag == fnv1a(r.body), "%s: ETag %s of bytes hashing to %s" % (path, etag, fnv1a(r.body)))
+        c.send(get(path, "If-None-Match: %s\r\n" % etag))
+        r = c.response()
+        check(r, 304)
+        expect(r.headers.get("etag") == etag, path + ": 304 without the ETag")
+        c.send(get(path, 'If-None-Match: "00000000"\r\n'))
+        r = c.response()
+        check(r, 200)
+        expect((gzip.decompress(r.body) if gzipped else r.body) == plain, path + ": after another ETag")
+    c.close()
+    # a 304 and the next request in one packet
+    c = Conn(port)
+    c.send(get("/asset/big.bin", "If-None-Match: %s\r\n" % fnv1a(pattern(100000))) + get("/"))
+    check(c.response(), 304)
+    check(c.response(), 200, b"hello")
+    c.close()
+
+
+def test_max_requests(port):
+    c = Conn(port)
+    for i in range(10):
+        c.send(get("/"))
+        r = c.response()
+        check(r, 200, b"hello")
+    expect(r.headers.get("connection") == "close", "10th response does not close")
+    expect(c.closed(), "connection open after 10 requests")
+    c.close()
+
+
+def test_idle(port):
+    c = Conn(port)
+    c.send(get("/"))
+    check(c.response(), 200, b"hello")
+    started = time.time()
+    expect(c.closed(timeout=6), "idle connection not closed")
+    expect(time.time() - started >= 1.5, "idle connection closed early")
+    c.close()
+
+
+def mutate(rnd, data):
+    data = bytearray(data)
+    for _ in range(rnd.randint(1, 6)):
+        pos = rnd.randrange(len(data) + 1)
+        op = rnd.randrange(5)
+        if op == 0 and data:
+            data[rnd.randrange(len(data))] = rnd.randrange(256)
+        elif op == 1:
+            data[pos:pos] = bytes(rnd.randrange(256) for _ in range(rnd.randint(1, 8)))
+        elif op == 2:
+            del data[pos:pos + rnd.randint(1, 16)]
+        elif op == 3:
+            data[pos:pos] = rnd.choice([b"\r\n", b"\r\n\r\n", b"Content-Length: 5\r\n", b"Transfer-Encoding: chunked\r\n",
+                                        b"Connection: close\r\n", b"Expect: 100-continue\r\n", b" HTTP/1.0"])
+        else:
+            end = min(len(data), pos + rnd.randint(1, 64))
+            data[pos:pos] = data[pos:end]
+    return bytes(data)
+
+
+def test_mutated(port, count):
+    rnd = random.Random(1)
+    stream = get("/") + post("/echo", b"0123456789") + get("/params?x=%41&y") + get("/chunked?n=50")
+    for i in range(count):
+        data = mutate(rnd, stream)
+        c = Conn(port)
+        try:
+            pos = 0
+            while pos < len(data):
+                n = rnd.randint(1, 64)
+                c.send(data[pos:pos + n])
+                pos += n
+            c.sock.shutdown(socket.SHUT_WR)
+            c.sock.settimeout(3)
+            while c.sock.recv(65536):
+                pass
+        except (ConnectionError, socket.timeout):
+            pass
+        c.close()
+    # still serving
+    c = Conn(port)
+    c.send(get("/"))
+    check(c.response(), 200, b"hello")
+    c.close()
+
+
+def main():
+    server = sys.argv[1]
+    mutations = int(sys.argv[2]) if len(sys.argv) > 2 else 400
+    port = free_port()
+    proc = subprocess.Popen([server, str(port)], stdout=subprocess.PIPE)
+    try:
+        expect(proc.stdout.readline().strip() == b"ready", "server did not start")
+        tests = [("reuse", test_reuse), ("pipelined", test_pipelined), ("http/1.0", test_http10),
+                 ("byte at a time", test_bytewise), ("chunked", test_chunked),
+                 ("header order", test_header_order), ("assets", test_assets), ("max requests", test_max_requests),
+                 ("idle timeout", test_idle), ("mutated streams", lambda p: test_mutated(p, mutations))]
+        for name, test in tests:
+            test(port)
+            expect(proc.poll() is None, "server exited during " + name)
+            print("%-16s ok" % name)
+    finally:
+        proc.terminate()
+        proc.wait()
+    if proc.returncode not in (0, -15):
+        print("server exit status %d" % proc.returncode)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,152 @@
+/*
+ * LinkedList against std::list: random add, remove, remove_first, remove_if and free, checking
+ * order, length(), nth(), front() and the onRemove callback after every step. Then add/remove
+ * churn, which once warmed up must not allocate (the spare nodes), outside the sanitizers.
+ *
+ *   espasyncwebserver_linked_list_test [operations]
+ */
+
+#include "BenchUtil.h"
+#include <StringArray.h>
+#include <list>
+#include <stdio.h>
+
+static int removed;
+static int failures;
+
+#define CHECK(cond) do{ if(!(cond)){ fprintf(stderr, "step %ld: %s\n", step, #cond); failures++; return; } }while(0)
+
+static void compare(const LinkedList<int>& l, const std::list<int>& ref, long step){
+  CHECK(l.length() == ref.size());
+  CHECK(l.isEmpty() == ref.empty());
+  auto r = ref.begin();
+  size_t i = 0;
+  for(int v : l){
+    CHECK(r != ref.end() && *r == v);
+    if(i < 3 || i + 1 == ref.size()){
+      CHECK(l.nth(i) && *l.nth(i) == v);
+    }
+    ++r;
+    ++i;
+  }
+  CHECK(r == ref.end());
+  CHECK(!l.nth(ref.size()));
+  if(!ref.empty()){
+    CHECK(l.front() == ref.front());
+  }
+}
+
+int main(int argc, char ** argv){
+  long ops = (argc > 1) ? atol(argv[1]) : 200000;
+  LinkedList<int> l([](int v){ removed++; });
+  std::list<int> ref;
+  uint32_t seed = 12345;
+  for(long step = 0; step < ops && !failures; step++){
+    seed = seed * 1103515245 + 12345;
+    uint32_t r = seed >> 8;
+    int v = r % 64;
+    int before = removed;
+    size_t size = ref.size();
+    switch(r % 11){
+      case 0: case 1: case 2: case 3:
+        l.add(v);
+        ref.push_back(v);
+        break;
+      case 4: case 5: {
+        bool found = false;
+        for(auto it = ref.begin(); it != ref.end(); ++it){
+          if(*it == v){
+            ref.erase(it);
+            found = true;
+            break;
+          }
+        }
+        if(l.remove(v) != found){
+          fprintf(stderr, "step %ld: remove(%d)\n", step, v);
+          failures++;
+        }
+        break;
+      }
+      case 6: case 7: {
+        auto pred = [v](int x){ return x >= v; };
+        bool found = false;
+        for(auto it = ref.begin(); it != ref.end(); ++it){
+          if(pred(*it)){
+            ref.erase(it);
+            found = true;
+            break;
+          }
+        }
+        if(l.remove_first(pred) != found){
+          fprintf(stderr, "step %ld: remove_first\n", step);
+          failures++;
+        }
+        break;
+      }
+      case 8: case 9: {
+        auto pred = [v](int x){ return (x % 8) == (v % 8); };
+        size_t n = l.remove_if(pred);
+        ref.remove_if(pred);
+        if(n != size - ref.size()){
+          fprintf(stderr, "step %ld: remove_if returned %zu\n", step, n);
+          failures++;
+        }
+        break;
+      }
+      case 10:
+        if(r % 7 == 0){
+          l.free();
+          ref.clear();
+        }
+        break;
+    }
+    if(removed - before != (int)(size + ((r % 11) < 4) - ref.size())){
+      fprintf(stderr, "step %ld: onRemove ran %d times\n", step, removed - before);
+      failures++;
+    }
+    compare(l, ref, step);
+  }
+
+  //a copy (what getClients() returns) has nodes of its own: changes to either leave the other alone
+  {
+    LinkedList<int> owner(nullptr);
+    std::list<int> ref;
+    for(int i = 0; i < 10; i++){
+      owner.add(i);
+      ref.push_back(i);
+    }
+    LinkedList<int> copy = owner;
+    LinkedList<int> assigned(nullptr);
+    assigned.add(99);
+    assigned = owner;
+    long step = -1;
+    owner.remove(9);
+    owner.remove(0);
+    owner.add(10);
+    compare(copy, ref, step);
+    compare(assigned, ref, step);
+    copy.add(11);
+    assigned.remove(5);
+    std::list<int> ownerRef = { 1, 2, 3, 4, 5, 6, 7, 8, 10 };
+    compare(owner, ownerRef, step);
+  }
+
+  //a message queue: one in, one out
+  LinkedList<int> q(nullptr);
+  for(int i = 0; i < 8; i++){
+    q.add(i);
+  }
+  q.remove_first([](int){ return true; });
+  uint64_t allocs = bench_allocs;
+  for(int i = 0; i < 20000; i++){
+    q.add(i);
+    q.remove_first([](int){ return true; });
+  }
+  allocs = bench_allocs - allocs;
+  if(BENCH_COUNTS_ALLOCS && allocs){
+    fprintf(stderr, "queue churn made %llu allocations\n", (unsigned long long)allocs);
+    failures++;
+  }
+  printf("%ld operations, queue churn %llu allocations: %s\n", ops, (unsigned long long)allocs, failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
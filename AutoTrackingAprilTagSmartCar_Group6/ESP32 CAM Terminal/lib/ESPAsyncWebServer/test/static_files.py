@@ -0,0 +1,132 @@
+# Static files from the RAM cache against test/host_server.cpp: the bytes, the ETag and
+# If-None-Match, and the filesystem accesses (GET /fs) each request makes. A cache hit and a 304
+# must not touch the filesystem at all; a file over the size limit, a miss and an evicted file do.
+#
+#   python3 static_files.py <path to espasyncwebserver_host_server>
+#
+# The files go to a temporary directory, passed to the server as ASYNC_HOST_FS_ROOT.
+# Exits non-zero on the first failure.
+import gzip
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from keepalive import Conn, check, expect, free_port, get, pattern  # noqa: E402
+
+
+def counts(c):
+    c.send(get("/fs"))
+    r = c.response()
+    check(r, 200)
+    return dict((k, int(v)) for k, v in (line.split("=") for line in r.body.decode().split()))
+
+
+# three requests on a connection of its own: host_server closes one after 10
+def fetch(port, path, extra=""):
+    c = Conn(port)
+    before = counts(c)
+    c.send(get(path, extra))
+    r = c.response()
+    after = counts(c)
+    c.close()
+    return r, dict((k, after[k] - before[k]) for k in after)
+
+
+def test_hit(port, files):
+    r, d = fetch(port, "/static/small.txt")
+    check(r, 200, files["small.txt"])
+    expect(d["misses"] == 1 and d["opens"] > 0, "first request: %s" % d)
+    etag = r.headers.get("etag")
+    expect(etag and etag.startswith('"'), "no strong ETag: %r" % etag)
+    for _ in range(3):
+        r, d = fetch(port, "/static/small.txt")
+        check(r, 200, files["small.txt"])
+        expect(d["hits"] == 1 and d["opens"] == 0, "cache hit: %s" % d)
+        expect(r.headers.get("etag") == etag, "ETag changed")
+
+
+def test_not_modified(port, files):
+    r, _ = fetch(port, "/static/small.txt")
+    etag = r.headers.get("etag")
+    r, d = fetch(port, "/static/small.txt", "If-None-Match: %s\r\n" % etag)
+    check(r, 304, b"")
+    expect(d["notModified"] == 1 and d["opens"] == 0, "304: %s" % d)
+    expect(r.headers.get("etag") == etag, "304 without the ETag")
+    # a list, as browsers may send
+    r, d = fetch(port, "/static/small.txt", 'If-None-Match: "0", %s\r\n' % etag)
+    check(r, 304, b"")
+    expect(d["opens"] == 0, "304 from a list: %s" % d)
+    r, d = fetch(port, "/static/small.txt", 'If-None-Match: "0"\r\n')
+    check(r, 200, files["small.txt"])
+    expect(d["opens"] == 0, "other ETag: %s" % d)
+
+
+def test_gzip(port, files):
+    for i in range(2):
+        r, d = fetch(port, "/static/app.js")
+        check(r, 200, files["app.js.gz"])
+        expect(r.headers.get("content-encoding") == "gzip", "not sent gzipped")
+        expect(gzip.decompress(r.body) == b"console.log('car');\n" * 200, "gzipped bytes")
+        expect(i == 0 or d["opens"] == 0, "gzipped hit: %s" % d)
+
+
+def test_too_big(port, files):
+    for _ in range(2):
+        r, d = fetch(port, "/static/big.bin")
+        check(r, 200, files["big.bin"])
+        expect(d["opens"] > 0 and d["hits"] == 0, "over the size limit: %s" % d)
+
+
+def test_eviction(port, files):
+    # 3 kB each in an 8 kB cache: the first ones make room
+    for name in ("e0.txt", "e1.txt", "e2.txt", "e3.txt"):
+        r, _ = fetch(port, "/static/" + name)
+        check(r, 200, files[name])
+    r, d = fetch(port, "/static/e0.txt")
+    check(r, 200, files["e0.txt"])
+    expect(d["misses"] == 1 and d["opens"] > 0, "evicted: %s" % d)
+    r, d = fetch(port, "/static/e0.txt")
+    check(r, 200, files["e0.txt"])
+    expect(d["hits"] == 1 and d["opens"] == 0, "back in: %s" % d)
+
+
+def main():
+    server = sys.argv[1]
+    root = tempfile.mkdtemp(prefix="espasyncwebserver_static_")
+    os.mkdir(os.path.join(root, "static"))
+    files = {
+        "small.txt": pattern(1000),
+        "app.js.gz": gzip.compress(b"console.log('car');\n" * 200, mtime=0),
+        "big.bin": os.urandom(10000),
+    }
+    for i in range(4):
+        files["e%d.txt" % i] = pattern(3000)[i:] + b"%d" % i
+    for name, data in files.items():
+        with open(os.path.join(root, "static", name), "wb") as f:
+            f.write(data)
+    port = free_port()
+    proc = subprocess.Popen([server, str(port)], stdout=subprocess.PIPE,
+                            env=dict(os.environ, ASYNC_HOST_FS_ROOT=root))
+    try:
+        expect(proc.stdout.readline().strip() == b"ready", "server did not start")
+        tests = [("cache hit", test_hit), ("if-none-match", test_not_modified), ("gzipped", test_gzip),
+                 ("over the limit", test_too_big), ("eviction", test_eviction)]
+        for name, test in tests:
+            test(port, files)
+            expect(proc.poll() is None, "server exited during " + name)
+            print("%-16s ok" % name)
+    finally:
+        proc.terminate()
+        proc.wait()
+        shutil.rmtree(root)
+    if proc.returncode not in (0, -15):
+        print("server exit status %d" % proc.returncode)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,227 @@
+/*
+ * Template files against a reference renderer: random pages of text, placeholders, "%%", stray '%'
+ * and names too long to be one, filled through the span index in random slices of 1 to 1500 bytes
+ * and compared with a one-pass render of the whole file by the rules in WebResponseImpl.h. Then two
+ * responses at once on the same index, more files than ASYNCWEBSERVER_TEMPLATE_CACHE (eviction while
+ * a page is half sent), and a file edited between requests. The files go to a temporary directory.
+ *
+ *   espasyncwebserver_template_test [pages]
+ */
+
+#include <ESPAsyncWebServer.h>
+#include "WebResponseImpl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+static int failures;
+static uint32_t seed = 12345;
+
+static uint32_t rnd(uint32_t n){
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % n;
+}
+
+//values of every length, with a '%' in some: what the processor returns is never read for placeholders
+static String processor(const String& name){
+  uint32_t h = 0;
+  for(size_t i = 0; i < name.length(); i++){
+    h = h * 31 + (uint8_t)name[i];
+  }
+  switch(h % 5){
+    case 0: return String();
+    case 1: return name;
+    case 2: return "<b>" + name + "%</b>";
+    case 3: return String((unsigned long)h);
+  }
+  std::string v(h % 700, 'a' + h % 26);
+  return String(v.c_str());
+}
+
+//"%name%" with 1 to TEMPLATE_PARAM_NAME_LENGTH bytes and no '%' in between, "%%" for '%', any other '%' as is
+static std::string reference(const std::string& page){
+  std::string out;
+  size_t i = 0;
+  while(i < page.size()){
+    if(page[i] != TEMPLATE_PLACEHOLDER){
+      out += page[i++];
+      continue;
+    }
+    size_t end = page.find(TEMPLATE_PLACEHOLDER, i + 1);
+    if(end == std::string::npos || end - i - 1 > TEMPLATE_PARAM_NAME_LENGTH){
+      out += page[i++];
+      continue;
+    }
+    std::string name = page.substr(i + 1, end - i - 1);
+    out += name.empty() ? std::string(1, TEMPLATE_PLACEHOLDER) : std::string(processor(String(name.c_str())).c_str());
+    i = end + 1;
+  }
+  return out;
+}
+
+static std::string randomPage(){
+  static const char * words[] = { "<p>", "tag ", "\n", "speed: ", "</div>", "100", " " };
+  std::string page;
+  uint32_t parts = rnd(60);
+  for(uint32_t p = 0; p < parts; p++){
+    switch(rnd(8)){
+      case 0: case 1: case 2: {
+        uint32_t n = rnd(300);
+        while(n--){
+          page += words[rnd(7)];
+        }
+        break;
+      }
+      case 3: case 4: {
+        std::string name;
+        uint32_t n = 1 + rnd(TEMPLATE_PARAM_NAME_LENGTH);
+        while(n--){
+          name += (char)('A' + rnd(26));
+        }
+        page += "%" + name + "%";
+        break;
+      }
+      case 5: page += "%%"; break;
+      case 6: page += (rnd(2) ? "100% " : "%"); break;
+      default: page += "%" + std::string(TEMPLATE_PARAM_NAME_LENGTH + 1 + rnd(3), 'X') + "%"; break;
+    }
+  }
+  return page;
+}
+
+class TemplateResponse: public AsyncFileResponse {
+  public:
+    TemplateResponse(fs::FS& fs, const String& path)
+      : AsyncFileResponse(fs, path, "text/html", false, processor) {}
+    //what _respond() and _ack() ask for, in slices of 1 to 1500 bytes. false once the page is done
+    bool fill(std::string& out){
+      static uint8_t buf[1500];
+      size_t n = _fillBufferAndProcessTemplates(buf, 1 + rnd(sizeof(buf)));
+      out.append((const char*)buf, n);
+      return n > 0;
+    }
+};
+
+static std::string render(FS& fs, const char * path){
+  TemplateResponse r(fs, path);
+  std::string out;
+  while(r.fill(out));
+  return out;
+}
+
+static std::string root;
+
+static void write(const char * path, const std::string& page){
+  FILE* f = fopen((root + path).c_str(), "wb");
+  if(!f || fwrite(page.data(), 1, page.size(), f) != page.size()){
+    fprintf(stderr, "cannot write %s%s\n", root.c_str(), path);
+    exit(1);
+  }
+  fclose(f);
+}
+
+static void check(const char * what, const std::string& got, const std::string& want){
+  if(got == want){
+    return;
+  }
+  size_t at = 0;
+  while(at < got.size() && at < want.size() && got[at] == want[at]){
+    at++;
+  }
+  fprintf(stderr, "%s: %zu bytes, wanted %zu, first difference at %zu\n", what, got.size(), want.size(), at);
+  failures++;
+}
+
+int main(int argc, char ** argv){
+  long pages = (argc > 1) ? atol(argv[1]) : 300;
+  char dir[] = "/tmp/espasyncwebserver_template_XXXXXX";
+  if(!mkdtemp(dir)){
+    perror("mkdtemp");
+    return 1;
+  }
+  root = dir;
+  setenv("ASYNC_HOST_FS_ROOT", dir, 1);
+  FS fs;
+  AsyncTemplateCache& cache = AsyncTemplateCache::Instance();
+
+  //every page twice: built, then from the index
+  size_t last = 0;
+  for(long i = 0; i < pages && failures < 5; i++){
+    //an edit of the same size goes unseen here (mtime is 0 on the host), so each page is a new size
+    std::string page = randomPage();
+    if(page.size() == last){
+      page += ' ';
+    }
+    last = page.size();
+    write("/page.html", page);
+    std::string want = reference(page);
+    uint32_t builds = cache.builds(), hits = cache.hits();
+    check("first request", render(fs, "/page.html"), want);
+    check("second request", render(fs, "/page.html"), want);
+    if(cache.builds() != builds + 1 || cache.hits() != hits + 1){
+      fprintf(stderr, "page %ld: %u builds, %u hits\n", i, cache.builds() - builds, cache.hits() - hits);
+      failures++;
+    }
+  }
+
+  //two responses on the same index, in turns
+  std::string page = randomPage() + "%A%%B%%%%C%";
+  write("/two.html", page);
+  {
+    TemplateResponse a(fs, "/two.html"), b(fs, "/two.html");
+    std::string outA, outB;
+    bool moreA = true, moreB = true;
+    while(moreA || moreB){
+      if(moreA){
+        moreA = a.fill(outA);
+      }
+      if(moreB){
+        moreB = b.fill(outB);
+      }
+    }
+    check("first of two", outA, reference(page));
+    check("second of two", outB, reference(page));
+  }
+
+  //more files than the cache keeps: a page half sent keeps its index when it is evicted
+  {
+    TemplateResponse r(fs, "/two.html");
+    std::string out;
+    r.fill(out);
+    for(int f = 0; f < ASYNCWEBSERVER_TEMPLATE_CACHE + 2; f++){
+      char path[32];
+      snprintf(path, sizeof(path), "/f%d.html", f);
+      std::string other = randomPage() + "%F%";
+      write(path, other);
+      check(path, render(fs, path), reference(other));
+    }
+    while(r.fill(out));
+    check("evicted while sent", out, reference(page));
+    uint32_t builds = cache.builds();
+    check("after eviction", render(fs, "/two.html"), reference(page));
+    if(cache.builds() != builds + 1){
+      fprintf(stderr, "an evicted index was used again\n");
+      failures++;
+    }
+  }
+
+  //edited between requests: a new size, a new index
+  page = "<h1>%TITLE%</h1>";
+  write("/edit.html", page);
+  check("before the edit", render(fs, "/edit.html"), reference(page));
+  page = "<h1>%TITLE%</h1><p>%%%BODY%</p>";
+  write("/edit.html", page);
+  check("after the edit", render(fs, "/edit.html"), reference(page));
+
+  cache.clear();
+  remove((root + "/page.html").c_str());
+  remove((root + "/two.html").c_str());
+  remove((root + "/edit.html").c_str());
+  for(int f = 0; f < ASYNCWEBSERVER_TEMPLATE_CACHE + 2; f++){
+    remove((root + "/f" + std::to_string(f) + ".html").c_str());
+  }
+  rmdir(dir);
+  printf("%ld pages, %u index builds, %u hits: %s\n", pages, cache.builds(), cache.hits(), failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+# WebSocket echo, fragments, permessage-deflate, broadcast, the queue policies and the reassembly
+# cap against test/host_server.cpp, with the Python websockets client.
+#
+#   python3 websocket.py <path to espasyncwebserver_host_server>
+#
+# Exits 77 (skipped) when the websockets module is missing, non-zero on the first failure.
+import os
+import subprocess
+import sys
+
+try:
+    from websockets.exceptions import ConnectionClosed
+    from websockets.sync.client import connect
+except ImportError:
+    print("websockets module not found, skipped")
+    sys.exit(77)
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from keepalive import expect, free_port, pattern  # noqa: E402
+
+
+def ws(port, deflate=False):
+    return connect("ws://127.0.0.1:%d/ws" % port, compression="deflate" if deflate else None,
+                   max_size=2 * 1024 * 1024, open_timeout=5, close_timeout=5)
+
+
+def echo(c, message):
+    c.send(message)
+    try:
+        back = c.recv(timeout=10)
+    except TimeoutError:
+        raise AssertionError("no echo of %d bytes (%s)" % (len(message), type(message).__name__))
+    expect(back == message, "echo of %d bytes came back as %d" % (len(message), len(back)))
+
+
+def test_echo(port):
+    with ws(port) as c:
+        # not 0: an empty message is never sent (AsyncWebSocketBasicMessage::send)
+        for n in (1, 125, 126, 1436, 65535, 65536, 300000):
+            echo(c, pattern(n))
+            echo(c, pattern(n).decode())
+
+
+def test_fragments(port):
+    with ws(port) as c:
+        c.send([b"tag 17 ", b"at 0.42 ", b"1.30"])
+        expect(c.recv(timeout=10) == b"tag 17 at 0.42 1.30", "fragmented message")
+        c.send(["x" * 70000, "y" * 3, "z" * 100000])
+        expect(c.recv(timeout=10) == "x" * 70000 + "yyy" + "z" * 100000, "large fragmented message")
+
+
+def test_ping(port):
+    with ws(port) as c:
+        expect(c.ping(b"car").wait(5), "no pong")
+        echo(c, "after ping")
+
+
+def test_deflate(port):
+    with ws(port, deflate=True) as c:
+        ext = c.response.headers.get("Sec-WebSocket-Extensions", "")
+        expect("permessage-deflate" in ext, "permessage-deflate not negotiated: %r" % ext)
+        telemetry = '{"tag":17,"x":0.42,"y":1.30,"heading":87}' * 2000
+        for _ in range(3):
+            echo(c, telemetry)
+        echo(c, os.urandom(50000))
+        echo(c, "short")
+
+
+def test_broadcast(port):
+    with ws(port) as a, ws(port, deflate=True) as b:
+        a.send("all:hello")
+        expect(a.recv(timeout=5) == "hello", "broadcast to the sender")
+        expect(b.recv(timeout=5) == "hello", "broadcast to the other client")
+        # more than one TCP window: the frame goes out by reference, slice by slice
+        big = pattern(300000).decode()
+        a.send("all:" + big)
+        expect(a.recv(timeout=10) == big, "large broadcast to the sender")
+        expect(b.recv(timeout=10) == big, "large broadcast to the other client")
+
+
+QUEUE = 32  # WS_MAX_QUEUED_MESSAGES on the host build
+BURST = 100
+
+
+def burst(port, policy, want, dropped, coalesced):
+    # the front of the queue ("0") is on the wire and stays, the policy decides about the rest
+    with ws(port) as c:
+        c.send("burst %s %d" % (policy, BURST))
+        got = [c.recv(timeout=5) for _ in want]
+        expect(got == [str(i) for i in want], "%s kept %s, wanted %s" % (policy, got, want))
+        try:
+            extra = c.recv(timeout=0.5)
+            expect(False, "%s: %r after the last one" % (policy, extra))
+        except TimeoutError:
+            pass
+        c.send("stats")
+        stats = c.recv(timeout=5)
+        expect(stats == "dropped=%d coalesced=%d" % (dropped, coalesced), "%s: %s" % (policy, stats))
+
+
+def test_queue_policies(port):
+    burst(port, "newest", range(QUEUE), BURST - QUEUE, 0)
+    burst(port, "oldest", [0] + list(range(BURST - QUEUE + 1, BURST)), BURST - QUEUE, 0)
+    # keys 1 to 4 in turn: each waiting message is replaced in its place by the last one with its key
+    last = [max(i for i in range(BURST) if i % 4 == k) for k in range(4)]
+    burst(port, "coalesce", [0, last[1], last[2], last[3], last[0]], 0, BURST - 5)
+
+
+def test_cap(port):
+    with ws(port) as c:
+        c.send(b"\0" * (1024 * 1024 + 1))
+        try:
+            c.recv(timeout=10)
+            expect(False, "message over the reassembly cap was answered")
+        except ConnectionClosed as e:
+            expect(e.rcvd is not None and e.rcvd.code == 1009, "closed with %s, wanted 1009" % e.rcvd)
+
+
+def main():
+    server = sys.argv[1]
+    port = free_port()
+    proc = subprocess.Popen([server, str(port)], stdout=subprocess.PIPE)
+    try:
+        expect(proc.stdout.readline().strip() == b"ready", "server did not start")
+        tests = [("echo", test_echo), ("fragments", test_fragments), ("ping", test_ping),
+                 ("deflate", test_deflate), ("broadcast", test_broadcast), ("queue policies", test_queue_policies),
+                 ("1009 cap", test_cap)]
+        for name, test in tests:
+            test(port)
+            expect(proc.poll() is None, "server exited during " + name)
+            print("%-16s ok" % name)
+    finally:
+        proc.terminate()
+        proc.wait()
+    if proc.returncode not in (0, -15):
+        print("server exit status %d" % proc.returncode)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -4,11 +4,15 @@
 #include "esp_camera.h"
 #include "Config.h"
 #include "ArduinoJson-v6.11.1.h"
+#include "ui_assets.h"
 
 // Async server
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
+#include <AsyncJsonParser.h>
 #include <vector>
+#include <atomic>
+#include <new>
 
 // ---------- WiFi ----------
 AsyncWebServer server(80);
@@ -22,20 +26,58 @@ static const uint32_t UART_BAUDRATE = 9600;   // Same as UNO
 // ---------- Camera ----------
 static const framesize_t STREAM_FRAME = FRAMESIZE_VGA;  // 640x480
 static const int JPEG_QUALITY = 8;                      // 1(best)~63(worst)
-static const int FB_COUNT = 2;                          // Double buffer
+static const int FB_COUNT = 3;                          // Double buffer + one frame pinned by in-flight MJPEG sends
 
 // ---------- MJPEG ----------
 static const char* BOUNDARY = "mjpeg-boundary-0123456789";
+// getTransportInfo() is a tcpip call, so it is kept off the frame path: read every TCP_INFO_STALLED_MS while
+// a viewer's previous frame is still unacked, and every TCP_INFO_INTERVAL_MS otherwise (for /tcpstats)
+static const uint32_t TCP_INFO_STALLED_MS = 200;
+static const uint32_t TCP_INFO_INTERVAL_MS = 1000;
+
+// Camera frame shared by all MJPEG clients; returned to the driver once the last client's send is acked
+struct SharedFrame {
+  camera_fb_t* fb;
+  std::atomic<int> refs;
+  SharedFrame(camera_fb_t* f): fb(f), refs(1) {}
+};
+
+static void frame_release(SharedFrame* f) {
+  if (f->refs.fetch_sub(1) == 1) {
+    esp_camera_fb_return(f->fb);
+    delete f;
+  }
+}
 
 // Maintains currently connected MJPEG clients
 struct MjpegClient {
   AsyncClient* c;
+  AsyncWebServerRequest* request;        // freed together with c once the viewer is gone
   bool headerSent;
-  MjpegClient(AsyncClient* client=nullptr): c(client), headerSent(false) {}
+  std::atomic<SharedFrame*> inFlight;    // frame referenced by the TCP stack, not acked yet (acks come on async_tcp)
+  std::atomic<bool> closed;              // set by onDisconnect, cameraTask frees the entry
+  async_tcp_info_t tcp;                  // transport state, last read at tcpAt
+  uint32_t tcpAt;
+  uint32_t lossSkips;                    // frames skipped while the previous one was being retransmitted
+  MjpegClient(AsyncClient* client, AsyncWebServerRequest* req)
+    : c(client), request(req), headerSent(false), inFlight(nullptr), closed(false), tcp(), tcpAt(0), lossSkips(0) {}
+};
+
+// What /tcpstats shows of a viewer
+struct MjpegTcpStats {
+  async_tcp_info_t tcp;
+  uint32_t lossSkips;
 };
 
-static std::vector<MjpegClient> g_clients;
+// Owned by cameraTask, which holds g_clients_mutex across tcpip calls. The async_tcp task must never wait for it:
+// lwIP may be waiting for room in the async_tcp queue at that moment.
+static std::vector<MjpegClient*> g_clients;
 static SemaphoreHandle_t g_clients_mutex;
+// New viewers handed over by the async_tcp task, and the viewers' stats published by cameraTask for /tcpstats;
+// only held for a push, a swap or a copy, so waiting for it is safe
+static std::vector<MjpegClient*> g_clients_new;
+static std::vector<MjpegTcpStats> g_clients_stats;
+static SemaphoreHandle_t g_clients_new_mutex;
 
 // Latest JPEG frame cache (updated by capture task, reused by MJPEG broadcast)
 static uint8_t* g_last_jpg = nullptr;
@@ -121,9 +163,28 @@ static bool copy_last_jpg(std::vector<uint8_t>& out) {
   return ok;
 }
 
-// Send a frame to a single MJPEG client (non-blocking attempt)
-static void mjpeg_send_frame_to(AsyncClient* client, const uint8_t* jpg, size_t len) {
+// Runs once the TCP stack no longer needs the JPEG bytes of a client
+static void mjpeg_frame_acked(void* arg, const char* data, size_t len) {
+  MjpegClient* mc = reinterpret_cast<MjpegClient*>(arg);
+  SharedFrame* f = mc->inFlight.exchange(nullptr);
+  if (f) frame_release(f);
+}
+
+// Send a frame to a single MJPEG client (non-blocking attempt, JPEG is sent without copying)
+static void mjpeg_send_frame_to(MjpegClient* mc, SharedFrame* frame) {
+  AsyncClient* client = mc->c;
   if (!client || !client->connected()) return;
+  uint32_t now = millis();
+  // Previous frame still in flight: drop this one for the slow client, and see whether it is being retransmitted
+  if (mc->inFlight.load()) {
+    if (now - mc->tcpAt >= TCP_INFO_STALLED_MS && client->getTransportInfo(&mc->tcp)) mc->tcpAt = now;
+    if (mc->tcp.nrtx > 0) mc->lossSkips++;
+    return;
+  }
+  // A frame goes out with one tcpip call (the writev below); the transport state is only refreshed now and then
+  if (now - mc->tcpAt >= TCP_INFO_INTERVAL_MS && client->getTransportInfo(&mc->tcp)) mc->tcpAt = now;
+  const uint8_t* jpg = frame->fb->buf;
+  size_t len = frame->fb->len;
   if (!jpg || len == 0) return;
 
   // Boundary + header
@@ -135,50 +196,85 @@ static void mjpeg_send_frame_to(AsyncClient* client, const uint8_t* jpg, size_t
                         BOUNDARY, (unsigned)len);
 
   if (client->space() >= (size_t)hdrlen + len + 2) {
-    client->add(hdr, hdrlen);
-    client->add((const char*)jpg, len);
-    client->add("\r\n", 2);
-    client->send();
+    frame->refs.fetch_add(1);
+    mc->inFlight.store(frame);
+    // Header (copied), JPEG (referenced until acked) and CRLF (a literal, no copy) in one tcpip call
+    async_iovec_t iov[3] = {
+      { hdr, (size_t)hdrlen, ASYNC_WRITE_FLAG_COPY, nullptr, nullptr },
+      { (const char*)jpg, len, 0, mjpeg_frame_acked, mc },
+      { "\r\n", 2, 0, nullptr, nullptr },
+    };
+    size_t queued = client->writev(iov, 3);
+    if (queued == 3) return;
+    // Without its JPEG segment the frame is ours to give back; once queued, the ack (or the close) returns it
+    if (queued < 2) {
+      SharedFrame* f = mc->inFlight.exchange(nullptr);
+      if (f) frame_release(f);
+    }
+    // Part of a frame is on the wire already: the multipart stream cannot be resynchronized
+    if (queued) client->close(true);
   }
 }
 
-// Broadcast a frame to all MJPEG clients
-static void mjpeg_broadcast(const uint8_t* jpg, size_t len) {
-  if (xSemaphoreTake(g_clients_mutex, pdMS_TO_TICKS(10)) != pdTRUE) return;
+// Frees a viewer that is gone; its client's destructor returns any frame still referenced, so mc goes last
+static void mjpeg_client_free(MjpegClient* mc) {
+  delete mc->request;
+  delete mc->c;
+  delete mc;
+}
+
+// Takes the new viewers in and frees the closed ones. cameraTask, with g_clients_mutex held.
+static void mjpeg_reap() {
+  xSemaphoreTake(g_clients_new_mutex, portMAX_DELAY);
+  g_clients.insert(g_clients.end(), g_clients_new.begin(), g_clients_new.end());
+  g_clients_new.clear();
+  xSemaphoreGive(g_clients_new_mutex);
 
-  // Clean up disconnected clients
   for (size_t i = 0; i < g_clients.size(); ) {
-    if (!g_clients[i].c || !g_clients[i].c->connected()) {
-      if (g_clients[i].c) {
-        g_clients[i].c->close(true);
-        delete g_clients[i].c;
-      }
+    if (g_clients[i]->closed.load()) {
+      mjpeg_client_free(g_clients[i]);
       g_clients.erase(g_clients.begin() + i);
     } else {
       ++i;
     }
   }
+}
+
+// Broadcast a frame to all MJPEG clients (disconnected clients are freed here, not in their onDisconnect)
+static void mjpeg_broadcast(SharedFrame* frame) {
+  if (xSemaphoreTake(g_clients_mutex, pdMS_TO_TICKS(10)) != pdTRUE) return;
 
-  for (auto& mc : g_clients) {
-    if (!mc.c || !mc.c->connected()) continue;
+  mjpeg_reap();
+  for (MjpegClient* mc : g_clients) {
+    if (mc->closed.load() || !mc->c->connected()) continue;
 
     // First time: send HTTP header
-    if (!mc.headerSent) {
+    if (!mc->headerSent) {
       char head[256];
       int n = snprintf(head, sizeof(head),
         "HTTP/1.1 200 OK\r\n"
         "Content-Type: multipart/x-mixed-replace; boundary=--%s\r\n"
         "Connection: close\r\n"
         "\r\n", BOUNDARY);
-      mc.c->add(head, n);
-      mc.c->send();
-      mc.headerSent = true;
+      mc->c->add(head, n);
+      mc->c->send();
+      mc->headerSent = true;
     }
 
     // Send a frame
-    mjpeg_send_frame_to(mc.c, jpg, len);
+    mjpeg_send_frame_to(mc, frame);
   }
 
+  // Published for /tcpstats, which runs on the async_tcp task and must not wait for g_clients_mutex
+  static std::vector<MjpegTcpStats> stats;
+  stats.clear();
+  for (MjpegClient* mc : g_clients) {
+    if (!mc->closed.load()) stats.push_back({ mc->tcp, mc->lossSkips });
+  }
+  xSemaphoreTake(g_clients_new_mutex, portMAX_DELAY);
+  g_clients_stats.swap(stats);
+  xSemaphoreGive(g_clients_new_mutex);
+
   xSemaphoreGive(g_clients_mutex);
 }
 
@@ -195,6 +291,11 @@ static void cameraTask(void* arg) {
 
     camera_fb_t* fb = esp_camera_fb_get();
     if (!fb) {
+      // No frame to broadcast, but viewers that left are still freed
+      if (xSemaphoreTake(g_clients_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+        mjpeg_reap();
+        xSemaphoreGive(g_clients_mutex);
+      }
       vTaskDelay(pdMS_TO_TICKS(5));
       continue;
     }
@@ -212,36 +313,79 @@ static void cameraTask(void* arg) {
         xSemaphoreGive(g_jpg_mutex);
       }
 
-      // Broadcast
-      mjpeg_broadcast(fb->buf, fb->len);
+      // Broadcast straight from the camera buffer; it goes back to the driver after the last ack
+      SharedFrame* frame = new SharedFrame(fb);
+      mjpeg_broadcast(frame);
+      frame_release(frame);
+      continue;
     }
 
     esp_camera_fb_return(fb);
   }
 }
 
-// ---------- HTTP: root ----------
-static void handle_root(AsyncWebServerRequest* request) {
-  String html;
-  html  = "<html><body><h3>ESP32 Async MJPEG (PC-side AprilTag)</h3>";
-  html += "<p><a href='/mjpeg'>/mjpeg</a> (async video stream)</p>";
-  html += "<p><a href='/jpg'>/jpg</a> (single snapshot)</p>";
-  html += "<p><a href='/status'>/status</a> (last command JSON)</p>";
-  html += "<p>POST control to <code>/cmd</code>, e.g. <code>{\"M\":\"Left\",\"v\":90}</code></p>";
-  html += "</body></html>";
-  request->send(200, "text/html", html);
-}
-
 // ---------- HTTP: /status ----------
 static void handle_status(AsyncWebServerRequest* request) {
   String j = "{";
   j += "\"motion\":\"" + g_last_motion + "\",";
   j += "\"speed\":" + String(g_last_speed) + ",";
-  j += "\"ts_ms\":" + String(g_last_cmd_ms);
+  j += "\"ts_ms\":" + String(g_last_cmd_ms) + ",";
+  // TCP payload bytes since boot; sample twice to get copied vs zero-copy bytes per second
+  j += "\"tx_copied\":" + String(AsyncClient::bytesCopied()) + ",";
+  j += "\"tx_referenced\":" + String(AsyncClient::bytesReferenced());
   j += "}";
   request->send(200, "application/json", j);
 }
 
+// ---------- HTTP: /tcpstats ----------
+// async_tcp event queue and callback timing; ?reset=1 clears the counters after reading them
+static void handle_tcpstats(AsyncWebServerRequest* request) {
+  async_tcp_stats_t st;
+  AsyncTCPStats::snapshot(&st);
+  if (request->hasParam("reset")) AsyncTCPStats::reset();
+
+  String j = "{";
+  j += "\"queue\":{\"size\":" + String(st.queue_size) + ",\"depth\":" + String(st.queue_depth) +
+       ",\"peak\":" + String(st.queue_peak) + ",\"discarded\":" + String(st.discarded) + "},";
+  j += "\"blocked\":{\"count\":" + String(st.blocked) + ",\"us\":" + String((uint32_t)st.blocked_us) +
+       ",\"max_us\":" + String(st.blocked_max_us) + "},";
+  j += "\"coalesced\":" + String(st.coalesced) + ",\"deferred_bytes\":" + String(st.deferred_bytes) + ",";
+  j += "\"http\":{\"connections\":" + String(server.connectionCount()) + ",\"requests\":" + String(server.requestCount()) + "},";
+  AsyncWebSendBuffers& sb = AsyncWebSendBuffers::Instance();
+  j += "\"sendbuf\":{\"allocated\":" + String(sb.allocated()) + ",\"in_use\":" + String(sb.inUse()) +
+       ",\"peak\":" + String(sb.peak()) + ",\"taken\":" + String(sb.taken()) + ",\"exhausted\":" + String(sb.exhausted()) + "},";
+  // As of cameraTask's last frame; g_clients itself is cameraTask's (see g_clients_mutex)
+  std::vector<MjpegTcpStats> viewers;
+  xSemaphoreTake(g_clients_new_mutex, portMAX_DELAY);
+  viewers = g_clients_stats;
+  xSemaphoreGive(g_clients_new_mutex);
+  j += "\"mjpeg\":[";
+  for (size_t i = 0; i < viewers.size(); i++) {
+    const MjpegTcpStats& v = viewers[i];
+    if (i) j += ",";
+    j += "{\"srtt_ms\":" + String(v.tcp.srtt_ms) + ",\"unacked\":" + String(v.tcp.unacked) +
+         ",\"cwnd\":" + String(v.tcp.cwnd) + ",\"snd_wnd\":" + String(v.tcp.snd_wnd) +
+         ",\"nrtx\":" + String(v.tcp.nrtx) + ",\"loss_skips\":" + String(v.lossSkips) + "}";
+  }
+  j += "],";
+  j += "\"events\":{";
+  for (uint8_t e = 0; e < ASYNC_TCP_EV_MAX; e++) {
+    if (e) j += ",";
+    j += "\"" + String(AsyncTCPStats::eventName(e)) + "\":{";
+    j += "\"enq\":" + String(st.enqueued[e]) + ",\"done\":" + String(st.handled[e]);
+    j += ",\"shed\":" + String(st.overflow[e]);
+    j += ",\"us\":" + String((uint32_t)st.handle_us[e]) + ",\"max_us\":" + String(st.handle_max_us[e]);
+    j += ",\"hist\":[";
+    for (uint8_t b = 0; b < ASYNC_TCP_STATS_BUCKETS; b++) {
+      if (b) j += ",";
+      j += String(st.handle_hist[e][b]);
+    }
+    j += "]}";
+  }
+  j += "}}";
+  request->send(200, "application/json", j);
+}
+
 // ---------- HTTP: /jpg ----------
 static void handle_jpg(AsyncWebServerRequest* request) {
   std::vector<uint8_t> jpg;
@@ -260,45 +404,81 @@ static void handle_jpg(AsyncWebServerRequest* request) {
   esp_camera_fb_return(fb);
 }
 
-// ---------- HTTP: /cmd (POST body, ArduinoJson version, thread-safe per-request caching)----------
+// ---------- HTTP: /cmd (POST body, parsed as it arrives, thread-safe per-request state)----------
+// Attached to each request so packets of different requests never mix; the server free()s it with the request
+struct CmdBody {
+  AsyncJsonParser parser;
+  char token[64];        // one key and its value at a time
+  char motion[2][16];    // "M", "m"
+  int speed[2];          // "v", "V"
+  uint8_t seen;          // one bit per key above, the first occurrence wins
+  CmdBody(): parser(token, sizeof(token)), seen(0) {}
+};
+
+static void cmd_token(CmdBody* cmd, AsyncJsonToken t) {
+  const char* key = cmd->parser.key();
+  if (cmd->parser.depth() != 1 || !key || key[0] == 0 || key[1] != 0) return;
+  const char* keys = "MmvV";
+  const char* k = strchr(keys, key[0]);
+  if (!k) return;
+  const int i = k - keys;
+  if (cmd->seen & (1 << i)) return;
+  cmd->seen |= 1 << i;
+
+  const bool scalar = t == JSON_STRING || t == JSON_NUMBER;
+  if (i < 2) {
+    // Like (const char*)doc["M"]: anything but a string reads as empty
+    strlcpy(cmd->motion[i], t == JSON_STRING ? cmd->parser.value() : "", sizeof(cmd->motion[i]));
+  } else {
+    // Like doc["v"].as<int>(): numbers and numeric strings convert, true is 1
+    cmd->speed[i - 2] = scalar ? (int)strtod(cmd->parser.value(), NULL) : (t == JSON_TRUE ? 1 : 0);
+  }
+}
+
 static void on_cmd_body(AsyncWebServerRequest* request,
                         uint8_t* data, size_t len, size_t index, size_t total) {
-  // Attach a String* to each request as a cache to avoid packet crosstalk between different requests
-  String* body = reinterpret_cast<String*>(request->_tempObject);
-  if (index == 0) {
-    if (!body) {
-      body = new String();
-      request->_tempObject = body;
-    }
-    body->reserve(total + 4);
-    body->clear();
+  CmdBody* cmd = reinterpret_cast<CmdBody*>(request->_tempObject);
+  if (index == 0 && !cmd) {
+    void* mem = malloc(sizeof(CmdBody));
+    // Without state the body is skipped and onRequest gives the one reply
+    if (!mem) return;
+    cmd = new (mem) CmdBody();
+    request->_tempObject = cmd;
   }
-  body->concat(reinterpret_cast<const char*>(data), len);
+  if (!cmd) return;
+
+  // Tokens are handled as the packets come in, the body itself is never kept
+  const uint8_t* p = data;
+  size_t n = len;
+  AsyncJsonToken t;
+  while ((t = cmd->parser.next(p, n)) != JSON_NEED_MORE) cmd_token(cmd, t);
 
   // Entire POST received
   if (index + len == total) {
     // Fault tolerance: Some clients may miss the closing brace
-    if (!body->endsWith("}")) body->concat("}");
+    if (!cmd->parser.done() && cmd->parser.error() == JSON_OK) {
+      p = (const uint8_t*)"}";
+      n = 1;
+      while ((t = cmd->parser.next(p, n)) != JSON_NEED_MORE) cmd_token(cmd, t);
+    }
+    if ((t = cmd->parser.finish()) != JSON_NEED_MORE) cmd_token(cmd, t);
 
     // 1) Parsing JSON (accepting "M"/"m" and "v"/"V")
-    StaticJsonDocument<100> docIn;
-    DeserializationError err = deserializeJson(docIn, *body);
-    if (err) {
-      Serial.printf("[cmd] JSON parse error: %s  raw=%s\n",
-                    err.c_str(), body->c_str());
+    if (cmd->parser.error() != JSON_OK) {
+      Serial.printf("[cmd] JSON parse error: %s\n", cmd->parser.errorString());
       request->send(400, "application/json", "{\"ok\":false,\"err\":\"bad json\"}");
       return;
     }
 
     // Extract and normalize
     String mVal;
-    if (docIn.containsKey("M"))      mVal = (const char*)docIn["M"];
-    else if (docIn.containsKey("m")) mVal = (const char*)docIn["m"];
-    else                             mVal = "Unknown";
+    if (cmd->seen & 1)      mVal = cmd->motion[0];
+    else if (cmd->seen & 2) mVal = cmd->motion[1];
+    else                    mVal = "Unknown";
 
     int vVal = -1;
-    if (docIn.containsKey("v"))      vVal = docIn["v"].as<int>();
-    else if (docIn.containsKey("V")) vVal = docIn["V"].as<int>();
+    if (cmd->seen & 4)      vVal = cmd->speed[0];
+    else if (cmd->seen & 8) vVal = cmd->speed[1];
     vVal = constrain(vVal < 0 ? 0 : vVal, 0, 255);
 
     // Normalize action name (keep consistent with UNO side mapping)
@@ -313,12 +493,8 @@ static void on_cmd_body(AsyncWebServerRequest* request,
     g_last_cmd_ms = millis();
     Serial.printf("[cmd] motion=%s  v=%d\n", g_last_motion.c_str(), g_last_speed);
 
-    // 4) Reply to client
+    // 4) Reply to client; the request state stays attached so onRequest knows it was answered
     request->send(200, "application/json", "{\"ok\":true}");
-
-    // Release request cache
-    delete body;
-    request->_tempObject = nullptr;
   }
 }
 
@@ -367,11 +543,12 @@ static bool init_camera() {
 
 // ---------- HTTP server start ----------
 static void startHttp() {
-  // Home
-  server.on("/", HTTP_GET, handle_root);
+  // Home and the rest of ui/, gzipped into flash at build time (tools/embed_assets.py)
+  for (size_t i = 0; i < ui_assets_count; i++) server.serveAsset(&ui_assets[i]);
 
   // Status
   server.on("/status", HTTP_GET, handle_status);
+  server.on("/tcpstats", HTTP_GET, handle_tcpstats);
 
   // Snapshot
   server.on("/jpg", HTTP_GET, handle_jpg);
@@ -381,30 +558,22 @@ static void startHttp() {
     // Get the underlying TCP client and add it to the list
     AsyncClient* client = request->client();
     client->setNoDelay(true);
+    // No response will be pumped on poll; a viewer that stops acking is closed by the ack timeout (request->_onTimeout)
+    client->onPoll(NULL, NULL);
 
-    // Disconnect callback: remove from list
+    // The client is used directly (not cloned) so that acks reach the object that holds the frame references
+    MjpegClient* mc = new MjpegClient(client, request);
+
+    // Disconnect callback: only marks the viewer. g_clients_mutex may be held by cameraTask inside a tcpip call,
+    // so the entry, the request and the client are freed by cameraTask on its next pass.
     client->onDisconnect([](void* arg, AsyncClient* c){
-      if (xSemaphoreTake(g_clients_mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-        for (size_t i = 0; i < g_clients.size(); ++i) {
-          if (g_clients[i].c == c) {
-            c->close(true);
-            delete c;
-            g_clients.erase(g_clients.begin()+i);
-            break;
-          }
-        }
-        xSemaphoreGive(g_clients_mutex);
-      } else {
-        c->close(true);
-        delete c;
-      }
-    }, nullptr);
+      reinterpret_cast<MjpegClient*>(arg)->closed.store(true);
+    }, mc);
 
     // Add to client list (later pushed frames by cameraTask)
-    if (xSemaphoreTake(g_clients_mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-      g_clients.emplace_back(new AsyncClient(*client)); // clone client
-      xSemaphoreGive(g_clients_mutex);
-    }
+    xSemaphoreTake(g_clients_new_mutex, portMAX_DELAY);
+    g_clients_new.push_back(mc);
+    xSemaphoreGive(g_clients_new_mutex);
 
     // Here we don't request->send(), we directly use AsyncClient to write header + data (written by broadcast function)
     // Immediately end handler (asynchronously continue)
@@ -414,8 +583,11 @@ static void startHttp() {
   server.on("/cmd", HTTP_POST,
     // onRequest
     [](AsyncWebServerRequest* request){
-      // If body has been processed and sent in onBody, it usually won't reach here; safely return OK
-      if (!request->_tempObject) request->send(200, "application/json", "{\"ok\":true}");
+      // A body was answered in onBody, which leaves its state attached
+      if (request->_tempObject) return;
+      // A body that got no state (out of memory) was skipped; only an empty POST is a plain OK
+      if (request->contentLength()) request->send(500, "application/json", "{\"ok\":false,\"err\":\"no memory\"}");
+      else request->send(200, "application/json", "{\"ok\":true}");
     },
     // onUpload (unused)
     NULL,
@@ -448,6 +620,7 @@ void setup() {
 
   // Mutexes
   g_clients_mutex = xSemaphoreCreateMutex();
+  g_clients_new_mutex = xSemaphoreCreateMutex();
   g_jpg_mutex     = xSemaphoreCreateMutex();
 
   // WiFi AP
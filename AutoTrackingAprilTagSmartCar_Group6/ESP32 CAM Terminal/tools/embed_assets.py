@@ -0,0 +1,92 @@
+# Compiles the files under ui/ into include/ui_assets.h: gzipped byte arrays in flash, each with its
+# Content-Length, Content-Type and ETag worked out here so the firmware only has to send them.
+#
+#   python tools/embed_assets.py          (or let PlatformIO run it, see extra_scripts in platformio.ini)
+#
+# ui/index.html is served as "/", everything else under its own path. The header is only rewritten
+# when its content changes, so an unchanged UI does not trigger a rebuild.
+import gzip
+import os
+import re
+
+CONTENT_TYPES = {
+    ".html": "text/html", ".htm": "text/html", ".css": "text/css", ".js": "application/javascript",
+    ".json": "application/json", ".svg": "image/svg+xml", ".png": "image/png", ".ico": "image/x-icon",
+    ".jpg": "image/jpeg", ".gif": "image/gif", ".woff2": "font/woff2", ".txt": "text/plain",
+}
+
+
+def etag(data):
+    # FNV-1a, the same hash the server uses for files it caches in RAM
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return '"%08x"' % h
+
+
+def c_name(rel):
+    return "ui_" + re.sub(r"[^0-9A-Za-z]", "_", rel)
+
+
+def render(ui_dir):
+    files = []
+    for root, _, names in os.walk(ui_dir):
+        for name in names:
+            files.append(os.path.relpath(os.path.join(root, name), ui_dir).replace(os.sep, "/"))
+    files.sort()
+
+    out = ["// Generated by tools/embed_assets.py from ui/, do not edit",
+           "#pragma once",
+           "",
+           "#include <ESPAsyncWebServer.h>",
+           ""]
+    table = []
+    for rel in files:
+        with open(os.path.join(ui_dir, rel), "rb") as f:
+            raw = f.read()
+        packed = gzip.compress(raw, 9, mtime=0)  # mtime 0 keeps the bytes, and the ETag, stable
+        gz = len(packed) < len(raw)
+        data = packed if gz else raw
+        name = c_name(rel)
+        out.append("// ui/%s: %d bytes%s" % (rel, len(raw), ", %d gzipped" % len(data) if gz else ""))
+        out.append("static const uint8_t %s[] PROGMEM = {" % name)
+        for i in range(0, len(data), 16):
+            out.append("  " + ", ".join("0x%02X" % b for b in data[i:i + 16]) + ",")
+        out.append("};")
+        out.append("")
+
+        tag = etag(data)
+        ext = os.path.splitext(rel)[1].lower()
+        headers = "Content-Length: %d\\r\\nContent-Type: %s\\r\\n" % (len(data), CONTENT_TYPES.get(ext, "application/octet-stream"))
+        if gz:
+            headers += "Content-Encoding: gzip\\r\\n"
+        headers += "ETag: %s\\r\\nCache-Control: no-cache\\r\\n" % tag.replace('"', '\\"')
+        uri = "/" if rel == "index.html" else "/" + rel
+        table.append('  { "%s", %s, %d, "%s", "%s" },' % (uri, name, len(data), tag.replace('"', '\\"'), headers))
+
+    out.append("static const AsyncWebAsset ui_assets[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("static const size_t ui_assets_count = sizeof(ui_assets) / sizeof(ui_assets[0]);")
+    out.append("")
+    return "\n".join(out)
+
+
+def generate(project_dir):
+    text = render(os.path.join(project_dir, "ui"))
+    path = os.path.join(project_dir, "include", "ui_assets.h")
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w", newline="\n") as f:
+        f.write(text)
+    print("embed_assets: wrote " + path)
+
+
+try:
+    Import("env")  # run by PlatformIO as a pre: extra script
+    generate(env.subst("$PROJECT_DIR"))
+except NameError:
+    if __name__ == "__main__":
+        generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))